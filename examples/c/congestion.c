@@ -0,0 +1,149 @@
+/**
+ * libzt C API example
+ *
+ * Congestion control benchmark. Run one instance as a server and another as a
+ * client. The client streams data for a fixed time with each congestion
+ * control algorithm in turn; the server reports the goodput of every
+ * connection it accepts.
+ *
+ * To compare the algorithms on a long, lossy path, impair the underlay that
+ * carries ZeroTier's UDP traffic. With both nodes on one host, for example:
+ *
+ *   tc qdisc add dev lo root netem delay 50ms loss 1%
+ *   ...
+ *   tc qdisc del dev lo root
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define SEND_BUF_SIZE    (64 * 1024)
+#define DURATION_SECONDS 20
+
+static const char* algorithms[] = { ZTS_TCP_CC_RENO, ZTS_TCP_CC_CUBIC, ZTS_TCP_CC_BBR };
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void start_node(char* storage_path, long long int net_id)
+{
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    printf("Waiting for address assignment from network\n");
+    while (! zts_addr_is_assigned(net_id, ZTS_AF_INET)) {
+        zts_util_delay(50);
+    }
+}
+
+static void report(const char* what, long long bytes, double elapsed)
+{
+    printf(
+        "%-8s %lld bytes in %.1f s (%.2f Mbit/s)\n",
+        what,
+        bytes,
+        elapsed,
+        bytes * 8 / 1000000.0 / (elapsed > 0 ? elapsed : 1));
+}
+
+static int run_server(int port)
+{
+    int lfd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    if (lfd < 0 || zts_bind(lfd, "0.0.0.0", port) != ZTS_ERR_OK || zts_bsd_listen(lfd, 1) != ZTS_ERR_OK) {
+        printf("Unable to listen (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    char* buf = malloc(SEND_BUF_SIZE);
+    int fd;
+    while ((fd = zts_bsd_accept(lfd, NULL, NULL)) >= 0) {
+        long long total = 0;
+        double start = now();
+        ssize_t n;
+        while ((n = zts_bsd_read(fd, buf, SEND_BUF_SIZE)) > 0) {
+            total += n;
+        }
+        report("Received", total, now() - start);
+        zts_bsd_close(fd);
+    }
+    free(buf);
+    zts_bsd_close(lfd);
+    return 0;
+}
+
+static int run_client(char* remote_addr, int port)
+{
+    char* buf = calloc(1, SEND_BUF_SIZE);
+    for (size_t i = 0; i < sizeof(algorithms) / sizeof(algorithms[0]); i++) {
+        int fd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+        const char* cc = algorithms[i];
+        if (fd < 0
+            || zts_bsd_setsockopt(fd, ZTS_IPPROTO_TCP, ZTS_TCP_CONGESTION, cc, (zts_socklen_t)strlen(cc)) != ZTS_ERR_OK
+            || zts_connect(fd, remote_addr, port, 0) != ZTS_ERR_OK) {
+            printf("Unable to connect using %s (zts_errno=%d). Exiting.\n", cc, zts_errno);
+            return 1;
+        }
+        long long total = 0;
+        double start = now();
+        while (now() - start < DURATION_SECONDS) {
+            ssize_t n = zts_bsd_write(fd, buf, SEND_BUF_SIZE);
+            if (n < 0) {
+                printf("Write failed (zts_errno=%d). Exiting.\n", zts_errno);
+                return 1;
+            }
+            total += n;
+        }
+        report(cc, total, now() - start);
+        zts_bsd_close(fd);
+        zts_util_delay(1000);
+    }
+    free(buf);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5 || (strcmp(argv[1], "server") == 0 && argc != 5) || (strcmp(argv[1], "client") == 0 && argc != 6)) {
+        printf("\nlibzt example congestion control benchmark\n");
+        printf("congestion server <id_storage_path> <net_id> <port>\n");
+        printf("congestion client <id_storage_path> <net_id> <remote_addr> <remote_port>\n");
+        exit(0);
+    }
+    long long int net_id = strtoull(argv[3], NULL, 16);   // At least 64 bits
+    start_node(argv[2], net_id);
+    int err;
+    if (strcmp(argv[1], "server") == 0) {
+        err = run_server(atoi(argv[4]));
+    }
+    else {
+        err = run_client(argv[4], atoi(argv[5]));
+    }
+    zts_node_stop();
+    return err;
+}
@@ -0,0 +1,161 @@
+/**
+ * libzt C API example
+ *
+ * Connection setup latency benchmark for short-lived request/response
+ * connections. The client repeatedly opens a connection, sends a small request,
+ * waits for the response and closes, first with zts_connect() + zts_bsd_send()
+ * and then with a single zts_bsd_sendto(ZTS_MSG_SEND_ON_CONNECT). The server
+ * answers each request and closes the connection.
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MSG_SIZE   64
+#define ITERATIONS 100
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static void start_node(char* storage_path, long long int net_id)
+{
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    printf("Waiting for address assignment from network\n");
+    while (! zts_addr_is_assigned(net_id, ZTS_AF_INET)) {
+        zts_util_delay(50);
+    }
+}
+
+static int read_full(int fd, char* buf, int len)
+{
+    for (int got = 0, n; got < len; got += n) {
+        if ((n = zts_bsd_read(fd, buf + got, len - got)) <= 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run_server(int port)
+{
+    int lfd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    if (lfd < 0 || zts_bind(lfd, "0.0.0.0", port) != ZTS_ERR_OK || zts_bsd_listen(lfd, 16) != ZTS_ERR_OK) {
+        printf("Unable to listen (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    char buf[MSG_SIZE];
+    int fd;
+    while ((fd = zts_bsd_accept(lfd, NULL, NULL)) >= 0) {
+        if (read_full(fd, buf, MSG_SIZE) == 0) {
+            zts_bsd_write(fd, buf, MSG_SIZE);
+        }
+        zts_bsd_close(fd);
+    }
+    zts_bsd_close(lfd);
+    return 0;
+}
+
+static void report(const char* method, double* samples, int n)
+{
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+    qsort(samples, n, sizeof(double), compare_double);
+    printf(
+        "%-16s mean %.2f ms, median %.2f ms, p99 %.2f ms\n",
+        method,
+        sum / n * 1000,
+        samples[n / 2] * 1000,
+        samples[n * 99 / 100] * 1000);
+}
+
+static int run_client(char* remote_addr, int port)
+{
+    struct zts_sockaddr_storage ss;
+    zts_socklen_t addrlen = sizeof(ss);
+    if (zts_util_ipstr_to_saddr(remote_addr, port, (struct zts_sockaddr*)&ss, &addrlen) != ZTS_ERR_OK) {
+        printf("Invalid address. Exiting.\n");
+        return 1;
+    }
+    int family = zts_util_get_ip_family(remote_addr);
+    char buf[MSG_SIZE] = { 0 };
+    double samples[ITERATIONS];
+    for (int on_connect = 0; on_connect < 2; on_connect++) {
+        for (int i = 0; i < ITERATIONS; i++) {
+            double start = now();
+            int fd = zts_bsd_socket(family, ZTS_SOCK_STREAM, 0);
+            ssize_t n;
+            if (on_connect) {
+                n = zts_bsd_sendto(fd, buf, MSG_SIZE, ZTS_MSG_SEND_ON_CONNECT, (struct zts_sockaddr*)&ss, addrlen);
+            }
+            else {
+                n = zts_connect(fd, remote_addr, port, 0) == ZTS_ERR_OK ? zts_bsd_send(fd, buf, MSG_SIZE, 0) : -1;
+            }
+            if (n != MSG_SIZE || read_full(fd, buf, MSG_SIZE) != 0) {
+                printf("Request failed (zts_errno=%d). Exiting.\n", zts_errno);
+                return 1;
+            }
+            zts_bsd_close(fd);
+            samples[i] = now() - start;
+        }
+        report(on_connect ? "SEND_ON_CONNECT" : "zts_connect", samples, ITERATIONS);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5 || (strcmp(argv[1], "server") == 0 && argc != 5) || (strcmp(argv[1], "client") == 0 && argc != 6)) {
+        printf("\nlibzt example connection setup latency benchmark\n");
+        printf("connlatency server <id_storage_path> <net_id> <port>\n");
+        printf("connlatency client <id_storage_path> <net_id> <remote_addr> <remote_port>\n");
+        exit(0);
+    }
+    long long int net_id = strtoull(argv[3], NULL, 16);   // At least 64 bits
+    start_node(argv[2], net_id);
+    int err;
+    if (strcmp(argv[1], "server") == 0) {
+        err = run_server(atoi(argv[4]));
+    }
+    else {
+        err = run_client(argv[4], atoi(argv[5]));
+    }
+    zts_node_stop();
+    return err;
+}
@@ -0,0 +1,249 @@
+/**
+ * libzt C API example
+ *
+ * Connection scaling benchmark. Run one instance as a server and another as a
+ * client on the same network. The client opens <count> simultaneous TCP
+ * connections (e.g. 1000, 10000, 50000) and holds them; both sides report
+ * the connect/accept rate and resident memory per connection.
+ *
+ * Once all connections are up the client sends a small message on each of
+ * them in turn and waits for the server to echo it back. Visiting the
+ * connections round-robin defeats lwIP's move-to-front PCB lookup, so the
+ * reported time per round trip shows how the per-packet receive cost grows
+ * with the number of open connections. With the hashed lookup from
+ * ext/lwip-patches applied it should stay flat.
+ *
+ * Between the two phases both sides leave the connections idle for a while
+ * and report the CPU time consumed meanwhile, which is dominated by the TCP
+ * timers. Plain lwIP walks all connections on each timer tick, so there this
+ * figure grows linearly with <count>. With the timer wheel (src/TcpTimers.cpp)
+ * idle connections are only visited when one of their timers is due, so it
+ * should stay roughly flat.
+ *
+ * Build libzt with -DZTS_MAX_SOCKETS=<n> larger than <count> to go beyond the
+ * default capacity of 1024 sockets.
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define ECHO_MSG_SIZE 64
+#define ECHO_ROUNDS   4
+#define IDLE_SECONDS  10
+
+static volatile int closed_count = 0;
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Current resident set size in KiB (peak RSS where /proc is unavailable) */
+static long rss_kb()
+{
+    long pages = 0, resident = 0;
+    FILE* f = fopen("/proc/self/statm", "r");
+    if (f) {
+        int n = fscanf(f, "%ld %ld", &pages, &resident);
+        fclose(f);
+        if (n == 2) {
+            return resident * 4;
+        }
+    }
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#if defined(__APPLE__)
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+static void report(const char* what, int count, double elapsed, long rss_before)
+{
+    long rss = rss_kb();
+    printf(
+        "%s %d connections in %.3f s (%.0f/s), RSS %ld KiB (%.2f KiB per connection)\n",
+        what,
+        count,
+        elapsed,
+        count / (elapsed > 0 ? elapsed : 1),
+        rss,
+        count ? (double)(rss - rss_before) / count : 0);
+}
+
+/* Report CPU time used while all connections sit idle */
+static void measure_idle(int count)
+{
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    double start = now();
+    zts_util_delay(IDLE_SECONDS * 1000);
+    double elapsed = now() - start;
+    getrusage(RUSAGE_SELF, &after);
+    double cpu = (after.ru_utime.tv_sec - before.ru_utime.tv_sec) + (after.ru_stime.tv_sec - before.ru_stime.tv_sec)
+                 + ((after.ru_utime.tv_usec - before.ru_utime.tv_usec) + (after.ru_stime.tv_usec - before.ru_stime.tv_usec))
+                       / 1000000.0;
+    printf("Idle with %d connections: %.2f%% of one core\n", count, 100.0 * cpu / elapsed);
+}
+
+static void start_node(char* storage_path, long long int net_id)
+{
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    printf("Waiting for address assignment from network\n");
+    while (! zts_addr_is_assigned(net_id, ZTS_AF_INET)) {
+        zts_util_delay(50);
+    }
+    char ipstr[ZTS_IP_MAX_STR_LEN] = { 0 };
+    zts_addr_get_str(net_id, ZTS_AF_INET, ipstr, ZTS_IP_MAX_STR_LEN);
+    printf("IP address on network %llx is %s\n", net_id, ipstr);
+}
+
+/* Echo everything received and close connections the client has closed */
+static void on_socket_event(int fd, int events, void* user)
+{
+    char buf[ECHO_MSG_SIZE];
+    ssize_t n;
+    while ((n = zts_bsd_read(fd, buf, sizeof(buf))) > 0) {
+        zts_bsd_write(fd, buf, n);
+    }
+    if (n == 0 || (events & ZTS_POLLERR)) {
+        zts_bsd_close(fd);
+        closed_count++;
+    }
+}
+
+static int run_server(int port, int count)
+{
+    int lfd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    if (lfd < 0 || zts_bind(lfd, "0.0.0.0", port) != ZTS_ERR_OK || zts_bsd_listen(lfd, 0xff) != ZTS_ERR_OK) {
+        printf("Unable to listen (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    int* fds = calloc(count, sizeof(int));
+    long rss_before = rss_kb();
+    double start = 0;
+    int accepted = 0;
+    while (accepted < count) {
+        int fd = zts_bsd_accept(lfd, NULL, NULL);
+        if (fd < 0) {
+            printf("Accept failed after %d connections (zts_errno=%d)\n", accepted, zts_errno);
+            break;
+        }
+        if (accepted == 0) {
+            start = now();
+        }
+        fds[accepted++] = fd;
+    }
+    report("Accepted", accepted, now() - start, rss_before);
+    measure_idle(accepted);
+    // Serve echo requests until the client has closed every connection
+    for (int i = 0; i < accepted; i++) {
+        zts_set_blocking(fds[i], 0);
+        zts_set_socket_callback(fds[i], on_socket_event, NULL);
+    }
+    while (closed_count < accepted) {
+        zts_util_delay(100);
+    }
+    zts_bsd_close(lfd);
+    free(fds);
+    return 0;
+}
+
+static int run_client(char* remote_addr, int port, int count)
+{
+    int* fds = calloc(count, sizeof(int));
+    long rss_before = rss_kb();
+    double start = now();
+    int connected = 0;
+    while (connected < count) {
+        int fd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+        if (fd < 0 || zts_connect(fd, remote_addr, port, 0) != ZTS_ERR_OK) {
+            printf("Connect failed after %d connections (zts_errno=%d)\n", connected, zts_errno);
+            if (fd >= 0) {
+                zts_bsd_close(fd);
+            }
+            break;
+        }
+        fds[connected++] = fd;
+    }
+    report("Connected", connected, now() - start, rss_before);
+    measure_idle(connected);
+    char msg[ECHO_MSG_SIZE] = { 0 };
+    start = now();
+    for (int r = 0; r < ECHO_ROUNDS; r++) {
+        for (int i = 0; i < connected; i++) {
+            if (zts_bsd_write(fds[i], msg, sizeof(msg)) != sizeof(msg)) {
+                printf("Echo write failed (zts_errno=%d). Exiting.\n", zts_errno);
+                exit(1);
+            }
+            for (ssize_t got = 0, n; got < (ssize_t)sizeof(msg); got += n) {
+                if ((n = zts_bsd_read(fds[i], msg + got, sizeof(msg) - got)) <= 0) {
+                    printf("Echo read failed (zts_errno=%d). Exiting.\n", zts_errno);
+                    exit(1);
+                }
+            }
+        }
+    }
+    double elapsed = now() - start;
+    if (connected) {
+        printf(
+            "Echo round trip over %d connections: %.1f us\n",
+            connected,
+            elapsed * 1000000.0 / ((double)connected * ECHO_ROUNDS));
+    }
+    for (int i = 0; i < connected; i++) {
+        zts_bsd_close(fds[i]);
+    }
+    free(fds);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5 || (strcmp(argv[1], "server") == 0 && argc != 6) || (strcmp(argv[1], "client") == 0 && argc != 7)) {
+        printf("\nlibzt example connection scaling benchmark\n");
+        printf("connscale server <id_storage_path> <net_id> <port> <count>\n");
+        printf("connscale client <id_storage_path> <net_id> <remote_addr> <remote_port> <count>\n");
+        exit(0);
+    }
+    long long int net_id = strtoull(argv[3], NULL, 16);   // At least 64 bits
+    start_node(argv[2], net_id);
+    int err;
+    if (strcmp(argv[1], "server") == 0) {
+        err = run_server(atoi(argv[4]), atoi(argv[5]));
+    }
+    else {
+        err = run_client(argv[4], atoi(argv[5]), atoi(argv[6]));
+    }
+    zts_node_stop();
+    return err;
+}
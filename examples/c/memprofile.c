@@ -0,0 +1,168 @@
+/**
+ * libzt C API example
+ *
+ * Memory footprint and throughput of the memory profiles. The client streams
+ * data to the server for a fixed time. Both sides start their node with the
+ * given profile; the server reports the goodput, the peak resident set size of
+ * the process and the peak memory the network stack had in use. Run once per
+ * profile (small, default, throughput) with a fresh server process each time,
+ * since the peak RSS never goes down.
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define BUF_SIZE         (128 * 1024)
+#define DURATION_SECONDS 10
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double peak_rss_mb()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / (1024.0 * 1024.0);   // Bytes
+#else
+    return ru.ru_maxrss / 1024.0;   // Kilobytes
+#endif
+}
+
+static int parse_profile(const char* name)
+{
+    if (strcmp(name, "small") == 0) {
+        return ZTS_PROFILE_SMALL;
+    }
+    if (strcmp(name, "throughput") == 0) {
+        return ZTS_PROFILE_THROUGHPUT;
+    }
+    if (strcmp(name, "default") == 0) {
+        return ZTS_PROFILE_DEFAULT;
+    }
+    return -1;
+}
+
+static void start_node(char* storage_path, long long int net_id, int profile)
+{
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    if ((err = zts_init_set_memory_profile(profile)) != ZTS_ERR_OK) {
+        printf("Unable to set memory profile, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    printf("Waiting for address assignment from network\n");
+    while (! zts_addr_is_assigned(net_id, ZTS_AF_INET)) {
+        zts_util_delay(50);
+    }
+}
+
+static int run_server(int port, const char* profile_name)
+{
+    int lfd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    if (lfd < 0 || zts_bind(lfd, "0.0.0.0", port) != ZTS_ERR_OK || zts_bsd_listen(lfd, 1) != ZTS_ERR_OK) {
+        printf("Unable to listen (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    printf("Idle: peak RSS %.1f MB\n", peak_rss_mb());
+    static char buf[BUF_SIZE];
+    int fd;
+    while ((fd = zts_bsd_accept(lfd, NULL, NULL)) >= 0) {
+        long long total = 0;
+        ssize_t n;
+        double start = now();
+        while ((n = zts_bsd_read(fd, buf, BUF_SIZE)) > 0) {
+            total += n;
+        }
+        double elapsed = now() - start;
+        zts_alloc_counter_t stack;
+        zts_stats_get_alloc(ZTS_ALLOC_STACK, &stack);
+        printf(
+            "%-10s %.1f MB in %.2f s: %.2f Mbit/s, peak RSS %.1f MB, peak stack memory %.1f MB\n",
+            profile_name,
+            total / (1024.0 * 1024.0),
+            elapsed,
+            total * 8 / elapsed / 1000000,
+            peak_rss_mb(),
+            stack.max_bytes / (1024.0 * 1024.0));
+        zts_bsd_close(fd);
+    }
+    zts_bsd_close(lfd);
+    return 0;
+}
+
+static int run_client(char* remote_addr, int port)
+{
+    int fd = zts_bsd_socket(zts_util_get_ip_family(remote_addr), ZTS_SOCK_STREAM, 0);
+    if (fd < 0 || zts_connect(fd, remote_addr, port, 0) != ZTS_ERR_OK) {
+        printf("Unable to connect (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    static char buf[BUF_SIZE];
+    double end = now() + DURATION_SECONDS;
+    while (now() < end) {
+        if (zts_bsd_write(fd, buf, BUF_SIZE) < 0) {
+            printf("Write failed (zts_errno=%d). Exiting.\n", zts_errno);
+            return 1;
+        }
+    }
+    zts_bsd_close(fd);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    int server = argc > 1 && strcmp(argv[1], "server") == 0;
+    int client = argc > 1 && strcmp(argv[1], "client") == 0;
+    int profile = -1;
+    if ((server && argc == 6) || (client && argc == 7)) {
+        profile = parse_profile(argv[argc - 1]);
+    }
+    if (profile < 0) {
+        printf("\nlibzt example memory profile benchmark\n");
+        printf("memprofile server <id_storage_path> <net_id> <port> <small|default|throughput>\n");
+        printf("memprofile client <id_storage_path> <net_id> <remote_addr> <remote_port> "
+               "<small|default|throughput>\n");
+        exit(0);
+    }
+    long long int net_id = strtoull(argv[3], NULL, 16);   // At least 64 bits
+    start_node(argv[2], net_id, profile);
+    int err;
+    if (server) {
+        err = run_server(atoi(argv[4]), argv[5]);
+    }
+    else {
+        err = run_client(argv[4], atoi(argv[5]));
+    }
+    zts_node_stop();
+    return err;
+}
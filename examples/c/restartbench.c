@@ -0,0 +1,125 @@
+/**
+ * libzt C API example
+ *
+ * Restart latency benchmark. The node is brought online, then repeatedly taken
+ * down and started again within the same process, either with zts_node_stop()
+ * (the network stack stays up) or with zts_node_free() (the stack is torn down
+ * and re-initialized as well). Reports how long the node takes to go down, how
+ * long zts_node_start() takes and how long until the node is online again.
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define ONLINE_TIMEOUT 30   // s
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int compare_double(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+static int wait_online()
+{
+    double deadline = now() + ONLINE_TIMEOUT;
+    while (! zts_node_is_online()) {
+        if (now() > deadline) {
+            return -1;
+        }
+        zts_util_delay(1);
+    }
+    return 0;
+}
+
+static void report(const char* name, double* samples, int n)
+{
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += samples[i];
+    }
+    qsort(samples, n, sizeof(double), compare_double);
+    printf(
+        "%-8s min %9.3f ms  avg %9.3f ms  p50 %9.3f ms  max %9.3f ms\n",
+        name,
+        samples[0] * 1000,
+        sum / n * 1000,
+        samples[n / 2] * 1000,
+        samples[n - 1] * 1000);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 4 || (strcmp(argv[1], "stop") != 0 && strcmp(argv[1], "free") != 0)) {
+        printf("\nlibzt example restart latency benchmark\n");
+        printf("restartbench <stop|free> <id_storage_path> <iterations>\n");
+        exit(0);
+    }
+    int full = strcmp(argv[1], "free") == 0;
+    char* storage_path = argv[2];
+    int iterations = atoi(argv[3]);
+    if (iterations <= 0) {
+        printf("Invalid number of iterations\n");
+        exit(1);
+    }
+    double* down = (double*)malloc(iterations * sizeof(double));
+    double* start = (double*)malloc(iterations * sizeof(double));
+    double* online = (double*)malloc(iterations * sizeof(double));
+
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK || (err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    if (wait_online() < 0) {
+        printf("Node did not come online. Exiting.\n");
+        exit(1);
+    }
+    printf("Restarting node %d times with zts_node_%s()\n", iterations, argv[1]);
+    for (int i = 0; i < iterations; i++) {
+        double t0 = now();
+        err = full ? zts_node_free() : zts_node_stop();
+        double t1 = now();
+        if (err != ZTS_ERR_OK) {
+            printf("Unable to bring node down, error = %d. Exiting.\n", err);
+            exit(1);
+        }
+        // The identity has to be loaded again either way
+        if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+            printf("Unable to initialize service, error = %d. Exiting.\n", err);
+            exit(1);
+        }
+        double t2 = now();
+        if ((err = zts_node_start()) != ZTS_ERR_OK) {
+            printf("Unable to restart service, error = %d. Exiting.\n", err);
+            exit(1);
+        }
+        double t3 = now();
+        if (wait_online() < 0) {
+            printf("Node did not come back online. Exiting.\n");
+            exit(1);
+        }
+        down[i] = t1 - t0;
+        start[i] = t3 - t2;
+        online[i] = now() - t2;
+    }
+    report("down", down, iterations);
+    report("start", start, iterations);
+    report("online", online, iterations);
+    zts_node_free();
+    free(down);
+    free(start);
+    free(online);
+    return 0;
+}
@@ -0,0 +1,142 @@
+/**
+ * libzt C API example
+ *
+ * Receive throughput and CPU cost benchmark. The client streams data to the
+ * server for a fixed time. The server, started with receive coalescing enabled
+ * (the default) or disabled, reports the goodput and the CPU time it spent per
+ * megabyte received. Run the server once with "gro" and once with "nogro" to
+ * compare.
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define BUF_SIZE         (128 * 1024)
+#define DURATION_SECONDS 10
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static double cpu_time()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1000000.0 + ru.ru_stime.tv_sec
+           + ru.ru_stime.tv_usec / 1000000.0;
+}
+
+static void start_node(char* storage_path, long long int net_id, int rx_coalescing)
+{
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    zts_init_allow_rx_coalescing(rx_coalescing);
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    printf("Waiting for address assignment from network\n");
+    while (! zts_addr_is_assigned(net_id, ZTS_AF_INET)) {
+        zts_util_delay(50);
+    }
+}
+
+static int run_server(int port, int rx_coalescing)
+{
+    int lfd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    if (lfd < 0 || zts_bind(lfd, "0.0.0.0", port) != ZTS_ERR_OK || zts_bsd_listen(lfd, 1) != ZTS_ERR_OK) {
+        printf("Unable to listen (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    static char buf[BUF_SIZE];
+    int fd;
+    while ((fd = zts_bsd_accept(lfd, NULL, NULL)) >= 0) {
+        long long total = 0;
+        ssize_t n;
+        double start = now();
+        double cpu_start = cpu_time();
+        while ((n = zts_bsd_read(fd, buf, BUF_SIZE)) > 0) {
+            total += n;
+        }
+        double elapsed = now() - start;
+        double cpu = cpu_time() - cpu_start;
+        double mb = total / (1024.0 * 1024.0);
+        printf(
+            "%-6s %.1f MB in %.2f s: %.2f Mbit/s, %.2f ms CPU per MB (%.0f%% of one core)\n",
+            rx_coalescing ? "gro" : "nogro",
+            mb,
+            elapsed,
+            total * 8 / elapsed / 1000000,
+            mb > 0 ? cpu * 1000 / mb : 0,
+            cpu / elapsed * 100);
+        zts_bsd_close(fd);
+    }
+    zts_bsd_close(lfd);
+    return 0;
+}
+
+static int run_client(char* remote_addr, int port)
+{
+    int fd = zts_bsd_socket(zts_util_get_ip_family(remote_addr), ZTS_SOCK_STREAM, 0);
+    if (fd < 0 || zts_connect(fd, remote_addr, port, 0) != ZTS_ERR_OK) {
+        printf("Unable to connect (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    static char buf[BUF_SIZE];
+    double end = now() + DURATION_SECONDS;
+    while (now() < end) {
+        if (zts_bsd_write(fd, buf, BUF_SIZE) < 0) {
+            printf("Write failed (zts_errno=%d). Exiting.\n", zts_errno);
+            return 1;
+        }
+    }
+    zts_bsd_close(fd);
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5 || (strcmp(argv[1], "server") == 0 && argc != 6) || (strcmp(argv[1], "client") == 0 && argc != 6)) {
+        printf("\nlibzt example receive throughput benchmark\n");
+        printf("rxbench server <id_storage_path> <net_id> <port> <gro|nogro>\n");
+        printf("rxbench client <id_storage_path> <net_id> <remote_addr> <remote_port>\n");
+        exit(0);
+    }
+    long long int net_id = strtoull(argv[3], NULL, 16);   // At least 64 bits
+    int server = strcmp(argv[1], "server") == 0;
+    int rx_coalescing = ! server || strcmp(argv[5], "nogro") != 0;
+    start_node(argv[2], net_id, rx_coalescing);
+    int err;
+    if (server) {
+        err = run_server(atoi(argv[4]), rx_coalescing);
+    }
+    else {
+        err = run_client(argv[4], atoi(argv[5]));
+    }
+    zts_node_stop();
+    return err;
+}
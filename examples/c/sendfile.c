@@ -0,0 +1,144 @@
+/**
+ * libzt C API example
+ *
+ * Compares the throughput of zts_sendfile() against a traditional read() +
+ * zts_write() loop when streaming a host file to a remote server. Any sink
+ * will do on the other end, e.g. the `server` example or `nc -l <port> > /dev/null`
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define COPY_BUF_SIZE (64 * 1024)
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static int connect_to_server(char* remote_addr, int remote_port)
+{
+    int fd;
+    while ((fd = zts_tcp_client(remote_addr, remote_port)) < 0) {
+        printf("Re-attempting to connect...\n");
+    }
+    return fd;
+}
+
+static void report(const char* method, long long bytes, double elapsed)
+{
+    printf(
+        "%-12s %lld bytes in %.3f s (%.2f MB/s)\n",
+        method,
+        bytes,
+        elapsed,
+        (bytes / (1024.0 * 1024.0)) / (elapsed > 0 ? elapsed : 1));
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 6) {
+        printf("\nlibzt example sendfile benchmark\n");
+        printf("sendfile <id_storage_path> <net_id> <remote_addr> <remote_port> <file>\n");
+        exit(0);
+    }
+    char* storage_path = argv[1];
+    long long int net_id = strtoull(argv[2], NULL, 16);   // At least 64 bits
+    char* remote_addr = argv[3];
+    int remote_port = atoi(argv[4]);
+    char* path = argv[5];
+    int err = ZTS_ERR_OK;
+
+    int host_fd = open(path, O_RDONLY);
+    struct stat st;
+    if (host_fd < 0 || fstat(host_fd, &st) != 0) {
+        printf("Unable to open %s. Exiting.\n", path);
+        exit(1);
+    }
+
+    // Initialize node
+
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+
+    // Start node
+
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+
+    // Join network
+
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    int family = zts_util_get_ip_family(remote_addr);
+    printf("Waiting for address assignment from network\n");
+    while (! (err = zts_addr_is_assigned(net_id, family))) {
+        zts_util_delay(50);
+    }
+
+    // read() + zts_write() loop
+
+    char* buf = malloc(COPY_BUF_SIZE);
+    int fd = connect_to_server(remote_addr, remote_port);
+    long long total = 0;
+    double start = now();
+    ssize_t n;
+    while ((n = read(host_fd, buf, COPY_BUF_SIZE)) > 0) {
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = zts_write(fd, buf + off, n - off);
+            if (w < 0) {
+                printf("Error (fd=%d, ret=%d, zts_errno=%d). Exiting.\n", fd, (int)w, zts_errno);
+                exit(1);
+            }
+            off += w;
+        }
+        total += n;
+    }
+    report("read/write", total, now() - start);
+    zts_close(fd);
+    free(buf);
+
+    // zts_sendfile()
+
+    fd = connect_to_server(remote_addr, remote_port);
+    total = 0;
+    start = now();
+    while (total < st.st_size) {
+        ssize_t w = zts_sendfile(fd, host_fd, total, st.st_size - total);
+        if (w <= 0) {
+            printf("Error (fd=%d, ret=%d, zts_errno=%d). Exiting.\n", fd, (int)w, zts_errno);
+            exit(1);
+        }
+        total += w;
+    }
+    report("zts_sendfile", total, now() - start);
+    zts_close(fd);
+
+    close(host_fd);
+    return zts_node_stop();
+}
@@ -0,0 +1,143 @@
+/**
+ * libzt C API example
+ *
+ * Small-message throughput benchmark. The client writes fixed-size messages as
+ * fast as it can, once per write call, with Nagle's algorithm (the default),
+ * with ZTS_TCP_NODELAY and with ZTS_TCP_NODELAY plus ZTS_TCP_COALESCE_USEC. The
+ * server reports the message rate of every connection it accepts.
+ */
+
+#include "ZeroTierSockets.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#define MSG_SIZE         32
+#define COALESCE_USEC    1000
+#define DURATION_SECONDS 10
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+static void start_node(char* storage_path, long long int net_id)
+{
+    int err = ZTS_ERR_OK;
+    if ((err = zts_init_from_storage(storage_path)) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    if ((err = zts_node_start()) != ZTS_ERR_OK) {
+        printf("Unable to start service, error = %d. Exiting.\n", err);
+        exit(1);
+    }
+    printf("Waiting for node to come online\n");
+    while (! zts_node_is_online()) {
+        zts_util_delay(50);
+    }
+    printf("Joining network %llx\n", net_id);
+    if (zts_net_join(net_id) != ZTS_ERR_OK) {
+        printf("Unable to join network. Exiting.\n");
+        exit(1);
+    }
+    printf("Waiting for join to complete\n");
+    while (! zts_net_transport_is_ready(net_id)) {
+        zts_util_delay(50);
+    }
+    printf("Waiting for address assignment from network\n");
+    while (! zts_addr_is_assigned(net_id, ZTS_AF_INET)) {
+        zts_util_delay(50);
+    }
+}
+
+static void report(const char* what, long long bytes, double elapsed)
+{
+    elapsed = elapsed > 0 ? elapsed : 1;
+    printf(
+        "%-10s %lld messages in %.1f s (%.0f msg/s, %.2f Mbit/s)\n",
+        what,
+        bytes / MSG_SIZE,
+        elapsed,
+        bytes / MSG_SIZE / elapsed,
+        bytes * 8 / 1000000.0 / elapsed);
+}
+
+static int run_server(int port)
+{
+    int lfd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    if (lfd < 0 || zts_bind(lfd, "0.0.0.0", port) != ZTS_ERR_OK || zts_bsd_listen(lfd, 1) != ZTS_ERR_OK) {
+        printf("Unable to listen (zts_errno=%d). Exiting.\n", zts_errno);
+        return 1;
+    }
+    char buf[64 * 1024];
+    int fd;
+    while ((fd = zts_bsd_accept(lfd, NULL, NULL)) >= 0) {
+        long long total = 0;
+        double start = now();
+        ssize_t n;
+        while ((n = zts_bsd_read(fd, buf, sizeof(buf))) > 0) {
+            total += n;
+        }
+        report("Received", total, now() - start);
+        zts_bsd_close(fd);
+    }
+    zts_bsd_close(lfd);
+    return 0;
+}
+
+static int run_client(char* remote_addr, int port)
+{
+    const char* modes[] = { "nagle", "nodelay", "coalesce" };
+    char msg[MSG_SIZE] = { 0 };
+    for (int mode = 0; mode < 3; mode++) {
+        int fd = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+        int on = 1, usec = COALESCE_USEC;
+        if (fd < 0 || zts_connect(fd, remote_addr, port, 0) != ZTS_ERR_OK
+            || (mode > 0 && zts_bsd_setsockopt(fd, ZTS_IPPROTO_TCP, ZTS_TCP_NODELAY, &on, sizeof(on)) != ZTS_ERR_OK)
+            || (mode > 1
+                && zts_bsd_setsockopt(fd, ZTS_IPPROTO_TCP, ZTS_TCP_COALESCE_USEC, &usec, sizeof(usec))
+                       != ZTS_ERR_OK)) {
+            printf("Unable to connect (zts_errno=%d). Exiting.\n", zts_errno);
+            return 1;
+        }
+        long long total = 0;
+        double start = now();
+        while (now() - start < DURATION_SECONDS) {
+            if (zts_bsd_write(fd, msg, MSG_SIZE) != MSG_SIZE) {
+                printf("Write failed (zts_errno=%d). Exiting.\n", zts_errno);
+                return 1;
+            }
+            total += MSG_SIZE;
+        }
+        report(modes[mode], total, now() - start);
+        zts_bsd_close(fd);
+        zts_util_delay(1000);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 5 || (strcmp(argv[1], "server") == 0 && argc != 5) || (strcmp(argv[1], "client") == 0 && argc != 6)) {
+        printf("\nlibzt example small-message throughput benchmark\n");
+        printf("smallmsg server <id_storage_path> <net_id> <port>\n");
+        printf("smallmsg client <id_storage_path> <net_id> <remote_addr> <remote_port>\n");
+        exit(0);
+    }
+    long long int net_id = strtoull(argv[3], NULL, 16);   // At least 64 bits
+    start_node(argv[2], net_id);
+    int err;
+    if (strcmp(argv[1], "server") == 0) {
+        err = run_server(atoi(argv[4]));
+    }
+    else {
+        err = run_client(argv[4], atoi(argv[5]));
+    }
+    zts_node_stop();
+    return err;
+}
@@ -125,6 +125,18 @@ int main(int argc, char** argv)
             s.nd6_rx,
             s.nd6_drop,
             s.nd6_err);
+        printf(
+            " mem_heap=%9d,  heap_max=%9d,    heap_err=%9d, reserved=%9d\n",
+            s.mem[ZTS_STATS_MEM_HEAP].used,
+            s.mem[ZTS_STATS_MEM_HEAP].max,
+            s.mem[ZTS_STATS_MEM_HEAP].err,
+            s.mem_reserved);
+        printf(
+            "  tcp_pcb=%9d,   pcb_max=%9d,     tcp_seg=%9d,  seg_max=%9d\n",
+            s.mem[ZTS_STATS_MEM_TCP_PCB].used,
+            s.mem[ZTS_STATS_MEM_TCP_PCB].max,
+            s.mem[ZTS_STATS_MEM_TCP_SEG].used,
+            s.mem[ZTS_STATS_MEM_TCP_SEG].max);
     }
     return zts_node_stop();
 }
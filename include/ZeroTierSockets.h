@@ -324,6 +324,11 @@ typedef enum {
  */
 #define ZTS_MAX_NETWORK_SHORT_NAME_LENGTH 127
 
+/**
+ * Maximum MTU of a network
+ */
+#define ZTS_MAX_MTU 10000
+
 /**
  * Maximum number of pushed routes on a network
  */
@@ -469,6 +474,7 @@ typedef void (*CppCallback)(void* msg);
 #define ZTS_MSG_OOB      0x0004   // NOT YET SUPPORTED
 #define ZTS_MSG_DONTWAIT 0x0008
 #define ZTS_MSG_MORE     0x0010
+#define ZTS_MSG_SEND_ON_CONNECT 0x20000000   // zts_bsd_sendto() on TCP: connect and send
 
 // Macro's for defining ioctl() command values
 #define ZTS_IOCPARM_MASK 0x7fU
@@ -717,6 +723,37 @@ typedef enum {
     ZTS_PEER_ROLE_PLANET = 2
 } zts_peer_role_t;
 
+/**
+ * What the network stack does to TCP connections when ZeroTier paths to the
+ * remote peer come and go. See `zts_init_set_peer_loss_policy()`
+ */
+typedef enum {
+    /**
+     * Connections are left alone and recover on their own retransmission
+     * timers (default)
+     */
+    ZTS_PEER_LOSS_POLICY_NONE = 0,
+    /**
+     * When a path to the peer dies or is discovered, outstanding data is
+     * retransmitted immediately and the retransmission backoff is reset
+     */
+    ZTS_PEER_LOSS_POLICY_RETRANSMIT = 1,
+    /**
+     * As `ZTS_PEER_LOSS_POLICY_RETRANSMIT`, but connections to a peer that has
+     * become unreachable fail with `ZTS_ECONNABORTED`: the node forgot the peer,
+     * or the peer had neither a direct path nor a root to relay through for
+     * `ZTS_PEER_LOSS_GRACE_PERIOD`. Losing only the direct paths is not enough
+     * since traffic still flows through the roots
+     */
+    ZTS_PEER_LOSS_POLICY_RESET = 2
+} zts_peer_loss_policy_t;
+
+/**
+ * How long a peer must be without any path before `ZTS_PEER_LOSS_POLICY_RESET`
+ * resets its connections (ms)
+ */
+#define ZTS_PEER_LOSS_GRACE_PERIOD 30000
+
 /**
  * Virtual network configuration
  */
@@ -1443,6 +1480,157 @@ ZTS_API int ZTCALL zts_init_allow_roots_cache(unsigned int allowed);
  */
 ZTS_API int ZTCALL zts_init_allow_id_cache(unsigned int allowed);
 
+/**
+ * @brief Set how TCP connections react to ZeroTier path changes towards their
+ * remote peer. This is an initialization function that can only be called
+ * before `zts_node_start()`.
+ *
+ * By default a connection to a peer whose path has died only notices once its
+ * own retransmission timer expires, which after a few losses can take many
+ * seconds even when ZeroTier has already found another path (or a relay). With
+ * `ZTS_PEER_LOSS_POLICY_RETRANSMIT` the outstanding data is resent as soon as a
+ * path dies or is discovered. With `ZTS_PEER_LOSS_POLICY_RESET` connections to
+ * a peer that can no longer be reached, directly or through a root, are failed
+ * with `ZTS_ECONNABORTED` so the application can react (or reconnect) without
+ * waiting for the retransmissions to give up.
+ *
+ * Path changes are observed on the node's background loop, so the reaction
+ * happens within a few hundred milliseconds of ZeroTier detecting the change.
+ *
+ * @param policy One of `zts_peer_loss_policy_t` (default: `ZTS_PEER_LOSS_POLICY_NONE`)
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_init_set_peer_loss_policy(int policy);
+
+/**
+ * @brief Enable or disable receive coalescing (enabled by default). Must be
+ * called before `zts_node_start()`.
+ *
+ * In-order TCP segments of the same connection that arrive in one burst are
+ * merged into a single segment before they reach the network stack, so that a
+ * bulk transfer is processed and acknowledged per burst rather than per frame.
+ * Segments are never held back beyond the burst they arrived in.
+ *
+ * @param allowed Whether or not this feature is enabled
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_init_allow_rx_coalescing(unsigned int allowed);
+
+/**
+ * Allocation function of a custom allocator. Must return memory aligned like
+ * `malloc()`, or NULL if out of memory. May be called from any thread.
+ */
+typedef void* (*zts_malloc_fn)(size_t size, void* ctx);
+
+/**
+ * Counterpart of `zts_malloc_fn`. Never called with NULL.
+ */
+typedef void (*zts_free_fn)(void* ptr, void* ctx);
+
+/**
+ * Reallocation function of a custom allocator, with the semantics of `realloc()`
+ */
+typedef void* (*zts_realloc_fn)(void* ptr, size_t size, void* ctx);
+
+/**
+ * @brief Set the allocator libzt uses for its own memory. Must be called
+ * before `zts_node_start()`.
+ *
+ * Used for the network stack's memory (obtained in large slabs that are kept
+ * and reused, see `ZTS_ALLOC_STACK`), event messages, virtual network
+ * interfaces and TCP tunnel connections. Memory that ZeroTier's core and the
+ * C++ runtime allocate is not affected. Blocks allocated before the allocator
+ * is replaced are returned to the allocator that provided them, so `ctx` must
+ * stay valid for as long as the process may free them. Use
+ * `zts_stats_get_alloc()` to see how much each subsystem allocates.
+ *
+ * @param malloc_fn Allocation function, or NULL (along with `free_fn`) to
+ *     restore the default libc allocator
+ * @param free_fn Function freeing blocks returned by `malloc_fn`
+ * @param realloc_fn Reallocation function, may be NULL. libzt does not resize
+ *     any of its blocks at present.
+ * @param ctx Passed to every call of the functions above
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL
+zts_init_set_allocator(zts_malloc_fn malloc_fn, zts_free_fn free_fn, zts_realloc_fn realloc_fn, void* ctx);
+
+/**
+ * @brief Set a hard limit on the memory libzt uses (no limit by default). Must
+ * be called before `zts_node_start()`.
+ *
+ * Covers the network stack (packet buffers, send and receive queues, protocol
+ * state), event messages, virtual network interfaces and TCP tunnel buffers.
+ * The budget bounds memory in use; memory the stack keeps for reuse is not
+ * counted. Pressure is applied in stages so that no single connection can use
+ * up the budget:
+ *
+ * - Past half of the budget, the receive windows of TCP connections shrink as
+ *   their data is read, down to four segments when the budget is exhausted.
+ * - Past seven eighths, sends fail with `ZTS_ENOBUFS` on UDP sockets and on TCP
+ *   sockets that already have four segments queued. The remainder is left for
+ *   received packets, which carry the acknowledgements that free send queues.
+ * - At the budget, stack allocations and events fail and received packets are
+ *   dropped (to be retransmitted by their senders).
+ *
+ * See `zts_get_sock_mem_usage()` for what a socket holds. A budget set here
+ * takes precedence over that of the memory profile.
+ *
+ * @param bytes Budget in bytes, at least 1 MiB, or 0 for no limit
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_init_set_memory_budget(uint64_t bytes);
+
+/**
+ * Memory profiles, see `zts_init_set_memory_profile()`
+ */
+typedef enum {
+    /** Sizing as compiled */
+    ZTS_PROFILE_DEFAULT = 0,
+    /** Least memory: 4 MiB budget, 64 KiB receive windows, small slabs and
+     * per-thread caches, at most 64 pending events */
+    ZTS_PROFILE_SMALL = 1,
+    /** Most throughput: large slabs and per-thread caches so that busy
+     * threads rarely contend for stack memory */
+    ZTS_PROFILE_THROUGHPUT = 2
+} zts_memory_profile_t;
+
+/**
+ * @brief Select how much memory libzt trades for throughput. Must be called
+ * before `zts_node_start()`, which applies it.
+ *
+ * The profile sizes the slabs and per-thread caches of the network stack, the
+ * default TCP receive window (sockets that set `ZTS_SO_RCVBUF` keep their own),
+ * the queue of events waiting for the callback and the memory budget. Limits
+ * fixed at build time, such as the largest window, are not raised.
+ *
+ * @param profile One of `zts_memory_profile_t`
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_init_set_memory_profile(int profile);
+
+/**
+ * @brief Limit how many sockets may be open at once. Must be called before
+ * `zts_node_start()`.
+ *
+ * The limit applies to the whole process and is enforced by
+ * `zts_bsd_socket()` and `zts_bsd_accept()`, which fail with `ZTS_EMFILE`
+ * once it is reached (a connection that cannot be accepted stays queued on
+ * the listener). It cannot exceed `ZTS_MAX_SOCKETS`, the capacity chosen at
+ * build time, which is also the default.
+ *
+ * @param max_sockets Maximum number of open sockets, `0` for `ZTS_MAX_SOCKETS`
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if `max_sockets` is larger than
+ *     `ZTS_MAX_SOCKETS`.
+ */
+ZTS_API int ZTCALL zts_init_set_max_sockets(unsigned int max_sockets);
+
 /**
  * @brief Return whether an address of the given family has been assigned by the network
  *
@@ -1627,6 +1815,11 @@ ZTS_API int ZTCALL zts_net_get_broadcast(uint64_t net_id);
 /**
  * @brief Get the MTU of the given network
  *
+ * The network stack's interface uses the same MTU (up to `ZTS_MAX_MTU`) and
+ * follows changes to the network's configuration. TCP connections derive
+ * their segment size from it, and fall back to smaller segments if a path
+ * turns out to be unable to carry full-size packets.
+ *
  * @param net_id Network ID
  *
  * @return MTU
@@ -1730,7 +1923,9 @@ ZTS_API int ZTCALL zts_node_get_port();
  *
  * While the ZeroTier will stop, the stack driver (with associated
  * timers) will remain active in case future traffic processing is required.
- * To stop all activity and free all resources use `zts_free()` instead.
+ * To stop all activity and free all resources use `zts_node_free()` instead.
+ * Returns once the node's service thread has exited, after which the node
+ * can be started again with `zts_node_start()`.
  *
  * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
  *     experiences a problem.
@@ -1739,12 +1934,21 @@ ZTS_API int ZTCALL zts_node_stop();
 
 /**
  * @brief Stop all background threads, bring down all transport services, free all
- *     resources. After calling this function an application restart will be
- *     required before the library can be used again. Callable only after the node
- *     has been started.
- *
- * This should be called at the end of your program or when you do not
- * anticipate communicating over ZeroTier again.
+ *     resources. Callable only after the node has been started (it may have
+ *     been stopped since).
+ *
+ * Returns once the node's threads have exited and its last event
+ * (`ZTS_EVENT_STACK_DOWN`) has been delivered. The node can then be
+ * initialized and started again without restarting the application; the
+ * TCP/IP stack comes back up with it, although its internal thread is kept
+ * for the life of the process. TCP connections still open when the stack
+ * goes down are reset. With several node instances
+ * (see `zts_ctx_new()`) this frees the calling thread's instance, and the
+ * TCP/IP stack is only stopped along with the last instance that used it.
+ *
+ * When called from the event handler, returns without waiting for the
+ * callback thread; the node can be initialized again once the handler has
+ * returned and `ZTS_EVENT_STACK_DOWN` has been delivered.
  *
  * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
  *     experiences a problem.
@@ -1770,10 +1974,113 @@ ZTS_API int ZTCALL zts_moon_orbit(uint64_t moon_roots_id, uint64_t moon_seed);
  */
 ZTS_API int ZTCALL zts_moon_deorbit(uint64_t moon_roots_id);
 
+//----------------------------------------------------------------------------//
+// Node Instances                                                             //
+//----------------------------------------------------------------------------//
+
+/**
+ * Handle of a node instance, see `zts_ctx_new()`
+ */
+typedef struct zts_ctx zts_ctx_t;
+
+/**
+ * @brief Create a node instance, for running several nodes (each with its own
+ *     identity) in one process.
+ *
+ * Every instance has its own node service, networks, event queue, event
+ * handler and background threads. The `zts_init_*`, `zts_node_*`,
+ * `zts_net_*`, `zts_addr_*`, `zts_core_*` and `zts_moon_*` functions act on
+ * the instance the calling thread selected with `zts_ctx_use()`, or on the
+ * default instance if it selected none. Applications using a single node need
+ * none of this.
+ *
+ * All instances share the TCP/IP stack: sockets can be used from any thread
+ * and reach the networks of every instance, and a socket bound to an address
+ * sends through the instance that was assigned that address. Settings of the
+ * stack (`zts_init_allow_rx_coalescing()`, `zts_init_set_memory_profile()`,
+ * `zts_init_set_memory_budget()`) are process-wide; the node started last
+ * applies its own.
+ *
+ * @return New instance, or NULL if out of memory
+ */
+ZTS_API zts_ctx_t* ZTCALL zts_ctx_new();
+
+/**
+ * @brief Select the instance the calling thread's node and network functions
+ *     act on. Other threads are not affected.
+ *
+ * @param ctx Instance returned by `zts_ctx_new()`, or NULL for the default
+ *     instance
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_ARG` if `ctx` has been freed.
+ */
+ZTS_API int ZTCALL zts_ctx_use(zts_ctx_t* ctx);
+
+/**
+ * @brief Return the instance selected by the calling thread, or the default
+ *     instance if it selected none or its instance has been freed since
+ */
+ZTS_API zts_ctx_t* ZTCALL zts_ctx_current();
+
+/**
+ * @brief Stop the node of an instance if it runs, wait for its background
+ *     threads to exit and free it. The TCP/IP stack keeps running.
+ *
+ * The application must make sure no other thread is inside a node or network
+ * function of the instance while it is freed. Threads that selected it act on
+ * the default instance afterwards, as if they had called `zts_ctx_use(NULL)`.
+ * May be called from the instance's own event handler: the instance is then
+ * deleted by its callback thread once the handler has returned and
+ * `ZTS_EVENT_STACK_DOWN` has been delivered.
+ *
+ * @param ctx Instance returned by `zts_ctx_new()`
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_ARG` if `ctx` is NULL, the
+ *     default instance or already freed.
+ */
+ZTS_API int ZTCALL zts_ctx_free(zts_ctx_t* ctx);
+
 //----------------------------------------------------------------------------//
 // Statistics                                                                 //
 //----------------------------------------------------------------------------//
 
+/**
+ * Memory pools of the network stack, index into `zts_stats_counter_t.mem`
+ */
+typedef enum {
+    /** All stack memory: packet buffers and the objects of every pool below (bytes) */
+    ZTS_STATS_MEM_HEAP = 0,
+    /** TCP connections */
+    ZTS_STATS_MEM_TCP_PCB = 1,
+    /** Listening TCP sockets */
+    ZTS_STATS_MEM_TCP_PCB_LISTEN = 2,
+    /** Queued TCP segments */
+    ZTS_STATS_MEM_TCP_SEG = 3,
+    /** UDP sockets */
+    ZTS_STATS_MEM_UDP_PCB = 4,
+    /** Sockets (netconns) */
+    ZTS_STATS_MEM_NETCONN = 5,
+    /** Received datagrams waiting to be read */
+    ZTS_STATS_MEM_NETBUF = 6,
+    /** pbuf headers referencing memory outside the stack */
+    ZTS_STATS_MEM_PBUF = 7,
+    /** Pending stack timers */
+    ZTS_STATS_MEM_SYS_TIMEOUT = 8,
+    /** All other pools together */
+    ZTS_STATS_MEM_OTHER = 9,
+    ZTS_STATS_MEM_COUNT = 10
+} zts_stats_mem_t;
+
+/**
+ * Usage of one memory pool
+ */
+typedef struct {
+    /** Objects in use (bytes for `ZTS_STATS_MEM_HEAP`) */
+    uint32_t used;
+    /** Highest value of used so far */
+    uint32_t max;
+    /** Number of failed allocations */
+    uint32_t err;
+} zts_stats_mem_counter_t;
+
 /**
  * Structure containing counters for various protocol statistics
  */
@@ -1849,6 +2156,12 @@ typedef struct {
     uint32_t tcp_drop;
     /** Aggregate number of TCP errors */
     uint32_t tcp_err;
+    /** Number of TCP segments retransmitted */
+    uint32_t tcp_rexmit;
+    /** Number of TCP segments retransmitted because SACK showed them lost */
+    uint32_t tcp_sack_rexmit;
+    /** Number of SACK-based TCP loss recovery episodes */
+    uint32_t tcp_recovery;
 
     /** Number of ND6 packets transmitted */
     uint32_t nd6_tx;
@@ -1858,6 +2171,11 @@ typedef struct {
     uint32_t nd6_drop;
     /** Aggregate number of ND6 errors */
     uint32_t nd6_err;
+
+    /** Usage of the stack's memory pools, indexed by `zts_stats_mem_t` */
+    zts_stats_mem_counter_t mem[ZTS_STATS_MEM_COUNT];
+    /** Bytes obtained from the system for stack memory (kept for reuse) */
+    uint32_t mem_reserved;
 } zts_stats_counter_t;
 
 /**
@@ -1872,6 +2190,50 @@ typedef struct {
  */
 ZTS_API int ZTCALL zts_stats_get_all(zts_stats_counter_t* dst);
 
+/**
+ * Parts of libzt whose memory is counted separately
+ */
+typedef enum {
+    /** Network stack: slabs and buffers too large for them */
+    ZTS_ALLOC_STACK = 0,
+    /** Event messages and their queue */
+    ZTS_ALLOC_EVENTS = 1,
+    /** Virtual network interfaces */
+    ZTS_ALLOC_TAP = 2,
+    /** TCP tunnel connections and their buffers */
+    ZTS_ALLOC_TUNNEL = 3,
+    ZTS_ALLOC_COUNT = 4
+} zts_alloc_subsys_t;
+
+/**
+ * Allocations of one subsystem
+ */
+typedef struct {
+    /** Blocks allocated so far */
+    uint64_t allocs;
+    /** Blocks freed so far */
+    uint64_t frees;
+    /** Bytes currently allocated */
+    uint64_t bytes;
+    /** Highest value of bytes so far */
+    uint64_t max_bytes;
+    /** Number of failed allocations */
+    uint32_t err;
+} zts_alloc_counter_t;
+
+/**
+ * @brief Get the allocation counters of a subsystem. Unlike other statistics
+ * these are available at any time.
+ *
+ * Once warmed up, a steady workload should leave `allocs` of every subsystem
+ * unchanged: the network stack recycles its slabs and the tunnel its buffers.
+ *
+ * @param subsys One of `zts_alloc_subsys_t`
+ * @param dst Pointer to structure that will be populated with the counters
+ * @return `ZTS_ERR_OK` on success, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_stats_get_alloc(int subsys, zts_alloc_counter_t* dst);
+
 //----------------------------------------------------------------------------//
 // Socket API                                                                 //
 //----------------------------------------------------------------------------//
@@ -1953,7 +2315,7 @@ struct zts_linger {
 #define ZTS_SO_DONTLINGER   ((int)(~ZTS_SO_LINGER))
 #define ZTS_SO_OOBINLINE    0x0100   // NOT YET SUPPORTED
 #define ZTS_SO_REUSEPORT    0x0200   // NOT YET SUPPORTED
-#define ZTS_SO_SNDBUF       0x1001   // NOT YET SUPPORTED
+#define ZTS_SO_SNDBUF       0x1001   // TCP only
 #define ZTS_SO_RCVBUF       0x1002
 #define ZTS_SO_SNDLOWAT     0x1003   // NOT YET SUPPORTED
 #define ZTS_SO_RCVLOWAT     0x1004   // NOT YET SUPPORTED
@@ -1974,6 +2336,14 @@ struct zts_linger {
 #define ZTS_TCP_KEEPIDLE  0x0003
 #define ZTS_TCP_KEEPINTVL 0x0004
 #define ZTS_TCP_KEEPCNT   0x0005
+#define ZTS_TCP_CONGESTION    0x000d   // Name of congestion control algorithm
+#define ZTS_TCP_CORK          0x000e   // Hold back partial segments (max 200 ms)
+#define ZTS_TCP_COALESCE_USEC 0x000f   // Hold back partial segments for up to N us
+// Values of ZTS_TCP_CONGESTION
+#define ZTS_TCP_CC_RENO  "reno"    // lwIP built-in NewReno (default)
+#define ZTS_TCP_CC_CUBIC "cubic"   // RFC 8312
+#define ZTS_TCP_CC_BBR   "bbr"     // Model-based, ignores random loss
+#define ZTS_TCP_CC_NAME_MAX 16
 // IPPROTO_IPV6 options
 #define ZTS_IPV6_CHECKSUM                                                                                              \
     0x0007 /* RFC3542: calculate and insert the ICMPv6 checksum for raw                                                \
@@ -2114,10 +2484,20 @@ ZTS_API int ZTCALL zts_bsd_getpeername(int fd, struct zts_sockaddr* addr, zts_so
  */
 ZTS_API int ZTCALL zts_bsd_close(int fd);
 
+/**
+ * Maximum number of simultaneously open sockets (including listening sockets).
+ * Set at build time with the `ZTS_MAX_SOCKETS` CMake option. Applications must
+ * be compiled with the same value as the library since it determines the size
+ * of `zts_fd_set`
+ */
+#ifndef ZTS_MAX_SOCKETS
+#define ZTS_MAX_SOCKETS 1024
+#endif
+
 /* FD_SET used for lwip_select */
 
 #define LWIP_SOCKET_OFFSET 0
-#define MEMP_NUM_NETCONN   1024
+#define MEMP_NUM_NETCONN   ZTS_MAX_SOCKETS
 
 #ifndef ZTS_FD_SET
 #undef ZTS_FD_SETSIZE
@@ -2237,6 +2617,18 @@ ZTS_API int ZTCALL zts_bsd_ioctl(int fd, unsigned long request, void* argp);
 /**
  * @brief Send data to remote host
  *
+ * On a TCP socket, `ZTS_MSG_MORE` (or the `ZTS_TCP_CORK` option) holds back
+ * data that does not fill a segment until more is written, so that small
+ * writes leave as one packet. Held back data is sent once a full segment has
+ * accumulated, with the next write that does not pass `ZTS_MSG_MORE` (unless
+ * corked), or after 200 ms. `ZTS_TCP_COALESCE_USEC` does the same for every
+ * write with a deadline of the given number of microseconds (rounded up to
+ * milliseconds). Combine these with `ZTS_TCP_NODELAY` so that Nagle's algorithm
+ * does not delay the coalesced segments further. Other ways of sending on the
+ * socket (`zts_bsd_sendto()`, `zts_bsd_sendmsg()`, `zts_bsd_writev()`,
+ * `zts_sendfile()`, `zts_send_zc()`) send held back data first, and
+ * `zts_bsd_close()` sends it before the connection is closed.
+ *
  * @param fd Socket file descriptor
  * @param buf Pointer to data buffer
  * @param len Length of data to write
@@ -2249,6 +2641,16 @@ ZTS_API ssize_t ZTCALL zts_bsd_send(int fd, const void* buf, size_t len, int fla
 /**
  * @brief Send data to remote host
  *
+ * On an unconnected TCP socket `ZTS_MSG_SEND_ON_CONNECT` connects to `addr` and
+ * sends the data in one call. The data is queued before the handshake
+ * completes and leaves together with its final ACK, so it still takes a round
+ * trip; unlike TCP Fast Open (RFC 7413) nothing is carried in the SYN, and no
+ * support from the peer is needed. A blocking socket returns once the
+ * connection is established; a non-blocking one returns the number of bytes
+ * queued (or fails with `ZTS_EINPROGRESS`). On a connected or connecting TCP
+ * socket the flag is ignored and the data is sent like with `zts_bsd_send()`.
+ * On other socket types the flag fails with `ZTS_EOPNOTSUPP`.
+ *
  * @param fd Socket file descriptor
  * @param buf Pointer to data buffer
  * @param len Length of data to write
@@ -2389,6 +2791,58 @@ ZTS_API ssize_t ZTCALL zts_bsd_writev(int fd, const struct zts_iovec* iov, int i
  */
 ZTS_API int ZTCALL zts_bsd_shutdown(int fd, int how);
 
+/**
+ * Maximum number of messages processed by a single call to
+ * `zts_bsd_sendmmsg` or `zts_bsd_recvmmsg`. Larger vectors are truncated
+ */
+#define ZTS_MMSG_MAX 1024
+
+/* */
+struct zts_mmsghdr {
+    struct zts_msghdr msg_hdr;
+    /** Number of bytes transmitted or received for this message */
+    unsigned int msg_len;
+};
+
+/**
+ * @brief Send multiple messages on a socket with a single call
+ *
+ * On datagram sockets all messages are handed to the network stack under a
+ * single acquisition of its core lock, without per-message thread handoff.
+ * Each message is sent to `msg_hdr.msg_name`, or to the connected peer if
+ * that is `NULL`. On other socket types this is equivalent to calling
+ * `zts_bsd_sendmsg` for each message.
+ *
+ * @param fd Socket file descriptor
+ * @param msgvec Array of messages. `msg_len` of each sent message is updated
+ * @param vlen Number of messages in `msgvec`
+ * @param flags Specifies type of message transmission
+ * @return Number of messages sent if successful (stops at the first failure),
+ *     `ZTS_ERR_SERVICE` if the node experiences a problem, `ZTS_ERR_ARG` if
+ *     invalid argument, `ZTS_ERR_SOCKET` if the first message could not be
+ *     sent. Sets `zts_errno`
+ */
+ZTS_API int ZTCALL zts_bsd_sendmmsg(int fd, struct zts_mmsghdr* msgvec, unsigned int vlen, int flags);
+
+/**
+ * @brief Receive multiple messages from a socket with a single call
+ *
+ * Waits for the first message according to the socket's blocking mode (or
+ * `ZTS_MSG_DONTWAIT`) and then returns as many further messages as are
+ * immediately available without blocking. `msg_hdr.msg_name` (if not `NULL`)
+ * receives the source address and `msg_hdr.msg_flags` is set to
+ * `ZTS_MSG_TRUNC` if a datagram did not fit into the supplied buffers.
+ *
+ * @param fd Socket file descriptor
+ * @param msgvec Array of messages. `msg_len` of each received message is updated
+ * @param vlen Number of messages in `msgvec`
+ * @param flags Specifies the type of message receipt
+ * @return Number of messages received if successful, `ZTS_ERR_SERVICE` if the
+ *     node experiences a problem, `ZTS_ERR_ARG` if invalid argument,
+ *     `ZTS_ERR_SOCKET` if no message could be received. Sets `zts_errno`
+ */
+ZTS_API int ZTCALL zts_bsd_recvmmsg(int fd, struct zts_mmsghdr* msgvec, unsigned int vlen, int flags);
+
 //----------------------------------------------------------------------------//
 // Simplified socket API                                                      //
 //----------------------------------------------------------------------------//
@@ -2769,6 +3223,10 @@ ZTS_API int ZTCALL zts_get_send_timeout(int fd);
 /**
  * @brief Set the value of `SO_SNDBUF`
  *
+ * Only supported for TCP sockets. The size is clamped to the range 64 KiB up
+ * to the stack's compile-time send buffer. A listening socket passes its value
+ * on to the sockets it accepts.
+ *
  * @param fd Socket file descriptor
  * @param size Size of buffer
  * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
@@ -2788,6 +3246,15 @@ ZTS_API int ZTCALL zts_get_send_buf_size(int fd);
 /**
  * @brief Set the value of `SO_RCVBUF`
  *
+ * For TCP sockets this limits the advertised receive window. The size is
+ * clamped to the range four segments up to the stack's compile-time window and
+ * takes effect once the connection is established. A listening socket passes
+ * its value on to the sockets it accepts.
+ *
+ * For UDP sockets this is the number of bytes of datagrams that may be queued
+ * for the application; datagrams arriving while it is exhausted are dropped
+ * and counted (see `zts_get_recv_drop_count()`).
+ *
  * @param fd Socket file descriptor
  * @param size Size of buffer
  * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
@@ -2804,6 +3271,66 @@ ZTS_API int ZTCALL zts_set_recv_buf_size(int fd, int size);
  */
 ZTS_API int ZTCALL zts_get_recv_buf_size(int fd);
 
+/**
+ * @brief Enable or disable receive window autotuning on a TCP socket
+ *
+ * An autotuned connection starts with a 64 KiB receive window and grows it to
+ * twice the amount of data the application reads per round trip, up to
+ * `SO_RCVBUF` (or the stack's compile-time window if unset). This keeps slow
+ * readers from tying up memory while letting fast ones reach full throughput
+ * on long paths. A listening socket passes the setting on to the sockets it
+ * accepts.
+ *
+ * @param fd Socket file descriptor
+ * @param enabled Whether autotuning should be enabled
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument
+ */
+ZTS_API int ZTCALL zts_set_recv_buf_autotune(int fd, int enabled);
+
+/**
+ * @brief Return whether receive window autotuning is enabled on a socket
+ *
+ * @param fd Socket file descriptor
+ * @return `1` if enabled, `0` if disabled, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument
+ */
+ZTS_API int ZTCALL zts_get_recv_buf_autotune(int fd);
+
+/**
+ * @brief Return the number of datagrams dropped on a UDP socket because its
+ * receive buffer (`SO_RCVBUF`) was full
+ *
+ * Counting starts when `SO_RCVBUF` is set or on the first call to this function.
+ *
+ * @param fd Socket file descriptor
+ * @return Number of dropped datagrams, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument
+ */
+ZTS_API int ZTCALL zts_get_recv_drop_count(int fd);
+
+/**
+ * Memory held by a socket
+ */
+typedef struct {
+    /** Bytes queued for sending that the peer has not acknowledged yet */
+    uint32_t snd_queued;
+    /** Bytes received that the application has not read yet */
+    uint32_t rcv_queued;
+    /** Bytes received out of order, waiting for the data before them (TCP) */
+    uint32_t rcv_ooseq;
+} zts_sock_mem_t;
+
+/**
+ * @brief Return how much memory a socket holds in its queues
+ *
+ * @param fd Socket file descriptor
+ * @param dst Pointer to structure that will be populated
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument
+ */
+ZTS_API int ZTCALL zts_get_sock_mem_usage(int fd, zts_sock_mem_t* dst);
+
 /**
  * @brief Set the value of `IP_TTL`
  *
@@ -2862,6 +3389,513 @@ ZTS_API int ZTCALL zts_set_keepalive(int fd, int enabled);
  */
 ZTS_API int ZTCALL zts_get_keepalive(int fd);
 
+//----------------------------------------------------------------------------//
+// Socket readiness notification                                              //
+//----------------------------------------------------------------------------//
+
+/**
+ * Allows external event loops (libuv, asio, epoll-based reactors) to treat
+ * zts sockets like native descriptors without dedicating a polling thread to
+ * each socket. Readiness is reported as a combination of `ZTS_POLLIN`,
+ * `ZTS_POLLOUT` and `ZTS_POLLERR`. Notifications are edge-triggered: one is
+ * generated when data arrives, when send buffer space is freed, or when an
+ * error occurs. The application should then read/write until
+ * `ZTS_EWOULDBLOCK` as it would with a non-blocking native socket.
+ */
+
+/**
+ * @brief Socket readiness callback
+ *
+ * @param fd Socket file descriptor that became ready
+ * @param events Bitmask of `ZTS_POLLIN`, `ZTS_POLLOUT`, `ZTS_POLLERR`
+ * @param user Opaque pointer provided to `zts_set_socket_callback`
+ */
+typedef void (*zts_socket_cb_t)(int fd, int events, void* user);
+
+/**
+ * @brief Set (or clear) a readiness callback for a socket
+ *
+ * The callback is never called from the network stack thread. Notifications
+ * are handed through a lock-free queue to a single libzt dispatch thread which
+ * invokes the callback, so it is safe to call any `zts_*` socket function from
+ * within it. The current readiness state is reported once immediately after
+ * registration. The callback is cleared automatically when the socket is
+ * closed with `zts_bsd_close` or `zts_close`.
+ *
+ * @param fd Socket file descriptor
+ * @param cb Callback to invoke, or `NULL` to stop receiving notifications
+ * @param user Opaque pointer passed back to the callback
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_set_socket_callback(int fd, zts_socket_cb_t cb, void* user);
+
+/**
+ * Maximum number of simultaneously allocated socket interest sets
+ */
+#define ZTS_MAX_SOCKET_SETS 16
+
+/**
+ * Ready socket reported by `zts_sockset_drain`
+ */
+typedef struct {
+    /**
+     * Socket file descriptor
+     */
+    int fd;
+
+    /**
+     * Bitmask of `ZTS_POLLIN`, `ZTS_POLLOUT`, `ZTS_POLLERR`
+     */
+    int events;
+} zts_socket_event_t;
+
+/**
+ * @brief Create a socket interest set
+ *
+ * An interest set groups zts sockets behind a single host file descriptor
+ * (an `eventfd` on Linux, the read end of a pipe on other POSIX systems). The
+ * host descriptor becomes readable whenever a member socket becomes ready, so
+ * it can be placed in a host `epoll_wait`/`poll`/`select` call alongside
+ * native descriptors. When it is readable, call `zts_sockset_drain` to learn
+ * which zts sockets are ready.
+ *
+ * @return Set identifier `[0, ZTS_MAX_SOCKET_SETS)` if successful,
+ *     `ZTS_ERR_NO_RESULT` if no more sets can be allocated, `ZTS_ERR_GENERAL`
+ *     if the host descriptor could not be created.
+ */
+ZTS_API int ZTCALL zts_sockset_new();
+
+/**
+ * @brief Free a socket interest set and close its host file descriptor
+ *
+ * @param set Set identifier
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_sockset_free(int set);
+
+/**
+ * @brief Add a socket to an interest set, or change its interest mask
+ *
+ * A socket may be a member of at most one set at a time. It may also have
+ * a callback set via `zts_set_socket_callback`.
+ *
+ * @param set Set identifier
+ * @param fd Socket file descriptor
+ * @param events Bitmask of `ZTS_POLLIN`, `ZTS_POLLOUT`, `ZTS_POLLERR`
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_sockset_add(int set, int fd, int events);
+
+/**
+ * @brief Remove a socket from an interest set
+ *
+ * @param set Set identifier
+ * @param fd Socket file descriptor
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_sockset_del(int set, int fd);
+
+/**
+ * @brief Return the host file descriptor associated with an interest set
+ *
+ * The descriptor is owned by libzt and must not be closed or read by the
+ * application.
+ *
+ * @param set Set identifier
+ * @return Host file descriptor if successful, `ZTS_ERR_ARG` if invalid
+ *     argument, `ZTS_ERR_GENERAL` if not supported on this platform.
+ */
+ZTS_API int ZTCALL zts_sockset_get_host_fd(int set);
+
+/**
+ * @brief Retrieve ready sockets from an interest set and re-arm its host
+ * file descriptor
+ *
+ * Does not block. If more sockets are ready than fit into `events` the host
+ * descriptor remains readable.
+ *
+ * @param set Set identifier
+ * @param events Array to be filled with ready sockets
+ * @param max_events Capacity of `events`
+ * @return Number of entries written to `events` if successful, `ZTS_ERR_ARG`
+ *     if invalid argument.
+ */
+ZTS_API int ZTCALL zts_sockset_drain(int set, zts_socket_event_t* events, int max_events);
+
+//----------------------------------------------------------------------------//
+// Zero-copy socket API                                                       //
+//----------------------------------------------------------------------------//
+
+/**
+ * Maximum number of buffer segments lent by a single call to `zts_recv_zc`
+ */
+#define ZTS_RXBUF_MAX_IOV 16
+
+/**
+ * Read-only lease on received data still owned by the network stack. Each
+ * segment points directly into the buffer that the incoming frame was copied
+ * into when it arrived from ZeroTier, so no further copy takes place. The
+ * lease must be returned with `zts_rxbuf_release`, until then the memory
+ * stays allocated and the received bytes are not yet re-advertised in the
+ * TCP receive window.
+ */
+typedef struct {
+    /**
+     * Segments of received data, in stream order
+     */
+    struct zts_iovec iov[ZTS_RXBUF_MAX_IOV];
+
+    /**
+     * Number of valid entries in `iov`
+     */
+    int iovcnt;
+
+    /**
+     * Total number of bytes across all segments
+     */
+    size_t len;
+
+    /**
+     * Internal. Do not modify
+     */
+    void* _chain;
+    void* _conn;
+    int _fd;
+} zts_rxbuf_t;
+
+/**
+ * @brief Receive data from a stream socket without copying it
+ *
+ * Blocks according to the socket's blocking mode. Returns whatever data is
+ * immediately available (up to `ZTS_RXBUF_MAX_IOV` segments), the remainder
+ * is returned by the next receive call. May be freely mixed with
+ * `zts_bsd_recv` and friends on the same socket.
+ *
+ * @param fd Socket file descriptor (`ZTS_SOCK_STREAM` only)
+ * @param out Lease to be filled in. Must be released with `zts_rxbuf_release`
+ *     if the return value is greater than zero
+ * @return Number of bytes lent if successful, `0` if the remote host has
+ *     closed the connection, `ZTS_ERR_SERVICE` if the node experiences a
+ *     problem, `ZTS_ERR_ARG` if invalid argument, `ZTS_ERR_SOCKET` if the
+ *     operation failed. Sets `zts_errno`
+ */
+ZTS_API ssize_t ZTCALL zts_recv_zc(int fd, zts_rxbuf_t* out);
+
+/**
+ * @brief Return a lease obtained by `zts_recv_zc` to the network stack
+ *
+ * Frees the underlying buffers and opens the TCP receive window by the
+ * number of bytes that were lent.
+ *
+ * @param buf Lease to release
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_rxbuf_release(zts_rxbuf_t* buf);
+
+/**
+ * Maximum number of buffers accepted by a single call to `zts_send_zc`
+ */
+#define ZTS_SEND_ZC_MAX_IOV 64
+
+/**
+ * Maximum number of outstanding (unreaped) zero-copy sends per socket
+ */
+#define ZTS_SEND_ZC_MAX_PENDING 256
+
+/**
+ * Completion of a zero-copy send reported by `zts_send_zc_reap`
+ */
+typedef struct {
+    /**
+     * Cookie passed to `zts_send_zc`
+     */
+    void* cookie;
+
+    /**
+     * `ZTS_ERR_OK` if the data was acknowledged by the remote host,
+     * `ZTS_ERR_SOCKET` if the connection failed before that happened. In both
+     * cases the memory is no longer referenced by the network stack
+     */
+    int status;
+} zts_zc_completion_t;
+
+/**
+ * @brief Send data on a stream socket without copying it into the network
+ * stack
+ *
+ * Segments are built to reference the caller's memory directly. The memory
+ * must remain valid and unmodified until a completion carrying `cookie` is
+ * returned by `zts_send_zc_reap`, which happens once every byte has been
+ * acknowledged by the remote host. Each completion also produces a
+ * `ZTS_POLLOUT` notification for sockets registered through
+ * `zts_set_socket_callback` or an interest set. Closing the socket blocks
+ * until outstanding zero-copy data has been acknowledged or the connection
+ * fails, for at most the `ZTS_SO_LINGER` time (20 seconds if it is not set).
+ * After that the connection is reset and the remaining sends complete with an
+ * error. Similar in spirit to Linux `MSG_ZEROCOPY`.
+ *
+ * @param fd Socket file descriptor (`ZTS_SOCK_STREAM` only)
+ * @param iov Array of source buffers
+ * @param iovcnt Number of buffers `[1, ZTS_SEND_ZC_MAX_IOV]`
+ * @param cookie Opaque value reported on completion
+ * @return Number of bytes queued if successful (may be less than requested on
+ *     a non-blocking socket, in which case the completion covers only the
+ *     queued bytes), `ZTS_ERR_SERVICE` if the node experiences a problem,
+ *     `ZTS_ERR_ARG` if invalid argument, `ZTS_ERR_SOCKET` if the operation
+ *     failed. Sets `zts_errno`, `ZTS_ENOBUFS` if too many completions are
+ *     outstanding.
+ */
+ZTS_API ssize_t ZTCALL zts_send_zc(int fd, const struct zts_iovec* iov, int iovcnt, void* cookie);
+
+/**
+ * @brief Collect completed zero-copy sends for a socket
+ *
+ * Does not block. Completions are returned in the order the sends were made.
+ *
+ * @param fd Socket file descriptor
+ * @param completions Array to be filled in
+ * @param max_completions Capacity of `completions`
+ * @return Number of completions written if successful, `ZTS_ERR_SERVICE` if
+ *     the node experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_send_zc_reap(int fd, zts_zc_completion_t* completions, int max_completions);
+
+/**
+ * Size of the window of a host file mapped (or read) at a time by
+ * `zts_sendfile`
+ */
+#define ZTS_SENDFILE_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * @brief Send the contents of a host file descriptor over a ZeroTier socket
+ *
+ * The file is memory-mapped in windows of `ZTS_SENDFILE_CHUNK_SIZE` bytes and
+ * written from the mapping straight into the network stack's segments, so no
+ * intermediate user buffer is involved. Descriptors that cannot be mapped
+ * (pipes, etc) fall back to `pread()`/`read()`. Blocking sockets wait for send
+ * window space instead of spinning; on non-blocking sockets only what fits in
+ * the window is sent. Similar to Linux `sendfile()`.
+ *
+ * @param fd Socket file descriptor (`ZTS_SOCK_STREAM` only)
+ * @param host_fd Host (operating system) file descriptor opened for reading
+ * @param offset Position in `host_fd` to start from, or `-1` to use (and
+ *     advance) the current file position
+ * @param count Maximum number of bytes to send
+ * @return Number of bytes sent if successful (`0` at end of file),
+ *     `ZTS_ERR_SERVICE` if the node experiences a problem, `ZTS_ERR_ARG` if
+ *     invalid argument, `ZTS_ERR_SOCKET` if nothing could be sent. Sets
+ *     `zts_errno`
+ */
+ZTS_API ssize_t ZTCALL zts_sendfile(int fd, int host_fd, int64_t offset, size_t count);
+
+//----------------------------------------------------------------------------//
+// Raw callback API                                                           //
+//----------------------------------------------------------------------------//
+
+/**
+ * Event-driven TCP/UDP interface built directly on lwIP's raw PCB callbacks.
+ * Unlike the socket API, no netconn mailbox, semaphore or thread handoff is
+ * involved: received segments are delivered to user callbacks straight from
+ * the network stack thread. All callbacks run on that thread with the core
+ * lock held, so they must not block and must not call the `zts_bsd_*` socket
+ * functions. They may call any `zts_tcp_raw_*` or `zts_udp_raw_*` function,
+ * which may also be called from any other thread.
+ *
+ * Handles stay valid until released with `zts_tcp_raw_close` or
+ * `zts_udp_raw_close`, which must be called even after an error has been
+ * reported. Error values passed to callbacks are `zts_errno` values.
+ */
+
+/**
+ * Opaque handle to a raw TCP connection or listener
+ */
+typedef struct zts_tcp_raw zts_tcp_raw_t;
+
+/**
+ * Opaque handle to a raw UDP endpoint
+ */
+typedef struct zts_udp_raw zts_udp_raw_t;
+
+/**
+ * @brief Called when a listener accepts a new connection. The new handle
+ * inherits the listener's `arg` and should have its receive callback set
+ * before returning, otherwise received data is discarded
+ */
+typedef void (*zts_tcp_raw_accept_cb)(zts_tcp_raw_t* listener, zts_tcp_raw_t* conn, void* arg);
+
+/**
+ * @brief Called once an outgoing connection is established (`err` is `0`) or
+ * has failed (`err` is e.g. `ZTS_ECONNREFUSED`)
+ */
+typedef void (*zts_tcp_raw_connect_cb)(zts_tcp_raw_t* conn, int err, void* arg);
+
+/**
+ * @brief Called with received data. `iov` refers to the network stack's
+ * buffers and is only valid for the duration of the callback. A chain longer
+ * than `ZTS_RXBUF_MAX_IOV` buffers is delivered over several calls. `len` is
+ * `0` when the remote host has closed its side of the connection
+ */
+typedef void (*zts_tcp_raw_recv_cb)(zts_tcp_raw_t* conn, const struct zts_iovec* iov, int iovcnt, size_t len, void* arg);
+
+/**
+ * @brief Called when the remote host has acknowledged `len` bytes, freeing
+ * send buffer space
+ */
+typedef void (*zts_tcp_raw_sent_cb)(zts_tcp_raw_t* conn, size_t len, void* arg);
+
+/**
+ * @brief Called when an established connection fails. The connection is gone
+ * but the handle must still be released with `zts_tcp_raw_close`
+ */
+typedef void (*zts_tcp_raw_err_cb)(zts_tcp_raw_t* conn, int err, void* arg);
+
+/**
+ * @brief Called with a received datagram. `iov` is only valid for the
+ * duration of the callback
+ */
+typedef void (*zts_udp_raw_recv_cb)(
+    zts_udp_raw_t* udp,
+    const struct zts_iovec* iov,
+    int iovcnt,
+    size_t len,
+    const char* remote_ipstr,
+    unsigned short remote_port,
+    void* arg);
+
+/**
+ * @brief Listen for incoming TCP connections
+ *
+ * @param out Receives the listener handle
+ * @param ipstr Local address to listen on, or `NULL` for any (IPv4 and IPv6)
+ * @param port Local port
+ * @param backlog Maximum number of pending connections
+ * @param cb Called for every accepted connection
+ * @param arg Opaque pointer passed to callbacks
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument,
+ *     `ZTS_ERR_SOCKET` if the listener could not be created. Sets `zts_errno`
+ */
+ZTS_API int ZTCALL zts_tcp_raw_listen(
+    zts_tcp_raw_t** out,
+    const char* ipstr,
+    unsigned short port,
+    int backlog,
+    zts_tcp_raw_accept_cb cb,
+    void* arg);
+
+/**
+ * @brief Start connecting to a remote host. Returns immediately, the outcome
+ * is reported to `cb`
+ *
+ * @param out Receives the connection handle
+ * @param ipstr Remote address
+ * @param port Remote port
+ * @param cb Called once the connection is established or has failed
+ * @param arg Opaque pointer passed to callbacks
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument,
+ *     `ZTS_ERR_SOCKET` if the connection could not be started. Sets `zts_errno`
+ */
+ZTS_API int ZTCALL
+zts_tcp_raw_connect(zts_tcp_raw_t** out, const char* ipstr, unsigned short port, zts_tcp_raw_connect_cb cb, void* arg);
+
+/**
+ * @brief Set (or clear) the receive callback of a connection. Received data
+ * is acknowledged to the remote host once the callback returns
+ *
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_tcp_raw_on_recv(zts_tcp_raw_t* conn, zts_tcp_raw_recv_cb cb);
+
+/**
+ * @brief Set (or clear) the sent (acknowledged) callback of a connection
+ *
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_tcp_raw_on_sent(zts_tcp_raw_t* conn, zts_tcp_raw_sent_cb cb);
+
+/**
+ * @brief Set (or clear) the error callback of a connection
+ *
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_tcp_raw_on_err(zts_tcp_raw_t* conn, zts_tcp_raw_err_cb cb);
+
+/**
+ * @brief Queue data for transmission. The data is copied, and as much as fits
+ * into the send buffer is queued. Segments are transmitted immediately unless
+ * `ZTS_MSG_MORE` is given
+ *
+ * @param conn Connection handle
+ * @param buf Data to send
+ * @param len Length of data
+ * @param flags `0` or `ZTS_MSG_MORE`
+ * @return Number of bytes queued if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument,
+ *     `ZTS_ERR_SOCKET` with `zts_errno` set to `ZTS_EWOULDBLOCK` if the send
+ *     buffer is full (wait for the sent callback) or another error.
+ */
+ZTS_API ssize_t ZTCALL zts_tcp_raw_write(zts_tcp_raw_t* conn, const void* buf, size_t len, int flags);
+
+/**
+ * @brief Return the amount of data that can currently be queued with
+ * `zts_tcp_raw_write`
+ *
+ * @return Free send buffer space in bytes, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API ssize_t ZTCALL zts_tcp_raw_sndbuf(zts_tcp_raw_t* conn);
+
+/**
+ * @brief Close a connection or listener (if still open) and release its
+ * handle. No further callbacks are made for it
+ *
+ * @param conn Connection or listener handle
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_tcp_raw_close(zts_tcp_raw_t* conn);
+
+/**
+ * @brief Open a UDP endpoint
+ *
+ * @param out Receives the endpoint handle
+ * @param ipstr Local address to bind to, or `NULL` for any (IPv4 and IPv6)
+ * @param port Local port, or `0` for an ephemeral port
+ * @param cb Called for every received datagram (may be `NULL`)
+ * @param arg Opaque pointer passed to the callback
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument,
+ *     `ZTS_ERR_SOCKET` if the endpoint could not be created. Sets `zts_errno`
+ */
+ZTS_API int ZTCALL
+zts_udp_raw_bind(zts_udp_raw_t** out, const char* ipstr, unsigned short port, zts_udp_raw_recv_cb cb, void* arg);
+
+/**
+ * @brief Send a datagram. `buf` is referenced rather than copied and may be
+ * reused as soon as the call returns
+ *
+ * @return Number of bytes sent if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument,
+ *     `ZTS_ERR_SOCKET` if the datagram could not be sent. Sets `zts_errno`
+ */
+ZTS_API ssize_t ZTCALL
+zts_udp_raw_sendto(zts_udp_raw_t* udp, const void* buf, size_t len, const char* remote_ipstr, unsigned short remote_port);
+
+/**
+ * @brief Close a UDP endpoint and release its handle
+ *
+ * @return `ZTS_ERR_OK` if successful, `ZTS_ERR_SERVICE` if the node
+ *     experiences a problem, `ZTS_ERR_ARG` if invalid argument.
+ */
+ZTS_API int ZTCALL zts_udp_raw_close(zts_udp_raw_t* udp);
+
 //----------------------------------------------------------------------------//
 // DNS                                                                        //
 //----------------------------------------------------------------------------//
@@ -16,13 +16,15 @@ from glob import glob
 
 DIR = os.path.dirname(os.path.realpath(__file__))
 ROOT_DIR = os.path.abspath(os.path.join(DIR, "..", ".."))
+# Copy of ext/lwip with ext/lwip-patches applied, see patch_lwip()
+LWIP_DIR = os.path.join(DIR, "build", "lwip")
 
 INCLUDE_DIRS = [
     os.path.join(ROOT_DIR, "include"),
     os.path.join(ROOT_DIR, "src"),
     os.path.join(ROOT_DIR, "src/bindings/python"),
     os.path.join(ROOT_DIR, "ext/concurrentqueue"),
-    os.path.join(ROOT_DIR, "ext/lwip/src/include"),
+    os.path.join(LWIP_DIR, "src/include"),
     os.path.join(ROOT_DIR, "ext/lwip-contrib/ports/unix/port/include"),
     os.path.join(ROOT_DIR, "ext/ZeroTierOne/include"),
     os.path.join(ROOT_DIR, "ext/ZeroTierOne"),
@@ -80,12 +82,12 @@ def cstuff():
         # miniupnpc
         *glob(os.path.join(ROOT_DIR, "ext/miniupnpc/*.c")),
         # lwip
-        *glob(os.path.join(ROOT_DIR, "ext/lwip/src/netif/*.c")),
-        *glob(os.path.join(ROOT_DIR, "ext/lwip/src/api/*.c")),
-        *glob(os.path.join(ROOT_DIR, "ext/lwip/src/core/*.c")),
-        *glob(os.path.join(ROOT_DIR, "ext/lwip/src/core/ipv4/*.c")),
-        *glob(os.path.join(ROOT_DIR, "ext/lwip/src/core/ipv6/*.c")),
-        *glob(os.path.join(ROOT_DIR, "ext/lwip/src/netif/*.c")),
+        *glob(os.path.join(LWIP_DIR, "src/netif/*.c")),
+        *glob(os.path.join(LWIP_DIR, "src/api/*.c")),
+        *glob(os.path.join(LWIP_DIR, "src/core/*.c")),
+        *glob(os.path.join(LWIP_DIR, "src/core/ipv4/*.c")),
+        *glob(os.path.join(LWIP_DIR, "src/core/ipv6/*.c")),
+        *glob(os.path.join(LWIP_DIR, "src/netif/*.c")),
         *glob(os.path.join(ROOT_DIR, "ext/lwip-contrib/ports/unix/port/sys_arch.c")),
     ]
     # noinspection PyUnresolvedReferences
@@ -97,6 +99,15 @@ def cstuff():
     })
 
 
+def patch_lwip():
+    """Copy lwIP into the build directory and apply ext/lwip-patches to the copy"""
+    shutil.rmtree(LWIP_DIR, ignore_errors=True)
+    shutil.copytree(os.path.join(ROOT_DIR, "ext/lwip/src"), os.path.join(LWIP_DIR, "src"))
+    env = dict(os.environ, GIT_CEILING_DIRECTORIES=os.path.dirname(LWIP_DIR))
+    for patch in sorted(glob(os.path.join(ROOT_DIR, "ext/lwip-patches/*.patch"))):
+        subprocess.run(["git", "apply", "--ignore-whitespace", patch], cwd=LWIP_DIR, env=env, check=True)
+
+
 def copy_python_files(src_dir: str, dst_dir: str):
     """ Copy all Python files from `src_dir` to `dst_dir`"""
     for filename in {os.path.basename(filepath) for filepath in glob(os.path.join(src_dir, "*.py"))}:
@@ -144,6 +155,7 @@ def build(setup_kwargs):
 
     # Ensure git submodules are loaded
     subprocess.run(["git", "submodule", "update", "--init"])
+    patch_lwip()
 
     # LICENSE file
     shutil.copy(os.path.join(ROOT_DIR, "LICENSE.txt"), os.path.join(DIR, "LICENSE"))
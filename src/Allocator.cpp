@@ -0,0 +1,208 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Allocator behind the memory libzt allocates for itself: the slabs and large
+ * buffers of the network stack (see Slab.cpp), event messages, virtual taps and
+ * their netifs, and TCP tunnel connections. Each block carries a small header
+ * naming the allocator that returned it and the subsystem it was charged to, so
+ * that replacing the allocator never sends a block to the wrong free function
+ * and the counters stay exact. Allocator records are never freed since blocks
+ * may outlive the record that was current when they were allocated.
+ *
+ * The memory budget bounds the memory in use rather than what was obtained
+ * from the allocator: the stack keeps its slabs, so those would fill any budget
+ * for good after a single burst. Stack objects are therefore charged by the
+ * slab allocator as it hands them out, everything else here. Taps and tunnel
+ * buffers are charged but never refused, event messages are dropped.
+ */
+
+#include "Allocator.hpp"
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace ZeroTier {
+
+struct zts_allocator {
+    zts_malloc_fn malloc_fn;
+    zts_free_fn free_fn;
+    zts_realloc_fn realloc_fn;   // Kept for completeness, no block is resized
+    void* ctx;
+};
+
+/**
+ * Header in front of every block, keeps the payload 16-byte aligned
+ */
+union zts_mem_hdr {
+    struct {
+        const zts_allocator* allocator;
+        uint32_t size;   // Payload bytes
+        uint32_t subsys;
+    } h;
+    uint64_t align[2];
+};
+
+struct zts_mem_counters {
+    std::atomic<uint64_t> allocs;
+    std::atomic<uint64_t> frees;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> max;
+    std::atomic<uint32_t> err;
+};
+
+static void* zts_libc_malloc(size_t size, void* ctx)
+{
+    (void)ctx;
+    return malloc(size);
+}
+
+static void zts_libc_free(void* ptr, void* ctx)
+{
+    (void)ctx;
+    free(ptr);
+}
+
+static void* zts_libc_realloc(void* ptr, size_t size, void* ctx)
+{
+    (void)ctx;
+    return realloc(ptr, size);
+}
+
+static const zts_allocator _libc = { zts_libc_malloc, zts_libc_free, zts_libc_realloc, NULL };
+
+static std::atomic<const zts_allocator*> _allocator(&_libc);
+
+static zts_mem_counters _counters[ZTS_ALLOC_COUNT];
+
+static std::atomic<uint64_t> _budget(0);
+static std::atomic<uint64_t> _charged(0);
+
+int zts_mem_set_allocator(zts_malloc_fn malloc_fn, zts_free_fn free_fn, zts_realloc_fn realloc_fn, void* ctx)
+{
+    if (! malloc_fn != ! free_fn) {
+        return ZTS_ERR_ARG;
+    }
+    if (! malloc_fn) {
+        _allocator = &_libc;
+        return ZTS_ERR_OK;
+    }
+    const zts_allocator* cur = _allocator;
+    if (cur->malloc_fn == malloc_fn && cur->free_fn == free_fn && cur->realloc_fn == realloc_fn && cur->ctx == ctx) {
+        return ZTS_ERR_OK;
+    }
+    zts_allocator* a = new (std::nothrow) zts_allocator();
+    if (! a) {
+        return ZTS_ERR_GENERAL;
+    }
+    a->malloc_fn = malloc_fn;
+    a->free_fn = free_fn;
+    a->realloc_fn = realloc_fn;
+    a->ctx = ctx;
+    _allocator = a;
+    return ZTS_ERR_OK;
+}
+
+void* zts_mem_alloc(int subsys, size_t size)
+{
+    zts_mem_counters& c = _counters[subsys];
+    const zts_allocator* a = _allocator;
+    bool charge = subsys != ZTS_ALLOC_STACK;
+    if (size > UINT32_MAX - sizeof(zts_mem_hdr)
+        || (charge && ! zts_mem_charge(size, subsys != ZTS_ALLOC_EVENTS))) {
+        c.err.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    zts_mem_hdr* hdr = (zts_mem_hdr*)a->malloc_fn(size + sizeof(zts_mem_hdr), a->ctx);
+    if (! hdr) {
+        if (charge) {
+            zts_mem_uncharge(size);
+        }
+        c.err.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    hdr->h.allocator = a;
+    hdr->h.size = (uint32_t)size;
+    hdr->h.subsys = (uint32_t)subsys;
+    c.allocs.fetch_add(1, std::memory_order_relaxed);
+    uint64_t bytes = c.bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    uint64_t max = c.max.load(std::memory_order_relaxed);
+    while (bytes > max && ! c.max.compare_exchange_weak(max, bytes, std::memory_order_relaxed)) {}
+    return hdr + 1;
+}
+
+void zts_mem_free(void* ptr)
+{
+    if (! ptr) {
+        return;
+    }
+    zts_mem_hdr* hdr = (zts_mem_hdr*)ptr - 1;
+    zts_mem_counters& c = _counters[hdr->h.subsys];
+    c.frees.fetch_add(1, std::memory_order_relaxed);
+    c.bytes.fetch_sub(hdr->h.size, std::memory_order_relaxed);
+    if (hdr->h.subsys != ZTS_ALLOC_STACK) {
+        zts_mem_uncharge(hdr->h.size);
+    }
+    const zts_allocator* a = hdr->h.allocator;
+    a->free_fn(hdr, a->ctx);
+}
+
+void zts_mem_get_counter(int subsys, zts_alloc_counter_t* dst)
+{
+    zts_mem_counters& c = _counters[subsys];
+    dst->allocs = c.allocs.load(std::memory_order_relaxed);
+    dst->frees = c.frees.load(std::memory_order_relaxed);
+    dst->bytes = c.bytes.load(std::memory_order_relaxed);
+    dst->max_bytes = c.max.load(std::memory_order_relaxed);
+    dst->err = c.err.load(std::memory_order_relaxed);
+}
+
+int zts_mem_set_budget(uint64_t bytes)
+{
+    if (bytes && bytes < ZTS_MEM_BUDGET_MIN) {
+        return ZTS_ERR_ARG;
+    }
+    _budget = bytes;
+    return ZTS_ERR_OK;
+}
+
+uint64_t zts_mem_budget()
+{
+    return _budget.load(std::memory_order_relaxed);
+}
+
+uint64_t zts_mem_charged()
+{
+    return _charged.load(std::memory_order_relaxed);
+}
+
+bool zts_mem_charge(size_t bytes, bool force)
+{
+    uint64_t budget = _budget.load(std::memory_order_relaxed);
+    uint64_t charged = _charged.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    if (budget && charged > budget && ! force) {
+        _charged.fetch_sub(bytes, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+void zts_mem_uncharge(size_t bytes)
+{
+    _charged.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+}   // namespace ZeroTier
@@ -0,0 +1,182 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for the allocator set with zts_init_set_allocator() and the per
+ * subsystem allocation counters
+ */
+
+#ifndef ZTS_ALLOCATOR_HPP
+#define ZTS_ALLOCATOR_HPP
+
+#include "ZeroTierSockets.h"
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Smallest accepted memory budget
+ */
+#define ZTS_MEM_BUDGET_MIN (1024 * 1024)
+
+/**
+ * Memory in use above which TCP receive windows start to shrink
+ */
+#define ZTS_MEM_WINDOW_THRESHOLD(budget) ((budget) / 2)
+
+/**
+ * Memory in use above which sends fail with `ZTS_ENOBUFS`. What remains of the
+ * budget is left for received packets, so that ACKs can still free send queues
+ */
+#define ZTS_MEM_SEND_THRESHOLD(budget) ((budget) - (budget) / 8)
+
+namespace ZeroTier {
+
+/**
+ * @brief Replace the allocator used for new blocks. All NULL restores libc.
+ * Blocks are always freed by the allocator that returned them
+ *
+ * @return `ZTS_ERR_OK`, `ZTS_ERR_ARG` if only one of malloc_fn and free_fn is
+ * given, `ZTS_ERR_GENERAL` if out of memory
+ */
+int zts_mem_set_allocator(zts_malloc_fn malloc_fn, zts_free_fn free_fn, zts_realloc_fn realloc_fn, void* ctx);
+
+/**
+ * @brief Allocate a block on behalf of a subsystem (`zts_alloc_subsys_t`).
+ * Aligned like malloc(), NULL if out of memory or, for event messages, over
+ * the memory budget
+ */
+void* zts_mem_alloc(int subsys, size_t size);
+
+/**
+ * @brief Free a block returned by zts_mem_alloc(). NULL is ignored
+ */
+void zts_mem_free(void* ptr);
+
+/**
+ * @brief Copy the counters of a subsystem
+ */
+void zts_mem_get_counter(int subsys, zts_alloc_counter_t* dst);
+
+/**
+ * @brief Set the memory budget in bytes, 0 for none
+ *
+ * @return `ZTS_ERR_OK`, `ZTS_ERR_ARG` if below `ZTS_MEM_BUDGET_MIN`
+ */
+int zts_mem_set_budget(uint64_t bytes);
+
+/**
+ * @brief Return the memory budget, 0 if there is none
+ */
+uint64_t zts_mem_budget();
+
+/**
+ * @brief Return the memory currently charged against the budget
+ */
+uint64_t zts_mem_charged();
+
+/**
+ * @brief Charge memory against the budget. Fails if that would exceed it,
+ * unless `force` is set (for memory that cannot be done without)
+ */
+bool zts_mem_charge(size_t bytes, bool force);
+
+/**
+ * @brief Return memory charged with zts_mem_charge()
+ */
+void zts_mem_uncharge(size_t bytes);
+
+/**
+ * @brief Construct a T in a block of the given subsystem, NULL if out of memory
+ */
+template <class T> T* zts_mem_new(int subsys)
+{
+    void* p = zts_mem_alloc(subsys, sizeof(T));
+    return p ? new (p) T() : NULL;
+}
+
+/**
+ * @brief Destroy an object created with zts_mem_new(). NULL is ignored
+ */
+template <class T> void zts_mem_delete(T* obj)
+{
+    if (obj) {
+        obj->~T();
+        zts_mem_free(obj);
+    }
+}
+
+/**
+ * Base class that makes `new` and `delete` of a class use a subsystem's blocks
+ */
+template <int S> struct zts_mem_object {
+    static void* operator new(size_t size)
+    {
+        void* p = zts_mem_alloc(S, size);
+        if (! p) {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+    static void operator delete(void* ptr)
+    {
+        zts_mem_free(ptr);
+    }
+};
+
+/**
+ * Standard library allocator for containers owned by a subsystem
+ */
+template <class T, int S> struct zts_mem_std_allocator {
+    typedef T value_type;
+    template <class U> struct rebind {
+        typedef zts_mem_std_allocator<U, S> other;
+    };
+    zts_mem_std_allocator()
+    {
+    }
+    template <class U> zts_mem_std_allocator(const zts_mem_std_allocator<U, S>&)
+    {
+    }
+    T* allocate(size_t n)
+    {
+        void* p = (n <= (size_t)-1 / sizeof(T)) ? zts_mem_alloc(S, n * sizeof(T)) : NULL;
+        if (! p) {
+            throw std::bad_alloc();
+        }
+        return (T*)p;
+    }
+    void deallocate(T* p, size_t)
+    {
+        zts_mem_free(p);
+    }
+};
+
+template <class T, class U, int S>
+bool operator==(const zts_mem_std_allocator<T, S>&, const zts_mem_std_allocator<U, S>&)
+{
+    return true;
+}
+
+template <class T, class U, int S>
+bool operator!=(const zts_mem_std_allocator<T, S>&, const zts_mem_std_allocator<U, S>&)
+{
+    return false;
+}
+
+}   // namespace ZeroTier
+
+#endif   // _H
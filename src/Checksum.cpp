@@ -0,0 +1,272 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Vectorized Internet checksum. The ones' complement sum does not depend on
+ * the order in which words are added, so 16-bit words are widened into 32-bit
+ * vector lanes and only folded at the end. The implementation is chosen at
+ * runtime: AVX2 if the CPU has it, else SSE2 on x86-64, NEON on ARM64 and
+ * plain C everywhere else. The copy variant stores each vector as it is
+ * summed, so that lwIP (LWIP_CHECKSUM_ON_COPY) reads data only once when it
+ * copies it into a segment.
+ */
+
+#include "Checksum.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define ZTS_CHKSUM_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && ! defined(__clang__)
+#include <intrin.h>
+#define ZTS_TARGET_AVX2
+#else
+#define ZTS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define ZTS_CHKSUM_ARM64 1
+#include <arm_neon.h>
+#endif
+
+// Bytes summed before 32-bit lanes are drained, each lane gains at most 2 * 0xffff per vector
+#define ZTS_CHKSUM_CHUNK 65536
+
+namespace ZeroTier {
+
+/**
+ * Sum of `len` bytes starting at src, copied to dst unless it is NULL
+ */
+typedef uint64_t (*zts_chksum_kernel)(const uint8_t* src, uint8_t* dst, size_t len);
+
+static uint16_t zts_chksum_fold(uint64_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+static uint64_t zts_chksum_scalar(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    if (dst) {
+        memcpy(dst, src, len);
+    }
+    uint64_t sum = 0;
+    uint16_t w;
+    for (; len >= 2; src += 2, len -= 2) {
+        memcpy(&w, src, 2);
+        sum += w;
+    }
+    if (len) {
+        w = 0;   // A trailing byte is the first byte of a word
+        memcpy(&w, src, 1);
+        sum += w;
+    }
+    return sum;
+}
+
+#ifdef ZTS_CHKSUM_X86
+
+template <bool Copy> static uint64_t zts_chksum_sse2_blocks(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    while (len) {
+        size_t chunk = len < ZTS_CHKSUM_CHUNK ? len : ZTS_CHKSUM_CHUNK;
+        __m128i acc = zero;
+        for (size_t i = 0; i < chunk; i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+            if (Copy) {
+                _mm_storeu_si128((__m128i*)(dst + i), v);
+            }
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i*)lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+        src += chunk;
+        dst += Copy ? chunk : 0;
+        len -= chunk;
+    }
+    return sum;
+}
+
+static uint64_t zts_chksum_sse2(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    size_t n = len & ~(size_t)15;
+    uint64_t sum = dst ? zts_chksum_sse2_blocks<true>(src, dst, n) : zts_chksum_sse2_blocks<false>(src, dst, n);
+    return sum + zts_chksum_scalar(src + n, dst ? dst + n : NULL, len - n);
+}
+
+template <bool Copy>
+ZTS_TARGET_AVX2 static uint64_t zts_chksum_avx2_blocks(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    while (len) {
+        size_t chunk = len < ZTS_CHKSUM_CHUNK ? len : ZTS_CHKSUM_CHUNK;
+        __m256i acc = zero;
+        for (size_t i = 0; i < chunk; i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+            if (Copy) {
+                _mm256_storeu_si256((__m256i*)(dst + i), v);
+            }
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i*)lanes, acc);
+        for (int i = 0; i < 8; i++) {
+            sum += lanes[i];
+        }
+        src += chunk;
+        dst += Copy ? chunk : 0;
+        len -= chunk;
+    }
+    return sum;
+}
+
+ZTS_TARGET_AVX2 static uint64_t zts_chksum_avx2(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    size_t n = len & ~(size_t)31;
+    uint64_t sum = dst ? zts_chksum_avx2_blocks<true>(src, dst, n) : zts_chksum_avx2_blocks<false>(src, dst, n);
+    return sum + zts_chksum_sse2(src + n, dst ? dst + n : NULL, len - n);
+}
+
+static bool zts_cpu_has_avx2()
+{
+#if defined(_MSC_VER) && ! defined(__clang__)
+    int regs[4];
+    __cpuid(regs, 1);
+    bool osxsave = (regs[2] & (1 << 27)) != 0;
+    __cpuidex(regs, 7, 0);
+    return osxsave && (regs[1] & (1 << 5)) && (_xgetbv(0) & 6) == 6;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif   // ZTS_CHKSUM_X86
+
+#ifdef ZTS_CHKSUM_ARM64
+
+template <bool Copy> static uint64_t zts_chksum_neon_blocks(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    uint64_t sum = 0;
+    while (len) {
+        size_t chunk = len < ZTS_CHKSUM_CHUNK ? len : ZTS_CHKSUM_CHUNK;
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (size_t i = 0; i < chunk; i += 16) {
+            uint8x16_t v = vld1q_u8(src + i);
+            if (Copy) {
+                vst1q_u8(dst + i, v);
+            }
+            acc = vpadalq_u16(acc, vreinterpretq_u16_u8(v));
+        }
+        sum += vaddlvq_u32(acc);
+        src += chunk;
+        dst += Copy ? chunk : 0;
+        len -= chunk;
+    }
+    return sum;
+}
+
+static uint64_t zts_chksum_neon(const uint8_t* src, uint8_t* dst, size_t len)
+{
+    size_t n = len & ~(size_t)15;
+    uint64_t sum = dst ? zts_chksum_neon_blocks<true>(src, dst, n) : zts_chksum_neon_blocks<false>(src, dst, n);
+    return sum + zts_chksum_scalar(src + n, dst ? dst + n : NULL, len - n);
+}
+
+#endif   // ZTS_CHKSUM_ARM64
+
+static zts_chksum_kernel zts_chksum_kernel_for(int impl)
+{
+    switch (impl) {
+        case ZTS_CHKSUM_AUTO:
+#if defined(ZTS_CHKSUM_X86)
+            return zts_cpu_has_avx2() ? zts_chksum_avx2 : zts_chksum_sse2;
+#elif defined(ZTS_CHKSUM_ARM64)
+            return zts_chksum_neon;
+#else
+            return zts_chksum_scalar;
+#endif
+        case ZTS_CHKSUM_SCALAR:
+            return zts_chksum_scalar;
+#ifdef ZTS_CHKSUM_X86
+        case ZTS_CHKSUM_SSE2:
+            return zts_chksum_sse2;
+        case ZTS_CHKSUM_AVX2:
+            return zts_cpu_has_avx2() ? zts_chksum_avx2 : NULL;
+#endif
+#ifdef ZTS_CHKSUM_ARM64
+        case ZTS_CHKSUM_NEON:
+            return zts_chksum_neon;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+static std::atomic<zts_chksum_kernel> _kernel(NULL);
+
+static zts_chksum_kernel zts_chksum_get_kernel()
+{
+    zts_chksum_kernel k = _kernel.load(std::memory_order_relaxed);
+    if (! k) {
+        k = zts_chksum_kernel_for(ZTS_CHKSUM_AUTO);
+        _kernel.store(k, std::memory_order_relaxed);
+    }
+    return k;
+}
+
+}   // namespace ZeroTier
+
+using namespace ZeroTier;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint16_t zts_chksum(const void* dataptr, int len)
+{
+    if (len <= 0) {
+        return 0;
+    }
+    return zts_chksum_fold(zts_chksum_get_kernel()((const uint8_t*)dataptr, NULL, (size_t)len));
+}
+
+uint16_t zts_chksum_copy(void* dst, const void* src, uint16_t len)
+{
+    return zts_chksum_fold(zts_chksum_get_kernel()((const uint8_t*)src, (uint8_t*)dst, len));
+}
+
+int zts_chksum_use(int impl)
+{
+    zts_chksum_kernel k = zts_chksum_kernel_for(impl);
+    if (! k) {
+        return -1;
+    }
+    _kernel.store(k, std::memory_order_relaxed);
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
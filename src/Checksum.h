@@ -0,0 +1,62 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Internet checksum used by lwIP (LWIP_CHKSUM and LWIP_CHKSUM_COPY, see
+ * lwipopts.h). Included by lwIP's C sources, so this must remain plain C.
+ */
+
+#ifndef ZTS_CHECKSUM_H
+#define ZTS_CHECKSUM_H
+
+#include <stdint.h>
+
+/* Implementations that can be selected with zts_chksum_use() */
+#define ZTS_CHKSUM_AUTO   0
+#define ZTS_CHKSUM_SCALAR 1
+#define ZTS_CHKSUM_SSE2   2
+#define ZTS_CHKSUM_AVX2   3
+#define ZTS_CHKSUM_NEON   4
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Ones' complement sum of `len` bytes taken as 16-bit words in host byte order,
+ * folded to 16 bits (same result as lwIP's lwip_standard_chksum)
+ */
+uint16_t zts_chksum(const void* dataptr, int len);
+
+/**
+ * Copy `len` bytes and return zts_chksum() of them, in one pass
+ */
+uint16_t zts_chksum_copy(void* dst, const void* src, uint16_t len);
+
+/**
+ * Select the implementation used by the functions above. ZTS_CHKSUM_AUTO picks
+ * the fastest one the CPU supports (the default). Returns 0 on success, -1 if
+ * the implementation is not available on this CPU or build
+ */
+int zts_chksum_use(int impl);
+
+/* lwIP's scalar implementation (LWIP_CHKSUM_ALGORITHM 2), kept for reference */
+uint16_t lwip_standard_chksum(const void* dataptr, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _H
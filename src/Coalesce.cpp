@@ -0,0 +1,319 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * TCP write coalescing. lwIP's netconn layer calls tcp_output() after every
+ * write, so each small write leaves as its own segment (and ZeroTier packet)
+ * unless Nagle happens to hold it back, and `TCP_WRITE_FLAG_MORE` only clears
+ * PSH. Small writes are therefore collected per socket here, before they reach
+ * lwIP, and written as one once a full segment has accumulated, the socket is
+ * uncorked, a write without `ZTS_MSG_MORE` arrives, or the deadline expires.
+ * The deadline is an lwIP timeout that queues the data directly on the PCB.
+ */
+
+#include "Coalesce.hpp"
+
+#include "lwip/api.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/sockets.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <string.h>
+
+namespace ZeroTier {
+
+/**
+ * Coalescing state of one lwIP socket slot
+ */
+struct zts_coalesce_state {
+    std::atomic<bool> active;   // Corked, coalescing or holding data
+    std::mutex m;               // Guards everything below
+    bool cork;                  // ZTS_TCP_CORK
+    u32_t delay_us;             // ZTS_TCP_COALESCE_USEC, 0 = off
+    char* buf;                  // TCP_MSS bytes, allocated on first use
+    u16_t len;                  // Bytes held back
+    u16_t mss;                  // Flush threshold, taken from the pcb
+    bool timer;                 // Deadline timeout is armed (core lock)
+};
+
+static zts_coalesce_state _co[NUM_SOCKETS];
+
+static zts_coalesce_state* zts_coalesce_get(int fd)
+{
+    int i = fd - LWIP_SOCKET_OFFSET;
+    return (i < 0 || i >= NUM_SOCKETS) ? NULL : &_co[i];
+}
+
+static void zts_coalesce_update(zts_coalesce_state* st)
+{
+    st->active = st->cork || st->delay_us || st->len;
+}
+
+/**
+ * Return the connected TCP pcb of a socket, or NULL. Core lock must be held
+ */
+static struct tcp_pcb* zts_coalesce_pcb(int fd, struct netconn** conn_out)
+{
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    if (! sock || ! sock->conn || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+        return NULL;
+    }
+    struct tcp_pcb* pcb = sock->conn->pcb.tcp;
+    if (! pcb || (pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT)) {
+        return NULL;
+    }
+    if (conn_out) {
+        *conn_out = sock->conn;
+    }
+    return pcb;
+}
+
+static void zts_coalesce_timeout(void* arg);
+
+/**
+ * Queue held back data directly on the pcb. Core lock and st->m must be held.
+ * Returns false if it has to be retried later. With `all`, data that does not
+ * fit into the send buffer is queued anyway
+ */
+static bool zts_coalesce_push(zts_coalesce_state* st, bool all)
+{
+    int fd = (int)(st - _co) + LWIP_SOCKET_OFFSET;
+    struct netconn* conn = NULL;
+    struct tcp_pcb* pcb = zts_coalesce_pcb(fd, &conn);
+    if (! pcb) {
+        st->len = 0;   // Connection is gone, so is the data
+        return true;
+    }
+    if (conn->current_msg) {
+        return false;   // A netconn write is in progress, don't interleave
+    }
+    tcpwnd_size_t sndbuf = pcb->snd_buf;
+    if (all && sndbuf < st->len) {
+        // Lend the pcb the missing buffer space (less than a segment), nothing is written after this
+        pcb->snd_buf = st->len;
+    }
+    u16_t n = (u16_t)LWIP_MIN(st->len, tcp_sndbuf(pcb));
+    if (n && tcp_write(pcb, st->buf, n, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+        memmove(st->buf, st->buf + n, st->len - n);
+        st->len = (u16_t)(st->len - n);
+        tcp_output(pcb);
+    }
+    else {
+        pcb->snd_buf = sndbuf;
+    }
+    return st->len == 0;
+}
+
+/**
+ * Deadline of held back data. Runs on the tcpip thread
+ */
+static void zts_coalesce_timeout(void* arg)
+{
+    zts_coalesce_state* st = (zts_coalesce_state*)arg;
+    // An application thread may hold the lock while it waits on this thread
+    if (! st->m.try_lock()) {
+        sys_timeout(1, zts_coalesce_timeout, st);
+        return;
+    }
+    st->timer = false;
+    if (st->len && ! zts_coalesce_push(st, false)) {
+        st->timer = true;
+        sys_timeout(1, zts_coalesce_timeout, st);
+    }
+    zts_coalesce_update(st);
+    st->m.unlock();
+}
+
+/**
+ * Start holding back data. st->m must be held. Returns false if the socket is
+ * not a connected TCP socket, in which case lwIP should handle the write
+ */
+static bool zts_coalesce_start(int fd, zts_coalesce_state* st, bool more)
+{
+    if (! st->buf && ! (st->buf = new (std::nothrow) char[TCP_MSS])) {
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    struct tcp_pcb* pcb = zts_coalesce_pcb(fd, NULL);
+    if (pcb) {
+        st->mss = (u16_t)LWIP_MIN(tcp_mss(pcb), TCP_MSS);
+        u32_t ms = (st->cork || more) ? ZTS_TCP_CORK_TIMEOUT : (st->delay_us + 999) / 1000;
+        if (! st->timer) {
+            st->timer = true;
+            sys_timeout(ms, zts_coalesce_timeout, st);
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    return pcb != NULL;
+}
+
+bool zts_coalesce_setsockopt(int fd, int optname, const void* optval, unsigned int optlen, int* result)
+{
+    zts_coalesce_state* st = zts_coalesce_get(fd);
+    if ((optname != ZTS_TCP_CORK && optname != ZTS_TCP_COALESCE_USEC) || ! st) {
+        return false;
+    }
+    if (! optval || optlen < sizeof(int)) {
+        *result = ZTS_ERR_SOCKET;
+        zts_errno = ZTS_EINVAL;
+        return true;
+    }
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    bool tcp = sock && sock->conn && NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP;
+    UNLOCK_TCPIP_CORE();
+    if (! tcp) {
+        return false;
+    }
+    int value = *(const int*)optval;
+    if (optname == ZTS_TCP_COALESCE_USEC && (value < 0 || value > ZTS_TCP_COALESCE_USEC_MAX)) {
+        *result = ZTS_ERR_SOCKET;
+        zts_errno = ZTS_EINVAL;
+        return true;
+    }
+    {
+        std::lock_guard<std::mutex> l(st->m);
+        if (optname == ZTS_TCP_CORK) {
+            st->cork = value != 0;
+        }
+        else {
+            st->delay_us = (u32_t)value;
+        }
+        zts_coalesce_update(st);
+    }
+    // Like Linux, uncorking sends what was held back
+    *result = (optname == ZTS_TCP_CORK && ! value) ? zts_coalesce_flush(fd) : ZTS_ERR_OK;
+    return true;
+}
+
+bool zts_coalesce_getsockopt(int fd, int optname, void* optval, unsigned int* optlen, int* result)
+{
+    zts_coalesce_state* st = zts_coalesce_get(fd);
+    if ((optname != ZTS_TCP_CORK && optname != ZTS_TCP_COALESCE_USEC) || ! st) {
+        return false;
+    }
+    if (! optval || ! optlen || *optlen < sizeof(int)) {
+        *result = ZTS_ERR_SOCKET;
+        zts_errno = ZTS_EINVAL;
+        return true;
+    }
+    std::lock_guard<std::mutex> l(st->m);
+    *(int*)optval = optname == ZTS_TCP_CORK ? (int)st->cork : (int)st->delay_us;
+    *optlen = sizeof(int);
+    *result = ZTS_ERR_OK;
+    return true;
+}
+
+bool zts_coalesce_send(int fd, const void* buf, size_t len, int flags, ssize_t* result)
+{
+    zts_coalesce_state* st = zts_coalesce_get(fd);
+    bool more = (flags & MSG_MORE) != 0;
+    if (! st || (! st->active && ! more)) {
+        return false;
+    }
+    std::lock_guard<std::mutex> l(st->m);
+    bool hold = st->cork || st->delay_us || more;
+    if (hold && len < TCP_MSS && (st->len || zts_coalesce_start(fd, st, more)) && st->len + len < st->mss) {
+        memcpy(st->buf + st->len, buf, len);
+        st->len = (u16_t)(st->len + len);
+        zts_coalesce_update(st);
+        *result = (ssize_t)len;
+        return true;
+    }
+    if (! st->len) {
+        return false;
+    }
+    // Send what was held back together with this write, in as few segments as possible
+    struct iovec iov[2];
+    iov[0].iov_base = st->buf;
+    iov[0].iov_len = st->len;
+    iov[1].iov_base = (void*)buf;
+    iov[1].iov_len = len;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    ssize_t n = lwip_sendmsg(fd, &msg, flags & ~MSG_MORE);
+    if (n < 0) {
+        *result = n;
+        return true;
+    }
+    if (n < st->len) {
+        memmove(st->buf, st->buf + n, st->len - n);
+        st->len = (u16_t)(st->len - n);
+        zts_errno = ZTS_EWOULDBLOCK;
+        *result = ZTS_ERR_SOCKET;
+        return true;
+    }
+    n -= st->len;
+    st->len = 0;
+    zts_coalesce_update(st);
+    if (! n && len) {
+        zts_errno = ZTS_EWOULDBLOCK;
+        *result = ZTS_ERR_SOCKET;
+        return true;
+    }
+    *result = n;
+    return true;
+}
+
+int zts_coalesce_flush(int fd)
+{
+    zts_coalesce_state* st = zts_coalesce_get(fd);
+    if (! st || ! st->active) {
+        return ZTS_ERR_OK;
+    }
+    std::lock_guard<std::mutex> l(st->m);
+    while (st->len) {
+        ssize_t n = lwip_send(fd, st->buf, st->len, 0);
+        if (n <= 0) {
+            return ZTS_ERR_SOCKET;
+        }
+        memmove(st->buf, st->buf + n, st->len - n);
+        st->len = (u16_t)(st->len - n);
+    }
+    zts_coalesce_update(st);
+    return ZTS_ERR_OK;
+}
+
+void zts_coalesce_close(int fd)
+{
+    zts_coalesce_state* st = zts_coalesce_get(fd);
+    if (! st || ! st->active) {
+        return;
+    }
+    std::lock_guard<std::mutex> l(st->m);
+    LOCK_TCPIP_CORE();
+    sys_untimeout(zts_coalesce_timeout, st);
+    st->timer = false;
+    if (st->len) {
+        // Like Linux, closing sends what was held back, without waiting for buffer space
+        zts_coalesce_push(st, true);
+    }
+    UNLOCK_TCPIP_CORE();
+    delete[] st->buf;
+    st->buf = NULL;
+    st->len = 0;
+    st->cork = false;
+    st->delay_us = 0;
+    zts_coalesce_update(st);
+}
+
+}   // namespace ZeroTier
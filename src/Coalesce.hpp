@@ -0,0 +1,83 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for TCP write coalescing (`ZTS_TCP_CORK`, `ZTS_MSG_MORE`,
+ * `ZTS_TCP_COALESCE_USEC`)
+ */
+
+#ifndef ZTS_COALESCE_HPP
+#define ZTS_COALESCE_HPP
+
+#include "ZeroTierSockets.h"
+
+#include <stddef.h>
+
+/**
+ * Longest time (ms) corked data or data sent with `ZTS_MSG_MORE` is held back
+ * before being sent anyway (same as Linux)
+ */
+#define ZTS_TCP_CORK_TIMEOUT 200
+
+/**
+ * Longest accepted `ZTS_TCP_COALESCE_USEC`
+ */
+#define ZTS_TCP_COALESCE_USEC_MAX (ZTS_TCP_CORK_TIMEOUT * 1000)
+
+namespace ZeroTier {
+
+/**
+ * @brief Handle `ZTS_TCP_CORK` and `ZTS_TCP_COALESCE_USEC`
+ *
+ * @return true if the option was handled (result stored in `*result`), false
+ * if it should be passed to lwIP
+ */
+bool zts_coalesce_setsockopt(int fd, int optname, const void* optval, unsigned int optlen, int* result);
+
+/**
+ * @brief Counterpart of zts_coalesce_setsockopt() for getsockopt
+ */
+bool zts_coalesce_getsockopt(int fd, int optname, void* optval, unsigned int* optlen, int* result);
+
+/**
+ * @brief Hold back small writes until a full segment has accumulated or the
+ * deadline expires, and send held back data together with the next write
+ *
+ * @usage Called from zts_bsd_send() and zts_bsd_write()
+ * @return true if the write was handled (result stored in `*result`), false
+ * if it should be passed to lwIP unchanged
+ */
+bool zts_coalesce_send(int fd, const void* buf, size_t len, int flags, ssize_t* result);
+
+/**
+ * @brief Send held back data now
+ *
+ * @usage Called before writes that do not go through zts_coalesce_send()
+ * @return `ZTS_ERR_OK`, or `ZTS_ERR_SOCKET` with `zts_errno` set if the held
+ * back data could not be sent
+ */
+int zts_coalesce_flush(int fd);
+
+/**
+ * @brief Queue held back data on the connection, even if its send buffer is
+ * full, and forget the socket's coalescing settings
+ *
+ * @usage Called from zts_bsd_close()
+ */
+void zts_coalesce_close(int fd);
+
+}   // namespace ZeroTier
+
+#endif   // _H
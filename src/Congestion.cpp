@@ -0,0 +1,427 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Pluggable TCP congestion control (ZTS_TCP_CONGESTION).
+ *
+ * lwIP implements NewReno and has no congestion control interface, so the
+ * alternative algorithms run from lwIP's packet hooks: every incoming segment
+ * of a connection is seen before lwIP processes it, which is where the
+ * algorithm updates its model and overwrites cwnd/ssthresh. lwIP's own loss
+ * response (a changed ssthresh) is noticed on the following segment and
+ * replaced with the algorithm's. lwIP's additive increase is neutralised by
+ * clearing bytes_acked, its slow start is kept.
+ *
+ * lwIP only measures RTT in 500 ms slow timer ticks, too coarse for either
+ * algorithm, so one segment per round trip is timed in the output hook with
+ * sys_now() (honoring Karn's rule).
+ */
+
+#include "Allocator.hpp"
+#include "ZeroTierSockets.h"
+#include "lwip/api.h"
+#include "lwip/def.h"
+#include "lwip/errno.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+#include "lwip/tcp.h"
+#include "lwiphooks.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// CUBIC constants (RFC 8312)
+#define ZTS_CUBIC_C    0.4
+#define ZTS_CUBIC_BETA 0.7
+
+// BBR constants
+#define ZTS_BBR_HIGH_GAIN        2.885   // 2/ln(2), doubles delivery rate each round
+#define ZTS_BBR_CWND_GAIN        2.0
+#define ZTS_BBR_BW_ROUNDS        10      // Window of the max bandwidth filter
+#define ZTS_BBR_MIN_RTT_WINDOW   10000   // ms
+#define ZTS_BBR_PROBE_RTT_TIME   200     // ms
+#define ZTS_BBR_FULL_BW_ROUNDS   3
+#define ZTS_BBR_MIN_CWND_SEGS    4
+#define ZTS_BBR_CYCLE_LEN        8
+
+// Upper bound for cwnd so that arithmetic on it cannot overflow
+#define ZTS_TCP_CC_CWND_MAX 0x3FFFFFFF
+
+namespace ZeroTier {
+
+enum zts_tcp_cc_algo { ZTS_CC_RENO = 0, ZTS_CC_CUBIC, ZTS_CC_BBR, ZTS_CC_COUNT };
+
+static const char* const _cc_names[ZTS_CC_COUNT] = { ZTS_TCP_CC_RENO, ZTS_TCP_CC_CUBIC, ZTS_TCP_CC_BBR };
+
+enum zts_bbr_mode { BBR_STARTUP, BBR_DRAIN, BBR_PROBE_BW, BBR_PROBE_RTT };
+
+static const double _bbr_cycle_gain[ZTS_BBR_CYCLE_LEN] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+/**
+ * Congestion control state of a connection. Connections that are not yet
+ * synchronized (and listeners) only carry the selected algorithm, stored
+ * directly in the ext arg pointer; the full state is allocated from the
+ * stack's memory on the first segment received once the connection exists
+ */
+struct zts_tcp_cc {
+    int algo;
+    // RTT sampling
+    bool rtt_pending;
+    u32_t rtt_seq;
+    u32_t rtt_sent;
+    u32_t srtt;             // ms
+    u32_t min_rtt;          // ms, 0 until the first sample
+    u32_t min_rtt_stamp;
+    // Loss detection
+    u32_t last_ssthresh;
+    tcpwnd_size_t last_cwnd;
+    // CUBIC
+    double w_max;
+    double w_last_max;
+    double w_est;
+    double k;
+    double origin;
+    u32_t epoch_start;
+    // BBR
+    int mode;
+    u32_t delivered;
+    u32_t round_end_seq;
+    u32_t round_delivered;
+    u32_t round_stamp;
+    u32_t rounds;
+    double bw[ZTS_BBR_BW_ROUNDS];   // bytes/ms, one sample per round
+    double full_bw;
+    int full_bw_rounds;
+    int cycle;
+    u32_t probe_rtt_done;
+};
+
+static u8_t _cc_id = LWIP_TCP_PCB_NUM_EXT_ARGS;   // Not yet allocated
+
+static bool zts_tcp_cc_is_state(void* arg)
+{
+    return (uintptr_t)arg >= ZTS_CC_COUNT;
+}
+
+static int zts_tcp_cc_algo_of(void* arg)
+{
+    return zts_tcp_cc_is_state(arg) ? ((zts_tcp_cc*)arg)->algo : (int)(uintptr_t)arg;
+}
+
+static void zts_tcp_cc_destroy(u8_t id, void* data)
+{
+    LWIP_UNUSED_ARG(id);
+    if (zts_tcp_cc_is_state(data)) {
+        zts_mem_delete((zts_tcp_cc*)data);
+    }
+}
+
+static err_t zts_tcp_cc_passive_open(u8_t id, struct tcp_pcb_listen* lpcb, struct tcp_pcb* cpcb);
+
+static const struct tcp_ext_arg_callbacks _cc_callbacks = { zts_tcp_cc_destroy, zts_tcp_cc_passive_open };
+
+static err_t zts_tcp_cc_passive_open(u8_t id, struct tcp_pcb_listen* lpcb, struct tcp_pcb* cpcb)
+{
+    // Accepted connections inherit the listener's algorithm, and need the callbacks to free its state
+    tcp_ext_arg_set_callbacks(cpcb, id, &_cc_callbacks);
+    tcp_ext_arg_set(cpcb, id, (void*)(uintptr_t)zts_tcp_cc_algo_of(tcp_ext_arg_get((struct tcp_pcb*)lpcb, id)));
+    return ERR_OK;
+}
+
+static zts_tcp_cc* zts_tcp_cc_get(const struct tcp_pcb* pcb)
+{
+    if (_cc_id == LWIP_TCP_PCB_NUM_EXT_ARGS || ! pcb) {
+        return NULL;
+    }
+    void* arg = tcp_ext_arg_get(pcb, _cc_id);
+    return zts_tcp_cc_is_state(arg) ? (zts_tcp_cc*)arg : NULL;
+}
+
+static double zts_bbr_max_bw(zts_tcp_cc* cc)
+{
+    double max = 0;
+    for (int i = 0; i < ZTS_BBR_BW_ROUNDS; i++) {
+        max = LWIP_MAX(max, cc->bw[i]);
+    }
+    return max;
+}
+
+static void zts_tcp_cc_set_cwnd(struct tcp_pcb* pcb, double cwnd)
+{
+    cwnd = LWIP_MAX(cwnd, 2.0 * pcb->mss);
+    pcb->cwnd = (tcpwnd_size_t)LWIP_MIN(cwnd, (double)ZTS_TCP_CC_CWND_MAX);
+}
+
+static void zts_cubic_update(zts_tcp_cc* cc, struct tcp_pcb* pcb, bool loss, bool rto, u32_t acked, u32_t now)
+{
+    double mss = pcb->mss;
+    if (loss) {
+        double cwnd = cc->last_cwnd / mss;
+        // Fast convergence: release bandwidth to newer flows
+        if (cwnd < cc->w_last_max) {
+            cc->w_last_max = cwnd;
+            cc->w_max = cwnd * (1 + ZTS_CUBIC_BETA) / 2;
+        }
+        else {
+            cc->w_last_max = cc->w_max = cwnd;
+        }
+        pcb->ssthresh = (tcpwnd_size_t)(LWIP_MAX(cwnd * ZTS_CUBIC_BETA, 2.0) * mss);
+        if (! rto && (pcb->flags & TF_INFR)) {
+            pcb->cwnd = pcb->ssthresh + 3 * pcb->mss;
+        }
+        cc->epoch_start = 0;
+        return;
+    }
+    if (! acked || (pcb->flags & TF_INFR) || pcb->cwnd < pcb->ssthresh) {
+        return;   // Slow start and fast recovery are left to lwIP
+    }
+    double cwnd = pcb->cwnd / mss;
+    if (cc->epoch_start == 0) {
+        cc->epoch_start = now;
+        cc->w_est = cwnd;
+        if (cwnd < cc->w_max) {
+            cc->k = cbrt((cc->w_max - cwnd) / ZTS_CUBIC_C);
+            cc->origin = cc->w_max;
+        }
+        else {
+            cc->k = 0;
+            cc->origin = cwnd;
+        }
+    }
+    double t = (now - cc->epoch_start + cc->srtt) / 1000.0;
+    double target = cc->origin + ZTS_CUBIC_C * (t - cc->k) * (t - cc->k) * (t - cc->k);
+    target = LWIP_MIN(target, 1.5 * cwnd);
+    // TCP-friendly region: never grow slower than Reno would
+    cc->w_est += 3 * (1 - ZTS_CUBIC_BETA) / (1 + ZTS_CUBIC_BETA) * (acked / mss) / cwnd;
+    target = LWIP_MAX(target, cc->w_est);
+    if (target > cwnd) {
+        cwnd += (target - cwnd) / cwnd * (acked / mss);
+    }
+    zts_tcp_cc_set_cwnd(pcb, cwnd * mss);
+    pcb->bytes_acked = 0;
+}
+
+static void zts_bbr_update(zts_tcp_cc* cc, struct tcp_pcb* pcb, u32_t ackno, u32_t acked, u32_t now)
+{
+    cc->delivered += acked;
+    bool round_end = acked && TCP_SEQ_GEQ(ackno, cc->round_end_seq);
+    if (round_end) {
+        u32_t elapsed = LWIP_MAX(now - cc->round_stamp, 1);
+        cc->bw[cc->rounds % ZTS_BBR_BW_ROUNDS] = (double)(cc->delivered - cc->round_delivered) / elapsed;
+        cc->rounds++;
+        cc->round_stamp = now;
+        cc->round_delivered = cc->delivered;
+        cc->round_end_seq = pcb->snd_nxt;
+    }
+    double max_bw = zts_bbr_max_bw(cc);
+    if (max_bw == 0 || cc->min_rtt == 0) {
+        return;   // No model yet, lwIP's slow start applies
+    }
+    double bdp = max_bw * cc->min_rtt;
+    u32_t inflight = pcb->snd_nxt - pcb->lastack;
+    // Periodically drain the path to re-measure the minimum RTT
+    if (cc->mode != BBR_PROBE_RTT && now - cc->min_rtt_stamp > ZTS_BBR_MIN_RTT_WINDOW) {
+        cc->mode = BBR_PROBE_RTT;
+        cc->probe_rtt_done = now + LWIP_MAX(ZTS_BBR_PROBE_RTT_TIME, cc->min_rtt);
+    }
+    double cwnd;
+    switch (cc->mode) {
+        case BBR_STARTUP:
+            if (round_end) {
+                if (max_bw >= cc->full_bw * 1.25) {
+                    cc->full_bw = max_bw;
+                    cc->full_bw_rounds = 0;
+                }
+                else if (++cc->full_bw_rounds >= ZTS_BBR_FULL_BW_ROUNDS) {
+                    cc->mode = BBR_DRAIN;
+                }
+            }
+            cwnd = LWIP_MAX((double)pcb->cwnd, ZTS_BBR_HIGH_GAIN * bdp);
+            break;
+        case BBR_DRAIN:
+            if (inflight <= bdp) {
+                cc->mode = BBR_PROBE_BW;
+                cc->cycle = 2 + cc->rounds % (ZTS_BBR_CYCLE_LEN - 2);
+            }
+            cwnd = bdp;
+            break;
+        case BBR_PROBE_BW:
+            if (round_end) {
+                cc->cycle = (cc->cycle + 1) % ZTS_BBR_CYCLE_LEN;
+            }
+            cwnd = ZTS_BBR_CWND_GAIN * _bbr_cycle_gain[cc->cycle] * bdp;
+            break;
+        default:   // BBR_PROBE_RTT
+            if (TCP_SEQ_GEQ(now, cc->probe_rtt_done)) {
+                cc->min_rtt_stamp = now;
+                cc->mode = cc->full_bw_rounds >= ZTS_BBR_FULL_BW_ROUNDS ? BBR_PROBE_BW : BBR_STARTUP;
+            }
+            cwnd = ZTS_BBR_MIN_CWND_SEGS * pcb->mss;
+            break;
+    }
+    cwnd = LWIP_MAX(cwnd, (double)ZTS_BBR_MIN_CWND_SEGS * pcb->mss);
+    // Loss is not a congestion signal; keep lwIP's recovery from shrinking cwnd
+    pcb->ssthresh = (tcpwnd_size_t)LWIP_MIN(cwnd, (double)ZTS_TCP_CC_CWND_MAX);
+    if (! (pcb->flags & TF_INFR)) {
+        zts_tcp_cc_set_cwnd(pcb, cwnd);
+    }
+    pcb->bytes_acked = 0;
+}
+
+static zts_tcp_cc* zts_tcp_cc_create(struct tcp_pcb* pcb, int algo)
+{
+    zts_tcp_cc* cc = zts_mem_new<zts_tcp_cc>(ZTS_ALLOC_STACK);
+    if (! cc) {
+        return NULL;
+    }
+    u32_t now = sys_now();
+    cc->algo = algo;
+    cc->min_rtt_stamp = now;
+    cc->last_ssthresh = pcb->ssthresh;
+    cc->last_cwnd = pcb->cwnd;
+    cc->mode = BBR_STARTUP;
+    cc->round_end_seq = pcb->snd_nxt;
+    cc->round_stamp = now;
+    tcp_ext_arg_set_callbacks(pcb, _cc_id, &_cc_callbacks);
+    tcp_ext_arg_set(pcb, _cc_id, cc);
+    return cc;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+err_t zts_tcp_cc_input(struct tcp_pcb* pcb, struct tcp_hdr* hdr)
+{
+    if (_cc_id == LWIP_TCP_PCB_NUM_EXT_ARGS || pcb->state == LISTEN || pcb->state == TIME_WAIT) {
+        return ERR_OK;
+    }
+    void* arg = tcp_ext_arg_get(pcb, _cc_id);
+    if (! arg) {
+        return ERR_OK;
+    }
+    zts_tcp_cc* cc = zts_tcp_cc_is_state(arg) ? (zts_tcp_cc*)arg : zts_tcp_cc_create(pcb, (int)(uintptr_t)arg);
+    if (! cc || ! (TCPH_FLAGS(hdr) & TCP_ACK)) {
+        return ERR_OK;
+    }
+    u32_t now = sys_now();
+    u32_t ackno = lwip_ntohl(hdr->ackno);
+    if (cc->rtt_pending && TCP_SEQ_GT(ackno, cc->rtt_seq)) {
+        u32_t rtt = LWIP_MAX(now - cc->rtt_sent, 1);
+        cc->srtt = cc->srtt ? (7 * cc->srtt + rtt) / 8 : rtt;
+        if (cc->min_rtt == 0 || rtt <= cc->min_rtt || now - cc->min_rtt_stamp > ZTS_BBR_MIN_RTT_WINDOW) {
+            cc->min_rtt = rtt;
+            cc->min_rtt_stamp = now;
+        }
+        cc->rtt_pending = false;
+    }
+    if (pcb->state >= ESTABLISHED) {
+        u32_t acked = 0;
+        if (TCP_SEQ_GT(ackno, pcb->lastack) && TCP_SEQ_LEQ(ackno, pcb->snd_nxt)) {
+            acked = ackno - pcb->lastack;
+        }
+        // lwIP halves ssthresh on fast retransmit and on RTO
+        bool loss = pcb->ssthresh != cc->last_ssthresh;
+        bool rto = loss && pcb->cwnd <= pcb->mss;
+        if (cc->algo == ZTS_CC_CUBIC) {
+            zts_cubic_update(cc, pcb, loss, rto, acked, now);
+        }
+        else if (cc->algo == ZTS_CC_BBR) {
+            zts_bbr_update(cc, pcb, ackno, acked, now);
+        }
+    }
+    cc->last_ssthresh = pcb->ssthresh;
+    cc->last_cwnd = pcb->cwnd;
+    return ERR_OK;
+}
+
+u32_t* zts_tcp_cc_output(const struct tcp_pcb* pcb, struct tcp_hdr* hdr, u32_t* opts)
+{
+    zts_tcp_cc* cc = zts_tcp_cc_get(pcb);
+    if (! cc) {
+        return opts;
+    }
+    u32_t seq = lwip_ntohl(hdr->seqno);
+    if (TCP_SEQ_LT(seq, pcb->snd_nxt)) {
+        cc->rtt_pending = false;   // Retransmission, the sample would be ambiguous
+    }
+    else if (! cc->rtt_pending || seq == cc->rtt_seq) {
+        // Re-stamped when an empty ACK is followed by data with the same seqno
+        cc->rtt_pending = true;
+        cc->rtt_seq = seq;
+        cc->rtt_sent = sys_now();
+    }
+    return opts;
+}
+
+int zts_tcp_cc_setsockopt(struct lwip_sock* sock, int level, int optname, const void* optval, unsigned int optlen, int* err)
+{
+    if (level != IPPROTO_TCP || optname != ZTS_TCP_CONGESTION) {
+        return 0;
+    }
+    struct tcp_pcb* pcb = sock->conn ? sock->conn->pcb.tcp : NULL;
+    if (! pcb || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP || ! optval) {
+        *err = EINVAL;
+        return 1;
+    }
+    char name[ZTS_TCP_CC_NAME_MAX] = { 0 };
+    memcpy(name, optval, LWIP_MIN(optlen, sizeof(name) - 1));
+    int algo = 0;
+    while (algo < ZTS_CC_COUNT && strcmp(name, _cc_names[algo]) != 0) {
+        algo++;
+    }
+    if (algo == ZTS_CC_COUNT) {
+        *err = ENOENT;
+        return 1;
+    }
+    if (_cc_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+        _cc_id = tcp_ext_arg_alloc_id();
+    }
+    void* arg = tcp_ext_arg_get(pcb, _cc_id);
+    if (zts_tcp_cc_is_state(arg)) {
+        // Switching on a live connection starts the new algorithm afresh
+        zts_mem_delete((zts_tcp_cc*)arg);
+    }
+    tcp_ext_arg_set_callbacks(pcb, _cc_id, &_cc_callbacks);
+    tcp_ext_arg_set(pcb, _cc_id, (void*)(uintptr_t)algo);
+    *err = 0;
+    return 1;
+}
+
+int zts_tcp_cc_getsockopt(struct lwip_sock* sock, int level, int optname, void* optval, unsigned int* optlen, int* err)
+{
+    if (level != IPPROTO_TCP || optname != ZTS_TCP_CONGESTION) {
+        return 0;
+    }
+    struct tcp_pcb* pcb = sock->conn ? sock->conn->pcb.tcp : NULL;
+    if (! pcb || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP || ! optval || ! optlen) {
+        *err = EINVAL;
+        return 1;
+    }
+    int algo = _cc_id == LWIP_TCP_PCB_NUM_EXT_ARGS ? ZTS_CC_RENO : zts_tcp_cc_algo_of(tcp_ext_arg_get(pcb, _cc_id));
+    unsigned int len = LWIP_MIN(*optlen, (unsigned int)strlen(_cc_names[algo]) + 1);
+    memcpy(optval, _cc_names[algo], len);
+    *optlen = len;
+    *err = 0;
+    return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
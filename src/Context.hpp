@@ -0,0 +1,80 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Node instances (zts_ctx_t). Each instance has its own node service, event
+ * queue and callback thread; the TCP/IP stack and the socket layer on top of
+ * it are shared by all instances of the process.
+ */
+
+#ifndef ZTS_CONTEXT_HPP
+#define ZTS_CONTEXT_HPP
+
+#include "Mutex.hpp"
+#include "ZeroTierSockets.h"
+
+#ifdef __WINDOWS__
+#include <windows.h>
+typedef HANDLE zts_thread_t;
+#else
+#include <pthread.h>
+typedef pthread_t zts_thread_t;
+#endif
+
+namespace ZeroTier {
+class NodeService;
+class Events;
+}   // namespace ZeroTier
+
+struct zts_ctx {
+    ZeroTier::NodeService* service;
+    ZeroTier::Events* events;
+    ZeroTier::Mutex service_m;     // Guards everything below
+    bool freeing;                  // Being freed, can't be initialized until that is done
+    bool stackUser;                // Has started its node, counted in the stack's users
+    bool serviceThread;            // Service thread was started and not joined yet
+    bool serviceExited;            // Service thread is done with the service and can be joined
+    bool callbackThread;           // Callback thread was started and not joined yet
+    bool cleanupOnExit;            // Shut down from its own callback, the callback thread finishes the job
+    bool freeOnExit;               // Freed from its own callback, the callback thread deletes it
+    zts_thread_t serviceHandle;
+    zts_thread_t callbackHandle;
+
+    zts_ctx()
+        : service(NULL)
+        , events(NULL)
+        , freeing(false)
+        , stackUser(false)
+        , serviceThread(false)
+        , serviceExited(false)
+        , callbackThread(false)
+        , cleanupOnExit(false)
+        , freeOnExit(false)
+        , serviceHandle()
+        , callbackHandle()
+    {
+    }
+};
+
+namespace ZeroTier {
+
+/**
+ * Create the service and event queue of an instance. ctx->service_m must be held
+ */
+int init_subsystems(zts_ctx* ctx);
+
+}   // namespace ZeroTier
+
+#endif   // _H
@@ -17,11 +17,19 @@
  * Node / Network control interface
  */
 
+#include "Allocator.hpp"
+#include "Context.hpp"
 #include "Events.hpp"
 #include "NodeService.hpp"
 #include "Signals.hpp"
+#include "SocketSlots.hpp"
+#include "Slab.h"
+#include "TcpRecovery.hpp"
 #include "VirtualTap.hpp"
+#include "lwip/stats.h"
 
+#include <map>
+#include <new>
 #include <string.h>
 
 using namespace ZeroTier;
@@ -37,47 +45,168 @@ WSADATA wsaData;
 
 namespace ZeroTier {
 
-#ifdef ZTS_ENABLE_PYTHON
-#endif
-#ifdef ZTS_ENABLE_PINVOKE
-extern void (*_userEventCallback)(void*);
-#endif
-#ifdef ZTS_C_API_ONLY
-extern void (*_userEventCallback)(void*);
-#endif
 extern uint8_t allowNetworkCaching;
 extern uint8_t allowPeerCaching;
 
-NodeService* zts_service;
-Events* zts_events;
+// Instance used by threads that have not selected one with zts_ctx_use()
+static zts_ctx _default_ctx;
+
+// Guards _live_ctx and _ctx_generation
+static Mutex _ctx_m;
+
+// Generation of every instance returned by zts_ctx_new() and not freed since
+static std::map<zts_ctx*, uint64_t> _live_ctx;
+static uint64_t _ctx_generation = 0;
 
-extern Mutex events_m;
-Mutex service_m;
+/* Instance selected by the thread. The generation tells a freed instance
+apart from a new one that was allocated at the same address */
+static thread_local zts_ctx* _current_ctx = NULL;
+static thread_local uint64_t _current_generation = 0;
 
-int init_subsystems()
+// Guards _stack_users
+static Mutex _stack_m;
+
+// Instances that have started their node and not been freed since
+static unsigned int _stack_users = 0;
+
+int init_subsystems(zts_ctx* ctx)
 {
     /** Set up service and callback threads and tell them about one another.
      * A separate thread is used for callbacks so that if the user fails to
      * return control it won't affect the core service's operations. */
-    if (! zts_events) {
-        zts_events = new Events();
-    }
-    if (zts_events->getState(ZTS_STATE_FREE_CALLED)) {
+    if (ctx->freeing) {
         return ZTS_ERR_SERVICE;
     }
+    if (! ctx->events) {
+        ctx->events = new Events();
+    }
 #ifdef ZTS_ENABLE_CUSTOM_SIGNAL_HANDLERS
     zts_install_signal_handlers();
 #endif   // ZTS_ENABLE_CUSTOM_SIGNAL_HANDLERS
-    if (! zts_service) {
+    if (! ctx->service) {
 #if defined(__WINDOWS__)
         WSAStartup(MAKEWORD(2, 2), &wsaData);
 #endif
-        zts_service = new NodeService();
-        zts_service->setUserEventSystem(zts_events);
+        ctx->service = new NodeService();
+        ctx->service->setUserEventSystem(ctx->events);
     }
     return ZTS_ERR_OK;
 }
 
+static void zts_thread_join(zts_thread_t thread)
+{
+#if defined(__WINDOWS__)
+    WaitForSingleObject(thread, INFINITE);
+    CloseHandle(thread);
+#else
+    pthread_join(thread, NULL);
+#endif
+}
+
+static bool zts_thread_is_current(zts_thread_t thread)
+{
+#if defined(__WINDOWS__)
+    return GetThreadId(thread) == GetCurrentThreadId();
+#else
+    return pthread_equal(thread, pthread_self());
+#endif
+}
+
+static void zts_thread_detach(zts_thread_t thread)
+{
+#if defined(__WINDOWS__)
+    CloseHandle(thread);
+#else
+    pthread_detach(thread);
+#endif
+}
+
+/**
+ * Wait for the service thread of an instance to exit. If `exited_only` is set,
+ * only a thread that is already done with the service is waited for.
+ * ctx->service_m must not be held, the thread takes it on its way out
+ */
+static void zts_ctx_join_service(zts_ctx* ctx, bool exited_only)
+{
+    zts_thread_t thread = zts_thread_t();
+    {
+        Mutex::Lock _ls(ctx->service_m);
+        if (! ctx->serviceThread || (exited_only && ! ctx->serviceExited)) {
+            return;
+        }
+        ctx->serviceThread = false;
+        thread = ctx->serviceHandle;
+    }
+    zts_thread_join(thread);
+}
+
+/**
+ * Stop the node of an instance, wait for its threads to exit and free its
+ * service and events. The instance can then be initialized again. If it was
+ * the last instance using the TCP/IP stack and `stop_stack` is set, the stack
+ * is shut down as well.
+ *
+ * When called from the user's callback, the callback thread can't be joined:
+ * it is detached instead and frees the events itself once the callback has
+ * returned and the last event is delivered. Returns false in that case, the
+ * instance must then not be deleted by the caller
+ */
+static bool zts_ctx_shutdown(zts_ctx* ctx, bool stop_stack)
+{
+    {
+        Mutex::Lock _ls(ctx->service_m);
+        ctx->freeing = true;
+        if (ctx->events) {
+            ctx->events->setState(ZTS_STATE_FREE_CALLED);
+            ctx->events->clrState(ZTS_STATE_NODE_RUNNING);
+        }
+        if (ctx->service && ctx->serviceThread && ! ctx->serviceExited) {
+            // Also stops a node whose thread has not entered run() yet
+            ctx->service->terminate();
+        }
+    }
+    zts_ctx_join_service(ctx, false);
+    bool callbackThread = false;
+    zts_thread_t thread = zts_thread_t();
+    {
+        Mutex::Lock _ls(ctx->service_m);
+        delete ctx->service;   // Never started
+        ctx->service = NULL;
+        if (ctx->stackUser) {
+            ctx->stackUser = false;
+            Mutex::Lock _l(_stack_m);
+            if (--_stack_users == 0 && stop_stack) {
+                zts_lwip_driver_shutdown();
+            }
+        }
+        if (ctx->events) {
+            // Last event of the instance, the callback thread exits once it is delivered
+            ctx->events->enable();
+            ctx->events->enqueue(ZTS_EVENT_STACK_DOWN, NULL);
+            ctx->events->clrState(ZTS_STATE_CALLBACKS_RUNNING);
+        }
+        if (ctx->callbackThread) {
+            ctx->callbackThread = false;
+            callbackThread = true;
+            thread = ctx->callbackHandle;
+            if (zts_thread_is_current(thread)) {
+                ctx->cleanupOnExit = true;
+                zts_thread_detach(thread);
+                return false;
+            }
+        }
+    }
+    // Not under the lock, the user's callback may call into the API
+    if (callbackThread) {
+        zts_thread_join(thread);
+    }
+    Mutex::Lock _ls(ctx->service_m);
+    delete ctx->events;
+    ctx->events = NULL;
+    ctx->freeing = false;
+    return true;
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -85,14 +214,14 @@ extern "C" {
 int zts_init_from_storage(const char* path)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    zts_service->setHomePath(path);
+    _ctx->service->setHomePath(path);
     return ZTS_ERR_OK;
 }
 
 int zts_init_from_memory(const char* keypair, unsigned int len)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->setIdentity(keypair, len);
+    return _ctx->service->setIdentity(keypair, len);
 }
 
 #ifdef ZTS_ENABLE_PYTHON
@@ -110,104 +239,144 @@ int zts_init_set_event_handler(PythonDirectorCallbackClass* callback)
 {
     ACQUIRE_SERVICE_OFFLINE();
 #ifdef ZTS_ENABLE_JAVA
-    zts_events->setJavaCallback(obj_ref, id);
+    _ctx->events->setJavaCallback(obj_ref, id);
 #else
     if (! callback) {
         return ZTS_ERR_ARG;
     }
+#ifdef ZTS_ENABLE_PYTHON
     _userEventCallback = callback;
+#else
+    _ctx->events->setCallback(callback);
+#endif
 #endif
-    zts_service->enableEvents();
+    _ctx->service->enableEvents();
     return ZTS_ERR_OK;
 }
 
 int zts_init_set_tcp_relay(const char* tcp_relay_addr, unsigned short tcp_relay_port)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    zts_service->setTcpRelayAddress(tcp_relay_addr, tcp_relay_port);
+    _ctx->service->setTcpRelayAddress(tcp_relay_addr, tcp_relay_port);
     return ZTS_ERR_OK;
 }
 
 int zts_init_allow_tcp_relay(int enabled)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    zts_service->allowTcpRelay(enabled);
+    _ctx->service->allowTcpRelay(enabled);
     return ZTS_ERR_OK;
 }
 
 int zts_init_force_tcp_relay(int enabled)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    zts_service->forceTcpRelay(enabled);
+    _ctx->service->forceTcpRelay(enabled);
     return ZTS_ERR_OK;
 }
 
 int zts_init_blacklist_if(const char* prefix, unsigned int len)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->addInterfacePrefixToBlacklist(prefix, len);
+    return _ctx->service->addInterfacePrefixToBlacklist(prefix, len);
 }
 
 int zts_init_set_roots(const void* roots_data, unsigned int len)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->setRoots(roots_data, len);
+    return _ctx->service->setRoots(roots_data, len);
 }
 
 int zts_init_set_low_bandwidth_mode(int enabled)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->setLowBandwidthMode(enabled);
+    return _ctx->service->setLowBandwidthMode(enabled);
 }
 
 int zts_init_set_port(unsigned short port)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    zts_service->setPrimaryPort(port);
+    _ctx->service->setPrimaryPort(port);
     return ZTS_ERR_OK;
 }
 
 int zts_init_set_random_port_range(unsigned short start_port, unsigned short end_port)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    zts_service->setRandomPortRange(start_port, end_port);
+    _ctx->service->setRandomPortRange(start_port, end_port);
     return ZTS_ERR_OK;
 }
 
 int zts_init_allow_secondary_port(unsigned int allowed)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->allowSecondaryPort(allowed);
+    return _ctx->service->allowSecondaryPort(allowed);
 }
 
 int zts_init_allow_port_mapping(unsigned int allowed)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->allowPortMapping(allowed);
+    return _ctx->service->allowPortMapping(allowed);
 }
 
 int zts_init_allow_peer_cache(unsigned int allowed)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->allowPeerCaching(allowed);
+    return _ctx->service->allowPeerCaching(allowed);
 }
 
 int zts_init_allow_net_cache(unsigned int allowed)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->allowNetworkCaching(allowed);
+    return _ctx->service->allowNetworkCaching(allowed);
 }
 
 int zts_init_allow_roots_cache(unsigned int allowed)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->allowRootSetCaching(allowed);
+    return _ctx->service->allowRootSetCaching(allowed);
 }
 
 int zts_init_allow_id_cache(unsigned int allowed)
 {
     ACQUIRE_SERVICE_OFFLINE();
-    return zts_service->allowIdentityCaching(allowed);
+    return _ctx->service->allowIdentityCaching(allowed);
+}
+
+int zts_init_set_peer_loss_policy(int policy)
+{
+    ACQUIRE_SERVICE_OFFLINE();
+    return _ctx->service->setPeerLossPolicy(policy);
+}
+
+int zts_init_allow_rx_coalescing(unsigned int allowed)
+{
+    ACQUIRE_SERVICE_OFFLINE();
+    return _ctx->service->allowRxCoalescing(allowed);
+}
+
+int zts_init_set_allocator(zts_malloc_fn malloc_fn, zts_free_fn free_fn, zts_realloc_fn realloc_fn, void* ctx)
+{
+    ACQUIRE_SERVICE_OFFLINE();
+    return zts_mem_set_allocator(malloc_fn, free_fn, realloc_fn, ctx);
+}
+
+int zts_init_set_memory_budget(uint64_t bytes)
+{
+    ACQUIRE_SERVICE_OFFLINE();
+    return _ctx->service->setMemoryBudget(bytes);
+}
+
+int zts_init_set_memory_profile(int profile)
+{
+    ACQUIRE_SERVICE_OFFLINE();
+    return _ctx->service->setMemoryProfile(profile);
+}
+
+int zts_init_set_max_sockets(unsigned int max_sockets)
+{
+    ACQUIRE_SERVICE_OFFLINE();
+    return zts_slot_set_limit(max_sockets);
 }
 
 int zts_addr_compute_6plane(const uint64_t net_id, const uint64_t node_id, struct zts_sockaddr_storage* addr)
@@ -305,7 +474,7 @@ int zts_node_get_id_pair(char* key, unsigned int* key_dst_len)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
     int err = ZTS_ERR_OK;
-    if ((err = zts_service->getIdentity(key, key_dst_len)) != ZTS_ERR_OK) {
+    if ((err = _ctx->service->getIdentity(key, key_dst_len)) != ZTS_ERR_OK) {
         return err;
     }
     return *key_dst_len > 0 ? ZTS_ERR_OK : ZTS_ERR_GENERAL;
@@ -317,11 +486,28 @@ DWORD WINAPI cbRun(LPVOID arg)
 void* cbRun(void* arg)
 #endif
 {
-    ZTS_UNUSED_ARG(arg);
+    zts_ctx* ctx = (zts_ctx*)arg;
 #if defined(__APPLE__)
     // pthread_setname_np(ZTS_EVENT_CALLBACK_THREAD_NAME);
 #endif
-    zts_events->run();
+    // API calls made from the user's callback act on this instance
+    zts_ctx_use(ctx);
+    ctx->events->run();
+    // Nobody joins this thread if the instance was shut down from the callback
+    bool remove = false;
+    {
+        Mutex::Lock _ls(ctx->service_m);
+        if (ctx->cleanupOnExit) {
+            ctx->cleanupOnExit = false;
+            delete ctx->events;
+            ctx->events = NULL;
+            ctx->freeing = false;
+            remove = ctx->freeOnExit;
+        }
+    }
+    if (remove) {
+        delete ctx;
+    }
     //#if ZTS_ENABLE_JAVA
     //    _java_detach_from_thread();
     // pthread_exit(0);
@@ -332,13 +518,13 @@ void* cbRun(void* arg)
 int zts_addr_is_assigned(uint64_t net_id, unsigned int family)
 {
     ACQUIRE_SERVICE(0);
-    return zts_service->addrIsAssigned(net_id, family);
+    return _ctx->service->addrIsAssigned(net_id, family);
 }
 
 int zts_addr_get(uint64_t net_id, unsigned int family, struct zts_sockaddr_storage* addr)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getFirstAssignedAddr(net_id, family, addr);
+    return _ctx->service->getFirstAssignedAddr(net_id, family, addr);
 }
 
 int zts_addr_get_str(uint64_t net_id, unsigned int family, char* dst, unsigned int len)
@@ -375,39 +561,39 @@ int zts_addr_get_str(uint64_t net_id, unsigned int family, char* dst, unsigned i
 int zts_addr_get_all(uint64_t net_id, struct zts_sockaddr_storage* addr, unsigned int* count)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getAllAssignedAddr(net_id, addr, count);
+    return _ctx->service->getAllAssignedAddr(net_id, addr, count);
 }
 
 int zts_core_lock_obtain()
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    zts_service->obtainLock();
+    _ctx->service->obtainLock();
     return ZTS_ERR_OK;
 }
 
 int zts_core_lock_release()
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    zts_service->releaseLock();
+    _ctx->service->releaseLock();
     return ZTS_ERR_OK;
 }
 
 int zts_core_query_addr_count(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->addressCount(net_id);
+    return _ctx->service->addressCount(net_id);
 }
 
 int zts_core_query_addr(uint64_t net_id, unsigned int idx, char* addr, unsigned int len)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getAddrAtIdx(net_id, idx, addr, len);
+    return _ctx->service->getAddrAtIdx(net_id, idx, addr, len);
 }
 
 int zts_core_query_route_count(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->routeCount(net_id);
+    return _ctx->service->routeCount(net_id);
 }
 
 int zts_core_query_route(
@@ -420,53 +606,53 @@ int zts_core_query_route(
     uint16_t* metric)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getRouteAtIdx(net_id, idx, target, via, len, flags, metric);
+    return _ctx->service->getRouteAtIdx(net_id, idx, target, via, len, flags, metric);
 }
 
 int zts_core_query_path_count(uint64_t peer_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->pathCount(peer_id);
+    return _ctx->service->pathCount(peer_id);
 }
 int zts_core_query_path(uint64_t peer_id, unsigned int idx, char* path, unsigned int len)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getPathAtIdx(peer_id, idx, path, len);
+    return _ctx->service->getPathAtIdx(peer_id, idx, path, len);
 }
 
 int zts_core_query_mc_count(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->multicastSubCount(net_id);
+    return _ctx->service->multicastSubCount(net_id);
 }
 int zts_core_query_mc(uint64_t net_id, unsigned int idx, uint64_t* mac, uint32_t* adi)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getMulticastSubAtIdx(net_id, idx, mac, adi);
+    return _ctx->service->getMulticastSubAtIdx(net_id, idx, mac, adi);
 }
 
 int zts_net_join(const uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->join(net_id);
+    return _ctx->service->join(net_id);
 }
 
 int zts_net_leave(const uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->leave(net_id);
+    return _ctx->service->leave(net_id);
 }
 
 int zts_net_transport_is_ready(const uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->networkIsReady(net_id);
+    return _ctx->service->networkIsReady(net_id);
 }
 
 uint64_t zts_net_get_mac(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getMACAddress(net_id);
+    return _ctx->service->getMACAddress(net_id);
 }
 
 ZTS_API int ZTCALL zts_net_get_mac_str(uint64_t net_id, char* dst, unsigned int len)
@@ -475,7 +661,7 @@ ZTS_API int ZTCALL zts_net_get_mac_str(uint64_t net_id, char* dst, unsigned int
     if (! dst || len < ZTS_MAC_ADDRSTRLEN) {
         return ZTS_ERR_ARG;
     }
-    uint64_t mac = zts_service->getMACAddress(net_id);
+    uint64_t mac = _ctx->service->getMACAddress(net_id);
     OSUtils::ztsnprintf(
         dst,
         ZTS_MAC_ADDRSTRLEN,
@@ -492,37 +678,37 @@ ZTS_API int ZTCALL zts_net_get_mac_str(uint64_t net_id, char* dst, unsigned int
 int zts_net_get_broadcast(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getNetworkBroadcast(net_id);
+    return _ctx->service->getNetworkBroadcast(net_id);
 }
 
 int zts_net_get_mtu(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getNetworkMTU(net_id);
+    return _ctx->service->getNetworkMTU(net_id);
 }
 
 int zts_net_get_name(uint64_t net_id, char* dst, unsigned int len)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getNetworkName(net_id, dst, len);
+    return _ctx->service->getNetworkName(net_id, dst, len);
 }
 
 int zts_net_get_status(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getNetworkStatus(net_id);
+    return _ctx->service->getNetworkStatus(net_id);
 }
 
 int zts_net_get_type(uint64_t net_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getNetworkType(net_id);
+    return _ctx->service->getNetworkType(net_id);
 }
 
 int zts_route_is_assigned(uint64_t net_id, unsigned int family)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->networkHasRoute(net_id, family);
+    return _ctx->service->networkHasRoute(net_id, family);
 }
 
 // Start a ZeroTier NodeService background thread
@@ -532,27 +718,25 @@ DWORD WINAPI _runNodeService(LPVOID arg)
 void* _runNodeService(void* arg)
 #endif
 {
-    ZTS_UNUSED_ARG(arg);
+    zts_ctx* ctx = (zts_ctx*)arg;
 #if defined(__APPLE__)
     // pthread_setname_np(ZTS_SERVICE_THREAD_NAME);
 #endif
     try {
-        zts_service->run();
+        ctx->service->run();
         // Begin shutdown
-        service_m.lock();
-        zts_events->clrState(ZTS_STATE_NODE_RUNNING);
-        delete zts_service;
-        zts_service = (NodeService*)0;
-        service_m.unlock();
-        events_m.lock();
-        zts_util_delay(ZTS_CALLBACK_PROCESSING_INTERVAL * 2);
-        if (zts_events) {
-            zts_events->disable();
-        }
-        events_m.unlock();
+        ctx->service_m.lock();
+        ctx->events->clrState(ZTS_STATE_NODE_RUNNING);
+        delete ctx->service;
+        ctx->service = (NodeService*)0;
+        ctx->events->disable();
+        ctx->service_m.unlock();
     }
     catch (...) {
     }
+    ctx->service_m.lock();
+    ctx->serviceExited = true;
+    ctx->service_m.unlock();
 #ifndef __WINDOWS__
     pthread_exit(0);
 #endif
@@ -561,69 +745,85 @@ void* _runNodeService(void* arg)
 
 int zts_node_start()
 {
+    // Reap the thread of a node that stopped on its own
+    zts_ctx_join_service(zts_ctx_current(), true);
     ACQUIRE_SERVICE_OFFLINE();
-    // Start TCP/IP stack
+    if (_ctx->serviceThread) {
+        return ZTS_ERR_SERVICE;
+    }
+    // Start TCP/IP stack, shared by all instances
     zts_lwip_driver_init();
-    // Start callback thread
+    if (! _ctx->stackUser) {
+        _ctx->stackUser = true;
+        Mutex::Lock _l(_stack_m);
+        _stack_users++;
+    }
+    // Start callback thread, unless it still runs from a previous start
     int res = ZTS_ERR_OK;
-    if (zts_events->hasCallback()) {
+    if (_ctx->events->hasCallback() && ! _ctx->callbackThread) {
+        _ctx->events->setState(ZTS_STATE_CALLBACKS_RUNNING);
 #if defined(__WINDOWS__)
-        HANDLE callbackThread = CreateThread(NULL, 0, cbRun, NULL, 0, NULL);
-        // TODO: Check success
+        _ctx->callbackHandle = CreateThread(NULL, 0, cbRun, _ctx, 0, NULL);
+        res = _ctx->callbackHandle ? ZTS_ERR_OK : ZTS_ERR_GENERAL;
 #else
-        pthread_t cbThread;
-        if ((res = pthread_create(&cbThread, NULL, cbRun, NULL)) != 0) {}
+        res = pthread_create(&_ctx->callbackHandle, NULL, cbRun, _ctx);
 #endif
 #if defined(__linux__)
-        // pthread_setname_np(cbThread, ZTS_EVENT_CALLBACK_THREAD_NAME);
+        // pthread_setname_np(_ctx->callbackHandle, ZTS_EVENT_CALLBACK_THREAD_NAME);
 #endif
         if (res != ZTS_ERR_OK) {
-            zts_events->clrState(ZTS_STATE_CALLBACKS_RUNNING);
-            zts_events->clrCallback();
+            _ctx->events->clrState(ZTS_STATE_CALLBACKS_RUNNING);
+            _ctx->events->clrCallback();
         }
-        zts_events->setState(ZTS_STATE_CALLBACKS_RUNNING);
+        _ctx->callbackThread = res == ZTS_ERR_OK;
     }
     // Start ZeroTier service
 #if defined(__WINDOWS__)
-    HANDLE serviceThread = CreateThread(NULL, 0, _runNodeService, (void*)NULL, 0, NULL);
-    // TODO: Check success
+    _ctx->serviceHandle = CreateThread(NULL, 0, _runNodeService, _ctx, 0, NULL);
+    res = _ctx->serviceHandle ? ZTS_ERR_OK : ZTS_ERR_GENERAL;
 #else
-    pthread_t service_thread;
-    if ((res = pthread_create(&service_thread, NULL, _runNodeService, (void*)NULL)) != 0) {}
+    res = pthread_create(&_ctx->serviceHandle, NULL, _runNodeService, _ctx);
 #endif
 #if defined(__linux__)
-    // pthread_setname_np(service_thread, ZTS_SERVICE_THREAD_NAME);
+    // pthread_setname_np(_ctx->serviceHandle, ZTS_SERVICE_THREAD_NAME);
 #endif
     if (res != ZTS_ERR_OK) {
-        zts_events->clrState(ZTS_STATE_NODE_RUNNING);
+        return ZTS_ERR_SERVICE;
     }
-    zts_events->setState(ZTS_STATE_NODE_RUNNING);
+    _ctx->serviceThread = true;
+    _ctx->serviceExited = false;
+    _ctx->events->setState(ZTS_STATE_NODE_RUNNING);
     return ZTS_ERR_OK;
 }
 
 int zts_node_is_online()
 {
     ACQUIRE_SERVICE(0);
-    return zts_service->nodeIsOnline();
+    return _ctx->service->nodeIsOnline();
 }
 
 uint64_t zts_node_get_id()
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getNodeId();
+    return _ctx->service->getNodeId();
 }
 
 int zts_node_get_port()
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    return zts_service->getPrimaryPort();
+    return _ctx->service->getPrimaryPort();
 }
 
 int zts_node_stop()
 {
-    ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    zts_events->clrState(ZTS_STATE_NODE_RUNNING);
-    zts_service->terminate();
+    zts_ctx* ctx = zts_ctx_current();
+    {
+        ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
+        _ctx->events->clrState(ZTS_STATE_NODE_RUNNING);
+        _ctx->service->terminate();
+    }
+    // Return once the node is down, so that it can be started again right away
+    zts_ctx_join_service(ctx, false);
 #if defined(__WINDOWS__)
     WSACleanup();
 #endif
@@ -632,30 +832,97 @@ int zts_node_stop()
 
 int zts_node_free()
 {
-    ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    zts_events->setState(ZTS_STATE_FREE_CALLED);
-    zts_events->clrState(ZTS_STATE_NODE_RUNNING);
-    zts_service->terminate();
+    zts_ctx* ctx = zts_ctx_current();
+    {
+        // Also allowed once the node has stopped, to release the stack
+        Mutex::Lock _ls(ctx->service_m);
+        if (ctx->freeing || ! ctx->stackUser) {
+            return ZTS_ERR_SERVICE;
+        }
+    }
+    zts_ctx_shutdown(ctx, true);
 #if defined(__WINDOWS__)
     WSACleanup();
 #endif
-    zts_lwip_driver_shutdown();
-    delete zts_events;
-    zts_events = (Events*)0;
+    return ZTS_ERR_OK;
+}
+
+zts_ctx_t* zts_ctx_new()
+{
+    zts_ctx* ctx = new (std::nothrow) zts_ctx();
+    if (ctx) {
+        Mutex::Lock _l(_ctx_m);
+        _live_ctx[ctx] = ++_ctx_generation;
+    }
+    return ctx;
+}
+
+int zts_ctx_use(zts_ctx_t* ctx)
+{
+    if (! ctx || ctx == &_default_ctx) {
+        _current_ctx = NULL;
+        return ZTS_ERR_OK;
+    }
+    Mutex::Lock _l(_ctx_m);
+    std::map<zts_ctx*, uint64_t>::iterator it = _live_ctx.find(ctx);
+    if (it == _live_ctx.end()) {
+        return ZTS_ERR_ARG;
+    }
+    _current_ctx = ctx;
+    _current_generation = it->second;
+    return ZTS_ERR_OK;
+}
+
+zts_ctx_t* zts_ctx_current()
+{
+    if (! _current_ctx) {
+        return &_default_ctx;
+    }
+    Mutex::Lock _l(_ctx_m);
+    std::map<zts_ctx*, uint64_t>::iterator it = _live_ctx.find(_current_ctx);
+    if (it == _live_ctx.end() || it->second != _current_generation) {
+        // Freed by another thread, which makes this one fall back to the default
+        _current_ctx = NULL;
+        return &_default_ctx;
+    }
+    return _current_ctx;
+}
+
+int zts_ctx_free(zts_ctx_t* ctx)
+{
+    if (! ctx || ctx == &_default_ctx) {
+        return ZTS_ERR_ARG;
+    }
+    {
+        Mutex::Lock _l(_ctx_m);
+        if (! _live_ctx.erase(ctx)) {
+            return ZTS_ERR_ARG;   // Already freed
+        }
+    }
+    if (_current_ctx == ctx) {
+        _current_ctx = NULL;
+    }
+    if (! zts_ctx_shutdown(ctx, false)) {
+        // Called from the instance's own callback, its thread deletes it on the way out
+        Mutex::Lock _ls(ctx->service_m);
+        ctx->freeOnExit = true;
+        return ZTS_ERR_OK;
+    }
+    delete ctx;
     return ZTS_ERR_OK;
 }
 
 int zts_moon_orbit(uint64_t moon_roots_id, uint64_t moon_seed)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    zts_service->orbit(moon_roots_id, moon_seed);
+    _ctx->service->orbit(moon_roots_id, moon_seed);
     return ZTS_ERR_OK;
 }
 
 int zts_moon_deorbit(uint64_t moon_roots_id)
 {
     ACQUIRE_SERVICE(ZTS_ERR_SERVICE);
-    zts_service->deorbit(moon_roots_id);
+    _ctx->service->deorbit(moon_roots_id);
     return ZTS_ERR_OK;
 }
 
@@ -726,6 +993,9 @@ int zts_stats_get_all(zts_stats_counter_t* dst)
     dst->tcp_drop = lws.tcp.drop;
     dst->tcp_err = lws.tcp.chkerr + lws.tcp.lenerr + lws.tcp.memerr + lws.tcp.rterr + lws.tcp.proterr + lws.tcp.opterr
                    + lws.tcp.err;
+    dst->tcp_rexmit = zts_tcp_recovery_counters.rexmit;
+    dst->tcp_sack_rexmit = zts_tcp_recovery_counters.sack_rexmit;
+    dst->tcp_recovery = zts_tcp_recovery_counters.recovery;
     // nd6
     dst->nd6_tx = lws.nd6.xmit;
     dst->nd6_rx = lws.nd6.recv;
@@ -733,7 +1003,39 @@ int zts_stats_get_all(zts_stats_counter_t* dst)
     dst->nd6_err = lws.nd6.chkerr + lws.nd6.lenerr + lws.nd6.memerr + lws.nd6.rterr + lws.nd6.proterr + lws.nd6.opterr
                    + lws.nd6.err;
 
-    // TODO: Add mem and sys stats
+    // mem
+    struct zts_slab_stats heap;
+    zts_slab_get_stats(&heap);
+    dst->mem[ZTS_STATS_MEM_HEAP].used = (uint32_t)heap.used;
+    dst->mem[ZTS_STATS_MEM_HEAP].max = (uint32_t)heap.max;
+    dst->mem[ZTS_STATS_MEM_HEAP].err = heap.err;
+    dst->mem_reserved = (uint32_t)heap.reserved;
+    const int pools[][2] = {
+        { ZTS_STATS_MEM_TCP_PCB, MEMP_TCP_PCB },
+        { ZTS_STATS_MEM_TCP_PCB_LISTEN, MEMP_TCP_PCB_LISTEN },
+        { ZTS_STATS_MEM_TCP_SEG, MEMP_TCP_SEG },
+        { ZTS_STATS_MEM_UDP_PCB, MEMP_UDP_PCB },
+        { ZTS_STATS_MEM_NETCONN, MEMP_NETCONN },
+        { ZTS_STATS_MEM_NETBUF, MEMP_NETBUF },
+        { ZTS_STATS_MEM_PBUF, MEMP_PBUF },
+        { ZTS_STATS_MEM_SYS_TIMEOUT, MEMP_SYS_TIMEOUT },
+    };
+    for (int i = 0; i < MEMP_MAX; i++) {
+        if (! lws.memp[i]) {
+            continue;
+        }
+        int idx = ZTS_STATS_MEM_OTHER;
+        for (unsigned int j = 0; j < sizeof(pools) / sizeof(pools[0]); j++) {
+            if (pools[j][1] == i) {
+                idx = pools[j][0];
+            }
+        }
+        dst->mem[idx].used += lws.memp[i]->used;
+        dst->mem[idx].max += lws.memp[i]->max;
+        dst->mem[idx].err += lws.memp[i]->err;
+    }
+
+    // TODO: Add sys stats
 
     return ZTS_ERR_OK;
 #else
@@ -742,6 +1044,15 @@ int zts_stats_get_all(zts_stats_counter_t* dst)
 #undef lws
 }
 
+int zts_stats_get_alloc(int subsys, zts_alloc_counter_t* dst)
+{
+    if (! dst || subsys < 0 || subsys >= ZTS_ALLOC_COUNT) {
+        return ZTS_ERR_ARG;
+    }
+    zts_mem_get_counter(subsys, dst);
+    return ZTS_ERR_OK;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,10 +19,15 @@
 
 #include "Events.hpp"
 
+#include "Allocator.hpp"
 #include "Mutex.hpp"
-#include "NodeService.hpp"
 #include "concurrentqueue.h"
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+
 #ifdef ZTS_ENABLE_JAVA
 #include <jni.h>
 #endif
@@ -53,43 +58,84 @@ jobject javaCbObjRef = NULL;
 jmethodID javaCbMethodId = NULL;
 #endif
 
-extern NodeService* zts_service;
-
 // Global state variable shared between Socket, Control, Event and
-// NodeService logic.
+// NodeService logic. Only holds the state of the TCP/IP stack and whether
+// sockets can be used, which is the case while the stack and any node
+// instance are running.
 volatile uint8_t service_state = 0;
 int last_state_check;
 
-#define RESET_FLAGS() service_state = 0;
-#define SET_FLAGS(f)  service_state |= f;
-#define CLR_FLAGS(f)  service_state &= ~f;
-#define GET_FLAGS(f)  ((service_state & f) > 0)
+// Guards service_state and _nodesRunning
+static Mutex _state_m;
 
-// Lock to guard access to callback function pointers.
-Mutex events_m;
+// Instances whose node is running
+static unsigned int _nodesRunning = 0;
 
-#ifdef ZTS_ENABLE_PINVOKE
-void (*_userEventCallback)(void*);
-#endif
-#ifdef ZTS_C_API_ONLY
-void (*_userEventCallback)(void*);
+static void zts_update_service_state()
+{
+    if ((service_state & ZTS_STATE_STACK_RUNNING) && _nodesRunning) {
+        service_state |= ZTS_STATE_NET_SERVICE_RUNNING;
+    }
+    else {
+        service_state &= ~ZTS_STATE_NET_SERVICE_RUNNING;
+    }
+}
+
+// Blocks of the event queue are charged to ZTS_ALLOC_EVENTS like the messages
+struct zts_event_queue_traits : public moodycamel::ConcurrentQueueDefaultTraits {
+    static inline void*(malloc)(size_t size)
+    {
+        return zts_mem_alloc(ZTS_ALLOC_EVENTS, size);
+    }
+    static inline void(free)(void* ptr)
+    {
+        zts_mem_free(ptr);
+    }
+};
+
+struct zts_event_queue {
+    moodycamel::ConcurrentQueue<zts_event_msg_t*, zts_event_queue_traits> q;
+    std::mutex wake_m;   // Wakes the callback thread as soon as an event is queued
+    std::condition_variable wake_cv;
+};
+
+Events::Events()
+    : _enabled(false)
+    , _queue(new zts_event_queue())
+    , _queueLimit(ZTS_CALLBACK_QUEUE_LIMIT)
+    , _state(0)
+#if defined(ZTS_ENABLE_PINVOKE) || defined(ZTS_C_API_ONLY)
+    , _callback(NULL)
 #endif
+{
+}
 
-moodycamel::ConcurrentQueue<zts_event_msg_t*> _callbackMsgQueue;
+Events::~Events()
+{
+    clrState(_state);
+    zts_event_msg_t* msg;
+    while (_queue->q.try_dequeue(msg)) {
+        destroy(msg);
+    }
+    delete _queue;
+}
 
 void Events::run()
 {
-    while (getState(ZTS_STATE_CALLBACKS_RUNNING) || _callbackMsgQueue.size_approx() > 0) {
+    while (getState(ZTS_STATE_CALLBACKS_RUNNING) || _queue->q.size_approx() > 0) {
         zts_event_msg_t* msg;
-        size_t sz = _callbackMsgQueue.size_approx();
+        size_t sz = _queue->q.size_approx();
         for (size_t j = 0; j < sz; j++) {
-            if (_callbackMsgQueue.try_dequeue(msg)) {
-                events_m.lock();
+            if (_queue->q.try_dequeue(msg)) {
+                _callback_m.lock();
                 sendToUser(msg);
-                events_m.unlock();
+                _callback_m.unlock();
             }
         }
-        zts_util_delay(ZTS_CALLBACK_PROCESSING_INTERVAL);
+        std::unique_lock<std::mutex> _l(_queue->wake_m);
+        _queue->wake_cv.wait_for(_l, std::chrono::milliseconds(ZTS_CALLBACK_PROCESSING_INTERVAL), [this] {
+            return _queue->q.size_approx() > 0 || ! getState(ZTS_STATE_CALLBACKS_RUNNING);
+        });
     }
 }
 
@@ -98,14 +144,17 @@ bool Events::enqueue(unsigned int event_code, const void* arg, int len)
     if (! _enabled) {
         return false;
     }
-    if (_callbackMsgQueue.size_approx() > 1024) {
+    if (_queue->q.size_approx() > _queueLimit) {
         /* Rate-limit number of events. This value should only grow if the
         user application isn't returning from the event handler in a timely manner.
         For most applications it should hover around 1 to 2 */
         return false;
     }
     
-    zts_event_msg_t* msg = new zts_event_msg_t();
+    zts_event_msg_t* msg = zts_mem_new<zts_event_msg_t>(ZTS_ALLOC_EVENTS);
+    if (! msg) {
+        return false;
+    }
     msg->event_code = event_code;
 
     if (ZTS_NODE_EVENT(event_code)) {
@@ -143,34 +192,43 @@ bool Events::enqueue(unsigned int event_code, const void* arg, int len)
     //
     // ownership of arg is now transferred
     //
-    _callbackMsgQueue.enqueue(msg);
+    _queue->q.enqueue(msg);
+    {
+        std::lock_guard<std::mutex> _l(_queue->wake_m);
+    }
+    _queue->wake_cv.notify_one();
     return true;
 }
 
+void Events::setQueueLimit(unsigned int limit)
+{
+    _queueLimit = limit;
+}
+
 void Events::destroy(zts_event_msg_t* msg)
 {
     if (! msg) {
         return;
     }
     if (msg->node) {
-        delete msg->node;
+        zts_mem_delete(msg->node);
     }
     if (msg->network) {
-        delete msg->network;
+        zts_mem_delete(msg->network);
     }
     if (msg->netif) {
-        delete msg->netif;
+        zts_mem_delete(msg->netif);
     }
     if (msg->route) {
-        delete msg->route;
+        zts_mem_delete(msg->route);
     }
     if (msg->peer) {
-        delete msg->peer;
+        zts_mem_delete(msg->peer);
     }
     if (msg->addr) {
-        delete msg->addr;
+        zts_mem_delete(msg->addr);
     }
-    delete msg;
+    zts_mem_delete(msg);
     msg = NULL;
 }
 
@@ -205,14 +263,9 @@ void Events::sendToUser(zts_event_msg_t* msg)
         jvm->DetachCurrentThread();
     }
 #endif   // ZTS_ENABLE_JAVA
-#ifdef ZTS_ENABLE_PINVOKE
-    if (_userEventCallback) {
-        _userEventCallback(msg);
-    }
-#endif
-#ifdef ZTS_C_API_ONLY
-    if (_userEventCallback) {
-        _userEventCallback(msg);
+#if defined(ZTS_ENABLE_PINVOKE) || defined(ZTS_C_API_ONLY)
+    if (_callback) {
+        _callback(msg);
     }
 #endif
     destroy(msg);
@@ -230,69 +283,99 @@ void Events::setJavaCallback(jobject objRef, jmethodID methodId)
     javaCbMethodId = methodId;
 }
 #endif
+
+#if defined(ZTS_ENABLE_PINVOKE) || defined(ZTS_C_API_ONLY)
+void Events::setCallback(void (*callback)(void*))
+{
+    Mutex::Lock _l(_callback_m);
+    _callback = callback;
+}
+#endif
+
 bool Events::hasCallback()
 {
-    events_m.lock();
-    bool retval = false;
-#ifdef ZTS_ENABLE_JAVA
-    retval = (jvm && javaCbObjRef && javaCbMethodId);
+    Mutex::Lock _l(_callback_m);
+#if defined(ZTS_ENABLE_JAVA)
+    return jvm && javaCbObjRef && javaCbMethodId;
+#elif defined(ZTS_ENABLE_PYTHON)
+    return _userEventCallback;
 #else
-    retval = _userEventCallback;
+    return _callback;
 #endif
-    events_m.unlock();
-    return retval;
 }
 
 void Events::clrCallback()
 {
-    events_m.lock();
-#ifdef ZTS_ENABLE_JAVA
+    Mutex::Lock _l(_callback_m);
+#if defined(ZTS_ENABLE_JAVA)
     javaCbObjRef = NULL;
     javaCbMethodId = NULL;
-#else
+#elif defined(ZTS_ENABLE_PYTHON)
     _userEventCallback = NULL;
+#else
+    _callback = NULL;
 #endif
-    events_m.unlock();
 }
 
-int Events::canPerformServiceOperation()
+/**
+ * An instance counts as running while its node runs and it has not been freed
+ */
+static bool zts_node_running(uint8_t state)
 {
-    return zts_service && zts_service->isRunning() && ! getState(ZTS_STATE_FREE_CALLED);
+    return (state & ZTS_STATE_NODE_RUNNING) && ! (state & ZTS_STATE_FREE_CALLED);
 }
 
-void Events::setState(uint8_t newFlags)
+static void zts_count_node(bool was, bool now)
 {
-    if ((newFlags ^ service_state) & ZTS_STATE_NET_SERVICE_RUNNING) {
-        return;   // No effect. Not allowed to set this flag manually
+    if (now && ! was) {
+        _nodesRunning++;
     }
-    SET_FLAGS(newFlags);
-    if (GET_FLAGS(ZTS_STATE_NODE_RUNNING) && GET_FLAGS(ZTS_STATE_STACK_RUNNING)
-        && ! (GET_FLAGS(ZTS_STATE_FREE_CALLED))) {
-        SET_FLAGS(ZTS_STATE_NET_SERVICE_RUNNING);
+    if (was && ! now) {
+        _nodesRunning--;
     }
-    else {
-        CLR_FLAGS(ZTS_STATE_NET_SERVICE_RUNNING);
+}
+
+void Events::setState(uint8_t newFlags)
+{
+    Mutex::Lock _l(_state_m);
+    if (newFlags & ZTS_STATE_STACK_RUNNING) {
+        service_state |= ZTS_STATE_STACK_RUNNING;
     }
+    newFlags &= ~(ZTS_STATE_STACK_RUNNING | ZTS_STATE_NET_SERVICE_RUNNING);
+    bool was = zts_node_running(_state);
+    _state |= newFlags;
+    zts_count_node(was, zts_node_running(_state));
+    zts_update_service_state();
 }
 
 void Events::clrState(uint8_t newFlags)
 {
-    if (newFlags & ZTS_STATE_NET_SERVICE_RUNNING) {
-        return;   // No effect. Not allowed to set this flag manually
-    }
-    CLR_FLAGS(newFlags);
-    if (GET_FLAGS(ZTS_STATE_NODE_RUNNING) && GET_FLAGS(ZTS_STATE_STACK_RUNNING)
-        && ! (GET_FLAGS(ZTS_STATE_FREE_CALLED))) {
-        SET_FLAGS(ZTS_STATE_NET_SERVICE_RUNNING);
-    }
-    else {
-        CLR_FLAGS(ZTS_STATE_NET_SERVICE_RUNNING);
+    Mutex::Lock _l(_state_m);
+    if (newFlags & ZTS_STATE_STACK_RUNNING) {
+        service_state &= ~ZTS_STATE_STACK_RUNNING;
     }
+    newFlags &= ~(ZTS_STATE_STACK_RUNNING | ZTS_STATE_NET_SERVICE_RUNNING);
+    bool was = zts_node_running(_state);
+    _state &= (uint8_t)~newFlags;
+    zts_count_node(was, zts_node_running(_state));
+    zts_update_service_state();
 }
 
 bool Events::getState(uint8_t testFlags)
 {
-    return testFlags & service_state;
+    return testFlags & (_state | service_state);
+}
+
+void Events::setStackState(bool running)
+{
+    Mutex::Lock _l(_state_m);
+    if (running) {
+        service_state |= ZTS_STATE_STACK_RUNNING;
+    }
+    else {
+        service_state &= ~ZTS_STATE_STACK_RUNNING;
+    }
+    zts_update_service_state();
 }
 
 void Events::enable()
@@ -20,45 +20,45 @@
 #ifndef ZTS_USER_EVENTS_HPP
 #define ZTS_USER_EVENTS_HPP
 
+#include "Mutex.hpp"
 #include "ZeroTierSockets.h"
 
+#include <atomic>
+
 #ifdef __WINDOWS__
 #include <basetsd.h>
 #endif
 
 /* Macro substitutions to standardize state checking of service, node, callbacks, and TCP/IP
  * stack. These are used only for control functions that are called at a low frequency. All higher
- * frequency socket calls use unguarded state flags */
+ * frequency socket calls use unguarded state flags. Each acts on the calling thread's node
+ * instance, which is then available as _ctx */
 
 // Lock service and check that it is running
 #define ACQUIRE_SERVICE(x)                                                                                             \
-    Mutex::Lock _ls(service_m);                                                                                        \
-    if (! zts_service || ! zts_service->isRunning()) {                                                                 \
+    zts_ctx* _ctx = zts_ctx_current();                                                                                 \
+    Mutex::Lock _ls(_ctx->service_m);                                                                                  \
+    if (! _ctx->service || ! _ctx->service->isRunning()) {                                                             \
         return x;                                                                                                      \
     }
 // Lock service and check that it is not currently running
 #define ACQUIRE_SERVICE_OFFLINE()                                                                                      \
-    Mutex::Lock _ls(service_m);                                                                                        \
-    if (zts_service && zts_service->isRunning()) {                                                                     \
+    zts_ctx* _ctx = zts_ctx_current();                                                                                 \
+    Mutex::Lock _ls(_ctx->service_m);                                                                                  \
+    if (_ctx->service && _ctx->service->isRunning()) {                                                                 \
         return ZTS_ERR_SERVICE;                                                                                        \
     }                                                                                                                  \
-    if (! zts_service) {                                                                                               \
-        init_subsystems();                                                                                             \
+    if (! _ctx->service && init_subsystems(_ctx) != ZTS_ERR_OK) {                                                      \
+        return ZTS_ERR_SERVICE;                                                                                        \
     }
 // Unlock service
-#define RELEASE_SERVICE() service_m.unlock();
+#define RELEASE_SERVICE() _ctx->service_m.unlock();
 // Lock service, ensure node is online
 #define ACQUIRE_ONLINE_NODE()                                                                                          \
-    ACQUIRE_SERVICE() if (! zts_service->nodeIsOnline())                                                               \
+    ACQUIRE_SERVICE() if (! _ctx->service->nodeIsOnline())                                                             \
     {                                                                                                                  \
         return ZTS_ERR_SERVICE;                                                                                        \
     }
-// Lock event callback
-#define ACQUIRE_EVENTS()                                                                                               \
-    Mutex::Lock _lc(events_m);                                                                                         \
-    if (! zts_events) {                                                                                                \
-        return ZTS_ERR_SERVICE;                                                                                        \
-    }
 
 namespace ZeroTier {
 
@@ -90,13 +90,30 @@ inline int transport_ok()
  */
 #define ZTS_CALLBACK_PROCESSING_INTERVAL 25
 
+/**
+ * Default number of event messages that may wait for the user's callback
+ */
+#define ZTS_CALLBACK_QUEUE_LIMIT 1024
+
+struct zts_event_queue;
+
+/**
+ * Events of one node instance. The TCP/IP stack is shared by all instances,
+ * so its state flag is process-wide; the other flags belong to the instance
+ */
 class Events {
     bool _enabled;
+    zts_event_queue* _queue;
+    std::atomic<unsigned int> _queueLimit;
+    std::atomic<uint8_t> _state;
+    Mutex _callback_m;   // Guards the callback and its invocation
+#if defined(ZTS_ENABLE_PINVOKE) || defined(ZTS_C_API_ONLY)
+    void (*_callback)(void*);
+#endif
 
   public:
-    Events() : _enabled(false)
-    {
-    }
+    Events();
+    ~Events();
 
     /**
      * Perform one iteration of callback processing
@@ -122,6 +139,12 @@ class Events {
      */
     bool enqueue(unsigned int event_code, const void* arg, int len = 0);
 
+    /**
+     * Set how many event messages may wait for the user's callback before
+     * further ones are dropped
+     */
+    void setQueueLimit(unsigned int limit);
+
     /**
      * Send callback message to user application
      */
@@ -136,6 +159,10 @@ class Events {
     void setJavaCallback(jobject objRef, jmethodID methodId);
 #endif
 
+#if defined(ZTS_ENABLE_PINVOKE) || defined(ZTS_C_API_ONLY)
+    void setCallback(void (*callback)(void*));
+#endif
+
     /**
      * Return whether a callback method has been set
      */
@@ -146,11 +173,6 @@ class Events {
      */
     void clrCallback();
 
-    /**
-     * Return whether service operation can be performed at this time
-     */
-    int canPerformServiceOperation();
-
     /**
      * Set internal state flags
      */
@@ -165,6 +187,19 @@ class Events {
      * Get internal state flags
      */
     bool getState(uint8_t testFlags);
+
+    /**
+     * Set whether the shared TCP/IP stack is running
+     */
+    static void setStackState(bool running);
+
+    /**
+     * Return whether the shared TCP/IP stack is running
+     */
+    static bool stackIsRunning()
+    {
+        return service_state & ZTS_STATE_STACK_RUNNING;
+    }
 };
 
 }   // namespace ZeroTier
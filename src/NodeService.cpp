@@ -17,6 +17,9 @@
  * ZeroTier Node Service
  */
 
+#include <algorithm>
+#include <errno.h>
+#include <set>
 #include <stdlib.h>
 
 #include "NodeService.hpp"
@@ -25,6 +28,8 @@
 #include "InetAddress.hpp"
 #include "Mutex.hpp"
 #include "Node.hpp"
+#include "Slab.h"
+#include "SocketBuffers.hpp"
 #include "Utilities.hpp"
 #include "VirtualTap.hpp"
 
@@ -39,8 +44,25 @@
 
 #define ZT_TCP_FALLBACK_RELAY "204.80.128.1/443"
 
+// Maximum number of bytes queued in the TCP fallback tunnel's send buffer
+#define ZT_TCP_FALLBACK_MAX_WRITEQ (1024 * 64)
+
 namespace ZeroTier {
 
+/**
+ * Whether the last failed underlay send failed because the socket's send
+ * buffer is full (as opposed to e.g. the destination being unreachable)
+ */
+static bool zts_underlay_send_would_block()
+{
+#if defined(__WINDOWS__)
+    int e = WSAGetLastError();
+    return e == WSAEWOULDBLOCK || e == WSAENOBUFS;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS;
+#endif
+}
+
 static int SnodeVirtualNetworkConfigFunction(
     ZT_Node* node,
     void* uptr,
@@ -184,6 +206,7 @@ NodeService::NodeService()
     , _lastRestart(0)
     , _nextBackgroundTaskDeadline(0)
     , _run(false)
+    , _terminated(false)
     , _termReason(ONE_STILL_RUNNING)
     , _allowPortMapping(true)
 #ifdef ZT_USE_MINIUPNPC
@@ -194,6 +217,10 @@ NodeService::NodeService()
     , _allowPeerCaching(true)
     , _allowIdentityCaching(true)
     , _allowRootSetCaching(true)
+    , _peerLossPolicy(ZTS_PEER_LOSS_POLICY_NONE)
+    , _allowRxCoalescing(true)
+    , _memoryProfile(ZTS_PROFILE_DEFAULT)
+    , _memoryBudget(0)
     , _userDefinedWorld(false)
     , _nodeIsOnline(false)
     , _eventsEnabled(false)
@@ -210,9 +237,47 @@ NodeService::~NodeService()
 #endif
 }
 
+/**
+ * Sizing selected by a memory profile (zts_memory_profile_t), 0 = default
+ */
+struct zts_memory_profile {
+    uint64_t budget;            // Memory budget
+    unsigned int rcvbuf;        // TCP receive window of sockets without SO_RCVBUF
+    uint32_t slab_size;         // Bytes per slab of stack memory
+    uint32_t slab_cache;        // Bytes of free stack objects per size class a thread may cache
+    unsigned int event_queue;   // Event messages that may wait for the callback
+};
+
+static const zts_memory_profile _memoryProfiles[] = {
+    // ZTS_PROFILE_DEFAULT: sizing as compiled
+    { 0, 0, 0, 0, ZTS_CALLBACK_QUEUE_LIMIT },
+    // ZTS_PROFILE_SMALL
+    { 4 * 1024 * 1024, 0x10000, 64 * 1024, 8 * 1024, 64 },
+    // ZTS_PROFILE_THROUGHPUT: fewer trips to the shared depot
+    { 0, 0, 1024 * 1024, 256 * 1024, ZTS_CALLBACK_QUEUE_LIMIT },
+};
+
 NodeService::ReasonForTermination NodeService::run()
 {
-    _run = true;
+    {
+        // A node stopped before its thread got here must not start
+        Mutex::Lock _lr(_run_m);
+        if (_terminated) {
+            Mutex::Lock _lt(_termReason_m);
+            _termReason = ONE_NORMAL_TERMINATION;
+            return _termReason;
+        }
+        _run = true;
+    }
+    // The stack is shared by all node instances, the one started last sets it up
+    zts_lwip_set_rx_coalescing(_allowRxCoalescing);
+    const zts_memory_profile& mp = _memoryProfiles[_memoryProfile];
+    zts_mem_set_budget(_memoryBudget ? _memoryBudget : mp.budget);
+    zts_sockbuf_set_default_rcvbuf(mp.rcvbuf);
+    zts_slab_tune(mp.slab_size, mp.slab_cache);
+    if (_events) {
+        _events->setQueueLimit(mp.event_queue);
+    }
     try {
         // Create home path (if necessary)
         // By default, _homePath is empty and nothing is written to storage
@@ -499,6 +564,7 @@ NodeService::ReasonForTermination NodeService::run()
             const unsigned long delay = (dl > now) ? (unsigned long)(dl - now) : 100;
             clockShouldBe = now + (uint64_t)delay;
             _phy.poll(delay);
+            zts_lwip_rx_flush();
         }
     }
     catch (std::exception& e) {
@@ -515,6 +581,7 @@ NodeService::ReasonForTermination NodeService::run()
     {
         Mutex::Lock _l(_nets_m);
         for (std::map<uint64_t, NetworkState>::iterator n(_nets.begin()); n != _nets.end(); ++n) {
+            forgetTap(n->second.tap);
             delete n->second.tap;
         }
         _nets.clear();
@@ -551,6 +618,7 @@ void NodeService::terminate()
 {
     _run_m.lock();
     _run = false;
+    _terminated = true;
     _run_m.unlock();
     _nodeId = 0x0;
     _primaryPort = 0;
@@ -559,6 +627,10 @@ void NodeService::terminate()
     _allowPeerCaching = true;
     _allowIdentityCaching = true;
     _allowRootSetCaching = true;
+    _peerLossPolicy = ZTS_PEER_LOSS_POLICY_NONE;
+    _allowRxCoalescing = true;
+    _memoryProfile = ZTS_PROFILE_DEFAULT;
+    _memoryBudget = 0;
     memset(_publicIdStr, 0, ZT_IDENTITY_STRING_BUFFER_LENGTH);
     memset(_secretIdStr, 0, ZT_IDENTITY_STRING_BUFFER_LENGTH);
     _interfacePrefixBlacklist.clear();
@@ -584,7 +656,10 @@ void NodeService::syncManagedStuff(NetworkState& n)
                 fprintf(stderr, "ERROR: unable to remove ip address %s" ZT_EOL_S, ip->toString(ipbuf));
             }
             else {
-                zts_addr_info_t* ad = new zts_addr_info_t();
+                zts_addr_info_t* ad = zts_mem_new<zts_addr_info_t>(ZTS_ALLOC_EVENTS);
+                if (! ad) {
+                    continue;
+                }
                 ad->net_id = n.tap->_net_id;
                 if ((*ip).isV4()) {
                     struct sockaddr_in* in4 = (struct sockaddr_in*)&(ad->addr);
@@ -607,7 +682,10 @@ void NodeService::syncManagedStuff(NetworkState& n)
                 fprintf(stderr, "ERROR: unable to add ip address %s" ZT_EOL_S, ip->toString(ipbuf));
             }
             else {
-                zts_addr_info_t* ad = new zts_addr_info_t();
+                zts_addr_info_t* ad = zts_mem_new<zts_addr_info_t>(ZTS_ALLOC_EVENTS);
+                if (! ad) {
+                    continue;
+                }
                 ad->net_id = n.tap->_net_id;
                 if ((*ip).isV4()) {
                     struct sockaddr_in* in4 = (struct sockaddr_in*)&(ad->addr);
@@ -692,6 +770,7 @@ void NodeService::phyOnTcpClose(PhySocket* sock, void** uptr)
     if (tc) {
         if (tc == _tcpFallbackTunnel) {
             _tcpFallbackTunnel = (TcpConnection*)0;
+            reportUnderlayState(0, false);
         }
         {
             Mutex::Lock _l(_tcpConnections_m);
@@ -834,6 +913,9 @@ void NodeService::phyOnTcpWritable(PhySocket* sock, void** uptr)
                     tc->writeq.erase(tc->writeq.begin(), tc->writeq.begin() + sent);
                 }
             }
+            if (tc == _tcpFallbackTunnel) {
+                reportUnderlayState((unsigned int)tc->writeq.length(), false);
+            }
         }
         else {
             _phy.setNotifyWritable(sock, false);
@@ -844,6 +926,21 @@ void NodeService::phyOnTcpWritable(PhySocket* sock, void** uptr)
     }
 }
 
+void NodeService::reportUnderlayState(unsigned int queued, bool failed)
+{
+    // Not under _nets_m: this runs inside the node, which threads holding _nets_m may be waiting for
+    Mutex::Lock _l(_taps_m);
+    for (std::vector<VirtualTap*>::iterator t(_taps.begin()); t != _taps.end(); ++t) {
+        (*t)->setUnderlayState(queued, failed);
+    }
+}
+
+void NodeService::forgetTap(VirtualTap* tap)
+{
+    Mutex::Lock _l(_taps_m);
+    _taps.erase(std::remove(_taps.begin(), _taps.end(), tap), _taps.end());
+}
+
 int NodeService::nodeVirtualNetworkConfigFunction(
     uint64_t net_id,
     void** nuptr,
@@ -866,6 +963,8 @@ int NodeService::nodeVirtualNetworkConfigFunction(
                     (void*)this);
                 *nuptr = (void*)&n;
                 n.tap->setUserEventSystem(_events);
+                Mutex::Lock _lt(_taps_m);
+                _taps.push_back(n.tap);
             }
             // After setting up tap, fall through to CONFIG_UPDATE since we
             // also want to do this...
@@ -888,6 +987,7 @@ int NodeService::nodeVirtualNetworkConfigFunction(
             sendEventToUser(ZTS_EVENT_NETWORK_DOWN, (void*)&n);
             if (n.tap) {   // sanity check
                 *nuptr = (void*)0;
+                forgetTap(n.tap);
                 delete n.tap;
                 _nets.erase(net_id);
                 if (_allowNetworkCaching) {
@@ -966,7 +1066,9 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
         case ZTS_EVENT_NODE_OFFLINE:
         case ZTS_EVENT_NODE_DOWN:
         case ZTS_EVENT_NODE_FATAL_ERROR: {
-            nd = new zts_node_info_t;
+            if (! (nd = zts_mem_new<zts_node_info_t>(ZTS_ALLOC_EVENTS))) {
+                break;
+            }
             nd->node_id = _nodeId;
             nd->ver_major = ZEROTIER_ONE_VERSION_MAJOR;
             nd->ver_minor = ZEROTIER_ONE_VERSION_MINOR;
@@ -983,7 +1085,9 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
         case ZTS_EVENT_NETWORK_ACCESS_DENIED:
         case ZTS_EVENT_NETWORK_DOWN: {
             NetworkState* ns = (NetworkState*)obj;
-            nt = new zts_net_info_t();
+            if (! (nt = zts_mem_new<zts_net_info_t>(ZTS_ALLOC_EVENTS))) {
+                break;
+            }
             nt->net_id = ns->config.nwid;
             objptr = (void*)nt;
             break;
@@ -993,7 +1097,9 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
         case ZTS_EVENT_NETWORK_READY_IP6:
         case ZTS_EVENT_NETWORK_OK: {
             NetworkState* ns = (NetworkState*)obj;
-            nt = new zts_net_info_t();
+            if (! (nt = zts_mem_new<zts_net_info_t>(ZTS_ALLOC_EVENTS))) {
+                break;
+            }
             nt->net_id = ns->config.nwid;
             nt->mac = ns->config.mac;
             strncpy(nt->name, ns->config.name, sizeof(ns->config.name));
@@ -1054,7 +1160,9 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
         case ZTS_EVENT_PEER_UNREACHABLE:
         case ZTS_EVENT_PEER_PATH_DISCOVERED:
         case ZTS_EVENT_PEER_PATH_DEAD: {
-            pr = new zts_peer_info_t();
+            if (! (pr = zts_mem_new<zts_peer_info_t>(ZTS_ALLOC_EVENTS))) {
+                break;
+            }
             ZT_Peer* peer = (ZT_Peer*)obj;
             memcpy(pr, peer, sizeof(zts_peer_info_t));
             for (unsigned int j = 0; j < peer->pathCount; j++) {
@@ -1080,7 +1188,7 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
                 case ZTS_EVENT_NODE_OFFLINE:
                 case ZTS_EVENT_NODE_DOWN:
                 case ZTS_EVENT_NODE_FATAL_ERROR: {
-                    delete nd;
+                    zts_mem_delete(nd);
                     break;
                 }
                 case ZTS_EVENT_NETWORK_NOT_FOUND:
@@ -1088,24 +1196,23 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
                 case ZTS_EVENT_NETWORK_REQ_CONFIG:
                 case ZTS_EVENT_NETWORK_ACCESS_DENIED:
                 case ZTS_EVENT_NETWORK_DOWN: {
-                    delete nt;
+                    zts_mem_delete(nt);
                     break;
                 }
                 case ZTS_EVENT_NETWORK_UPDATE:
                 case ZTS_EVENT_NETWORK_READY_IP4:
                 case ZTS_EVENT_NETWORK_READY_IP6:
                 case ZTS_EVENT_NETWORK_OK: {
-                    delete nt;
+                    zts_mem_delete(nt);
                     break;
                 }
                 case ZTS_EVENT_ADDR_ADDED_IP4:
-                    break;
                 case ZTS_EVENT_ADDR_ADDED_IP6:
-                    break;
                 case ZTS_EVENT_ADDR_REMOVED_IP4:
+                case ZTS_EVENT_ADDR_REMOVED_IP6: {
+                    zts_mem_delete((zts_addr_info_t*)objptr);
                     break;
-                case ZTS_EVENT_ADDR_REMOVED_IP6:
-                    break;
+                }
                 case ZTS_EVENT_STORE_IDENTITY_PUBLIC:
                     break;
                 case ZTS_EVENT_STORE_IDENTITY_SECRET:
@@ -1121,7 +1228,7 @@ void NodeService::sendEventToUser(unsigned int zt_event_code, const void* obj, u
                 case ZTS_EVENT_PEER_UNREACHABLE:
                 case ZTS_EVENT_PEER_PATH_DISCOVERED:
                 case ZTS_EVENT_PEER_PATH_DEAD: {
-                    delete pr;
+                    zts_mem_delete(pr);
                     break;
                 }
                 default:
@@ -1138,43 +1245,46 @@ void NodeService::generateSyntheticEvents()
     if (! _node->online() || ! zts_lwip_is_up()) {
         return;
     }
-    // Generate messages to be dequeued by the callback message thread
-    Mutex::Lock _l(_nets_m);
-    for (std::map<uint64_t, NetworkState>::iterator n(_nets.begin()); n != _nets.end(); ++n) {
-        auto netState = n->second;
-        int mostRecentStatus = netState.config.status;
-        VirtualTap* tap = netState.tap;
-        // uint64_t net_id = n->first;
-        if (netState.tap->_networkStatus == mostRecentStatus) {
-            continue;   // No state change
-        }
-        switch (mostRecentStatus) {
-            case ZT_NETWORK_STATUS_NOT_FOUND:
-                sendEventToUser(ZTS_EVENT_NETWORK_NOT_FOUND, (void*)&netState);
-                break;
-            case ZT_NETWORK_STATUS_CLIENT_TOO_OLD:
-                sendEventToUser(ZTS_EVENT_NETWORK_CLIENT_TOO_OLD, (void*)&netState);
-                break;
-            case ZT_NETWORK_STATUS_REQUESTING_CONFIGURATION:
-                sendEventToUser(ZTS_EVENT_NETWORK_REQ_CONFIG, (void*)&netState);
-                break;
-            case ZT_NETWORK_STATUS_OK:
-                if (tap->hasIpv4Addr() && zts_lwip_is_netif_up(tap->netif4)) {
-                    sendEventToUser(ZTS_EVENT_NETWORK_READY_IP4, (void*)&netState);
-                }
-                if (tap->hasIpv6Addr() && zts_lwip_is_netif_up(tap->netif6)) {
-                    sendEventToUser(ZTS_EVENT_NETWORK_READY_IP6, (void*)&netState);
-                }
-                // In addition to the READY messages, send one OK message
-                sendEventToUser(ZTS_EVENT_NETWORK_OK, (void*)&netState);
-                break;
-            case ZT_NETWORK_STATUS_ACCESS_DENIED:
-                sendEventToUser(ZTS_EVENT_NETWORK_ACCESS_DENIED, (void*)&netState);
-                break;
-            default:
-                break;
+    // Generate messages to be dequeued by the callback message thread.
+    // The lock is not held below, reacting to path changes may send frames through the node
+    {
+        Mutex::Lock _l(_nets_m);
+        for (std::map<uint64_t, NetworkState>::iterator n(_nets.begin()); n != _nets.end(); ++n) {
+            auto netState = n->second;
+            int mostRecentStatus = netState.config.status;
+            VirtualTap* tap = netState.tap;
+            // uint64_t net_id = n->first;
+            if (netState.tap->_networkStatus == mostRecentStatus) {
+                continue;   // No state change
+            }
+            switch (mostRecentStatus) {
+                case ZT_NETWORK_STATUS_NOT_FOUND:
+                    sendEventToUser(ZTS_EVENT_NETWORK_NOT_FOUND, (void*)&netState);
+                    break;
+                case ZT_NETWORK_STATUS_CLIENT_TOO_OLD:
+                    sendEventToUser(ZTS_EVENT_NETWORK_CLIENT_TOO_OLD, (void*)&netState);
+                    break;
+                case ZT_NETWORK_STATUS_REQUESTING_CONFIGURATION:
+                    sendEventToUser(ZTS_EVENT_NETWORK_REQ_CONFIG, (void*)&netState);
+                    break;
+                case ZT_NETWORK_STATUS_OK:
+                    if (tap->hasIpv4Addr() && zts_lwip_is_netif_up(tap->netif4)) {
+                        sendEventToUser(ZTS_EVENT_NETWORK_READY_IP4, (void*)&netState);
+                    }
+                    if (tap->hasIpv6Addr() && zts_lwip_is_netif_up(tap->netif6)) {
+                        sendEventToUser(ZTS_EVENT_NETWORK_READY_IP6, (void*)&netState);
+                    }
+                    // In addition to the READY messages, send one OK message
+                    sendEventToUser(ZTS_EVENT_NETWORK_OK, (void*)&netState);
+                    break;
+                case ZT_NETWORK_STATUS_ACCESS_DENIED:
+                    sendEventToUser(ZTS_EVENT_NETWORK_ACCESS_DENIED, (void*)&netState);
+                    break;
+                default:
+                    break;
+            }
+            netState.tap->_networkStatus = mostRecentStatus;
         }
-        netState.tap->_networkStatus = mostRecentStatus;
     }
     ZT_PeerList* pl = _node->peers();
     if (pl) {
@@ -1191,9 +1301,15 @@ void NodeService::generateSyntheticEvents()
             else {   // Previously known peer, update status
                 if (peerCache[pl->peers[i].address] < pl->peers[i].pathCount) {
                     sendEventToUser(ZTS_EVENT_PEER_PATH_DISCOVERED, (void*)&(pl->peers[i]));
+                    if (_peerLossPolicy != ZTS_PEER_LOSS_POLICY_NONE) {
+                        zts_lwip_peer_path_changed(pl->peers[i].address, false);
+                    }
                 }
                 if (peerCache[pl->peers[i].address] > pl->peers[i].pathCount) {
                     sendEventToUser(ZTS_EVENT_PEER_PATH_DEAD, (void*)&(pl->peers[i]));
+                    if (_peerLossPolicy != ZTS_PEER_LOSS_POLICY_NONE) {
+                        zts_lwip_peer_path_changed(pl->peers[i].address, false);
+                    }
                 }
                 if (peerCache[pl->peers[i].address] == 0 && pl->peers[i].pathCount > 0) {
                     sendEventToUser(ZTS_EVENT_PEER_DIRECT, (void*)&(pl->peers[i]));
@@ -1205,10 +1321,55 @@ void NodeService::generateSyntheticEvents()
             // Update our cache with most recently observed path count
             peerCache[pl->peers[i].address] = pl->peers[i].pathCount;
         }
+        checkPeerReachability(pl);
     }
     _node->freeQueryResult((void*)pl);
 }
 
+void NodeService::checkPeerReachability(ZT_PeerList* pl)
+{
+    // Peers without a direct path are still reached through a root that has one
+    bool relay = false;
+    for (unsigned long i = 0; i < pl->peerCount; ++i) {
+        if (pl->peers[i].role != ZT_PEER_ROLE_LEAF && pl->peers[i].pathCount > 0) {
+            relay = true;
+        }
+    }
+    bool reset = _peerLossPolicy == ZTS_PEER_LOSS_POLICY_RESET;
+    int64_t now = OSUtils::now();
+    std::set<uint64_t> listed;
+    for (unsigned long i = 0; i < pl->peerCount; ++i) {
+        uint64_t address = pl->peers[i].address;
+        listed.insert(address);
+        if (pl->peers[i].pathCount > 0 || relay) {
+            _peerUnreachableSince.erase(address);
+            continue;
+        }
+        std::map<uint64_t, int64_t>::iterator u(_peerUnreachableSince.find(address));
+        if (u == _peerUnreachableSince.end()) {
+            _peerUnreachableSince[address] = now;
+        }
+        else if (u->second >= 0 && now - u->second >= ZTS_PEER_LOSS_GRACE_PERIOD) {
+            if (reset) {
+                zts_lwip_peer_path_changed(address, true);
+            }
+            u->second = -1;   // Once, until the peer is reachable again
+        }
+    }
+    // Peers the node has forgotten are gone for good
+    for (std::map<uint64_t, unsigned int>::iterator p(peerCache.begin()); p != peerCache.end();) {
+        if (listed.count(p->first)) {
+            ++p;
+            continue;
+        }
+        if (reset) {
+            zts_lwip_peer_path_changed(p->first, true);
+        }
+        _peerUnreachableSince.erase(p->first);
+        peerCache.erase(p++);
+    }
+}
+
 int NodeService::join(uint64_t net_id)
 {
     if (! net_id) {
@@ -1736,7 +1897,10 @@ int NodeService::nodeWirePacketSendFunction(
                         bool flushNow = false;
                         {
                             Mutex::Lock _l(_tcpFallbackTunnel->writeq_m);
-                            if (_tcpFallbackTunnel->writeq.size() < (1024 * 64)) {
+                            if (_tcpFallbackTunnel->writeq.size() >= ZT_TCP_FALLBACK_MAX_WRITEQ) {
+                                reportUnderlayState((unsigned int)_tcpFallbackTunnel->writeq.size(), true);
+                            }
+                            else {
                                 if (_tcpFallbackTunnel->writeq.length() == 0) {
                                     _phy.setNotifyWritable(_tcpFallbackTunnel->sock, true);
                                     flushNow = true;
@@ -1757,6 +1921,7 @@ int NodeService::nodeWirePacketSendFunction(
                                         &(reinterpret_cast<const struct sockaddr_in*>(addr)->sin_port))),
                                     2);
                                 _tcpFallbackTunnel->writeq.append((const char*)data, len);
+                                reportUnderlayState((unsigned int)_tcpFallbackTunnel->writeq.size(), false);
                             }
                         }
                         if (flushNow) {
@@ -1801,12 +1966,19 @@ int NodeService::nodeWirePacketSendFunction(
         if ((ttl) && (addr->ss_family == AF_INET))
             _phy.setIp4UdpTtl((PhySocket*)((uintptr_t)localSocket), ttl);
         const bool r = _phy.udpSend((PhySocket*)((uintptr_t)localSocket), (const struct sockaddr*)addr, data, len);
+        if (! r && zts_underlay_send_would_block()) {
+            reportUnderlayState(0, true);
+        }
         if ((ttl) && (addr->ss_family == AF_INET))
             _phy.setIp4UdpTtl((PhySocket*)((uintptr_t)localSocket), 255);
         return ((r) ? 0 : -1);
     }
     else {
-        return ((_binder.udpSendAll(_phy, addr, data, len, ttl)) ? 0 : -1);
+        const bool r = _binder.udpSendAll(_phy, addr, data, len, ttl);
+        if (! r && zts_underlay_send_would_block()) {
+            reportUnderlayState(0, true);
+        }
+        return ((r) ? 0 : -1);
     }
 }
 
@@ -2284,6 +2456,56 @@ int NodeService::allowRootSetCaching(unsigned int allowed)
     _allowRootSetCaching = allowed;
     return ZTS_ERR_OK;
 }
+
+int NodeService::setPeerLossPolicy(int policy)
+{
+    if (policy < ZTS_PEER_LOSS_POLICY_NONE || policy > ZTS_PEER_LOSS_POLICY_RESET) {
+        return ZTS_ERR_ARG;
+    }
+    Mutex::Lock _lr(_run_m);
+    if (_run) {
+        return ZTS_ERR_SERVICE;
+    }
+    _peerLossPolicy = policy;
+    return ZTS_ERR_OK;
+}
+
+int NodeService::allowRxCoalescing(unsigned int allowed)
+{
+    Mutex::Lock _lr(_run_m);
+    if (_run) {
+        return ZTS_ERR_SERVICE;
+    }
+    _allowRxCoalescing = allowed;
+    return ZTS_ERR_OK;
+}
+
+int NodeService::setMemoryProfile(int profile)
+{
+    if (profile < ZTS_PROFILE_DEFAULT || profile > ZTS_PROFILE_THROUGHPUT) {
+        return ZTS_ERR_ARG;
+    }
+    Mutex::Lock _lr(_run_m);
+    if (_run) {
+        return ZTS_ERR_SERVICE;
+    }
+    _memoryProfile = profile;
+    return ZTS_ERR_OK;
+}
+
+int NodeService::setMemoryBudget(uint64_t bytes)
+{
+    if (bytes && bytes < ZTS_MEM_BUDGET_MIN) {
+        return ZTS_ERR_ARG;
+    }
+    Mutex::Lock _lr(_run_m);
+    if (_run) {
+        return ZTS_ERR_SERVICE;
+    }
+    _memoryBudget = bytes;
+    return ZTS_ERR_OK;
+}
+
 int NodeService::getNetworkBroadcast(uint64_t net_id)
 {
     if (net_id == 0) {
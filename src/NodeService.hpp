@@ -22,6 +22,7 @@
 
 #define ZTS_UNUSED_ARG(x) (void)x
 
+#include "Allocator.hpp"
 #include "Binder.hpp"
 #include "Mutex.hpp"
 #include "Node.hpp"
@@ -70,10 +71,16 @@ class VirtualTap;
 class MAC;
 class Events;
 
+/**
+ * Buffer of a TCP connection, charged to ZTS_ALLOC_TUNNEL
+ */
+typedef std::basic_string<char, std::char_traits<char>, zts_mem_std_allocator<char, ZTS_ALLOC_TUNNEL> >
+    TcpConnectionBuffer;
+
 /**
  * A TCP connection and related state and buffers
  */
-struct TcpConnection {
+struct TcpConnection : public zts_mem_object<ZTS_ALLOC_TUNNEL> {
     enum {
         TCP_UNCATEGORIZED_INCOMING,   // uncategorized incoming connection
         TCP_HTTP_INCOMING,
@@ -86,8 +93,8 @@ struct TcpConnection {
     InetAddress remoteAddr;
     uint64_t lastReceive;
 
-    std::string readq;
-    std::string writeq;
+    TcpConnectionBuffer readq;
+    TcpConnectionBuffer writeq;
     Mutex writeq_m;
 };
 
@@ -164,6 +171,8 @@ class NodeService {
     volatile unsigned int _udpPortPickerCounter;
 
     std::map<uint64_t, unsigned int> peerCache;
+    // Peers with neither a direct path nor a relay, and since when (-1 once reset)
+    std::map<uint64_t, int64_t> _peerUnreachableSince;
 
     // Local configuration and memo-ized information from it
     Hashtable<uint64_t, std::vector<InetAddress> > _v4Hints;
@@ -234,12 +243,17 @@ class NodeService {
 
     /** Lock to control access to network configuration data */
     Mutex _nets_m;
+    /** Taps that are told about the underlay's send state, see reportUnderlayState() */
+    std::vector<VirtualTap*> _taps;
+    Mutex _taps_m;
     /** Lock to control access to storage data */
     Mutex _store_m;
     /** Lock to control access to service run state */
     Mutex _run_m;
     // Set to false to force service to stop
     volatile bool _run;
+    // terminate() was called, also before run() got to start
+    bool _terminated;
     /** Lock to control access to termination reason */
     Mutex _termReason_m;
     // Termination status information
@@ -259,6 +273,11 @@ class NodeService {
     uint8_t _allowIdentityCaching;
     uint8_t _allowRootSetCaching;
 
+    int _peerLossPolicy;
+    uint8_t _allowRxCoalescing;
+    int _memoryProfile;
+    uint64_t _memoryBudget;
+
     char _publicIdStr[ZT_IDENTITY_STRING_BUFFER_LENGTH] = { 0 };
     char _secretIdStr[ZT_IDENTITY_STRING_BUFFER_LENGTH] = { 0 };
 
@@ -316,6 +335,23 @@ class NodeService {
 
     void generateSyntheticEvents();
 
+    /**
+     * Pass the state of the underlay send path on to every tap, see
+     * VirtualTap::setUnderlayState()
+     */
+    void reportUnderlayState(unsigned int queued, bool failed);
+
+    /**
+     * Stop reporting to a tap that is about to be deleted
+     */
+    void forgetTap(VirtualTap* tap);
+
+    /**
+     * Track which peers can no longer be reached and, depending on the peer
+     * loss policy, reset their connections
+     */
+    void checkPeerReachability(ZT_PeerList* pl);
+
     void sendEventToUser(unsigned int zt_event_code, const void* obj, unsigned int len = 0);
 
     /** Join a network */
@@ -480,6 +516,18 @@ class NodeService {
     /** Allow ZeroTier to cache root definitions to storage */
     int allowRootSetCaching(unsigned int allowed);
 
+    /** Set how TCP connections react to path changes towards their peer */
+    int setPeerLossPolicy(int policy);
+
+    /** Allow merging of received TCP segments before they are input to the stack */
+    int allowRxCoalescing(unsigned int allowed);
+
+    /** Set how pools, windows and queues are sized when the node starts */
+    int setMemoryProfile(int profile);
+
+    /** Set a limit on the memory in use, 0 for the memory profile's */
+    int setMemoryBudget(uint64_t bytes);
+
     /** Return whether broadcast is enabled on the given network */
     int getNetworkBroadcast(uint64_t net_id);
 
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Packetization layer path MTU discovery for TCP (RFC 4821 style).
+ *
+ * ZeroTier carries frames of up to the network's MTU by splitting them into
+ * underlay packets of its physical MTU, so lwIP never has to fragment TCP
+ * segments itself. If a path nonetheless cannot carry full-size frames (e.g. a
+ * tunnel that drops rather than fragments), large segments disappear while
+ * handshakes and ACKs still get through, and the connection stalls in RTO
+ * backoff. Once the same large segment has been retransmitted
+ * ZTS_TCP_PMTU_BLACKHOLE_RTX times, the connection falls back to the largest
+ * segment size known to work (at first ZTS_TCP_PMTU_BASE_MSS). Larger sizes
+ * are then probed by binary search, one step per ZTS_TCP_PMTU_PROBE_INTERVAL,
+ * and the full range is searched again every ZTS_TCP_PMTU_RESET_INTERVAL in
+ * case the path has changed.
+ *
+ * The output hook only observes: pcb->mss must not change while lwIP is
+ * building or sending segments. A new size is applied from a zero-length
+ * timeout, i.e. right after the current output pass, where segments already
+ * queued (including unacknowledged ones, which a retransmission would resend
+ * as they are) are split down to it.
+ */
+
+#include "lwip/def.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/sys.h"
+#include "lwip/tcp.h"
+#include "lwip/timeouts.h"
+#include "lwiphooks.h"
+
+#include <new>
+
+// Segment size that every path is expected to carry: IPv6 minimum MTU minus headers
+#define ZTS_TCP_PMTU_BASE_MSS 1220
+
+// Retransmissions of the same large segment after which the path is considered unable to carry it
+#define ZTS_TCP_PMTU_BLACKHOLE_RTX 2
+
+// Time (ms) spent at a segment size before probing a larger one
+#define ZTS_TCP_PMTU_PROBE_INTERVAL 60000
+
+// Time (ms) after which sizes that failed before are probed again
+#define ZTS_TCP_PMTU_RESET_INTERVAL 600000
+
+// Search stops once the largest working and smallest failing size are this close
+#define ZTS_TCP_PMTU_SEARCH_STEP 64
+
+namespace ZeroTier {
+
+/**
+ * Search state of a connection, allocated when it first loses large segments
+ */
+struct zts_tcp_pmtu {
+    struct tcp_pcb* pcb;
+    u16_t max;           // MSS negotiated with the peer
+    u16_t good;          // Largest size known to work
+    u16_t bad;           // Smallest size known to fail
+    u16_t pending;       // Size waiting to be applied, 0 if none
+    u32_t changed_at;    // sys_now() of the last change of pcb->mss
+    u32_t failed_at;     // sys_now() of the last black hole
+};
+
+static u8_t _pmtu_id = LWIP_TCP_PCB_NUM_EXT_ARGS;   // Not yet allocated
+
+static void zts_tcp_pmtu_apply(void* arg);
+
+static void zts_tcp_pmtu_destroy(u8_t id, void* data)
+{
+    LWIP_UNUSED_ARG(id);
+    sys_untimeout(zts_tcp_pmtu_apply, data);
+    delete (zts_tcp_pmtu*)data;
+}
+
+static const struct tcp_ext_arg_callbacks _pmtu_callbacks = { zts_tcp_pmtu_destroy, NULL };
+
+/**
+ * Cut every segment on a queue that is longer than pcb->mss. lwIP's
+ * tcp_split_unsent_seg() splits the head of pcb->unsent, so each segment is
+ * made the head for the duration of the call. The remainder is inserted after
+ * the segment and checked in turn
+ */
+static void zts_tcp_pmtu_split(struct tcp_pcb* pcb, struct tcp_seg* seg)
+{
+    struct tcp_seg* unsent = pcb->unsent;
+    for (; seg; seg = seg->next) {
+        if (seg->len <= pcb->mss) {
+            continue;
+        }
+        pcb->unsent = seg;
+        err_t err = tcp_split_unsent_seg(pcb, pcb->mss);
+        pcb->unsent = unsent;
+        if (err != ERR_OK) {
+            break;   // Out of memory, the next change of size tries again
+        }
+    }
+}
+
+static void zts_tcp_pmtu_apply(void* arg)
+{
+    zts_tcp_pmtu* st = (zts_tcp_pmtu*)arg;
+    struct tcp_pcb* pcb = st->pcb;
+    u16_t mss = st->pending;
+    st->pending = 0;
+    if (! mss || pcb->state < ESTABLISHED || pcb->state == TIME_WAIT) {
+        return;
+    }
+    pcb->mss = mss;
+    /* tcp_write() appends to the last unsent segment assuming it is no longer
+    than pcb->mss, and retransmissions resend segments as they were built */
+    zts_tcp_pmtu_split(pcb, pcb->unacked);
+    zts_tcp_pmtu_split(pcb, pcb->unsent);
+}
+
+static void zts_tcp_pmtu_schedule(zts_tcp_pmtu* st, u16_t mss, u32_t now)
+{
+    if (! st->pending) {
+        sys_timeout(0, zts_tcp_pmtu_apply, st);
+    }
+    st->pending = mss;
+    st->changed_at = now;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+u32_t* zts_tcp_pmtu_output(const struct tcp_pcb* cpcb, struct tcp_hdr* hdr, u32_t* opts)
+{
+    if (! cpcb || cpcb->state < ESTABLISHED || cpcb->state == TIME_WAIT) {
+        return opts;
+    }
+    struct tcp_pcb* pcb = (struct tcp_pcb*)cpcb;
+    zts_tcp_pmtu* st = NULL;
+    if (_pmtu_id != LWIP_TCP_PCB_NUM_EXT_ARGS) {
+        st = (zts_tcp_pmtu*)tcp_ext_arg_get(pcb, _pmtu_id);
+    }
+    if (st && st->pending) {
+        return opts;
+    }
+    u32_t now = sys_now();
+    u16_t good = st ? st->good : ZTS_TCP_PMTU_BASE_MSS;
+    bool rexmit = TCP_SEQ_LT(lwip_ntohl(hdr->seqno), pcb->snd_nxt) && pcb->unsent
+                  && lwip_ntohl(pcb->unsent->tcphdr->seqno) == lwip_ntohl(hdr->seqno);
+    if (rexmit && pcb->nrtx >= ZTS_TCP_PMTU_BLACKHOLE_RTX && pcb->mss > good && pcb->unsent->len > good) {
+        if (! st) {
+            if (_pmtu_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+                _pmtu_id = tcp_ext_arg_alloc_id();
+            }
+            if (! (st = new (std::nothrow) zts_tcp_pmtu())) {
+                return opts;
+            }
+            st->pcb = pcb;
+            st->max = pcb->mss;
+            st->good = ZTS_TCP_PMTU_BASE_MSS;
+            st->pending = 0;
+            tcp_ext_arg_set_callbacks(pcb, _pmtu_id, &_pmtu_callbacks);
+            tcp_ext_arg_set(pcb, _pmtu_id, st);
+        }
+        st->bad = pcb->mss;
+        st->failed_at = now;
+        zts_tcp_pmtu_schedule(st, st->good, now);
+        return opts;
+    }
+    if (! st || now - st->changed_at < ZTS_TCP_PMTU_PROBE_INTERVAL) {
+        return opts;
+    }
+    // The current size survived a whole interval
+    st->good = LWIP_MAX(st->good, pcb->mss);
+    if (st->bad <= st->max && now - st->failed_at >= ZTS_TCP_PMTU_RESET_INTERVAL) {
+        st->bad = (u16_t)(st->max + 1);   // Search up to the negotiated MSS again
+    }
+    if (st->bad - st->good > ZTS_TCP_PMTU_SEARCH_STEP) {
+        zts_tcp_pmtu_schedule(st, (u16_t)LWIP_MIN((st->good + st->bad) / 2, st->max), now);
+    }
+    return opts;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
@@ -0,0 +1,225 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Hashed PCB lookup for tcp_input() and udp_input().
+ *
+ * lwIP finds the PCB of an incoming segment by walking tcp_active_pcbs (or
+ * udp_pcbs), so the cost per packet grows with the number of connections.
+ * The lwIP sources are patched at build time (ext/lwip-patches) with lookup
+ * hooks that are tried before the walk:
+ *
+ * TCP: connections are kept in a table hashed on their 4-tuple. A connection
+ * is entered when its first segment has been found by walking the list (from
+ * the packet input hook) and leaves the table when lwIP frees its PCB (TCP ext
+ * arg destroy callback). A hit is checked against the segment exactly like
+ * the walk would check it; anything else falls back to the walk. Listening
+ * and TIME_WAIT PCBs keep their list lookup, there are few of them and they
+ * only see connection setup and teardown.
+ *
+ * UDP: PCBs are indexed by local port from udp_bind() and udp_remove(). When a
+ * port is bound by a single PCB, lwIP checks that one instead of walking the
+ * list. Ports shared by several PCBs (SO_REUSEADDR, per-address binds) are
+ * walked as before since which one gets a datagram depends on list order.
+ *
+ * Everything here runs with the core lock held.
+ */
+
+#include "lwip/def.h"
+#include "lwip/ip_addr.h"
+#include "lwip/netif.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/prot/tcp.h"
+#include "lwip/tcp.h"
+#include "lwip/udp.h"
+#include "lwiphooks.h"
+
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+// Smallest number of TCP hash buckets, the table grows with ZTS_MAX_SOCKETS
+#define ZTS_PCB_HASH_MIN_BUCKETS 256
+
+namespace ZeroTier {
+
+/**
+ * Table entry of a TCP connection, stored in its PCB's ext arg
+ */
+struct zts_pcb_entry {
+    struct tcp_pcb* pcb;
+    zts_pcb_entry* next;
+    u32_t bucket;
+};
+
+static std::vector<zts_pcb_entry*> _tcp_buckets;
+static u8_t _lookup_id = LWIP_TCP_PCB_NUM_EXT_ARGS;   // Not yet allocated
+
+// PCBs bound to each UDP port
+static std::unordered_map<u16_t, std::vector<struct udp_pcb*> > _udp_ports;
+
+static inline u32_t zts_pcb_addr_hash(const ip_addr_t* addr)
+{
+#if LWIP_IPV6
+    if (IP_IS_V6(addr)) {
+        const u32_t* a = ip_2_ip6(addr)->addr;
+        return a[0] ^ a[1] ^ a[2] ^ a[3];
+    }
+#endif
+    return ip4_addr_get_u32(ip_2_ip4(addr));
+}
+
+static u32_t zts_pcb_hash(const ip_addr_t* local_ip, u16_t local_port, const ip_addr_t* remote_ip, u16_t remote_port)
+{
+    // Multiplicative mix of the addresses, then the ports, then a shift-add finalizer
+    u32_t h = zts_pcb_addr_hash(remote_ip) * 0x9E3779B1U;
+    h ^= zts_pcb_addr_hash(local_ip) + 0x7F4A7C15U + (h << 6) + (h >> 2);
+    h ^= ((u32_t)remote_port << 16) | local_port;
+    h += (h << 3);
+    h ^= (h >> 11);
+    h += (h << 15);
+    return h & (u32_t)(_tcp_buckets.size() - 1);
+}
+
+static void zts_pcb_unlink(zts_pcb_entry* e)
+{
+    zts_pcb_entry** pp = &_tcp_buckets[e->bucket];
+    while (*pp && *pp != e) {
+        pp = &(*pp)->next;
+    }
+    if (*pp) {
+        *pp = e->next;
+    }
+}
+
+static void zts_pcb_destroy(u8_t id, void* data)
+{
+    LWIP_UNUSED_ARG(id);
+    if (data) {
+        zts_pcb_unlink((zts_pcb_entry*)data);
+        delete (zts_pcb_entry*)data;
+    }
+}
+
+static const struct tcp_ext_arg_callbacks _lookup_callbacks = { zts_pcb_destroy, NULL };
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void zts_tcp_lookup_input(struct tcp_pcb* pcb)
+{
+    if (pcb->state == LISTEN || pcb->state == TIME_WAIT || pcb->state == CLOSED) {
+        return;
+    }
+    if (_lookup_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+        _lookup_id = tcp_ext_arg_alloc_id();
+    }
+    if (tcp_ext_arg_get(pcb, _lookup_id)) {
+        return;
+    }
+    if (_tcp_buckets.empty()) {
+        size_t n = ZTS_PCB_HASH_MIN_BUCKETS;
+        while (n < NUM_SOCKETS) {
+            n <<= 1;
+        }
+        _tcp_buckets.assign(n, NULL);
+    }
+    zts_pcb_entry* e = new (std::nothrow) zts_pcb_entry();
+    if (! e) {
+        return;   // Found by walking the list instead
+    }
+    e->pcb = pcb;
+    e->bucket = zts_pcb_hash(&pcb->local_ip, pcb->local_port, &pcb->remote_ip, pcb->remote_port);
+    e->next = _tcp_buckets[e->bucket];
+    _tcp_buckets[e->bucket] = e;
+    tcp_ext_arg_set_callbacks(pcb, _lookup_id, &_lookup_callbacks);
+    tcp_ext_arg_set(pcb, _lookup_id, e);
+}
+
+struct tcp_pcb*
+zts_tcp_lookup(const struct tcp_hdr* hdr, const ip_addr_t* src, const ip_addr_t* dest, struct netif* inp)
+{
+    if (_tcp_buckets.empty()) {
+        return NULL;
+    }
+    // Ports in hdr have already been converted to host byte order by tcp_input()
+    for (zts_pcb_entry* e = _tcp_buckets[zts_pcb_hash(dest, hdr->dest, src, hdr->src)]; e; e = e->next) {
+        struct tcp_pcb* pcb = e->pcb;
+        if (pcb->remote_port == hdr->src && pcb->local_port == hdr->dest && ip_addr_cmp(&pcb->remote_ip, src)
+            && ip_addr_cmp(&pcb->local_ip, dest)) {
+            // Same checks as the walk over tcp_active_pcbs
+            if (pcb->state == LISTEN || pcb->state == TIME_WAIT || pcb->state == CLOSED
+                || (pcb->netif_idx != NETIF_NO_INDEX && pcb->netif_idx != netif_get_index(inp))) {
+                return NULL;
+            }
+            return pcb;
+        }
+    }
+    return NULL;
+}
+
+void zts_udp_lookup_bind(struct udp_pcb* pcb, u16_t port)
+{
+    if (pcb->local_port == port) {
+        std::vector<struct udp_pcb*>& v = _udp_ports[port];
+        for (size_t i = 0; i < v.size(); i++) {
+            if (v[i] == pcb) {
+                return;
+            }
+        }
+    }
+    zts_udp_lookup_remove(pcb);
+    _udp_ports[port].push_back(pcb);
+}
+
+void zts_udp_lookup_remove(struct udp_pcb* pcb)
+{
+    std::unordered_map<u16_t, std::vector<struct udp_pcb*> >::iterator it = _udp_ports.find(pcb->local_port);
+    if (it == _udp_ports.end()) {
+        return;
+    }
+    std::vector<struct udp_pcb*>& v = it->second;
+    for (size_t i = 0; i < v.size(); i++) {
+        if (v[i] == pcb) {
+            v.erase(v.begin() + i);
+            break;
+        }
+    }
+    if (v.empty()) {
+        _udp_ports.erase(it);
+    }
+}
+
+int zts_udp_lookup(u16_t port, struct udp_pcb** pcb)
+{
+    std::unordered_map<u16_t, std::vector<struct udp_pcb*> >::iterator it = _udp_ports.find(port);
+    if (it == _udp_ports.end()) {
+        // No PCB bound to the port can match, which the walk would find out too
+        *pcb = NULL;
+        return 1;
+    }
+    if (it->second.size() != 1) {
+        return 0;
+    }
+    *pcb = it->second[0];
+    return 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
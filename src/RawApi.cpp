@@ -0,0 +1,645 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Raw callback TCP/UDP API operating directly on lwIP PCBs
+ */
+
+#include "Events.hpp"
+#include "ZeroTierSockets.h"
+#include "lwip/ip_addr.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+
+#include <new>
+
+/**
+ * Raw TCP connection or listener. Only accessed with the core lock held
+ */
+struct zts_tcp_raw {
+    struct tcp_pcb* pcb;   // NULL once lwIP has freed the PCB (error) or after close
+    bool listener;
+    bool connected;
+    zts_tcp_raw_accept_cb accept_cb;
+    zts_tcp_raw_connect_cb connect_cb;
+    zts_tcp_raw_recv_cb recv_cb;
+    zts_tcp_raw_sent_cb sent_cb;
+    zts_tcp_raw_err_cb err_cb;
+    void* arg;
+    int dispatching;   // Number of user callbacks currently running for this handle
+    bool closing;      // Closed from within one of its own callbacks, release when done
+    bool aborted;      // PCB was aborted while lwIP is inside one of its callbacks
+};
+
+/**
+ * Raw UDP endpoint. Only accessed with the core lock held
+ */
+struct zts_udp_raw {
+    struct udp_pcb* pcb;
+    zts_udp_raw_recv_cb recv_cb;
+    void* arg;
+    int dispatching;
+    bool closing;
+};
+
+namespace ZeroTier {
+
+// Set on the network stack thread while a user callback runs (core lock held)
+static thread_local bool _raw_in_callback = false;
+
+/**
+ * Acquire the core lock unless the caller is a raw API callback, which
+ * already holds it (the lock is not recursive)
+ */
+static bool zts_raw_lock()
+{
+    if (_raw_in_callback) {
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    return true;
+}
+
+static void zts_raw_unlock(bool locked)
+{
+    if (locked) {
+        UNLOCK_TCPIP_CORE();
+    }
+}
+
+static void zts_raw_enter(int* dispatching)
+{
+    (*dispatching)++;
+    _raw_in_callback = true;
+}
+
+static void zts_raw_leave(int* dispatching, bool was_in_callback)
+{
+    (*dispatching)--;
+    _raw_in_callback = was_in_callback;
+}
+
+static bool zts_raw_parse_addr(const char* ipstr, ip_addr_t* addr)
+{
+    if (! ipstr) {
+        ip_addr_copy(*addr, *IP_ANY_TYPE);
+        return true;
+    }
+    return ipaddr_aton(ipstr, addr) != 0;
+}
+
+/**
+ * Build an iovec view over (part of) a pbuf chain. Returns the first pbuf not
+ * covered
+ */
+static struct pbuf* zts_raw_pbuf_to_iov(struct pbuf* p, struct zts_iovec* iov, int* iovcnt, size_t* len)
+{
+    *iovcnt = 0;
+    *len = 0;
+    for (; p && *iovcnt < ZTS_RXBUF_MAX_IOV; p = p->next) {
+        if (p->len == 0) {
+            continue;
+        }
+        iov[*iovcnt].iov_base = p->payload;
+        iov[*iovcnt].iov_len = p->len;
+        (*iovcnt)++;
+        *len += p->len;
+    }
+    return p;
+}
+
+//----------------------------------------------------------------------------//
+// TCP                                                                        //
+//----------------------------------------------------------------------------//
+
+static err_t zts_tcp_raw_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err);
+static err_t zts_tcp_raw_sent(void* arg, struct tcp_pcb* pcb, u16_t len);
+static void zts_tcp_raw_err(void* arg, err_t err);
+
+static void zts_tcp_raw_attach(zts_tcp_raw_t* c, struct tcp_pcb* pcb)
+{
+    c->pcb = pcb;
+    tcp_arg(pcb, c);
+    tcp_recv(pcb, zts_tcp_raw_recv);
+    tcp_sent(pcb, zts_tcp_raw_sent);
+    tcp_err(pcb, zts_tcp_raw_err);
+}
+
+/**
+ * Detach the handle from its PCB and close the PCB. Returns true if the PCB
+ * had to be aborted instead
+ */
+static bool zts_tcp_raw_detach(zts_tcp_raw_t* c)
+{
+    struct tcp_pcb* pcb = c->pcb;
+    c->pcb = NULL;
+    if (! pcb) {
+        return false;
+    }
+    tcp_arg(pcb, NULL);
+    if (c->listener) {
+        tcp_accept(pcb, NULL);
+    }
+    else {
+        tcp_recv(pcb, NULL);
+        tcp_sent(pcb, NULL);
+        tcp_err(pcb, NULL);
+    }
+    if (tcp_close(pcb) != ERR_OK) {
+        tcp_abort(pcb);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Called after a user callback for `c` returns. Completes a close requested
+ * from within the callback. Returns ERR_ABRT if the PCB lwIP is currently
+ * processing was aborted
+ */
+static err_t zts_tcp_raw_finish(zts_tcp_raw_t* c, struct tcp_pcb* pcb)
+{
+    if (c->dispatching > 0 || ! c->closing) {
+        return ERR_OK;
+    }
+    bool aborted = c->aborted || zts_tcp_raw_detach(c);
+    delete c;
+    return (aborted && pcb) ? ERR_ABRT : ERR_OK;
+}
+
+static err_t zts_tcp_raw_recv(void* arg, struct tcp_pcb* pcb, struct pbuf* p, err_t err)
+{
+    zts_tcp_raw_t* c = (zts_tcp_raw_t*)arg;
+    LWIP_UNUSED_ARG(err);
+    if (! c || ! c->recv_cb) {
+        if (p) {
+            tcp_recved(pcb, p->tot_len);
+            pbuf_free(p);
+        }
+        return ERR_OK;
+    }
+    bool was_in_callback = _raw_in_callback;
+    zts_raw_enter(&c->dispatching);
+    if (! p) {
+        // Remote host closed its side
+        c->recv_cb(c, NULL, 0, 0, c->arg);
+    }
+    else {
+        /* The data is consumed by the time the callback returns. Re-open the
+        window first so that closing from within the callback does not look
+        like closing with unread data (which would reset the connection) */
+        tcp_recved(pcb, p->tot_len);
+        struct zts_iovec iov[ZTS_RXBUF_MAX_IOV];
+        int iovcnt = 0;
+        size_t len = 0;
+        struct pbuf* q = p;
+        while (q && ! c->closing && c->recv_cb) {
+            q = zts_raw_pbuf_to_iov(q, iov, &iovcnt, &len);
+            if (iovcnt > 0) {
+                c->recv_cb(c, iov, iovcnt, len, c->arg);
+            }
+        }
+        pbuf_free(p);
+    }
+    zts_raw_leave(&c->dispatching, was_in_callback);
+    return zts_tcp_raw_finish(c, pcb);
+}
+
+static err_t zts_tcp_raw_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    zts_tcp_raw_t* c = (zts_tcp_raw_t*)arg;
+    if (! c || ! c->sent_cb) {
+        return ERR_OK;
+    }
+    bool was_in_callback = _raw_in_callback;
+    zts_raw_enter(&c->dispatching);
+    c->sent_cb(c, len, c->arg);
+    zts_raw_leave(&c->dispatching, was_in_callback);
+    return zts_tcp_raw_finish(c, pcb);
+}
+
+static void zts_tcp_raw_err(void* arg, err_t err)
+{
+    zts_tcp_raw_t* c = (zts_tcp_raw_t*)arg;
+    if (! c) {
+        return;
+    }
+    // lwIP has already freed the PCB
+    c->pcb = NULL;
+    bool was_in_callback = _raw_in_callback;
+    zts_raw_enter(&c->dispatching);
+    if (! c->connected && ! c->listener) {
+        if (c->connect_cb) {
+            c->connect_cb(c, err_to_errno(err), c->arg);
+        }
+    }
+    else if (c->err_cb) {
+        c->err_cb(c, err_to_errno(err), c->arg);
+    }
+    zts_raw_leave(&c->dispatching, was_in_callback);
+    zts_tcp_raw_finish(c, NULL);
+}
+
+static err_t zts_tcp_raw_connected(void* arg, struct tcp_pcb* pcb, err_t err)
+{
+    zts_tcp_raw_t* c = (zts_tcp_raw_t*)arg;
+    LWIP_UNUSED_ARG(err);
+    if (! c) {
+        return ERR_OK;
+    }
+    c->connected = true;
+    if (! c->connect_cb) {
+        return ERR_OK;
+    }
+    bool was_in_callback = _raw_in_callback;
+    zts_raw_enter(&c->dispatching);
+    c->connect_cb(c, 0, c->arg);
+    zts_raw_leave(&c->dispatching, was_in_callback);
+    return zts_tcp_raw_finish(c, pcb);
+}
+
+static err_t zts_tcp_raw_accept(void* arg, struct tcp_pcb* newpcb, err_t err)
+{
+    zts_tcp_raw_t* l = (zts_tcp_raw_t*)arg;
+    if (! l || err != ERR_OK || ! newpcb) {
+        return ERR_VAL;
+    }
+    zts_tcp_raw_t* c = new (std::nothrow) zts_tcp_raw_t();
+    if (! c) {
+        return ERR_MEM;
+    }
+    c->connected = true;
+    c->arg = l->arg;
+    zts_tcp_raw_attach(c, newpcb);
+    if (l->accept_cb) {
+        bool was_in_callback = _raw_in_callback;
+        zts_raw_enter(&l->dispatching);
+        c->dispatching++;
+        l->accept_cb(l, c, l->arg);
+        c->dispatching--;
+        zts_raw_leave(&l->dispatching, was_in_callback);
+        zts_tcp_raw_finish(l, NULL);
+    }
+    return zts_tcp_raw_finish(c, newpcb);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int zts_tcp_raw_listen(
+    zts_tcp_raw_t** out,
+    const char* ipstr,
+    unsigned short port,
+    int backlog,
+    zts_tcp_raw_accept_cb cb,
+    void* arg)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    ip_addr_t addr;
+    if (! out || ! cb || ! zts_raw_parse_addr(ipstr, &addr)) {
+        return ZTS_ERR_ARG;
+    }
+    zts_tcp_raw_t* l = new (std::nothrow) zts_tcp_raw_t();
+    if (! l) {
+        zts_errno = ZTS_ENOMEM;
+        return ZTS_ERR_SOCKET;
+    }
+    l->listener = true;
+    l->accept_cb = cb;
+    l->arg = arg;
+    bool locked = zts_raw_lock();
+    struct tcp_pcb* pcb = tcp_new_ip_type(IP_GET_TYPE(&addr));
+    err_t err = pcb ? tcp_bind(pcb, &addr, port) : ERR_MEM;
+    struct tcp_pcb* lpcb = NULL;
+    if (err == ERR_OK) {
+        backlog = backlog < 1 ? 1 : (backlog > 0xFF ? 0xFF : backlog);
+        lpcb = tcp_listen_with_backlog_and_err(pcb, (u8_t)backlog, &err);
+    }
+    if (! lpcb) {
+        if (pcb) {
+            tcp_close(pcb);
+        }
+        zts_raw_unlock(locked);
+        delete l;
+        zts_errno = err_to_errno(err);
+        return ZTS_ERR_SOCKET;
+    }
+    l->pcb = lpcb;
+    tcp_arg(lpcb, l);
+    tcp_accept(lpcb, zts_tcp_raw_accept);
+    zts_raw_unlock(locked);
+    *out = l;
+    return ZTS_ERR_OK;
+}
+
+int zts_tcp_raw_connect(zts_tcp_raw_t** out, const char* ipstr, unsigned short port, zts_tcp_raw_connect_cb cb, void* arg)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    ip_addr_t addr;
+    if (! out || ! ipstr || ! cb || ! zts_raw_parse_addr(ipstr, &addr)) {
+        return ZTS_ERR_ARG;
+    }
+    zts_tcp_raw_t* c = new (std::nothrow) zts_tcp_raw_t();
+    if (! c) {
+        zts_errno = ZTS_ENOMEM;
+        return ZTS_ERR_SOCKET;
+    }
+    c->connect_cb = cb;
+    c->arg = arg;
+    bool locked = zts_raw_lock();
+    struct tcp_pcb* pcb = tcp_new_ip_type(IP_GET_TYPE(&addr));
+    if (! pcb) {
+        zts_raw_unlock(locked);
+        delete c;
+        zts_errno = ZTS_ENOMEM;
+        return ZTS_ERR_SOCKET;
+    }
+    zts_tcp_raw_attach(c, pcb);
+    err_t err = tcp_connect(pcb, &addr, port, zts_tcp_raw_connected);
+    if (err != ERR_OK) {
+        zts_tcp_raw_detach(c);
+        zts_raw_unlock(locked);
+        delete c;
+        zts_errno = err_to_errno(err);
+        return ZTS_ERR_SOCKET;
+    }
+    zts_raw_unlock(locked);
+    *out = c;
+    return ZTS_ERR_OK;
+}
+
+int zts_tcp_raw_on_recv(zts_tcp_raw_t* conn, zts_tcp_raw_recv_cb cb)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! conn || conn->listener) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    conn->recv_cb = cb;
+    zts_raw_unlock(locked);
+    return ZTS_ERR_OK;
+}
+
+int zts_tcp_raw_on_sent(zts_tcp_raw_t* conn, zts_tcp_raw_sent_cb cb)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! conn || conn->listener) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    conn->sent_cb = cb;
+    zts_raw_unlock(locked);
+    return ZTS_ERR_OK;
+}
+
+int zts_tcp_raw_on_err(zts_tcp_raw_t* conn, zts_tcp_raw_err_cb cb)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! conn || conn->listener) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    conn->err_cb = cb;
+    zts_raw_unlock(locked);
+    return ZTS_ERR_OK;
+}
+
+ssize_t zts_tcp_raw_write(zts_tcp_raw_t* conn, const void* buf, size_t len, int flags)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! conn || ! buf || conn->listener) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    if (! conn->pcb || conn->closing) {
+        zts_raw_unlock(locked);
+        zts_errno = ZTS_ENOTCONN;
+        return ZTS_ERR_SOCKET;
+    }
+    size_t n = len > tcp_sndbuf(conn->pcb) ? tcp_sndbuf(conn->pcb) : len;
+    n = n > 0xFFFF ? 0xFFFF : n;
+    u8_t apiflags = TCP_WRITE_FLAG_COPY | ((flags & ZTS_MSG_MORE) ? TCP_WRITE_FLAG_MORE : 0);
+    // tcp_write() fails with ERR_MEM when the send queue is full
+    err_t err = n > 0 ? tcp_write(conn->pcb, buf, (u16_t)n, apiflags) : ERR_MEM;
+    if (err == ERR_OK && ! (flags & ZTS_MSG_MORE)) {
+        tcp_output(conn->pcb);
+    }
+    zts_raw_unlock(locked);
+    if (err != ERR_OK) {
+        zts_errno = err == ERR_MEM ? ZTS_EWOULDBLOCK : err_to_errno(err);
+        return ZTS_ERR_SOCKET;
+    }
+    return (ssize_t)n;
+}
+
+ssize_t zts_tcp_raw_sndbuf(zts_tcp_raw_t* conn)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! conn || conn->listener) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    ssize_t n = (conn->pcb && ! conn->closing) ? tcp_sndbuf(conn->pcb) : 0;
+    zts_raw_unlock(locked);
+    return n;
+}
+
+int zts_tcp_raw_close(zts_tcp_raw_t* conn)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! conn) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    if (conn->closing) {
+        zts_raw_unlock(locked);
+        return ZTS_ERR_ARG;
+    }
+    conn->closing = true;
+    if (conn->dispatching > 0) {
+        /* Closed from within one of its own callbacks. lwIP may still be
+        processing the PCB, so an abort must be reported back to it by the
+        callback wrapper, which also releases the handle */
+        conn->aborted = zts_tcp_raw_detach(conn);
+    }
+    else {
+        zts_tcp_raw_finish(conn, NULL);
+    }
+    zts_raw_unlock(locked);
+    return ZTS_ERR_OK;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+//----------------------------------------------------------------------------//
+// UDP                                                                        //
+//----------------------------------------------------------------------------//
+
+static void zts_udp_raw_release(zts_udp_raw_t* u)
+{
+    if (u->pcb) {
+        udp_remove(u->pcb);
+    }
+    delete u;
+}
+
+static void zts_udp_raw_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    zts_udp_raw_t* u = (zts_udp_raw_t*)arg;
+    LWIP_UNUSED_ARG(pcb);
+    if (! u || ! u->recv_cb || u->closing) {
+        pbuf_free(p);
+        return;
+    }
+    char ipstr[ZTS_IP_MAX_STR_LEN] = { 0 };
+    ipaddr_ntoa_r(addr, ipstr, sizeof(ipstr));
+    struct zts_iovec iov[ZTS_RXBUF_MAX_IOV];
+    int iovcnt = 0;
+    size_t len = 0;
+    if (pbuf_clen(p) > ZTS_RXBUF_MAX_IOV) {
+        // Datagrams are delivered whole, flatten long chains
+        struct pbuf* flat = pbuf_clone(PBUF_RAW, PBUF_RAM, p);
+        pbuf_free(p);
+        if (! (p = flat)) {
+            return;
+        }
+    }
+    zts_raw_pbuf_to_iov(p, iov, &iovcnt, &len);
+    bool was_in_callback = _raw_in_callback;
+    zts_raw_enter(&u->dispatching);
+    u->recv_cb(u, iov, iovcnt, len, ipstr, port, u->arg);
+    zts_raw_leave(&u->dispatching, was_in_callback);
+    pbuf_free(p);
+    if (u->closing && u->dispatching == 0) {
+        zts_udp_raw_release(u);
+    }
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int zts_udp_raw_bind(zts_udp_raw_t** out, const char* ipstr, unsigned short port, zts_udp_raw_recv_cb cb, void* arg)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    ip_addr_t addr;
+    if (! out || ! zts_raw_parse_addr(ipstr, &addr)) {
+        return ZTS_ERR_ARG;
+    }
+    zts_udp_raw_t* u = new (std::nothrow) zts_udp_raw_t();
+    if (! u) {
+        zts_errno = ZTS_ENOMEM;
+        return ZTS_ERR_SOCKET;
+    }
+    u->recv_cb = cb;
+    u->arg = arg;
+    bool locked = zts_raw_lock();
+    u->pcb = udp_new_ip_type(IP_GET_TYPE(&addr));
+    err_t err = u->pcb ? udp_bind(u->pcb, &addr, port) : ERR_MEM;
+    if (err != ERR_OK) {
+        zts_udp_raw_release(u);
+        zts_raw_unlock(locked);
+        zts_errno = err_to_errno(err);
+        return ZTS_ERR_SOCKET;
+    }
+    udp_recv(u->pcb, zts_udp_raw_recv, u);
+    zts_raw_unlock(locked);
+    *out = u;
+    return ZTS_ERR_OK;
+}
+
+ssize_t zts_udp_raw_sendto(zts_udp_raw_t* udp, const void* buf, size_t len, const char* remote_ipstr, unsigned short remote_port)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    ip_addr_t addr;
+    if (! udp || (! buf && len) || ! remote_ipstr || ! zts_raw_parse_addr(remote_ipstr, &addr)) {
+        return ZTS_ERR_ARG;
+    }
+    if (len > 0xFFFF) {
+        zts_errno = ZTS_EMSGSIZE;
+        return ZTS_ERR_SOCKET;
+    }
+    bool locked = zts_raw_lock();
+    if (! udp->pcb || udp->closing) {
+        zts_raw_unlock(locked);
+        zts_errno = ZTS_EBADF;
+        return ZTS_ERR_SOCKET;
+    }
+    err_t err = ERR_MEM;
+    struct pbuf* p = pbuf_alloc(PBUF_TRANSPORT, (u16_t)len, PBUF_REF);
+    if (p) {
+        p->payload = (void*)buf;
+        err = udp_sendto(udp->pcb, p, &addr, remote_port);
+        pbuf_free(p);
+    }
+    zts_raw_unlock(locked);
+    if (err != ERR_OK) {
+        zts_errno = err_to_errno(err);
+        return ZTS_ERR_SOCKET;
+    }
+    return (ssize_t)len;
+}
+
+int zts_udp_raw_close(zts_udp_raw_t* udp)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! udp) {
+        return ZTS_ERR_ARG;
+    }
+    bool locked = zts_raw_lock();
+    if (udp->closing) {
+        zts_raw_unlock(locked);
+        return ZTS_ERR_ARG;
+    }
+    udp->closing = true;
+    if (udp->dispatching == 0) {
+        zts_udp_raw_release(udp);
+    }
+    zts_raw_unlock(locked);
+    return ZTS_ERR_OK;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
@@ -0,0 +1,184 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Streaming of host files into ZeroTier TCP sockets
+ */
+
+#if defined(__WINDOWS__)
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Coalesce.hpp"
+#include "Events.hpp"
+#include "SocketBuffers.hpp"
+#include "ZeroTierSockets.h"
+#include "lwip/api.h"
+#include "lwip/priv/sockets_priv.h"
+
+#include <stdlib.h>
+
+namespace ZeroTier {
+
+#if defined(__WINDOWS__)
+static int64_t zts_host_seek(int host_fd, int64_t pos, int whence)
+{
+    return _lseeki64(host_fd, pos, whence);
+}
+
+static ssize_t zts_host_pread(int host_fd, void* buf, size_t len, int64_t pos)
+{
+    if (_lseeki64(host_fd, pos, SEEK_SET) < 0) {
+        return -1;
+    }
+    return _read(host_fd, buf, (unsigned int)len);
+}
+#else
+static int64_t zts_host_seek(int host_fd, int64_t pos, int whence)
+{
+    return lseek(host_fd, (off_t)pos, whence);
+}
+
+static ssize_t zts_host_pread(int host_fd, void* buf, size_t len, int64_t pos)
+{
+    return pread(host_fd, buf, len, (off_t)pos);
+}
+
+/**
+ * Write one window of a regular file by mapping it and letting lwIP copy
+ * directly from the page cache into its segments. Returns false if the file
+ * cannot be mapped
+ */
+static bool
+zts_sendfile_mapped(struct netconn* conn, int host_fd, int64_t pos, size_t len, u8_t flags, size_t* written, err_t* err)
+{
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    int64_t base = pos - (pos % page_size);
+    size_t skew = (size_t)(pos - base);
+    void* map = mmap(NULL, len + skew, PROT_READ, MAP_SHARED, host_fd, (off_t)base);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    posix_madvise(map, len + skew, POSIX_MADV_SEQUENTIAL);
+    *err = netconn_write_partly(conn, (char*)map + skew, len, flags, written);
+    munmap(map, len + skew);
+    return true;
+}
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t zts_sendfile(int fd, int host_fd, int64_t offset, size_t count)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (host_fd < 0) {
+        return ZTS_ERR_ARG;
+    }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    if (! sock || ! sock->conn || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+        return ZTS_ERR_ARG;
+    }
+    // Data held back by write coalescing goes first
+    if (zts_coalesce_flush(fd) != ZTS_ERR_OK) {
+        return ZTS_ERR_SOCKET;
+    }
+    // Only seekable descriptors are supported, since data that was read but
+    // did not fit into the send window could not be put back
+    bool use_file_pos = offset < 0;
+    if (use_file_pos && (offset = zts_host_seek(host_fd, 0, SEEK_CUR)) < 0) {
+        zts_errno = ZTS_EINVAL;
+        return ZTS_ERR_ARG;
+    }
+    int64_t file_size = -1;
+#if ! defined(__WINDOWS__)
+    struct stat st;
+    if (fstat(host_fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        file_size = st.st_size;
+    }
+#endif
+    bool mapped = file_size >= 0;
+    char* bounce = NULL;
+    size_t sent = 0;
+    err_t err = ERR_OK;
+    while (sent < count) {
+        int64_t pos = offset + (int64_t)sent;
+        size_t len = count - sent;
+        len = len > ZTS_SENDFILE_CHUNK_SIZE ? ZTS_SENDFILE_CHUNK_SIZE : len;
+        if (file_size >= 0) {
+            if (pos >= file_size) {
+                break;   // EOF
+            }
+            len = (int64_t)len > file_size - pos ? (size_t)(file_size - pos) : len;
+        }
+        u8_t flags = NETCONN_COPY | (sent + len < count ? NETCONN_MORE : 0);
+        size_t written = 0;
+#if ! defined(__WINDOWS__)
+        if (mapped) {
+            if (! zts_sendfile_mapped(sock->conn, host_fd, pos, len, flags, &written, &err)) {
+                // File system does not support mapping, read it instead
+                mapped = false;
+                continue;
+            }
+        }
+        else
+#endif
+        {
+            if (! bounce && ! (bounce = (char*)malloc(ZTS_SENDFILE_CHUNK_SIZE))) {
+                err = ERR_MEM;
+                break;
+            }
+            ssize_t n = zts_host_pread(host_fd, bounce, len, pos);
+            if (n < 0) {
+                err = ERR_ARG;
+                break;
+            }
+            if (n == 0) {
+                break;   // EOF
+            }
+            err = netconn_write_partly(sock->conn, bounce, (size_t)n, flags, &written);
+        }
+        sent += written;
+        // Stop once the send window is full (non-blocking) or on error
+        if (err != ERR_OK || written < len) {
+            break;
+        }
+    }
+    free(bounce);
+    if (use_file_pos) {
+        zts_host_seek(host_fd, offset + (int64_t)sent, SEEK_SET);
+    }
+    if (sent == 0 && err != ERR_OK) {
+        zts_errno = err == ERR_ARG ? ZTS_EIO : err_to_errno(err);
+        return ZTS_ERR_SOCKET;
+    }
+    return (ssize_t)sent;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
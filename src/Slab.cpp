@@ -0,0 +1,336 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Slab allocator for lwIP. With MEMP_MEM_MALLOC and MEM_LIBC_MALLOC every pool
+ * object (PCBs, segments, netbufs, pbuf headers, ...) and every PBUF_RAM buffer
+ * goes through mem_malloc(), which lwipopts.h routes here instead of to libc.
+ *
+ * Requests are rounded up to power-of-two size classes from 64 bytes to 16 KB
+ * (the largest frame, ZT_MAX_MTU plus headers). Each thread keeps a small cache
+ * of free objects per class, so the common malloc/free pair takes no lock even
+ * when, as with received packets, the object is freed on another thread than
+ * the one that allocated it. Caches exchange objects with a per-class depot in
+ * batches, and the depot carves new objects out of slabs obtained from the
+ * system. Slabs are kept for the life of the process. Slabs and larger
+ * requests come from the allocator set with zts_init_set_allocator(), huge
+ * pages directly from the system.
+ */
+
+#include "Slab.h"
+
+#include "Allocator.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+#if ZTS_SLAB_HUGE_PAGES && defined(__linux__)
+#include <sys/mman.h>
+#define ZTS_SLAB_HUGE_SIZE (2 * 1024 * 1024)
+#endif
+
+// Default size of a slab, see zts_slab_tune()
+#define ZTS_SLAB_SIZE (256 * 1024)
+
+// Smallest size class is 1 << ZTS_SLAB_MIN_SHIFT bytes, each one is twice the previous
+#define ZTS_SLAB_MIN_SHIFT 6
+#define ZTS_SLAB_CLASSES   9
+
+// Default bytes of free objects per class a thread may cache before it hands some back
+#define ZTS_SLAB_CACHE_BYTES (64 * 1024)
+
+// Class of blocks that came from zts_mem_alloc()
+#define ZTS_SLAB_LARGE 0xff
+
+namespace ZeroTier {
+
+/**
+ * Header in front of every block, keeps the payload 16-byte aligned
+ */
+struct zts_slab_hdr {
+    uint32_t cls;    // Size class, or ZTS_SLAB_LARGE
+    uint32_t size;   // Block size in bytes
+    uint64_t pad;
+};
+
+struct zts_slab_obj {
+    zts_slab_obj* next;
+};
+
+/**
+ * Free objects of one size class shared by all threads
+ */
+struct zts_slab_depot {
+    std::mutex m;
+    zts_slab_obj* free_list;
+    char* cur;   // Part of the newest slab not handed out yet
+    char* end;
+};
+
+static zts_slab_depot _depot[ZTS_SLAB_CLASSES];
+
+static std::atomic<uint64_t> _used(0);
+static std::atomic<uint64_t> _max(0);
+static std::atomic<uint64_t> _reserved(0);
+static std::atomic<uint32_t> _err(0);
+
+static std::atomic<uint32_t> _slab_size(ZTS_SLAB_SIZE);
+static std::atomic<uint32_t> _cache_bytes(ZTS_SLAB_CACHE_BYTES);
+
+static size_t zts_slab_class_size(unsigned int cls)
+{
+    return (size_t)1 << (cls + ZTS_SLAB_MIN_SHIFT);
+}
+
+/**
+ * Objects moved between a thread cache and the depot at once
+ */
+static unsigned int zts_slab_batch(unsigned int cls)
+{
+    size_t n = _cache_bytes.load(std::memory_order_relaxed) / 2 / zts_slab_class_size(cls);
+    return n < 2 ? 2 : n > 64 ? 64 : (unsigned int)n;
+}
+
+static void zts_slab_account(int64_t bytes)
+{
+    uint64_t used = _used.fetch_add((uint64_t)bytes, std::memory_order_relaxed) + (uint64_t)bytes;
+    uint64_t max = _max.load(std::memory_order_relaxed);
+    while (bytes > 0 && used > max && ! _max.compare_exchange_weak(max, used, std::memory_order_relaxed)) {}
+}
+
+/**
+ * Obtain a new slab, storing its size in *size
+ */
+static char* zts_slab_map(size_t* size)
+{
+    void* p = NULL;
+#if ZTS_SLAB_HUGE_PAGES && defined(__linux__)
+    *size = ZTS_SLAB_HUGE_SIZE;
+    p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p == MAP_FAILED) {
+        // No reserved huge pages, ask for transparent ones instead
+        p = mmap(NULL, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p != MAP_FAILED) {
+            madvise(p, *size, MADV_HUGEPAGE);
+        }
+    }
+    p = (p == MAP_FAILED) ? NULL : p;
+#else
+    *size = _slab_size.load(std::memory_order_relaxed);
+    p = zts_mem_alloc(ZTS_ALLOC_STACK, *size);
+#endif
+    if (p) {
+        _reserved.fetch_add(*size, std::memory_order_relaxed);
+    }
+    return (char*)p;
+}
+
+/**
+ * Take up to `want` objects from the depot, carving new ones if it has none.
+ * Returns the number of objects linked from *head
+ */
+static unsigned int zts_slab_take(unsigned int cls, zts_slab_obj** head, unsigned int want)
+{
+    zts_slab_depot& d = _depot[cls];
+    size_t size = zts_slab_class_size(cls);
+    unsigned int n = 0;
+    std::lock_guard<std::mutex> l(d.m);
+    while (n < want && d.free_list) {
+        zts_slab_obj* o = d.free_list;
+        d.free_list = o->next;
+        o->next = *head;
+        *head = o;
+        n++;
+    }
+    while (n < want) {
+        if (d.cur + size > d.end) {
+            size_t slab_size;
+            char* slab = zts_slab_map(&slab_size);
+            if (! slab) {
+                break;
+            }
+            d.cur = slab;
+            d.end = slab + slab_size;
+        }
+        zts_slab_obj* o = (zts_slab_obj*)d.cur;
+        d.cur += size;
+        o->next = *head;
+        *head = o;
+        n++;
+    }
+    return n;
+}
+
+/**
+ * Give the first `count` objects of a list back to the depot. Returns the rest
+ */
+static zts_slab_obj* zts_slab_give(unsigned int cls, zts_slab_obj* head, unsigned int count)
+{
+    if (! head || ! count) {
+        return head;
+    }
+    zts_slab_obj* last = head;
+    for (unsigned int i = 1; i < count && last->next; i++) {
+        last = last->next;
+    }
+    zts_slab_obj* rest = last->next;
+    zts_slab_depot& d = _depot[cls];
+    std::lock_guard<std::mutex> l(d.m);
+    last->next = d.free_list;
+    d.free_list = head;
+    return rest;
+}
+
+/**
+ * Free objects cached by one thread
+ */
+struct zts_slab_cache {
+    zts_slab_obj* head[ZTS_SLAB_CLASSES];
+    unsigned int count[ZTS_SLAB_CLASSES];
+    bool dead;   // Thread is exiting, use the depot directly
+
+    ~zts_slab_cache()
+    {
+        for (unsigned int cls = 0; cls < ZTS_SLAB_CLASSES; cls++) {
+            zts_slab_give(cls, head[cls], count[cls]);
+            head[cls] = NULL;
+            count[cls] = 0;
+        }
+        dead = true;
+    }
+};
+
+static thread_local zts_slab_cache _cache;
+
+}   // namespace ZeroTier
+
+using namespace ZeroTier;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void* zts_slab_malloc(size_t size)
+{
+    size_t total = size + sizeof(zts_slab_hdr);
+    unsigned int cls = 0;
+    while (cls < ZTS_SLAB_CLASSES && zts_slab_class_size(cls) < total) {
+        cls++;
+    }
+    // Charged against the memory budget until freed
+    size_t charge = (cls == ZTS_SLAB_CLASSES) ? total : zts_slab_class_size(cls);
+    if (total < size || total > UINT32_MAX || ! zts_mem_charge(charge, false)) {
+        _err.fetch_add(1, std::memory_order_relaxed);
+        return NULL;
+    }
+    zts_slab_hdr* hdr;
+    if (cls == ZTS_SLAB_CLASSES) {
+        if (! (hdr = (zts_slab_hdr*)zts_mem_alloc(ZTS_ALLOC_STACK, total))) {
+            zts_mem_uncharge(charge);
+            _err.fetch_add(1, std::memory_order_relaxed);
+            return NULL;
+        }
+        hdr->cls = ZTS_SLAB_LARGE;
+        hdr->size = (uint32_t)total;
+    }
+    else {
+        zts_slab_cache& c = _cache;
+        if (c.dead) {
+            zts_slab_obj* o = NULL;
+            if (! zts_slab_take(cls, &o, 1)) {
+                zts_mem_uncharge(charge);
+                _err.fetch_add(1, std::memory_order_relaxed);
+                return NULL;
+            }
+            hdr = (zts_slab_hdr*)o;
+        }
+        else {
+            if (! c.head[cls] && ! (c.count[cls] = zts_slab_take(cls, &c.head[cls], zts_slab_batch(cls)))) {
+                zts_mem_uncharge(charge);
+                _err.fetch_add(1, std::memory_order_relaxed);
+                return NULL;
+            }
+            hdr = (zts_slab_hdr*)c.head[cls];
+            c.head[cls] = c.head[cls]->next;
+            c.count[cls]--;
+        }
+        hdr->cls = cls;
+        hdr->size = (uint32_t)zts_slab_class_size(cls);
+    }
+    zts_slab_account(hdr->size);
+    return hdr + 1;
+}
+
+void* zts_slab_calloc(size_t count, size_t size)
+{
+    if (size && count > SIZE_MAX / size) {
+        return NULL;
+    }
+    void* p = zts_slab_malloc(count * size);
+    if (p) {
+        memset(p, 0, count * size);
+    }
+    return p;
+}
+
+void zts_slab_free(void* ptr)
+{
+    if (! ptr) {
+        return;
+    }
+    zts_slab_hdr* hdr = (zts_slab_hdr*)ptr - 1;
+    zts_slab_account(-(int64_t)hdr->size);
+    zts_mem_uncharge(hdr->size);
+    unsigned int cls = hdr->cls;
+    if (cls == ZTS_SLAB_LARGE) {
+        zts_mem_free(hdr);
+        return;
+    }
+    zts_slab_obj* o = (zts_slab_obj*)hdr;
+    zts_slab_cache& c = _cache;
+    if (c.dead) {
+        o->next = NULL;
+        zts_slab_give(cls, o, 1);
+        return;
+    }
+    o->next = c.head[cls];
+    c.head[cls] = o;
+    unsigned int batch = zts_slab_batch(cls);
+    if (++c.count[cls] > 2 * batch) {
+        c.head[cls] = zts_slab_give(cls, c.head[cls], batch);
+        c.count[cls] -= batch;
+    }
+}
+
+void zts_slab_tune(uint32_t slab_size, uint32_t cache_bytes)
+{
+    size_t largest = zts_slab_class_size(ZTS_SLAB_CLASSES - 1);
+    _slab_size = slab_size ? (slab_size < largest ? (uint32_t)largest : slab_size) : ZTS_SLAB_SIZE;
+    _cache_bytes = cache_bytes ? cache_bytes : ZTS_SLAB_CACHE_BYTES;
+}
+
+void zts_slab_get_stats(struct zts_slab_stats* dst)
+{
+    dst->used = _used.load(std::memory_order_relaxed);
+    dst->max = _max.load(std::memory_order_relaxed);
+    dst->reserved = _reserved.load(std::memory_order_relaxed);
+    dst->err = _err.load(std::memory_order_relaxed);
+}
+
+#ifdef __cplusplus
+}
+#endif
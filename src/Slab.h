@@ -0,0 +1,59 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Slab allocator behind lwIP's heap (mem_clib_malloc and friends, see
+ * lwipopts.h). Included by lwIP's C sources, so this must remain plain C.
+ */
+
+#ifndef ZTS_SLAB_H
+#define ZTS_SLAB_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* Back slabs with 2 MB huge pages where the system has them (Linux only) */
+#ifndef ZTS_SLAB_HUGE_PAGES
+#define ZTS_SLAB_HUGE_PAGES 0
+#endif
+
+/**
+ * Usage of the slab allocator
+ */
+struct zts_slab_stats {
+    uint64_t used;       // Bytes handed out, headers and size class rounding included
+    uint64_t max;        // Highest value of used
+    uint64_t reserved;   // Bytes obtained from the system for slabs, never given back
+    uint32_t err;        // Failed allocations
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void* zts_slab_malloc(size_t size);
+void* zts_slab_calloc(size_t count, size_t size);
+void zts_slab_free(void* ptr);
+void zts_slab_get_stats(struct zts_slab_stats* dst);
+
+/* Set the size of new slabs (ignored with huge pages) and how many bytes of free
+objects per size class each thread may cache. 0 restores the default */
+void zts_slab_tune(uint32_t slab_size, uint32_t cache_bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _H
@@ -0,0 +1,494 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Per-socket send/receive buffer sizing implemented on top of lwIP's global
+ * TCP_SND_BUF/TCP_WND. A smaller buffer is obtained by permanently holding
+ * back part of a PCB's send buffer and receive window: lwIP only ever adds
+ * back what was acknowledged (snd_buf) or consumed (rcv_wnd), so whatever is
+ * withheld stays unavailable until it is explicitly returned.
+ *
+ * The same mechanism applies backpressure when a memory budget is set: past
+ * ZTS_MEM_WINDOW_THRESHOLD every connection's receive window shrinks as the
+ * budget is used up, and past ZTS_MEM_SEND_THRESHOLD sockets that already have
+ * data queued are refused further sends with ZTS_ENOBUFS.
+ */
+
+#include "SocketBuffers.hpp"
+
+#include "Allocator.hpp"
+#include "Events.hpp"
+#include "ZeroTierSockets.h"
+#include "lwip/api.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
+
+#include <atomic>
+#include <string.h>
+
+namespace ZeroTier {
+
+/**
+ * Buffer settings of one lwIP socket slot. Only accessed with the core lock
+ * held (except the `active` fast-path flag and `pending`)
+ */
+struct zts_sockbuf_state {
+    std::atomic<bool> active;     // Any setting differs from lwIP's defaults
+    std::atomic<u32_t> pending;   // Bytes read but not yet accounted for
+    struct netconn* conn;         // Connection the settings belong to
+    u32_t snd_limit;              // TCP send buffer size, 0 = TCP_SND_BUF
+    u32_t rcv_limit;              // TCP receive window, 0 = TCP_WND
+    u32_t snd_withheld;           // Bytes currently held back from pcb->snd_buf
+    u32_t rcv_withheld;           // Bytes currently held back from pcb->rcv_wnd
+    bool autotune;                // Grow the receive window with consumption
+    u32_t rcv_target;             // Current autotuned receive window
+    u32_t consumed;               // Bytes read in the current measurement interval
+    u32_t interval_start;         // sys_now() at start of measurement interval
+    u32_t udp_drops;              // Datagrams dropped because SO_RCVBUF was full
+};
+
+static zts_sockbuf_state _sb[NUM_SOCKETS];
+
+// TCP receive window of sockets that do not set SO_RCVBUF, 0 = TCP_WND
+static std::atomic<u32_t> _default_rcv_limit(0);
+
+// UDP receive callback lwIP's netconn layer originally installed
+static udp_recv_fn _lwip_udp_recv_cb = NULL;
+
+/**
+ * Return state for the socket, resetting it if the descriptor now belongs to
+ * a different connection. Core lock must be held
+ */
+static zts_sockbuf_state* zts_sockbuf_get(int fd, struct lwip_sock** sock_out)
+{
+    int i = fd - LWIP_SOCKET_OFFSET;
+    if (i < 0 || i >= NUM_SOCKETS) {
+        return NULL;
+    }
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    if (! sock || ! sock->conn) {
+        return NULL;
+    }
+    zts_sockbuf_state* st = &_sb[i];
+    if (st->conn != sock->conn) {
+        st->conn = sock->conn;
+        st->snd_limit = 0;
+        st->rcv_limit = _default_rcv_limit.load(std::memory_order_relaxed);
+        st->active = st->rcv_limit != 0;
+        st->snd_withheld = st->rcv_withheld = 0;
+        st->autotune = false;
+        st->rcv_target = ZTS_TCP_RCVBUF_AUTOTUNE_INIT;
+        st->consumed = 0;
+        st->interval_start = sys_now();
+        st->udp_drops = 0;
+    }
+    if (sock_out) {
+        *sock_out = sock;
+    }
+    return st;
+}
+
+/**
+ * Receive window allowed by the memory budget: the full window up to
+ * ZTS_MEM_WINDOW_THRESHOLD, then shrinking linearly to ZTS_TCP_RCVBUF_MIN
+ * as the rest of the budget is used up
+ */
+static u32_t zts_sockbuf_budget_cap(u32_t max)
+{
+    uint64_t budget = zts_mem_budget();
+    uint64_t used = zts_mem_charged();
+    uint64_t start = ZTS_MEM_WINDOW_THRESHOLD(budget);
+    if (! budget || used <= start || max <= ZTS_TCP_RCVBUF_MIN) {
+        return max;
+    }
+    if (used >= budget) {
+        return ZTS_TCP_RCVBUF_MIN;
+    }
+    return max - (u32_t)((max - ZTS_TCP_RCVBUF_MIN) * (used - start) / (budget - start));
+}
+
+static u32_t zts_sockbuf_rcv_target(zts_sockbuf_state* st, struct tcp_pcb* pcb)
+{
+    u32_t max = TCP_WND_MAX(pcb);
+    u32_t target = st->rcv_limit ? st->rcv_limit : max;
+    if (st->autotune && st->rcv_target < target) {
+        target = st->rcv_target;
+    }
+    target = LWIP_MIN(target, zts_sockbuf_budget_cap(max));
+    return target < max ? target : max;
+}
+
+/**
+ * Bytes queued on a TCP connection for sending and not yet acknowledged. Core
+ * lock must be held
+ */
+static u32_t zts_sockbuf_snd_queued(zts_sockbuf_state* st, struct tcp_pcb* pcb)
+{
+    if (! pcb || pcb->state == LISTEN) {
+        return 0;
+    }
+    return TCP_SND_BUF - st->snd_withheld - pcb->snd_buf;
+}
+
+/**
+ * Move snd_buf/rcv_wnd towards the configured sizes. Core lock must be held
+ */
+static void zts_sockbuf_apply(zts_sockbuf_state* st, struct tcp_pcb* pcb)
+{
+    if (! pcb || pcb->state == LISTEN) {
+        return;
+    }
+    // Send buffer
+    u32_t want = st->snd_limit ? TCP_SND_BUF - st->snd_limit : 0;
+    if (want > st->snd_withheld) {
+        u32_t take = LWIP_MIN(want - st->snd_withheld, (u32_t)pcb->snd_buf);
+        pcb->snd_buf -= take;
+        st->snd_withheld += take;
+    }
+    else if (want < st->snd_withheld) {
+        pcb->snd_buf += st->snd_withheld - want;
+        st->snd_withheld = want;
+    }
+    // The receive window is reset when window scaling is negotiated
+    if (pcb->state < ESTABLISHED) {
+        return;
+    }
+    want = TCP_WND_MAX(pcb) - zts_sockbuf_rcv_target(st, pcb);
+    if (want > st->rcv_withheld) {
+        u32_t take = LWIP_MIN(want - st->rcv_withheld, (u32_t)pcb->rcv_wnd);
+        pcb->rcv_wnd -= take;
+        st->rcv_withheld += take;
+    }
+    else if (want < st->rcv_withheld) {
+        u32_t give = st->rcv_withheld - want;
+        st->rcv_withheld = want;
+        while (give > 0) {
+            u16_t n = (u16_t)LWIP_MIN(give, 0xFFFF);
+            tcp_recved(pcb, n);
+            give -= n;
+        }
+    }
+    if (st->rcv_withheld) {
+        st->active = true;   // So that the window is given back once memory is freed
+    }
+}
+
+/**
+ * Replacement UDP receive callback counting datagrams that the netconn layer
+ * is about to drop because SO_RCVBUF is exhausted
+ */
+static void zts_sockbuf_udp_recv(void* arg, struct udp_pcb* pcb, struct pbuf* p, const ip_addr_t* addr, u16_t port)
+{
+    struct netconn* conn = (struct netconn*)arg;
+    int i = conn ? conn->socket - LWIP_SOCKET_OFFSET : -1;
+    if (i >= 0 && i < NUM_SOCKETS && _sb[i].conn == conn) {
+        int recv_avail;
+        SYS_ARCH_GET(conn->recv_avail, recv_avail);
+        if (! sys_mbox_valid(&conn->recvmbox) || (recv_avail + (int)(p->tot_len)) > conn->recv_bufsize) {
+            _sb[i].udp_drops++;
+        }
+    }
+    _lwip_udp_recv_cb(arg, pcb, p, addr, port);
+}
+
+static void zts_sockbuf_watch_udp(struct netconn* conn)
+{
+    struct udp_pcb* pcb = conn->pcb.udp;
+    if (pcb && pcb->recv != zts_sockbuf_udp_recv) {
+        _lwip_udp_recv_cb = pcb->recv;
+        udp_recv(pcb, zts_sockbuf_udp_recv, pcb->recv_arg);
+    }
+}
+
+bool zts_sockbuf_setsockopt(int fd, int optname, const void* optval, unsigned int optlen, int* result)
+{
+    if ((optname != SO_SNDBUF && optname != SO_RCVBUF) || ! optval || optlen < sizeof(int)) {
+        return false;
+    }
+    int size = *(const int*)optval;
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    if (! st) {
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+    enum netconn_type type = NETCONNTYPE_GROUP(netconn_type(sock->conn));
+    if (type == NETCONN_UDP && optname == SO_RCVBUF) {
+        // lwIP enforces the limit itself, only count what it drops
+        zts_sockbuf_watch_udp(sock->conn);
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+    if (type != NETCONN_TCP) {
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+    if (size <= 0) {
+        UNLOCK_TCPIP_CORE();
+        *result = ZTS_ERR_SOCKET;
+        zts_errno = ZTS_EINVAL;
+        return true;
+    }
+    if (optname == SO_SNDBUF) {
+        st->snd_limit = LWIP_MIN(LWIP_MAX((u32_t)size, ZTS_TCP_SNDBUF_MIN), TCP_SND_BUF);
+    }
+    else {
+        st->rcv_limit = LWIP_MIN(LWIP_MAX((u32_t)size, ZTS_TCP_RCVBUF_MIN), TCP_WND);
+    }
+    st->active = true;
+    zts_sockbuf_apply(st, sock->conn->pcb.tcp);
+    UNLOCK_TCPIP_CORE();
+    *result = ZTS_ERR_OK;
+    return true;
+}
+
+bool zts_sockbuf_getsockopt(int fd, int optname, void* optval, unsigned int* optlen, int* result)
+{
+    if ((optname != SO_SNDBUF && optname != SO_RCVBUF) || ! optval || ! optlen || *optlen < sizeof(int)) {
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    if (! st || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+    if (optname == SO_SNDBUF) {
+        *(int*)optval = st->snd_limit ? st->snd_limit : TCP_SND_BUF;
+    }
+    else {
+        *(int*)optval = st->rcv_limit ? st->rcv_limit : TCP_WND;
+    }
+    UNLOCK_TCPIP_CORE();
+    *optlen = sizeof(int);
+    *result = ZTS_ERR_OK;
+    return true;
+}
+
+void zts_sockbuf_accepted(int listen_fd, int fd)
+{
+    int l = listen_fd - LWIP_SOCKET_OFFSET;
+    if (l < 0 || l >= NUM_SOCKETS || (! _sb[l].active && ! _default_rcv_limit.load(std::memory_order_relaxed))) {
+        return;
+    }
+    LOCK_TCPIP_CORE();
+    zts_sockbuf_state* ls = zts_sockbuf_get(listen_fd, NULL);
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    if (ls && st && ls->active) {
+        st->snd_limit = ls->snd_limit;
+        st->rcv_limit = ls->rcv_limit;
+        st->autotune = ls->autotune;
+        st->active = true;
+    }
+    if (st && st->active) {
+        zts_sockbuf_apply(st, sock->conn->pcb.tcp);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+void zts_sockbuf_consumed(int fd, size_t len)
+{
+    int i = fd - LWIP_SOCKET_OFFSET;
+    if (i < 0 || i >= NUM_SOCKETS) {
+        return;
+    }
+    uint64_t budget = zts_mem_budget();
+    if (! _sb[i].active && ! _default_rcv_limit.load(std::memory_order_relaxed)
+        && (! budget || zts_mem_charged() <= ZTS_MEM_WINDOW_THRESHOLD(budget))) {
+        return;
+    }
+    if (len > 0) {
+        /* Like lwIP's own window updates, only act once enough has been read
+        to matter. Small reads then cost an atomic add instead of the core
+        lock. A length of 0 (new connection) always applies the settings */
+        u32_t n = (u32_t)LWIP_MIN(len, (size_t)TCP_WND);
+        if (_sb[i].pending.fetch_add(n) + n < TCP_WND_UPDATE_THRESHOLD) {
+            return;
+        }
+    }
+    LOCK_TCPIP_CORE();
+    u32_t consumed = _sb[i].pending.exchange(0);
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    struct tcp_pcb* pcb = st ? sock->conn->pcb.tcp : NULL;
+    if (st && pcb && NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+        if (st->autotune) {
+            /* Dynamic right-sizing: once per (smoothed) RTT, grow the window
+            to twice what the application consumed in that time. A flow that
+            is limited by the window rather than by the application or path
+            keeps doubling until it reaches SO_RCVBUF */
+            st->consumed += consumed;
+            u32_t srtt_ms = (u32_t)(pcb->sa >> 3) * TCP_SLOW_INTERVAL;
+            u32_t interval = LWIP_MAX(srtt_ms, ZTS_TCP_RCVBUF_AUTOTUNE_INTERVAL);
+            u32_t now = sys_now();
+            if (now - st->interval_start >= interval) {
+                if (st->consumed * 2 > st->rcv_target) {
+                    st->rcv_target = LWIP_MIN(st->consumed * 2, (u32_t)TCP_WND);
+                }
+                st->consumed = 0;
+                st->interval_start = now;
+            }
+        }
+        zts_sockbuf_apply(st, pcb);
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+bool zts_sockbuf_send_refused(int fd)
+{
+    uint64_t budget = zts_mem_budget();
+    uint64_t used = zts_mem_charged();
+    if (! budget || used < ZTS_MEM_SEND_THRESHOLD(budget)) {
+        return false;
+    }
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    bool refused = false;
+    if (st) {
+        // Datagrams need fresh buffers, TCP gets to finish what it has queued
+        refused = NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP || used >= budget
+                  || zts_sockbuf_snd_queued(st, sock->conn->pcb.tcp) >= ZTS_TCP_SNDBUF_RESERVE;
+    }
+    UNLOCK_TCPIP_CORE();
+    if (refused) {
+        zts_errno = ZTS_ENOBUFS;
+    }
+    return refused;
+}
+
+void zts_sockbuf_set_default_rcvbuf(unsigned int size)
+{
+    _default_rcv_limit = size ? LWIP_MIN(LWIP_MAX((u32_t)size, ZTS_TCP_RCVBUF_MIN), TCP_WND) : 0;
+}
+
+void zts_sockbuf_close(int fd)
+{
+    int i = fd - LWIP_SOCKET_OFFSET;
+    if (i < 0 || i >= NUM_SOCKETS) {
+        return;
+    }
+    LOCK_TCPIP_CORE();
+    _sb[i].active = false;
+    _sb[i].pending = 0;
+    _sb[i].conn = NULL;
+    UNLOCK_TCPIP_CORE();
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int zts_set_recv_buf_autotune(int fd, int enabled)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    if (! st || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_TCP) {
+        UNLOCK_TCPIP_CORE();
+        return ZTS_ERR_ARG;
+    }
+    st->autotune = enabled;
+    st->rcv_target = ZTS_TCP_RCVBUF_AUTOTUNE_INIT;
+    st->consumed = 0;
+    st->interval_start = sys_now();
+    st->active = true;
+    zts_sockbuf_apply(st, sock->conn->pcb.tcp);
+    UNLOCK_TCPIP_CORE();
+    return ZTS_ERR_OK;
+}
+
+int zts_get_recv_buf_autotune(int fd)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    LOCK_TCPIP_CORE();
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, NULL);
+    int enabled = st ? st->autotune : ZTS_ERR_ARG;
+    UNLOCK_TCPIP_CORE();
+    return enabled;
+}
+
+int zts_get_recv_drop_count(int fd)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    if (! st || NETCONNTYPE_GROUP(netconn_type(sock->conn)) != NETCONN_UDP) {
+        UNLOCK_TCPIP_CORE();
+        return ZTS_ERR_ARG;
+    }
+    zts_sockbuf_watch_udp(sock->conn);
+    int drops = (int)st->udp_drops;
+    UNLOCK_TCPIP_CORE();
+    return drops;
+}
+
+int zts_get_sock_mem_usage(int fd, zts_sock_mem_t* dst)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! dst) {
+        return ZTS_ERR_ARG;
+    }
+    LOCK_TCPIP_CORE();
+    struct lwip_sock* sock = NULL;
+    zts_sockbuf_state* st = zts_sockbuf_get(fd, &sock);
+    if (! st) {
+        UNLOCK_TCPIP_CORE();
+        return ZTS_ERR_ARG;
+    }
+    memset(dst, 0, sizeof(*dst));
+    int recv_avail;
+    SYS_ARCH_GET(sock->conn->recv_avail, recv_avail);
+    dst->rcv_queued = (uint32_t)recv_avail;
+    if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+        struct tcp_pcb* pcb = sock->conn->pcb.tcp;
+        // Remainder of a segment the application has partially read
+        if (sock->lastdata.pbuf) {
+            dst->rcv_queued += sock->lastdata.pbuf->tot_len;
+        }
+        dst->snd_queued = zts_sockbuf_snd_queued(st, pcb);
+#if TCP_QUEUE_OOSEQ
+        if (pcb && pcb->state != LISTEN) {
+            for (struct tcp_seg* seg = pcb->ooseq; seg; seg = seg->next) {
+                dst->rcv_ooseq += seg->p->tot_len;
+            }
+        }
+#endif
+    }
+    UNLOCK_TCPIP_CORE();
+    return ZTS_ERR_OK;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for per-socket send/receive buffer sizing and memory backpressure
+ */
+
+#ifndef ZTS_SOCKET_BUFFERS_HPP
+#define ZTS_SOCKET_BUFFERS_HPP
+
+#include <stddef.h>
+
+/**
+ * Smallest accepted TCP `SO_SNDBUF`. lwIP only signals a socket as writable
+ * once more than `TCP_SNDLOWAT` bytes of send buffer are free
+ */
+#define ZTS_TCP_SNDBUF_MIN 0x10000
+
+/**
+ * Smallest accepted TCP `SO_RCVBUF`
+ */
+#define ZTS_TCP_RCVBUF_MIN (4 * TCP_MSS)
+
+/**
+ * Window an autotuned TCP connection starts with
+ */
+#define ZTS_TCP_RCVBUF_AUTOTUNE_INIT 0x10000
+
+/**
+ * Shortest interval (ms) over which the application's consumption rate is
+ * measured when autotuning. lwIP's RTT estimate is only as fine as its slow
+ * timer, so this acts as a floor for it
+ */
+#define ZTS_TCP_RCVBUF_AUTOTUNE_INTERVAL 100
+
+/**
+ * Data a TCP socket may still queue while sends of others are refused because
+ * the memory budget is nearly used up
+ */
+#define ZTS_TCP_SNDBUF_RESERVE (4 * TCP_MSS)
+
+namespace ZeroTier {
+
+/**
+ * @brief Handle `SO_SNDBUF`/`SO_RCVBUF` for sockets where libzt implements
+ * them on top of lwIP.
+ *
+ * @return true if the option was handled (result stored in `*result`), false
+ * if it should be passed to lwIP
+ */
+bool zts_sockbuf_setsockopt(int fd, int optname, const void* optval, unsigned int optlen, int* result);
+
+/**
+ * @brief Counterpart of zts_sockbuf_setsockopt() for getsockopt
+ */
+bool zts_sockbuf_getsockopt(int fd, int optname, void* optval, unsigned int* optlen, int* result);
+
+/**
+ * @brief Copy buffer settings of a listening socket to a newly accepted one
+ * and apply them
+ *
+ * @usage Called from zts_bsd_accept()
+ */
+void zts_sockbuf_accepted(int listen_fd, int fd);
+
+/**
+ * @brief Note that the application consumed `len` bytes from a socket. Applies
+ * settings that could not take effect earlier (e.g. before the connection was
+ * established) and drives receive window autotuning. Reads are accumulated
+ * and only acted upon every TCP_WND_UPDATE_THRESHOLD bytes
+ *
+ * @usage Called after every successful read/receive and connect
+ */
+void zts_sockbuf_consumed(int fd, size_t len);
+
+/**
+ * @brief Check whether a send must be refused because the memory budget is
+ * nearly used up. Sets `zts_errno` to `ZTS_ENOBUFS` if so
+ *
+ * @usage Called before every send/write
+ */
+bool zts_sockbuf_send_refused(int fd);
+
+/**
+ * @brief Set the TCP receive window of sockets that do not set `SO_RCVBUF`
+ * themselves, 0 for the stack's compile-time window. Applies to connections
+ * established from now on
+ *
+ * @usage Called when the node starts, according to the memory profile
+ */
+void zts_sockbuf_set_default_rcvbuf(unsigned int size);
+
+/**
+ * @brief Forget buffer settings of a socket
+ *
+ * @usage Called from zts_bsd_close()
+ */
+void zts_sockbuf_close(int fd);
+
+}   // namespace ZeroTier
+
+#endif   // _H
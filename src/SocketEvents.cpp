@@ -0,0 +1,467 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Per-socket readiness notification for integration with external event loops
+ */
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+#if ! defined(__WINDOWS__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "Events.hpp"
+#include "Mutex.hpp"
+#include "SocketEvents.hpp"
+#include "concurrentqueue.h"
+#include "lwip/api.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/sys.h"
+#include "lwip/tcpip.h"
+
+#include <atomic>
+
+#define ZTS_SOCKET_EVENT_MASK (ZTS_POLLIN | ZTS_POLLOUT | ZTS_POLLERR)
+
+namespace ZeroTier {
+
+/**
+ * Notification state kept for each lwIP socket slot. Written only while the
+ * core lock is held, so the netconn event hook (which always runs with the
+ * core lock held) sees a consistent view.
+ */
+struct zts_socket_watch {
+    zts_socket_cb_t cb;
+    void* user;
+    bool in_set;                // Whether this socket belongs to an interest set
+    int set;                    // Interest set this socket belongs to
+    int interest;               // Events the interest set cares about
+    std::atomic<int> pending;   // Events not yet collected by zts_sockset_drain()
+};
+
+/**
+ * Notification handed from the stack to the dispatch thread
+ */
+struct zts_socket_notice {
+    int fd;
+    int events;
+    zts_socket_cb_t cb;
+    void* user;
+};
+
+struct zts_socket_set {
+    bool used;
+    int host_fd[2];           // [0] is given to the user, [1] is signaled
+    std::atomic<bool> armed;   // Whether host_fd[0] has been signaled since the last drain
+    moodycamel::ConcurrentQueue<int> ready;
+};
+
+static zts_socket_watch _watch[NUM_SOCKETS];
+static zts_socket_set _sets[ZTS_MAX_SOCKET_SETS];
+
+// Guards allocation of interest sets and creation of the dispatch thread
+static Mutex _socket_events_m;
+
+// Callback lwIP's socket layer originally installed on its netconns
+static netconn_callback _lwip_event_cb = NULL;
+
+static moodycamel::ConcurrentQueue<zts_socket_notice> _noticeQueue;
+static std::atomic<bool> _dispatch_armed(false);
+static bool _dispatch_started = false;
+static sys_sem_t _dispatch_sem;
+
+static inline zts_socket_watch* zts_socket_watch_get(int fd)
+{
+    int i = fd - LWIP_SOCKET_OFFSET;
+    if (i < 0 || i >= NUM_SOCKETS) {
+        return NULL;
+    }
+    return &_watch[i];
+}
+
+static void zts_sockset_signal(zts_socket_set* s)
+{
+    if (s->armed.exchange(true)) {
+        return;   // Already readable, no need to signal again
+    }
+#if defined(__linux__)
+    uint64_t one = 1;
+    ssize_t n = ::write(s->host_fd[1], &one, sizeof(one));
+    LWIP_UNUSED_ARG(n);
+#elif ! defined(__WINDOWS__)
+    ssize_t n = ::write(s->host_fd[1], "\0", 1);
+    LWIP_UNUSED_ARG(n);
+#endif
+}
+
+static void zts_sockset_reset_host_fd(zts_socket_set* s)
+{
+#if defined(__linux__)
+    uint64_t count = 0;
+    ssize_t n = ::read(s->host_fd[0], &count, sizeof(count));
+    LWIP_UNUSED_ARG(n);
+#elif ! defined(__WINDOWS__)
+    char buf[64];
+    while (::read(s->host_fd[0], buf, sizeof(buf)) > 0) {}
+#endif
+}
+
+/**
+ * Called with the core lock held whenever an event is observed on a socket
+ * that has a callback or interest set
+ */
+static void zts_socket_notify(int fd, zts_socket_watch* w, int events)
+{
+    if (w->cb) {
+        zts_socket_notice n = { fd, events, w->cb, w->user };
+        _noticeQueue.enqueue(n);
+        if (! _dispatch_armed.exchange(true)) {
+            sys_sem_signal(&_dispatch_sem);
+        }
+    }
+    if (w->in_set && (events & w->interest)) {
+        if (w->pending.fetch_or(events & w->interest) == 0) {
+            zts_socket_set* s = &_sets[w->set];
+            s->ready.enqueue(fd);
+            zts_sockset_signal(s);
+        }
+    }
+}
+
+/**
+ * Replacement netconn event callback. Forwards to lwIP's socket layer first so
+ * that select/poll/blocking calls keep working, then queues a notification
+ */
+static void zts_netconn_event(struct netconn* conn, enum netconn_evt evt, u16_t len)
+{
+    if (_lwip_event_cb) {
+        _lwip_event_cb(conn, evt, len);
+    }
+    int events = 0;
+    switch (evt) {
+        case NETCONN_EVT_RCVPLUS:
+            events = ZTS_POLLIN;
+            break;
+        case NETCONN_EVT_SENDPLUS:
+            events = ZTS_POLLOUT;
+            break;
+        case NETCONN_EVT_ERROR:
+            events = ZTS_POLLERR;
+            break;
+        default:
+            return;
+    }
+    if (! conn) {
+        return;
+    }
+    // Connections that have not yet been accepted carry a negative count here
+    int fd = conn->socket;
+    zts_socket_watch* w = zts_socket_watch_get(fd);
+    if (! w || (! w->cb && ! w->in_set)) {
+        return;
+    }
+    zts_socket_notify(fd, w, events);
+}
+
+/**
+ * Install the event hook on the socket's netconn and report its current
+ * readiness. Core lock must be held.
+ */
+static int zts_socket_watch_install(int fd, zts_socket_watch* w)
+{
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    if (! sock || ! sock->conn) {
+        return ZTS_ERR_ARG;
+    }
+    if (sock->conn->callback != zts_netconn_event) {
+        _lwip_event_cb = sock->conn->callback;
+        sock->conn->callback = zts_netconn_event;
+    }
+    int events = 0;
+    if (sock->rcvevent > 0 || sock->lastdata.pbuf) {
+        events |= ZTS_POLLIN;
+    }
+    if (sock->sendevent) {
+        events |= ZTS_POLLOUT;
+    }
+    if (sock->errevent) {
+        events |= ZTS_POLLERR;
+    }
+    if (events) {
+        zts_socket_notify(fd, w, events);
+    }
+    return ZTS_ERR_OK;
+}
+
+static void zts_socket_dispatch_loop(void* arg)
+{
+    LWIP_UNUSED_ARG(arg);
+    zts_socket_notice n;
+    while (true) {
+        sys_arch_sem_wait(&_dispatch_sem, 0);
+        _dispatch_armed = false;
+        while (_noticeQueue.try_dequeue(n)) {
+            // Drop notices for callbacks that were replaced or cleared after queuing
+            zts_socket_watch* w = zts_socket_watch_get(n.fd);
+            if (w && w->cb == n.cb && w->user == n.user) {
+                n.cb(n.fd, n.events, n.user);
+            }
+        }
+    }
+}
+
+static int zts_socket_dispatch_start()
+{
+    Mutex::Lock _l(_socket_events_m);
+    if (_dispatch_started) {
+        return ZTS_ERR_OK;
+    }
+    if (sys_sem_new(&_dispatch_sem, 0) != ERR_OK) {
+        return ZTS_ERR_GENERAL;
+    }
+    sys_thread_new(
+        ZTS_SOCKET_DISPATCH_THREAD_NAME,
+        zts_socket_dispatch_loop,
+        NULL,
+        DEFAULT_THREAD_STACKSIZE,
+        DEFAULT_THREAD_PRIO);
+    _dispatch_started = true;
+    return ZTS_ERR_OK;
+}
+
+static inline bool zts_sockset_valid(int set)
+{
+    return set >= 0 && set < ZTS_MAX_SOCKET_SETS && _sets[set].used;
+}
+
+void zts_socket_watch_notify(int fd, int events)
+{
+    zts_socket_watch* w = zts_socket_watch_get(fd);
+    if (! w || (! w->cb && ! w->in_set)) {
+        return;
+    }
+    zts_socket_notify(fd, w, events & ZTS_SOCKET_EVENT_MASK);
+}
+
+void zts_socket_watch_clear(int fd)
+{
+    zts_socket_watch* w = zts_socket_watch_get(fd);
+    if (! w || (! w->cb && ! w->in_set)) {
+        return;
+    }
+    LOCK_TCPIP_CORE();
+    w->cb = NULL;
+    w->user = NULL;
+    w->in_set = false;
+    w->interest = 0;
+    w->pending = 0;
+    UNLOCK_TCPIP_CORE();
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int zts_set_socket_callback(int fd, zts_socket_cb_t cb, void* user)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    zts_socket_watch* w = zts_socket_watch_get(fd);
+    if (! w) {
+        return ZTS_ERR_ARG;
+    }
+    int err = ZTS_ERR_OK;
+    if (cb && (err = zts_socket_dispatch_start()) != ZTS_ERR_OK) {
+        return err;
+    }
+    LOCK_TCPIP_CORE();
+    w->cb = cb;
+    w->user = user;
+    if (cb) {
+        err = zts_socket_watch_install(fd, w);
+        if (err != ZTS_ERR_OK) {
+            w->cb = NULL;
+            w->user = NULL;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    return err;
+}
+
+int zts_sockset_new()
+{
+    Mutex::Lock _l(_socket_events_m);
+    for (int i = 0; i < ZTS_MAX_SOCKET_SETS; i++) {
+        zts_socket_set* s = &_sets[i];
+        if (s->used) {
+            continue;
+        }
+#if defined(__linux__)
+        int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (efd < 0) {
+            return ZTS_ERR_GENERAL;
+        }
+        s->host_fd[0] = s->host_fd[1] = efd;
+#elif ! defined(__WINDOWS__)
+        if (::pipe(s->host_fd) < 0) {
+            return ZTS_ERR_GENERAL;
+        }
+        for (int j = 0; j < 2; j++) {
+            ::fcntl(s->host_fd[j], F_SETFL, ::fcntl(s->host_fd[j], F_GETFL) | O_NONBLOCK);
+            ::fcntl(s->host_fd[j], F_SETFD, FD_CLOEXEC);
+        }
+#else
+        s->host_fd[0] = s->host_fd[1] = -1;
+#endif
+        s->armed = false;
+        s->used = true;
+        return i;
+    }
+    return ZTS_ERR_NO_RESULT;
+}
+
+int zts_sockset_free(int set)
+{
+    Mutex::Lock _l(_socket_events_m);
+    if (! zts_sockset_valid(set)) {
+        return ZTS_ERR_ARG;
+    }
+    zts_socket_set* s = &_sets[set];
+    bool locked = transport_ok();
+    if (locked) {
+        LOCK_TCPIP_CORE();
+    }
+    for (int i = 0; i < NUM_SOCKETS; i++) {
+        if (_watch[i].in_set && _watch[i].set == set) {
+            _watch[i].in_set = false;
+            _watch[i].interest = 0;
+            _watch[i].pending = 0;
+        }
+    }
+    if (locked) {
+        UNLOCK_TCPIP_CORE();
+    }
+    int fd;
+    while (s->ready.try_dequeue(fd)) {}
+#if ! defined(__WINDOWS__)
+    ::close(s->host_fd[0]);
+    if (s->host_fd[1] != s->host_fd[0]) {
+        ::close(s->host_fd[1]);
+    }
+#endif
+    s->used = false;
+    return ZTS_ERR_OK;
+}
+
+int zts_sockset_add(int set, int fd, int events)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    zts_socket_watch* w = zts_socket_watch_get(fd);
+    if (! w || ! zts_sockset_valid(set) || ! (events & ZTS_SOCKET_EVENT_MASK)) {
+        return ZTS_ERR_ARG;
+    }
+    int err = ZTS_ERR_OK;
+    LOCK_TCPIP_CORE();
+    if (w->in_set && w->set != set) {
+        err = ZTS_ERR_ARG;   // Already a member of another set
+    }
+    else {
+        w->in_set = true;
+        w->set = set;
+        w->interest = events & ZTS_SOCKET_EVENT_MASK;
+        w->pending = 0;
+        if ((err = zts_socket_watch_install(fd, w)) != ZTS_ERR_OK) {
+            w->in_set = false;
+            w->interest = 0;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+    return err;
+}
+
+int zts_sockset_del(int set, int fd)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    zts_socket_watch* w = zts_socket_watch_get(fd);
+    if (! w || ! zts_sockset_valid(set)) {
+        return ZTS_ERR_ARG;
+    }
+    int err = ZTS_ERR_OK;
+    LOCK_TCPIP_CORE();
+    if (! w->in_set || w->set != set) {
+        err = ZTS_ERR_ARG;
+    }
+    else {
+        w->in_set = false;
+        w->interest = 0;
+        w->pending = 0;
+    }
+    UNLOCK_TCPIP_CORE();
+    return err;
+}
+
+int zts_sockset_get_host_fd(int set)
+{
+    if (! zts_sockset_valid(set)) {
+        return ZTS_ERR_ARG;
+    }
+#if defined(__WINDOWS__)
+    return ZTS_ERR_GENERAL;
+#else
+    return _sets[set].host_fd[0];
+#endif
+}
+
+int zts_sockset_drain(int set, zts_socket_event_t* events, int max_events)
+{
+    if (! zts_sockset_valid(set) || ! events || max_events <= 0) {
+        return ZTS_ERR_ARG;
+    }
+    zts_socket_set* s = &_sets[set];
+    /* Disarm before consuming the host descriptor so that an event arriving
+    while draining re-signals it instead of being lost */
+    s->armed = false;
+    zts_sockset_reset_host_fd(s);
+    int count = 0;
+    int fd;
+    while (count < max_events && s->ready.try_dequeue(fd)) {
+        zts_socket_watch* w = zts_socket_watch_get(fd);
+        int pending = w->pending.exchange(0);
+        if (pending == 0 || ! w->in_set || w->set != set) {
+            continue;   // Removed from the set after being queued
+        }
+        events[count].fd = fd;
+        events[count].events = pending;
+        count++;
+    }
+    if (s->ready.size_approx() > 0) {
+        zts_sockset_signal(s);
+    }
+    return count;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for per-socket readiness notification
+ */
+
+#ifndef ZTS_SOCKET_EVENTS_HPP
+#define ZTS_SOCKET_EVENTS_HPP
+
+#define ZTS_SOCKET_DISPATCH_THREAD_NAME "ZTSocketDispatchThread"
+
+namespace ZeroTier {
+
+/**
+ * @brief Report readiness of a socket to its callback and/or interest set as
+ * if it had been signaled by the netconn layer. Core lock must be held.
+ *
+ * @usage Called when libzt itself changes a socket's state, e.g. when
+ * zero-copy send completions are posted
+ */
+void zts_socket_watch_notify(int fd, int events);
+
+/**
+ * @brief Forget any callback or interest set membership for a socket. Must be
+ * called before the socket is handed back to lwIP so that a reused descriptor
+ * does not inherit another socket's notifications.
+ *
+ * @usage Called from zts_bsd_close()
+ */
+void zts_socket_watch_clear(int fd);
+
+}   // namespace ZeroTier
+
+#endif   // _H
@@ -0,0 +1,106 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Socket slot allocation and the runtime socket limit
+ *
+ * lwIP looks for a free entry in its socket array by scanning it from the
+ * start, so with many sockets open every socket()/accept() walks past all of
+ * them. The lwIP sources are patched at build time (ext/lwip-patches) with a
+ * hook that asks for the slot to start the scan at. Slots freed by
+ * zts_bsd_close() are kept on a free list and suggested again most recently
+ * freed first; until the list has entries, slots that were never suggested
+ * are handed out in order. The suggestion is
+ * only a hint: lwIP checks that the slot is free and otherwise continues its
+ * scan from there, so a stale entry costs a few steps, never a wrong slot.
+ */
+
+#include "SocketSlots.hpp"
+
+#include "Mutex.hpp"
+#include "ZeroTierSockets.h"
+#include "lwip/opt.h"
+#include "lwiphooks.h"
+
+#include <atomic>
+
+namespace ZeroTier {
+
+static Mutex _slots_m;
+static int _free_slots[NUM_SOCKETS];
+static int _free_count = 0;
+static int _next_slot = 0;   // Slots from here on have not been suggested yet
+
+static std::atomic<int> _open_sockets(0);
+static std::atomic<int> _max_sockets(NUM_SOCKETS);
+
+bool zts_slot_reserve()
+{
+    if (_open_sockets.fetch_add(1) >= _max_sockets.load(std::memory_order_relaxed)) {
+        _open_sockets.fetch_sub(1);
+        zts_errno = ZTS_EMFILE;
+        return false;
+    }
+    return true;
+}
+
+void zts_slot_unreserve()
+{
+    _open_sockets.fetch_sub(1);
+}
+
+void zts_slot_release(int fd)
+{
+    _open_sockets.fetch_sub(1);
+    int i = fd - LWIP_SOCKET_OFFSET;
+    if (i < 0 || i >= NUM_SOCKETS) {
+        return;
+    }
+    Mutex::Lock _l(_slots_m);
+    if (_free_count < NUM_SOCKETS) {
+        _free_slots[_free_count++] = i;
+    }
+}
+
+int zts_slot_set_limit(unsigned int max_sockets)
+{
+    if (max_sockets > NUM_SOCKETS) {
+        return ZTS_ERR_ARG;
+    }
+    _max_sockets = max_sockets ? (int)max_sockets : NUM_SOCKETS;
+    return ZTS_ERR_OK;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int zts_socket_alloc_hint(void)
+{
+    Mutex::Lock _l(_slots_m);
+    if (_free_count > 0) {
+        return _free_slots[--_free_count];
+    }
+    if (_next_slot < NUM_SOCKETS) {
+        return _next_slot++;
+    }
+    return 0;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
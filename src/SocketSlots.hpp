@@ -0,0 +1,52 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for socket slot allocation and the runtime socket limit
+ */
+
+#ifndef ZTS_SOCKET_SLOTS_HPP
+#define ZTS_SOCKET_SLOTS_HPP
+
+namespace ZeroTier {
+
+/**
+ * @brief Count a socket about to be created or accepted against the limit
+ *
+ * @return false (and sets zts_errno to ZTS_EMFILE) if the limit is reached
+ */
+bool zts_slot_reserve();
+
+/**
+ * @brief Give back a reservation for a socket that was not created after all
+ */
+void zts_slot_unreserve();
+
+/**
+ * @brief Called once lwIP has closed fd. Its slot goes to the free list
+ */
+void zts_slot_release(int fd);
+
+/**
+ * @brief Set how many sockets may be open at once, at most ZTS_MAX_SOCKETS.
+ * 0 restores ZTS_MAX_SOCKETS. Sockets already open are not affected
+ *
+ * @return ZTS_ERR_OK, or ZTS_ERR_ARG if the limit is too large
+ */
+int zts_slot_set_limit(unsigned int max_sockets);
+
+}   // namespace ZeroTier
+
+#endif   // _H
@@ -19,10 +19,19 @@
 
 #include "lwip/sockets.h"
 
+#include "Coalesce.hpp"
 #include "Events.hpp"
+#include "SocketBuffers.hpp"
+#include "SocketEvents.hpp"
+#include "SocketSlots.hpp"
+#include "ZeroCopy.hpp"
 #include "ZeroTierSockets.h"
 #include "lwip/dns.h"
 #include "lwip/netdb.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwip/udp.h"
 
 #if defined(__ANDROID__)
 #include <sys/endian.h>
@@ -30,6 +39,10 @@
 
 int zts_errno;
 
+// Delay (ms) between zts_connect() attempts, doubled after every failure
+#define ZTS_CONNECT_RETRY_DELAY_MIN 25
+#define ZTS_CONNECT_RETRY_DELAY_MAX 250
+
 namespace ZeroTier {
 
 #ifdef __cplusplus
@@ -41,7 +54,14 @@ int zts_bsd_socket(const int socket_family, const int socket_type, const int pro
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
-    return lwip_socket(socket_family, socket_type, protocol);
+    if (! zts_slot_reserve()) {
+        return ZTS_ERR_SOCKET;
+    }
+    int fd = lwip_socket(socket_family, socket_type, protocol);
+    if (fd < 0) {
+        zts_slot_unreserve();
+    }
+    return fd;
 }
 
 int zts_bsd_connect(int fd, const struct zts_sockaddr* addr, zts_socklen_t addrlen)
@@ -56,7 +76,11 @@ int zts_bsd_connect(int fd, const struct zts_sockaddr* addr, zts_socklen_t addrl
         || addrlen < (zts_socklen_t)sizeof(struct zts_sockaddr_in)) {
         return ZTS_ERR_ARG;
     }
-    return lwip_connect(fd, (sockaddr*)addr, addrlen);
+    int err = lwip_connect(fd, (sockaddr*)addr, addrlen);
+    if (err == ZTS_ERR_OK) {
+        zts_sockbuf_consumed(fd, 0);
+    }
+    return err;
 }
 
 int zts_bsd_bind(int fd, const struct zts_sockaddr* addr, zts_socklen_t addrlen)
@@ -86,7 +110,18 @@ int zts_bsd_accept(int fd, struct zts_sockaddr* addr, zts_socklen_t* addrlen)
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
-    return lwip_accept(fd, (sockaddr*)addr, (socklen_t*)addrlen);
+    // Like EMFILE on other systems, the connection stays queued on the listener
+    if (! zts_slot_reserve()) {
+        return ZTS_ERR_SOCKET;
+    }
+    int accepted_fd = lwip_accept(fd, (sockaddr*)addr, (socklen_t*)addrlen);
+    if (accepted_fd >= 0) {
+        zts_sockbuf_accepted(fd, accepted_fd);
+    }
+    else {
+        zts_slot_unreserve();
+    }
+    return accepted_fd;
 }
 
 int zts_bsd_setsockopt(int fd, int level, int optname, const void* optval, zts_socklen_t optlen)
@@ -94,6 +129,13 @@ int zts_bsd_setsockopt(int fd, int level, int optname, const void* optval, zts_s
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
+    int err;
+    if (level == SOL_SOCKET && zts_sockbuf_setsockopt(fd, optname, optval, optlen, &err)) {
+        return err;
+    }
+    if (level == IPPROTO_TCP && zts_coalesce_setsockopt(fd, optname, optval, optlen, &err)) {
+        return err;
+    }
     return lwip_setsockopt(fd, level, optname, optval, optlen);
 }
 
@@ -102,6 +144,13 @@ int zts_bsd_getsockopt(int fd, int level, int optname, void* optval, zts_socklen
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
+    int err;
+    if (level == SOL_SOCKET && zts_sockbuf_getsockopt(fd, optname, optval, (unsigned int*)optlen, &err)) {
+        return err;
+    }
+    if (level == IPPROTO_TCP && zts_coalesce_getsockopt(fd, optname, optval, (unsigned int*)optlen, &err)) {
+        return err;
+    }
     return lwip_getsockopt(fd, level, optname, optval, (socklen_t*)optlen);
 }
 
@@ -138,7 +187,15 @@ int zts_bsd_close(int fd)
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
-    return lwip_close(fd);
+    zts_socket_watch_clear(fd);
+    zts_zc_close(fd);
+    zts_sockbuf_close(fd);
+    zts_coalesce_close(fd);
+    int err = lwip_close(fd);
+    if (err == ZTS_ERR_OK) {
+        zts_slot_release(fd);
+    }
+    return err;
 }
 
 int zts_bsd_select(
@@ -189,9 +246,104 @@ ssize_t zts_bsd_send(int fd, const void* buf, size_t len, int flags)
     if (! buf) {
         return ZTS_ERR_ARG;
     }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    ssize_t n;
+    if (zts_coalesce_send(fd, buf, len, flags, &n)) {
+        return n;
+    }
     return lwip_send(fd, buf, len, flags);
 }
 
+/**
+ * Return the TCP PCB behind fd, or NULL if it has none. is_tcp tells whether
+ * fd is an open TCP socket. Core lock must be held. The netconn is read
+ * inside the socket array's protection since lwIP frees it without the core
+ * lock; a PCB found there stays valid until the core lock is released.
+ */
+static struct tcp_pcb* zts_tcp_pcb(int fd, bool* is_tcp)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+    SYS_ARCH_PROTECT(lev);
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    struct netconn* conn = sock ? sock->conn : NULL;
+    *is_tcp = conn && NETCONNTYPE_GROUP(netconn_type(conn)) == NETCONN_TCP;
+    struct tcp_pcb* pcb = *is_tcp ? conn->pcb.tcp : NULL;
+    SYS_ARCH_UNPROTECT(lev);
+    return pcb;
+}
+
+/**
+ * Start connecting and queue the first data on the SYN_SENT pcb so that it
+ * leaves together with the ACK completing the handshake (lwIP holds it back
+ * until then since cwnd is only opened by the SYN-ACK). Sockets that are
+ * connected or connecting already just send
+ */
+static ssize_t
+zts_tcp_send_on_connect(int fd, const void* buf, size_t len, int flags, const struct sockaddr* addr, socklen_t addrlen)
+{
+    bool is_tcp = false;
+    LOCK_TCPIP_CORE();
+    struct tcp_pcb* pcb = zts_tcp_pcb(fd, &is_tcp);
+    bool unconnected = pcb && pcb->state == CLOSED;
+    UNLOCK_TCPIP_CORE();
+    if (! is_tcp) {
+        zts_errno = lwip_socket_dbg_get_socket(fd) ? ZTS_EOPNOTSUPP : ZTS_EBADF;
+        return ZTS_ERR_SOCKET;
+    }
+    if (! unconnected) {
+        return zts_bsd_send(fd, buf, len, flags);
+    }
+    int fl = lwip_fcntl(fd, F_GETFL, 0);
+    if (fl < 0) {
+        return fl;
+    }
+    lwip_fcntl(fd, F_SETFL, fl | O_NONBLOCK);
+    int err = lwip_connect(fd, addr, addrlen);
+    bool connecting = err == 0 || zts_errno == ZTS_EINPROGRESS;
+    size_t queued = 0;
+    if (connecting) {
+        LOCK_TCPIP_CORE();
+        struct tcp_pcb* pcb = zts_tcp_pcb(fd, &is_tcp);
+        if (pcb && pcb->state == SYN_SENT) {
+            u16_t n = (u16_t)LWIP_MIN(len, LWIP_MIN(tcp_sndbuf(pcb), 0xFFFF));
+            if (n > 0 && tcp_write(pcb, buf, n, TCP_WRITE_FLAG_COPY) == ERR_OK) {
+                queued = n;
+            }
+        }
+        UNLOCK_TCPIP_CORE();
+    }
+    lwip_fcntl(fd, F_SETFL, fl);
+    if (! connecting) {
+        return err;
+    }
+    if (fl & O_NONBLOCK) {
+        if (queued) {
+            return queued;
+        }
+        zts_errno = ZTS_EINPROGRESS;
+        return ZTS_ERR_SOCKET;
+    }
+    // Blocking: report the outcome of the handshake, then send the rest
+    struct pollfd pfd = { fd, POLLOUT, 0 };
+    if (lwip_poll(&pfd, 1, -1) < 0) {
+        return ZTS_ERR_SOCKET;
+    }
+    int so_error = 0;
+    socklen_t optlen = sizeof(so_error);
+    lwip_getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &optlen);
+    if (so_error) {
+        zts_errno = so_error;
+        return ZTS_ERR_SOCKET;
+    }
+    if (queued == len) {
+        return queued;
+    }
+    ssize_t n = lwip_send(fd, (const char*)buf + queued, len - queued, flags);
+    return n < 0 ? (queued ? (ssize_t)queued : n) : (ssize_t)queued + n;
+}
+
 ssize_t
 zts_bsd_sendto(int fd, const void* buf, size_t len, int flags, const struct zts_sockaddr* addr, zts_socklen_t addrlen)
 {
@@ -204,6 +356,15 @@ zts_bsd_sendto(int fd, const void* buf, size_t len, int flags, const struct zts_
     if (addrlen > (int)sizeof(struct zts_sockaddr_storage) || addrlen < (int)sizeof(struct zts_sockaddr_in)) {
         return ZTS_ERR_ARG;
     }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    if (zts_coalesce_flush(fd) != ZTS_ERR_OK) {
+        return ZTS_ERR_SOCKET;
+    }
+    if (flags & ZTS_MSG_SEND_ON_CONNECT) {
+        return zts_tcp_send_on_connect(fd, buf, len, flags & ~ZTS_MSG_SEND_ON_CONNECT, (sockaddr*)addr, addrlen);
+    }
     return lwip_sendto(fd, buf, len, flags, (sockaddr*)addr, addrlen);
 }
 
@@ -212,6 +373,12 @@ ssize_t zts_bsd_sendmsg(int fd, const struct zts_msghdr* msg, int flags)
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    if (zts_coalesce_flush(fd) != ZTS_ERR_OK) {
+        return ZTS_ERR_SOCKET;
+    }
     return lwip_sendmsg(fd, (const struct msghdr*)msg, flags);
 }
 
@@ -223,7 +390,11 @@ ssize_t zts_bsd_recv(int fd, void* buf, size_t len, int flags)
     if (! buf) {
         return ZTS_ERR_ARG;
     }
-    return lwip_recv(fd, buf, len, flags);
+    ssize_t n = lwip_recv(fd, buf, len, flags);
+    if (n > 0 && ! (flags & MSG_PEEK)) {
+        zts_sockbuf_consumed(fd, n);
+    }
+    return n;
 }
 
 ssize_t zts_bsd_recvfrom(int fd, void* buf, size_t len, int flags, struct zts_sockaddr* addr, zts_socklen_t* addrlen)
@@ -234,7 +405,11 @@ ssize_t zts_bsd_recvfrom(int fd, void* buf, size_t len, int flags, struct zts_so
     if (! buf) {
         return ZTS_ERR_ARG;
     }
-    return lwip_recvfrom(fd, buf, len, flags, (sockaddr*)addr, (socklen_t*)addrlen);
+    ssize_t n = lwip_recvfrom(fd, buf, len, flags, (sockaddr*)addr, (socklen_t*)addrlen);
+    if (n > 0 && ! (flags & MSG_PEEK)) {
+        zts_sockbuf_consumed(fd, n);
+    }
+    return n;
 }
 
 ssize_t zts_bsd_recvmsg(int fd, struct zts_msghdr* msg, int flags)
@@ -245,7 +420,11 @@ ssize_t zts_bsd_recvmsg(int fd, struct zts_msghdr* msg, int flags)
     if (! msg) {
         return ZTS_ERR_ARG;
     }
-    return lwip_recvmsg(fd, (struct msghdr*)msg, flags);
+    ssize_t n = lwip_recvmsg(fd, (struct msghdr*)msg, flags);
+    if (n > 0 && ! (flags & MSG_PEEK)) {
+        zts_sockbuf_consumed(fd, n);
+    }
+    return n;
 }
 
 ssize_t zts_bsd_read(int fd, void* buf, size_t len)
@@ -256,7 +435,11 @@ ssize_t zts_bsd_read(int fd, void* buf, size_t len)
     if (! buf) {
         return ZTS_ERR_ARG;
     }
-    return lwip_read(fd, buf, len);
+    ssize_t n = lwip_read(fd, buf, len);
+    if (n > 0) {
+        zts_sockbuf_consumed(fd, n);
+    }
+    return n;
 }
 
 ssize_t zts_bsd_readv(int fd, const struct zts_iovec* iov, int iovcnt)
@@ -264,7 +447,11 @@ ssize_t zts_bsd_readv(int fd, const struct zts_iovec* iov, int iovcnt)
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
-    return lwip_readv(fd, (iovec*)iov, iovcnt);
+    ssize_t n = lwip_readv(fd, (iovec*)iov, iovcnt);
+    if (n > 0) {
+        zts_sockbuf_consumed(fd, n);
+    }
+    return n;
 }
 
 ssize_t zts_bsd_write(int fd, const void* buf, size_t len)
@@ -275,6 +462,13 @@ ssize_t zts_bsd_write(int fd, const void* buf, size_t len)
     if (! buf) {
         return ZTS_ERR_ARG;
     }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    ssize_t n;
+    if (zts_coalesce_send(fd, buf, len, 0, &n)) {
+        return n;
+    }
     return lwip_write(fd, buf, len);
 }
 
@@ -283,6 +477,12 @@ ssize_t zts_bsd_writev(int fd, const struct zts_iovec* iov, int iovcnt)
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    if (zts_coalesce_flush(fd) != ZTS_ERR_OK) {
+        return ZTS_ERR_SOCKET;
+    }
     return lwip_writev(fd, (iovec*)iov, iovcnt);
 }
 
@@ -291,9 +491,229 @@ int zts_bsd_shutdown(int fd, int how)
     if (! transport_ok()) {
         return ZTS_ERR_SERVICE;
     }
+    if (how != ZTS_SHUT_RD) {
+        zts_coalesce_flush(fd);
+    }
     return lwip_shutdown(fd, how);
 }
 
+/**
+ * Build a PBUF_REF chain over the application's buffers so that the datagram
+ * is not copied until it is written to the tap. Core lock must be held.
+ */
+static err_t zts_mmsg_to_pbuf(const struct zts_msghdr* msg, struct pbuf** out, size_t* len)
+{
+    struct pbuf* chain = NULL;
+    size_t total = 0;
+    for (int i = 0; i < msg->msg_iovlen; i++) {
+        if (msg->msg_iov[i].iov_len == 0) {
+            continue;
+        }
+        if (! msg->msg_iov[i].iov_base) {
+            pbuf_free(chain);
+            return ERR_ARG;
+        }
+        if (total + msg->msg_iov[i].iov_len > 0xFFFF) {
+            pbuf_free(chain);
+            return ERR_VAL;
+        }
+        struct pbuf* p = pbuf_alloc(PBUF_RAW, (u16_t)msg->msg_iov[i].iov_len, PBUF_REF);
+        if (! p) {
+            pbuf_free(chain);
+            return ERR_MEM;
+        }
+        p->payload = msg->msg_iov[i].iov_base;
+        if (chain) {
+            pbuf_cat(chain, p);
+        }
+        else {
+            chain = p;
+        }
+        total += msg->msg_iov[i].iov_len;
+    }
+    if (! chain) {
+        // Zero-length datagram
+        if (! (chain = pbuf_alloc(PBUF_TRANSPORT, 0, PBUF_RAM))) {
+            return ERR_MEM;
+        }
+    }
+    *out = chain;
+    *len = total;
+    return ERR_OK;
+}
+
+/**
+ * Convert a destination sockaddr into an lwIP address and host-order port.
+ * Returns 0 or the errno of an unsupported family or a short address
+ */
+static int zts_mmsg_to_addr(const struct zts_msghdr* msg, ip_addr_t* addr, u16_t* port)
+{
+    const struct sockaddr* sa = (const struct sockaddr*)msg->msg_name;
+    if (sa->sa_family != AF_INET && sa->sa_family != AF_INET6) {
+        return ZTS_EAFNOSUPPORT;
+    }
+    if (sa->sa_family == AF_INET && msg->msg_namelen >= (zts_socklen_t)sizeof(struct sockaddr_in)) {
+        const struct sockaddr_in* in4 = (const struct sockaddr_in*)sa;
+        inet_addr_to_ip4addr(ip_2_ip4(addr), &in4->sin_addr);
+        IP_SET_TYPE_VAL(*addr, IPADDR_TYPE_V4);
+        *port = lwip_ntohs(in4->sin_port);
+        return 0;
+    }
+    if (sa->sa_family == AF_INET6 && msg->msg_namelen >= (zts_socklen_t)sizeof(struct sockaddr_in6)) {
+        const struct sockaddr_in6* in6 = (const struct sockaddr_in6*)sa;
+        inet6_addr_to_ip6addr(ip_2_ip6(addr), &in6->sin6_addr);
+        IP_SET_TYPE_VAL(*addr, IPADDR_TYPE_V6);
+        *port = lwip_ntohs(in6->sin6_port);
+        // Dual-stack: Unmap IPv4 mapped IPv6 addresses (as lwip_sendto does)
+        if (ip6_addr_isipv4mappedipv6(ip_2_ip6(addr))) {
+            unmap_ipv4_mapped_ipv6(ip_2_ip4(addr), ip_2_ip6(addr));
+            IP_SET_TYPE_VAL(*addr, IPADDR_TYPE_V4);
+        }
+        return 0;
+    }
+    return ZTS_EINVAL;
+}
+
+/**
+ * Return the UDP PCB behind fd, or NULL if fd is not an open UDP socket. Core
+ * lock must be held. lwIP frees a closed socket's netconn without the core
+ * lock, so the netconn is only read inside the socket array's protection. A
+ * PCB found there stays valid until the core lock is released, since removing
+ * it requires the core lock.
+ */
+static struct udp_pcb* zts_mmsg_udp_pcb(int fd, bool* is_udp)
+{
+    SYS_ARCH_DECL_PROTECT(lev);
+    SYS_ARCH_PROTECT(lev);
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    struct netconn* conn = sock ? sock->conn : NULL;
+    *is_udp = conn && NETCONNTYPE_GROUP(netconn_type(conn)) == NETCONN_UDP;
+    struct udp_pcb* pcb = *is_udp ? conn->pcb.udp : NULL;
+    SYS_ARCH_UNPROTECT(lev);
+    return pcb;
+}
+
+/**
+ * Send a vector of datagrams directly on a UDP PCB. The whole batch is sent
+ * while holding the core lock once instead of once per message. Returns false
+ * (without sending anything) if fd is not a UDP socket
+ */
+static bool zts_udp_sendmmsg(int fd, struct zts_mmsghdr* msgvec, unsigned int vlen, int* result)
+{
+    unsigned int n = 0;
+    err_t err = ERR_OK;
+    int error = 0;   // errno not derived from err
+    bool is_udp = false;
+    LOCK_TCPIP_CORE();
+    struct udp_pcb* pcb = zts_mmsg_udp_pcb(fd, &is_udp);
+    if (! is_udp) {
+        UNLOCK_TCPIP_CORE();
+        return false;
+    }
+    for (; n < vlen; n++) {
+        const struct zts_msghdr* msg = &msgvec[n].msg_hdr;
+        if (! pcb) {
+            err = ERR_CONN;
+            break;
+        }
+        if (msg->msg_iovlen < 0 || (msg->msg_iovlen > 0 && ! msg->msg_iov)) {
+            err = ERR_ARG;
+            break;
+        }
+        if (! msg->msg_name && ! (pcb->flags & UDP_FLAGS_CONNECTED)) {
+            err = ERR_CONN;
+            break;
+        }
+        ip_addr_t addr;
+        u16_t port = 0;
+        if (msg->msg_name && (error = zts_mmsg_to_addr(msg, &addr, &port)) != 0) {
+            break;
+        }
+        struct pbuf* p = NULL;
+        size_t len = 0;
+        if ((err = zts_mmsg_to_pbuf(msg, &p, &len)) != ERR_OK) {
+            // Only the length check fails with ERR_VAL there
+            error = err == ERR_VAL ? ZTS_EMSGSIZE : 0;
+            break;
+        }
+        err = msg->msg_name ? udp_sendto(pcb, p, &addr, port) : udp_send(pcb, p);
+        pbuf_free(p);
+        if (err != ERR_OK) {
+            break;
+        }
+        msgvec[n].msg_len = (unsigned int)len;
+    }
+    UNLOCK_TCPIP_CORE();
+    if (n == 0 && (error || err != ERR_OK)) {
+        zts_errno = error ? error : err_to_errno(err);
+        *result = ZTS_ERR_SOCKET;
+    }
+    else {
+        *result = (int)n;
+    }
+    return true;
+}
+
+int zts_bsd_sendmmsg(int fd, struct zts_mmsghdr* msgvec, unsigned int vlen, int flags)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! msgvec) {
+        return ZTS_ERR_ARG;
+    }
+    if (zts_sockbuf_send_refused(fd)) {
+        return ZTS_ERR_SOCKET;
+    }
+    vlen = vlen > ZTS_MMSG_MAX ? ZTS_MMSG_MAX : vlen;
+    int result = 0;
+    if (zts_udp_sendmmsg(fd, msgvec, vlen, &result)) {
+        return result;
+    }
+    // Other socket types go through lwIP's socket layer, which validates fd
+    unsigned int n = 0;
+    for (; n < vlen; n++) {
+        ssize_t len = lwip_sendmsg(fd, (const struct msghdr*)&msgvec[n].msg_hdr, flags);
+        if (len < 0) {
+            break;
+        }
+        msgvec[n].msg_len = (unsigned int)len;
+    }
+    return (n == 0 && vlen > 0) ? ZTS_ERR_SOCKET : (int)n;
+}
+
+int zts_bsd_recvmmsg(int fd, struct zts_mmsghdr* msgvec, unsigned int vlen, int flags)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! msgvec) {
+        return ZTS_ERR_ARG;
+    }
+    vlen = vlen > ZTS_MMSG_MAX ? ZTS_MMSG_MAX : vlen;
+    /* Received datagrams are taken straight off the netconn's mailbox by the
+    calling thread, so (unlike sending) no trip through the core is needed per
+    message. Only the first receive may block */
+    unsigned int n = 0;
+    size_t total = 0;
+    for (; n < vlen; n++) {
+        ssize_t len = lwip_recvmsg(fd, (struct msghdr*)&msgvec[n].msg_hdr, n == 0 ? flags : flags | ZTS_MSG_DONTWAIT);
+        if (len < 0) {
+            break;
+        }
+        msgvec[n].msg_len = (unsigned int)len;
+        total += (size_t)len;
+        if (flags & ZTS_MSG_PEEK) {
+            n++;
+            break;
+        }
+    }
+    if (total > 0 && ! (flags & ZTS_MSG_PEEK)) {
+        zts_sockbuf_consumed(fd, total);
+    }
+    return (n == 0 && vlen > 0) ? ZTS_ERR_SOCKET : (int)n;
+}
+
 struct zts_hostent* zts_bsd_gethostbyname(const char* name)
 {
     if (! transport_ok()) {
@@ -409,9 +829,6 @@ int zts_connect(int fd, const char* ipstr, unsigned short port, int timeout_ms)
     if (timeout_ms == 0) {
         timeout_ms = 30000;   // Default
     }
-    int div = 4;   // Must be > 0, Four connection attempts per second
-    int n_tries = (timeout_ms / 1000) * div;
-    int connect_delay = 1000 / div;
     int err = ZTS_ERR_SOCKET;
 
     zts_socklen_t addrlen = 0;
@@ -425,12 +842,17 @@ int zts_connect(int fd, const char* ipstr, unsigned short port, int timeout_ms)
     sa = (struct zts_sockaddr*)&ss;
 
     if (addrlen > 0 && sa != NULL) {
-        if (zts_get_blocking(fd)) {
-            do {
-                err = zts_bsd_connect(fd, sa, addrlen);
-                zts_util_delay(connect_delay);
-                n_tries--;
-            } while ((err < 0) && (zts_errno != 0) && (n_tries > 0));
+        if (! zts_get_blocking(fd)) {
+            return zts_bsd_connect(fd, sa, addrlen);
+        }
+        // Back off between attempts, starting low since the first retry
+        // usually succeeds once the peer link is up
+        int delay = ZTS_CONNECT_RETRY_DELAY_MIN;
+        int waited = 0;
+        while ((err = zts_bsd_connect(fd, sa, addrlen)) < 0 && (zts_errno != 0) && (waited < timeout_ms)) {
+            zts_util_delay(delay);
+            waited += delay;
+            delay = delay * 2 > ZTS_CONNECT_RETRY_DELAY_MAX ? ZTS_CONNECT_RETRY_DELAY_MAX : delay * 2;
         }
         return err;
     }
@@ -562,9 +984,10 @@ int zts_tcp_client(const char* remote_ipstr, unsigned short remote_port)
         return fd;   // Failed to create socket
     }
     int timeout = 0;
-    if ((fd = zts_connect(fd, remote_ipstr, remote_port, timeout)) < 0) {
+    int err;
+    if ((err = zts_connect(fd, remote_ipstr, remote_port, timeout)) < 0) {
         zts_bsd_close(fd);
-        return fd;   // Failed to connect
+        return err;   // Failed to connect
     }
     return fd;
 }
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * SACK-based TCP loss recovery (RFC 6675 style).
+ *
+ * lwIP advertises SACK (LWIP_TCP_SACK_OUT) but as a sender ignores the SACK
+ * blocks it receives: only the first unacknowledged segment is ever fast
+ * retransmitted, so a second loss in the same window waits for the RTO. Here
+ * the SACK blocks of every incoming ACK are collected into a per-connection
+ * scoreboard from lwIP's input hook. Once lwIP has processed the ACK, every
+ * unacknowledged segment with more than (DupThresh - 1) * MSS bytes SACKed
+ * above it is considered lost and handed back to tcp_output(), once per
+ * recovery episode, the same way tcp_rexmit() does for the first segment.
+ */
+
+#include "TcpRecovery.hpp"
+
+#include "lwip/def.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/tcp.h"
+#include "lwip/tcpip.h"
+#include "lwiphooks.h"
+
+#include <new>
+
+// Number of SACKed segments above a hole after which it is considered lost
+#define ZTS_TCP_SACK_DUPTHRESH 3
+
+// Maximum number of disjoint SACKed ranges remembered per connection
+#define ZTS_TCP_SACK_RANGES 8
+
+#define ZTS_TCP_OPT_SACK 5
+
+namespace ZeroTier {
+
+struct zts_tcp_recovery_stats zts_tcp_recovery_counters;
+
+struct zts_sack_range {
+    u32_t start;
+    u32_t end;
+};
+
+/**
+ * SACK scoreboard of a connection
+ */
+struct zts_tcp_sack {
+    struct tcp_pcb* pcb;
+    zts_sack_range ranges[ZTS_TCP_SACK_RANGES];   // Sorted, disjoint
+    int num_ranges;
+    bool in_recovery;
+    u32_t recovery_point;   // snd_nxt when the episode started
+    u32_t rexmit_high;      // Everything below was retransmitted this episode
+    bool scheduled;         // zts_tcp_sack_recover() is queued
+    bool dead;              // pcb freed while queued, free on dequeue
+};
+
+static u8_t _sack_id = LWIP_TCP_PCB_NUM_EXT_ARGS;   // Not yet allocated
+
+static void zts_tcp_sack_destroy(u8_t id, void* data)
+{
+    LWIP_UNUSED_ARG(id);
+    zts_tcp_sack* st = (zts_tcp_sack*)data;
+    if (st->scheduled) {
+        st->dead = true;
+    }
+    else {
+        delete st;
+    }
+}
+
+static const struct tcp_ext_arg_callbacks _sack_callbacks = { zts_tcp_sack_destroy, NULL };
+
+/**
+ * Add a received SACK block to the scoreboard, merging overlapping ranges
+ */
+static void zts_tcp_sack_add(zts_tcp_sack* st, u32_t start, u32_t end)
+{
+    zts_sack_range* r = st->ranges;
+    int i = 0;
+    while (i < st->num_ranges && TCP_SEQ_LT(r[i].end, start)) {
+        i++;
+    }
+    if (i < st->num_ranges && TCP_SEQ_LEQ(r[i].start, end)) {
+        // Overlaps range i, and possibly the ones following it
+        r[i].start = TCP_SEQ_LT(start, r[i].start) ? start : r[i].start;
+        r[i].end = TCP_SEQ_GT(end, r[i].end) ? end : r[i].end;
+        int j = i + 1;
+        while (j < st->num_ranges && TCP_SEQ_LEQ(r[j].start, r[i].end)) {
+            r[i].end = TCP_SEQ_GT(r[j].end, r[i].end) ? r[j].end : r[i].end;
+            j++;
+        }
+        for (int k = j; k < st->num_ranges; k++) {
+            r[i + 1 + k - j] = r[k];
+        }
+        st->num_ranges -= j - i - 1;
+        return;
+    }
+    if (i == ZTS_TCP_SACK_RANGES) {
+        return;   // Full, the lowest holes matter most
+    }
+    int last = st->num_ranges < ZTS_TCP_SACK_RANGES ? st->num_ranges : ZTS_TCP_SACK_RANGES - 1;
+    for (int k = last; k > i; k--) {
+        r[k] = r[k - 1];
+    }
+    r[i].start = start;
+    r[i].end = end;
+    if (st->num_ranges < ZTS_TCP_SACK_RANGES) {
+        st->num_ranges++;
+    }
+}
+
+/**
+ * Drop everything the cumulative ACK has covered
+ */
+static void zts_tcp_sack_prune(zts_tcp_sack* st, u32_t ackno)
+{
+    int i = 0;
+    while (i < st->num_ranges && TCP_SEQ_LEQ(st->ranges[i].end, ackno)) {
+        i++;
+    }
+    for (int k = i; k < st->num_ranges; k++) {
+        st->ranges[k - i] = st->ranges[k];
+    }
+    st->num_ranges -= i;
+}
+
+static u32_t zts_tcp_sack_bytes_above(zts_tcp_sack* st, u32_t seq)
+{
+    u32_t bytes = 0;
+    for (int i = 0; i < st->num_ranges; i++) {
+        if (TCP_SEQ_GEQ(st->ranges[i].start, seq)) {
+            bytes += st->ranges[i].end - st->ranges[i].start;
+        }
+        else if (TCP_SEQ_GT(st->ranges[i].end, seq)) {
+            bytes += st->ranges[i].end - seq;
+        }
+    }
+    return bytes;
+}
+
+static bool zts_tcp_sack_covered(zts_tcp_sack* st, u32_t start, u32_t end)
+{
+    for (int i = 0; i < st->num_ranges; i++) {
+        if (TCP_SEQ_LEQ(st->ranges[i].start, start) && TCP_SEQ_GEQ(st->ranges[i].end, end)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Retransmit every segment the scoreboard marks lost. Runs on the tcpip
+ * thread after lwIP has processed the ACK that scheduled it
+ */
+static void zts_tcp_sack_recover(void* arg)
+{
+    zts_tcp_sack* st = (zts_tcp_sack*)arg;
+    st->scheduled = false;
+    if (st->dead) {
+        delete st;
+        return;
+    }
+    struct tcp_pcb* pcb = st->pcb;
+    if (pcb->state < ESTABLISHED || pcb->state == TIME_WAIT) {
+        return;
+    }
+    zts_tcp_sack_prune(st, pcb->lastack);
+    if (st->in_recovery && TCP_SEQ_GEQ(pcb->lastack, st->recovery_point)) {
+        st->in_recovery = false;
+    }
+    if (! st->num_ranges) {
+        return;
+    }
+    u32_t thresh = (ZTS_TCP_SACK_DUPTHRESH - 1) * pcb->mss;
+    bool sent = false;
+    struct tcp_seg** prev = &pcb->unacked;
+    while (*prev) {
+        struct tcp_seg* seg = *prev;
+        u32_t seq = lwip_ntohl(seg->tcphdr->seqno);
+        u32_t end = seq + TCP_TCPLEN(seg);
+        bool retransmitted = st->in_recovery && TCP_SEQ_LEQ(end, st->rexmit_high);
+        if (retransmitted || zts_tcp_sack_covered(st, seq, end) || zts_tcp_sack_bytes_above(st, end) <= thresh
+            || seg->p->ref != 1) {
+            prev = &seg->next;
+            continue;
+        }
+        if (! st->in_recovery) {
+            st->in_recovery = true;
+            st->recovery_point = pcb->snd_nxt;
+            st->rexmit_high = seq;
+            zts_tcp_recovery_counters.recovery++;
+        }
+        // Same as tcp_rexmit(), for an arbitrary unacknowledged segment
+        *prev = seg->next;
+        struct tcp_seg** cur = &pcb->unsent;
+        while (*cur && TCP_SEQ_LT(lwip_ntohl((*cur)->tcphdr->seqno), seq)) {
+            cur = &((*cur)->next);
+        }
+        seg->next = *cur;
+        *cur = seg;
+#if TCP_OVERSIZE
+        if (seg->next == NULL) {
+            pcb->unsent_oversize = 0;
+        }
+#endif
+        st->rexmit_high = end;
+        zts_tcp_recovery_counters.sack_rexmit++;
+        sent = true;
+    }
+    if (sent) {
+        pcb->rttest = 0;   // Karn's rule
+        tcp_output(pcb);
+    }
+}
+
+static u8_t zts_tcp_opt_byte(struct tcp_hdr* hdr, u16_t opt1len, u8_t* opt2, u16_t i)
+{
+    return i < opt1len ? ((u8_t*)(hdr + 1))[i] : opt2[i - opt1len];
+}
+
+static u32_t zts_tcp_opt_u32(struct tcp_hdr* hdr, u16_t opt1len, u8_t* opt2, u16_t i)
+{
+    u32_t v = 0;
+    for (u16_t k = 0; k < 4; k++) {
+        v = (v << 8) | zts_tcp_opt_byte(hdr, opt1len, opt2, (u16_t)(i + k));
+    }
+    return v;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void zts_tcp_sack_input(struct tcp_pcb* pcb, struct tcp_hdr* hdr, u16_t optlen, u16_t opt1len, u8_t* opt2)
+{
+    if (! optlen || pcb->state < ESTABLISHED || pcb->state == TIME_WAIT || ! (TCPH_FLAGS(hdr) & TCP_ACK)) {
+        return;
+    }
+    zts_tcp_sack* st = NULL;
+    u16_t i = 0;
+    while (i < optlen) {
+        u8_t kind = zts_tcp_opt_byte(hdr, opt1len, opt2, i);
+        if (kind == LWIP_TCP_OPT_EOL) {
+            break;
+        }
+        if (kind == LWIP_TCP_OPT_NOP) {
+            i++;
+            continue;
+        }
+        if (i + 1 >= optlen) {
+            break;
+        }
+        u8_t len = zts_tcp_opt_byte(hdr, opt1len, opt2, (u16_t)(i + 1));
+        if (len < 2 || i + len > optlen) {
+            break;   // Malformed, lwIP will ignore the rest too
+        }
+        if (kind == ZTS_TCP_OPT_SACK && len >= 10) {
+            if (! st) {
+                if (_sack_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+                    _sack_id = tcp_ext_arg_alloc_id();
+                }
+                st = (zts_tcp_sack*)tcp_ext_arg_get(pcb, _sack_id);
+                if (! st) {
+                    if (! (st = new (std::nothrow) zts_tcp_sack())) {
+                        return;
+                    }
+                    st->pcb = pcb;
+                    tcp_ext_arg_set_callbacks(pcb, _sack_id, &_sack_callbacks);
+                    tcp_ext_arg_set(pcb, _sack_id, st);
+                }
+            }
+            u32_t ackno = lwip_ntohl(hdr->ackno);
+            for (u16_t b = (u16_t)(i + 2); b + 8 <= i + len; b = (u16_t)(b + 8)) {
+                u32_t start = zts_tcp_opt_u32(hdr, opt1len, opt2, b);
+                u32_t end = zts_tcp_opt_u32(hdr, opt1len, opt2, (u16_t)(b + 4));
+                // Ignore D-SACKs and blocks outside of what was sent
+                if (TCP_SEQ_LT(start, end) && TCP_SEQ_GT(start, ackno) && TCP_SEQ_LEQ(end, pcb->snd_nxt)) {
+                    zts_tcp_sack_add(st, start, end);
+                }
+            }
+        }
+        i = (u16_t)(i + len);
+    }
+    if (st && st->num_ranges && ! st->scheduled && tcpip_try_callback(zts_tcp_sack_recover, st) == ERR_OK) {
+        st->scheduled = true;
+    }
+}
+
+u32_t* zts_tcp_sack_output(const struct tcp_pcb* pcb, struct tcp_hdr* hdr, u32_t* opts)
+{
+    if (! pcb || pcb->state < ESTABLISHED) {
+        return opts;
+    }
+    // Data segments are output from the head of unsent (keepalives also use an old seqno)
+    u32_t seq = lwip_ntohl(hdr->seqno);
+    if (TCP_SEQ_LT(seq, pcb->snd_nxt) && pcb->unsent && lwip_ntohl(pcb->unsent->tcphdr->seqno) == seq) {
+        zts_tcp_recovery_counters.rexmit++;
+    }
+    return opts;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
@@ -0,0 +1,40 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for SACK-based TCP loss recovery
+ */
+
+#ifndef ZTS_TCP_RECOVERY_HPP
+#define ZTS_TCP_RECOVERY_HPP
+
+#include <stdint.h>
+
+namespace ZeroTier {
+
+/**
+ * Retransmission counters, only modified with the core lock held
+ */
+struct zts_tcp_recovery_stats {
+    uint32_t rexmit;        // Segments retransmitted for any reason
+    uint32_t sack_rexmit;   // Segments retransmitted because SACK marked them lost
+    uint32_t recovery;      // SACK loss recovery episodes entered
+};
+
+extern struct zts_tcp_recovery_stats zts_tcp_recovery_counters;
+
+}   // namespace ZeroTier
+
+#endif   // _H
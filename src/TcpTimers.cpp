@@ -0,0 +1,514 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Hierarchical timer wheel for the per-connection TCP timers.
+ *
+ * lwIP's tcp_fasttmr() and tcp_slowtmr() visit every connection on every
+ * tick, so idle connections cost as much timer work as busy ones. lwIP is
+ * patched (ext/lwip-patches) to hand its TCP timer tick to this file, which
+ * keeps every connection in a timer wheel and only visits the ones that are
+ * due. What a visit does is what lwIP 2.1's timers do for that connection.
+ *
+ * A connection with anything pending (data in flight or queued, persist
+ * timer, delayed ACK, out of sequence or refused data, a netconn waiting to
+ * write or close) is visited on every tick, exactly like lwIP would. An idle
+ * one is parked until its keepalive, FIN-WAIT-2 or TIME-WAIT deadline, and
+ * for no longer than ZTS_TCP_TIMER_RECHECK: lwIP retries a write or close
+ * that failed for lack of memory from its timers, without sending anything
+ * that would wake the connection. Every segment a connection receives or
+ * sends, and setting one of its keepalive options, wakes it for the next tick.
+ *
+ * lwIP inserts new connections at the head of tcp_active_pcbs and
+ * tcp_tw_pcbs, so those found there on each tick are added until the first
+ * one that is known already.
+ *
+ * Everything here runs with the core lock held.
+ */
+
+#include "lwip/api.h"
+#include "lwip/def.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/tcp.h"
+#include "lwiphooks.h"
+
+#include <new>
+
+// Each level has 2^ZTS_TCP_WHEEL_BITS slots, the first one of a tick each
+#define ZTS_TCP_WHEEL_BITS   6
+#define ZTS_TCP_WHEEL_SLOTS  (1 << ZTS_TCP_WHEEL_BITS)
+#define ZTS_TCP_WHEEL_LEVELS 4
+
+// Longest an idle connection is left alone, ms
+#define ZTS_TCP_TIMER_RECHECK 10000
+
+namespace ZeroTier {
+
+// List a connection was last found on
+enum { ZTS_TCP_TIMER_ACTIVE = 1, ZTS_TCP_TIMER_TW = 2 };
+
+/**
+ * Wheel entry of a connection, stored in its PCB's ext arg
+ */
+struct zts_tcp_timer {
+    struct tcp_pcb* pcb;
+    zts_tcp_timer* next;
+    zts_tcp_timer** pprev;   // NULL while not in the wheel
+    u32_t expires;           // Tick it is due at
+    u8_t list;
+};
+
+// Copies of the backoff tables in lwIP's tcp.c
+static const u8_t _tcp_backoff[13] = { 1, 2, 3, 4, 5, 6, 7, 7, 7, 7, 7, 7, 7 };
+static const u8_t _tcp_persist_backoff[7] = { 3, 6, 12, 24, 48, 96, 120 };
+
+static zts_tcp_timer* _wheel[ZTS_TCP_WHEEL_LEVELS][ZTS_TCP_WHEEL_SLOTS];
+static u32_t _now = 0;   // Ticks of TCP_TMR_INTERVAL
+static u8_t _timer_id = LWIP_TCP_PCB_NUM_EXT_ARGS;   // Not yet allocated
+
+// Entry being visited, reset if its connection is freed by a callback meanwhile
+static zts_tcp_timer* _running = NULL;
+
+static void zts_tcp_timer_unlink(zts_tcp_timer* t)
+{
+    if (! t->pprev) {
+        return;
+    }
+    *t->pprev = t->next;
+    if (t->next) {
+        t->next->pprev = t->pprev;
+    }
+    t->next = NULL;
+    t->pprev = NULL;
+}
+
+/**
+ * Put an entry in the wheel. Only entries cascading down from a higher level
+ * may be due at the current tick, everything else is due at the next one at
+ * the earliest
+ */
+static void zts_tcp_timer_insert(zts_tcp_timer* t, u32_t expires)
+{
+    s32_t delta = (s32_t)(expires - _now);
+    if (delta < 0) {
+        delta = 0;
+    }
+    if (delta >= (s32_t)1 << (ZTS_TCP_WHEEL_BITS * ZTS_TCP_WHEEL_LEVELS)) {
+        delta = ((s32_t)1 << (ZTS_TCP_WHEEL_BITS * ZTS_TCP_WHEEL_LEVELS)) - 1;   // Visited early, then parked again
+    }
+    t->expires = _now + (u32_t)delta;
+    int level = 0;
+    while (level < ZTS_TCP_WHEEL_LEVELS - 1 && delta >= (s32_t)1 << (ZTS_TCP_WHEEL_BITS * (level + 1))) {
+        level++;
+    }
+    zts_tcp_timer** head = &_wheel[level][(t->expires >> (ZTS_TCP_WHEEL_BITS * level)) & (ZTS_TCP_WHEEL_SLOTS - 1)];
+    t->next = *head;
+    if (t->next) {
+        t->next->pprev = &t->next;
+    }
+    t->pprev = head;
+    *head = t;
+}
+
+static void zts_tcp_timer_destroy(u8_t id, void* data)
+{
+    LWIP_UNUSED_ARG(id);
+    zts_tcp_timer* t = (zts_tcp_timer*)data;
+    zts_tcp_timer_unlink(t);
+    if (_running == t) {
+        _running = NULL;
+    }
+    delete t;
+}
+
+static const struct tcp_ext_arg_callbacks _timer_callbacks = { zts_tcp_timer_destroy, NULL };
+
+/**
+ * Wake an entry up for the next tick. Entries not in the wheel are either new
+ * (found by the next scan) or being visited (scheduled when done)
+ */
+static void zts_tcp_timer_wake_entry(zts_tcp_timer* t)
+{
+    if (t->pprev && t->expires != _now + 1) {
+        zts_tcp_timer_unlink(t);
+        zts_tcp_timer_insert(t, _now + 1);
+    }
+}
+
+/**
+ * Add the connections lwIP has inserted at the head of a list since the last
+ * tick, and those that moved there from the other list
+ */
+static void zts_tcp_timer_scan(struct tcp_pcb* pcb, u8_t list)
+{
+    for (; pcb; pcb = pcb->next) {
+        zts_tcp_timer* t = (zts_tcp_timer*)tcp_ext_arg_get(pcb, _timer_id);
+        if (t && t->list == list) {
+            break;   // Found on an earlier tick, like all connections behind it
+        }
+        if (! t) {
+            if (! (t = new (std::nothrow) zts_tcp_timer())) {
+                continue;   // Tried again on the next tick
+            }
+            t->pcb = pcb;
+            t->next = NULL;
+            t->pprev = NULL;
+            tcp_ext_arg_set_callbacks(pcb, _timer_id, &_timer_callbacks);
+            tcp_ext_arg_set(pcb, _timer_id, t);
+        }
+        t->list = list;
+        zts_tcp_timer_unlink(t);
+        zts_tcp_timer_insert(t, _now + 1);
+    }
+}
+
+/**
+ * Send a FIN that tcp_close() could not queue for lack of memory. Same as
+ * tcp_close_shutdown_fin() in lwIP's tcp.c, which is static
+ */
+static void zts_tcp_timer_close_fin(struct tcp_pcb* pcb)
+{
+    err_t err = ERR_OK;
+    switch (pcb->state) {
+        case SYN_RCVD:
+            if ((err = tcp_send_fin(pcb)) == ERR_OK) {
+                tcp_backlog_accepted(pcb);
+                pcb->state = FIN_WAIT_1;
+            }
+            break;
+        case ESTABLISHED:
+            if ((err = tcp_send_fin(pcb)) == ERR_OK) {
+                pcb->state = FIN_WAIT_1;
+            }
+            break;
+        case CLOSE_WAIT:
+            if ((err = tcp_send_fin(pcb)) == ERR_OK) {
+                pcb->state = LAST_ACK;
+            }
+            break;
+        default:
+            return;
+    }
+    if (err == ERR_OK) {
+        tcp_output(pcb);
+    }
+    else if (err == ERR_MEM) {
+        tcp_set_flags(pcb, TF_CLOSEPEND);
+    }
+}
+
+/**
+ * tcp_fasttmr() for one connection. Returns false if the connection was freed
+ */
+static bool zts_tcp_timer_fast(struct tcp_pcb* pcb)
+{
+    if (pcb->flags & TF_ACK_DELAY) {
+        tcp_ack_now(pcb);
+        tcp_output(pcb);
+        tcp_clear_flags(pcb, TF_ACK_DELAY | TF_ACK_NOW);
+    }
+    if (pcb->flags & TF_CLOSEPEND) {
+        tcp_clear_flags(pcb, TF_CLOSEPEND);
+        zts_tcp_timer_close_fin(pcb);
+    }
+    if (pcb->refused_data) {
+        tcp_process_refused_data(pcb);
+    }
+    return _running != NULL;
+}
+
+/**
+ * tcp_slowtmr() for one active connection. Returns false if the connection
+ * was freed
+ */
+static bool zts_tcp_timer_slow(struct tcp_pcb* pcb)
+{
+    bool remove = false;
+    bool reset = false;
+    if (pcb->state == SYN_SENT && pcb->nrtx >= TCP_SYNMAXRTX) {
+        remove = true;
+    }
+    else if (pcb->nrtx >= TCP_MAXRTX) {
+        remove = true;
+    }
+    else if (pcb->persist_backoff > 0) {
+        if (pcb->persist_probe >= TCP_MAXRTX) {
+            remove = true;
+        }
+        else {
+            u8_t backoff_cnt = _tcp_persist_backoff[pcb->persist_backoff - 1];
+            if (pcb->persist_cnt < backoff_cnt) {
+                pcb->persist_cnt++;
+            }
+            if (pcb->persist_cnt >= backoff_cnt) {
+                bool next_slot = true;
+                if (pcb->snd_wnd == 0) {
+                    // Zero window, send 1 byte probes
+                    if (tcp_zero_window_probe(pcb) != ERR_OK) {
+                        next_slot = false;
+                    }
+                }
+                else if (tcp_split_unsent_seg(pcb, (u16_t)pcb->snd_wnd) == ERR_OK && tcp_output(pcb) == ERR_OK) {
+                    next_slot = false;   // Sending cancels the persist timer
+                }
+                if (next_slot) {
+                    pcb->persist_cnt = 0;
+                    if (pcb->persist_backoff < sizeof(_tcp_persist_backoff)) {
+                        pcb->persist_backoff++;
+                    }
+                }
+            }
+        }
+    }
+    else {
+        if (pcb->rtime >= 0 && pcb->rtime < 0x7FFF) {
+            ++pcb->rtime;
+        }
+        if (pcb->rtime >= pcb->rto) {
+            if (tcp_rexmit_rto_prepare(pcb) == ERR_OK || (! pcb->unacked && pcb->unsent)) {
+                if (pcb->state != SYN_SENT) {
+                    u8_t backoff_idx = LWIP_MIN(pcb->nrtx, sizeof(_tcp_backoff) - 1);
+                    int calc_rto = ((pcb->sa >> 3) + pcb->sv) << _tcp_backoff[backoff_idx];
+                    pcb->rto = (s16_t)LWIP_MIN(calc_rto, 0x7FFF);
+                }
+                pcb->rtime = 0;
+                tcpwnd_size_t eff_wnd = LWIP_MIN(pcb->cwnd, pcb->snd_wnd);
+                pcb->ssthresh = eff_wnd >> 1;
+                if (pcb->ssthresh < (tcpwnd_size_t)(pcb->mss << 1)) {
+                    pcb->ssthresh = (tcpwnd_size_t)(pcb->mss << 1);
+                }
+                pcb->cwnd = pcb->mss;
+                pcb->bytes_acked = 0;
+                tcp_rexmit_rto_commit(pcb);
+            }
+        }
+    }
+    // A connection closed with SHUT_WR stays in FIN-WAIT-2 as long as it likes
+    if (pcb->state == FIN_WAIT_2 && (pcb->flags & TF_RXCLOSED)
+        && (u32_t)(tcp_ticks - pcb->tmr) > TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL) {
+        remove = true;
+    }
+    if (ip_get_option(pcb, SOF_KEEPALIVE) && (pcb->state == ESTABLISHED || pcb->state == CLOSE_WAIT)) {
+        if ((u32_t)(tcp_ticks - pcb->tmr) > (pcb->keep_idle + TCP_KEEP_DUR(pcb)) / TCP_SLOW_INTERVAL) {
+            remove = true;
+            reset = true;
+        }
+        else if (
+            (u32_t)(tcp_ticks - pcb->tmr)
+            > (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb)) / TCP_SLOW_INTERVAL) {
+            if (tcp_keepalive(pcb) == ERR_OK) {
+                pcb->keep_cnt_sent++;
+            }
+        }
+    }
+#if TCP_QUEUE_OOSEQ
+    // Out of sequence data held for too long is dropped, it will be retransmitted
+    if (pcb->ooseq && tcp_ticks - pcb->tmr >= (u32_t)pcb->rto * TCP_OOSEQ_TIMEOUT) {
+        tcp_free_ooseq(pcb);
+    }
+#endif
+    if (pcb->state == SYN_RCVD && (u32_t)(tcp_ticks - pcb->tmr) > TCP_SYN_RCVD_TIMEOUT / TCP_SLOW_INTERVAL) {
+        remove = true;
+    }
+    if (pcb->state == LAST_ACK && (u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+        remove = true;
+    }
+    if (remove) {
+        tcp_err_fn err_fn = pcb->errf;
+        void* err_arg = pcb->callback_arg;
+        enum tcp_state last_state = pcb->state;
+        tcp_pcb_purge(pcb);
+        TCP_RMV_ACTIVE(pcb);
+        if (reset) {
+            tcp_rst(
+                pcb,
+                pcb->snd_nxt,
+                pcb->rcv_nxt,
+                &pcb->local_ip,
+                &pcb->remote_ip,
+                pcb->local_port,
+                pcb->remote_port);
+        }
+        tcp_free(pcb);
+        TCP_EVENT_ERR(last_state, err_fn, err_arg, ERR_ABRT);
+        return false;
+    }
+    ++pcb->polltmr;
+    if (pcb->polltmr >= pcb->pollinterval) {
+        pcb->polltmr = 0;
+        err_t err = ERR_OK;
+        TCP_EVENT_POLL(pcb, err);
+        if (! _running) {
+            return false;
+        }
+        if (err == ERR_OK) {
+            tcp_output(pcb);
+        }
+    }
+    return true;
+}
+
+/**
+ * Whether a connection has nothing for the timers to do before one of its
+ * deadlines
+ */
+static bool zts_tcp_timer_idle(const struct tcp_pcb* pcb)
+{
+    if (pcb->state != ESTABLISHED && pcb->state != CLOSE_WAIT && pcb->state != FIN_WAIT_2) {
+        return false;
+    }
+    if (pcb->unacked || pcb->unsent || pcb->rtime >= 0 || pcb->persist_backoff || pcb->refused_data
+        || (pcb->flags & (TF_ACK_DELAY | TF_ACK_NOW | TF_CLOSEPEND)) || pcb->nrtx >= TCP_MAXRTX) {
+        return false;
+    }
+#if TCP_QUEUE_OOSEQ
+    if (pcb->ooseq) {
+        return false;
+    }
+#endif
+    if (pcb->poll) {
+        // The netconn's poll callback only has work while a write or close is pending
+        const struct netconn* conn = (const struct netconn*)pcb->callback_arg;
+        if (! conn || conn->state != NETCONN_NONE || (conn->flags & NETCONN_FLAG_CHECK_WRITESPACE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Slow timer ticks until `tcp_ticks - pcb->tmr > limit` first holds
+ */
+static s32_t zts_tcp_timer_until(const struct tcp_pcb* pcb, u32_t limit)
+{
+    return (s32_t)(pcb->tmr + limit + 1 - tcp_ticks);
+}
+
+static void zts_tcp_timer_schedule(zts_tcp_timer* t)
+{
+    const struct tcp_pcb* pcb = t->pcb;
+    s32_t slow = 0;
+    if (pcb->state == CLOSED) {
+        slow = ZTS_TCP_TIMER_RECHECK / TCP_SLOW_INTERVAL;   // Back on a list with a segment sent, which wakes it
+    }
+    else if (pcb->state == TIME_WAIT) {
+        slow = zts_tcp_timer_until(pcb, 2 * TCP_MSL / TCP_SLOW_INTERVAL);
+    }
+    else if (zts_tcp_timer_idle(pcb)) {
+        slow = ZTS_TCP_TIMER_RECHECK / TCP_SLOW_INTERVAL;
+        if (pcb->state == FIN_WAIT_2 && (pcb->flags & TF_RXCLOSED)) {
+            slow = LWIP_MIN(slow, zts_tcp_timer_until(pcb, TCP_FIN_WAIT_TIMEOUT / TCP_SLOW_INTERVAL));
+        }
+        if (ip_get_option(pcb, SOF_KEEPALIVE) && pcb->state != FIN_WAIT_2) {
+            u32_t limit = (pcb->keep_idle + pcb->keep_cnt_sent * TCP_KEEP_INTVL(pcb)) / TCP_SLOW_INTERVAL;
+            slow = LWIP_MIN(slow, zts_tcp_timer_until(pcb, limit));
+        }
+    }
+    // The n-th slow tick from now is 2n-1 or 2n ticks away, an early visit just parks again
+    zts_tcp_timer_insert(t, _now + (slow > 1 ? (u32_t)(2 * slow - 1) : 1));
+}
+
+/**
+ * Run the timers of a connection that is due
+ */
+static void zts_tcp_timer_visit(zts_tcp_timer* t, bool slow)
+{
+    struct tcp_pcb* pcb = t->pcb;
+    _running = t;
+    if (pcb->state == CLOSED) {
+        // Off the lists (connect failed), no timers to run
+    }
+    else if (pcb->state == TIME_WAIT) {
+        if (slow && (u32_t)(tcp_ticks - pcb->tmr) > 2 * TCP_MSL / TCP_SLOW_INTERVAL) {
+            tcp_pcb_purge(pcb);
+            TCP_RMV(&tcp_tw_pcbs, pcb);
+            tcp_free(pcb);
+            return;
+        }
+    }
+    else if (! zts_tcp_timer_fast(pcb) || (slow && ! zts_tcp_timer_slow(pcb))) {
+        return;
+    }
+    _running = NULL;
+    zts_tcp_timer_schedule(t);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int zts_tcp_timer_tick(void)
+{
+    if (_timer_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+        _timer_id = tcp_ext_arg_alloc_id();
+    }
+    zts_tcp_timer_scan(tcp_active_pcbs, ZTS_TCP_TIMER_ACTIVE);
+    zts_tcp_timer_scan(tcp_tw_pcbs, ZTS_TCP_TIMER_TW);
+    _now++;
+    // Slow timer on every other tick, starting with the first one like tcp_tmr()
+    bool slow = _now & 1;
+    if (slow) {
+        ++tcp_ticks;
+    }
+    // Move the entries of the next slot of each higher level down once the level below wraps
+    for (int level = 1; level < ZTS_TCP_WHEEL_LEVELS; level++) {
+        if (_now & ((1UL << (ZTS_TCP_WHEEL_BITS * level)) - 1)) {
+            break;
+        }
+        zts_tcp_timer** head = &_wheel[level][(_now >> (ZTS_TCP_WHEEL_BITS * level)) & (ZTS_TCP_WHEEL_SLOTS - 1)];
+        while (*head) {
+            zts_tcp_timer* t = *head;
+            zts_tcp_timer_unlink(t);
+            zts_tcp_timer_insert(t, t->expires);
+        }
+    }
+    // Callbacks may free or wake other entries of the slot, so it is emptied one entry at a time
+    zts_tcp_timer** head = &_wheel[0][_now & (ZTS_TCP_WHEEL_SLOTS - 1)];
+    while (*head) {
+        zts_tcp_timer* t = *head;
+        zts_tcp_timer_unlink(t);
+        zts_tcp_timer_visit(t, slow);
+    }
+    return 1;
+}
+
+void zts_tcp_timer_wake(const struct tcp_pcb* pcb)
+{
+    if (! pcb || _timer_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+        return;
+    }
+    zts_tcp_timer* t = (zts_tcp_timer*)tcp_ext_arg_get(pcb, _timer_id);
+    if (t) {
+        zts_tcp_timer_wake_entry(t);
+    }
+}
+
+void zts_tcp_timer_setsockopt(struct lwip_sock* sock, int level, int optname)
+{
+    bool keepalive = (level == SOL_SOCKET && optname == SO_KEEPALIVE)
+                     || (level == IPPROTO_TCP
+                         && (optname == TCP_KEEPIDLE || optname == TCP_KEEPINTVL || optname == TCP_KEEPCNT));
+    if (keepalive && sock->conn && NETCONNTYPE_GROUP(netconn_type(sock->conn)) == NETCONN_TCP) {
+        // Applied by lwIP after this hook, the new deadline is computed on the next tick
+        zts_tcp_timer_wake(sock->conn->pcb.tcp);
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
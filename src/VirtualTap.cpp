@@ -24,9 +24,13 @@
 #include "OSUtils.hpp"
 #include "lwip/etharp.h"
 #include "lwip/ethip6.h"
+#include "lwip/ip.h"
 #include "lwip/netif.h"
+#include "lwip/priv/tcp_priv.h"
 #include "lwip/sys.h"
 #include "lwip/tcpip.h"
+#include "lwip/timeouts.h"
+#include "lwiphooks.h"
 #include "netif/ethernet.h"
 
 #ifdef LWIP_STATS
@@ -42,12 +46,19 @@
 #include <time.h>
 #endif
 
+#include <algorithm>
+#include <atomic>
+
 #define ZTS_TAP_THREAD_POLLING_INTERVAL 50
-#define LWIP_DRIVER_LOOP_INTERVAL       100
 
-namespace ZeroTier {
+// Bytes queued below the tap (TCP fallback tunnel) above which TCP data is held back
+#define ZTS_TX_BACKLOG_MAX (1024 * 32)
+// How long TCP data is held back after the underlay refused a packet (ms)
+#define ZTS_TX_BLOCK_TIME 5
+// Interval at which held back TCP data is retried (ms)
+#define ZTS_TX_RETRY_INTERVAL 5
 
-extern Events* zts_events;
+namespace ZeroTier {
 
 /**
  * Virtual tap device. ZeroTier will create one per joined network. It will
@@ -80,11 +91,16 @@ VirtualTap::VirtualTap(
     , _mtu(mtu)
     , _net_id(net_id)
     , _phy(this, false, true)
+    , _txBacklog(0)
+    , _txBlockedUntil(0)
+    , _txRetryScheduled(false)
+    , _gro(NULL)
 {
     OSUtils::ztsnprintf(vtap_full_name, VTAP_NAME_LEN, "libzt-vtap-%llx", _net_id);
 #ifndef __WINDOWS__
     ::pipe(_shutdownSignalPipe);
 #endif
+    zts_lwip_rx_attach(this);
     // Start virtual tap thread and stack I/O loops
     _thread = Thread::start(this);
 }
@@ -96,10 +112,12 @@ VirtualTap::~VirtualTap()
     ::write(_shutdownSignalPipe[1], "\0", 1);
 #endif
     _phy.whack();
+    zts_lwip_rx_detach(this);
     zts_lwip_remove_netif(netif4);
     netif4 = NULL;
     zts_lwip_remove_netif(netif6);
     netif6 = NULL;
+    zts_lwip_tx_cancel(this);
     Thread::join(_thread);
 #ifndef __WINDOWS__
     ::close(_shutdownSignalPipe[0]);
@@ -233,7 +251,12 @@ void VirtualTap::scanMulticastGroups(std::vector<MulticastGroup>& added, std::ve
 
 void VirtualTap::setMtu(unsigned int mtu)
 {
+    if (mtu == _mtu) {
+        return;
+    }
     _mtu = mtu;
+    zts_lwip_set_mtu(netif4, mtu);
+    zts_lwip_set_mtu(netif6, mtu);
 }
 
 void VirtualTap::threadMain() throw()
@@ -272,8 +295,9 @@ void VirtualTap::threadMain() throw()
 // Netif driver code for lwIP network stack                                   //
 //----------------------------------------------------------------------------//
 
-bool _has_exited = false;
-bool _has_started = false;
+// lwIP has no tcpip_deinit(), so its thread, mailbox and timers are kept for
+// the life of the process and reused whenever the stack is started again
+static bool _tcpip_started = false;
 
 // Used to generate enumerated lwIP interface names
 int netifCount = 0;
@@ -284,83 +308,365 @@ Mutex lwip_state_m;
 // Callback for when the TCPIP thread has been successfully started
 static void zts_tcpip_init_done(void* arg)
 {
-    sys_sem_t* sem;
-    sem = (sys_sem_t*)arg;
-    zts_events->setState(ZTS_STATE_STACK_RUNNING);
-    _has_started = true;
-    // zts_events->enqueue(ZTS_EVENT_STACK_UP, NULL);
-    sys_sem_signal(sem);
+    sys_sem_signal((sys_sem_t*)arg);
 }
 
-static void zts_main_lwip_driver_loop(void* arg)
+bool zts_lwip_is_up()
 {
-#if defined(__linux__)
-    // pthread_setname_np(pthread_self(), ZTS_LWIP_THREAD_NAME);
+    Mutex::Lock _l(lwip_state_m);
+    return Events::stackIsRunning();
+}
+
+void zts_lwip_driver_init()
+{
+    Mutex::Lock _l(lwip_state_m);
+    if (Events::stackIsRunning()) {
+        return;
+    }
+    if (! _tcpip_started) {
+#if defined(__WINDOWS__)
+        sys_init();   // Required for win32 init of critical sections
 #endif
-#if defined(__APPLE__)
-    // pthread_setname_np(ZTS_LWIP_THREAD_NAME);
+        sys_sem_t sem;
+        if (sys_sem_new(&sem, 0) != ERR_OK) {
+            return;
+        }
+        tcpip_init(zts_tcpip_init_done, &sem);
+        sys_sem_wait(&sem);
+        sys_sem_free(&sem);
+        _tcpip_started = true;
+    }
+    Events::setStackState(true);
+}
+
+void zts_lwip_driver_shutdown()
+{
+    Mutex::Lock _l(lwip_state_m);
+    if (! Events::stackIsRunning()) {
+        return;
+    }
+    // Stop sending frames into the core
+    Events::setStackState(false);
+    // The netifs went with their taps. Connections left open by the application
+    // are reset so that their pcbs don't linger into the next start. Listeners
+    // and UDP pcbs belong to sockets that are still open and are left alone
+    LOCK_TCPIP_CORE();
+    while (tcp_active_pcbs) {
+        tcp_abort(tcp_active_pcbs);
+    }
+    while (tcp_tw_pcbs) {
+        tcp_abort(tcp_tw_pcbs);
+    }
+    UNLOCK_TCPIP_CORE();
+    netifCount = 0;
+}
+
+// Receive coalescing (GRO): in-order TCP segments of a flow that arrive in the
+// same burst are merged into one pbuf chain before they are input to the stack
+static std::atomic<bool> _rx_coalescing(true);
+
+// Flows of a tap that can be pending at the same time
+#define ZTS_GRO_MAX_FLOWS 8
+// Largest merged IP datagram
+#define ZTS_GRO_MAX_LEN 65000
+// pbuf flag telling the TCP input hook that a segment was merged
+#define ZTS_PBUF_FLAG_GRO 0x80U
+
+// Merged segments keep the IP and TCP checksums of their first segment
+#if CHECKSUM_CHECK_IP || CHECKSUM_CHECK_TCP
+#error "Receive coalescing requires CHECKSUM_CHECK_IP and CHECKSUM_CHECK_TCP to be disabled"
 #endif
-    sys_sem_t sem;
-    LWIP_UNUSED_ARG(arg);
-    if (sys_sem_new(&sem, 0) != ERR_OK) {
-        // DEBUG_ERROR("failed to create semaphore");
+
+/**
+ * A TCP segment, possibly merged, waiting for more of its flow
+ */
+struct zts_gro_flow {
+    struct netif* netif;
+    struct pbuf* p;   // Ethernet frame, NULL if the slot is free
+    u32_t next_seq;   // Sequence number the next segment must start with
+};
+
+/**
+ * Headers of a received TCP segment
+ */
+struct zts_gro_seg {
+    uint8_t* ip;
+    uint8_t* tcp;
+    u16_t iphlen;     // IP header length
+    u16_t hlen;       // Ethernet, IP and TCP header length
+    u16_t datalen;    // TCP payload length
+    bool mergeable;   // Carries data, nothing but ACK (and PSH) set
+};
+
+/**
+ * Receive coalescing state of a tap
+ */
+struct zts_gro_table {
+    Mutex m;
+    zts_gro_flow flows[ZTS_GRO_MAX_FLOWS];
+    unsigned int next;   // Slot evicted next when all are in use
+};
+
+// Taps that have a flow table, visited by zts_lwip_rx_flush()
+static Mutex _gro_taps_m;
+static std::vector<VirtualTap*> _gro_taps;
+
+void zts_lwip_set_rx_coalescing(bool enabled)
+{
+    _rx_coalescing = enabled;
+}
+
+static u32_t zts_gro_seq(const uint8_t* tcp)
+{
+    return ((u32_t)tcp[4] << 24) | ((u32_t)tcp[5] << 16) | ((u32_t)tcp[6] << 8) | tcp[7];
+}
+
+static void zts_lwip_input(struct netif* n, struct pbuf* p)
+{
+    if (n->input(p, n) != ERR_OK) {
+        pbuf_free(p);
     }
-    tcpip_init(zts_tcpip_init_done, &sem);
-    sys_sem_wait(&sem);
-    // Main loop
-    while (zts_events->getState(ZTS_STATE_STACK_RUNNING)) {
-        zts_util_delay(LWIP_DRIVER_LOOP_INTERVAL);
+}
+
+/**
+ * Parse a frame carrying a TCP segment in an unfragmented IPv4 packet without
+ * options or an IPv6 packet without extension headers. Returns false for
+ * anything else
+ */
+static bool zts_gro_parse(struct pbuf* p, zts_gro_seg* s)
+{
+    if (p->len != p->tot_len || p->len < SIZEOF_ETH_HDR) {
+        return false;
+    }
+    uint8_t* eth = (uint8_t*)p->payload;
+    unsigned int type = (eth[12] << 8) | eth[13];
+    unsigned int avail = p->len - SIZEOF_ETH_HDR;
+    unsigned int iplen;
+    s->ip = eth + SIZEOF_ETH_HDR;
+    if (type == ETHTYPE_IP && avail >= IP_HLEN) {
+        if (s->ip[0] != 0x45 || s->ip[9] != IP_PROTO_TCP || (s->ip[6] & 0x3f) || s->ip[7]) {
+            return false;
+        }
+        s->iphlen = IP_HLEN;
+        iplen = (s->ip[2] << 8) | s->ip[3];
+    }
+    else if (type == ETHTYPE_IPV6 && avail >= IP6_HLEN) {
+        if ((s->ip[0] >> 4) != 6 || s->ip[6] != IP6_NEXTH_TCP) {
+            return false;
+        }
+        s->iphlen = IP6_HLEN;
+        iplen = IP6_HLEN + ((s->ip[4] << 8) | s->ip[5]);
+    }
+    else {
+        return false;
     }
-    _has_exited = true;
-    
-    //
-    // no need to check if event was enqueued since NULL is being passed
-    //
-    zts_events->enqueue(ZTS_EVENT_STACK_DOWN, NULL);
+    s->tcp = s->ip + s->iphlen;
+    unsigned int tcphlen = (s->tcp[12] >> 4) * 4;
+    if (iplen > avail || tcphlen < TCP_HLEN || s->iphlen + tcphlen > iplen) {
+        return false;
+    }
+    s->hlen = (u16_t)(SIZEOF_ETH_HDR + s->iphlen + tcphlen);
+    s->datalen = (u16_t)(iplen - s->iphlen - tcphlen);
+    // Trailing padding would end up in the middle of the merged payload
+    s->mergeable = s->datalen && iplen == avail && (s->tcp[13] & ~TCP_PSH) == TCP_ACK;
+    return true;
 }
 
-bool zts_lwip_is_up()
+/**
+ * Whether a segment belongs to the flow of a pending one
+ */
+static bool zts_gro_same_flow(const zts_gro_flow* f, struct netif* n, const zts_gro_seg* s)
 {
-    Mutex::Lock _l(lwip_state_m);
-    return zts_events->getState(ZTS_STATE_STACK_RUNNING);
+    const uint8_t* eth = (const uint8_t*)f->p->payload;
+    const uint8_t* ip = eth + SIZEOF_ETH_HDR;
+    if (f->netif != n || eth[12] != s->ip[-2] || eth[13] != s->ip[-1]) {
+        return false;
+    }
+    if (s->iphlen == IP_HLEN ? memcmp(ip + 12, s->ip + 12, 8) : memcmp(ip + 8, s->ip + 8, 32)) {
+        return false;
+    }
+    return ! memcmp(ip + s->iphlen, s->tcp, 4);   // Ports
 }
 
-void zts_lwip_driver_init()
+/**
+ * Whether a segment of the same flow can be appended to a pending one: it
+ * continues it in sequence, and traffic class, acknowledgement, window and
+ * options are all unchanged
+ */
+static bool zts_gro_can_merge(const zts_gro_flow* f, const zts_gro_seg* s)
 {
-    if (zts_lwip_is_up()) {
-        return;
+    const uint8_t* ip = (const uint8_t*)f->p->payload + SIZEOF_ETH_HDR;
+    const uint8_t* tcp = ip + s->iphlen;
+    if (! s->mergeable || zts_gro_seq(s->tcp) != f->next_seq || f->p->tot_len + s->datalen > ZTS_GRO_MAX_LEN + SIZEOF_ETH_HDR) {
+        return false;
+    }
+    if (s->iphlen == IP_HLEN ? ip[1] != s->ip[1] : memcmp(ip, s->ip, 2)) {
+        return false;
+    }
+    unsigned int tcphlen = s->hlen - SIZEOF_ETH_HDR - s->iphlen;
+    return (unsigned int)(tcp[12] >> 4) * 4 == tcphlen && ! memcmp(tcp + 8, s->tcp + 8, 4)
+           && ! memcmp(tcp + 14, s->tcp + 14, tcphlen - 14);
+}
+
+/**
+ * Append the payload of a segment to a pending one and fix up the lengths in
+ * its headers. Checksums are left alone: lwIP is built without checking them
+ * on input (ZeroTier authenticates every frame)
+ */
+static void zts_gro_merge(zts_gro_flow* f, struct pbuf* p, const zts_gro_seg* s)
+{
+    u8_t psh = s->tcp[13] & TCP_PSH;
+    pbuf_remove_header(p, s->hlen);
+    pbuf_cat(f->p, p);
+    f->next_seq += s->datalen;
+    f->p->flags |= ZTS_PBUF_FLAG_GRO;
+    uint8_t* ip = (uint8_t*)f->p->payload + SIZEOF_ETH_HDR;
+    unsigned int iplen = f->p->tot_len - SIZEOF_ETH_HDR;
+    if (s->iphlen == IP_HLEN) {
+        ip[2] = (uint8_t)(iplen >> 8);
+        ip[3] = (uint8_t)iplen;
     }
-    if (_has_exited) {
+    else {
+        ip[4] = (uint8_t)((iplen - IP6_HLEN) >> 8);
+        ip[5] = (uint8_t)(iplen - IP6_HLEN);
+    }
+    ip[s->iphlen + 13] |= psh;
+}
+
+/**
+ * Hand a received frame to the stack, or hold it back to merge it with the
+ * segments of its flow that follow in the same burst. Held back segments are
+ * input by zts_lwip_rx_flush() at the latest. Each tap has its own flow table
+ */
+static void zts_lwip_rx_input(VirtualTap* tap, struct netif* n, struct pbuf* p)
+{
+    zts_gro_table* t = (zts_gro_table*)tap->_gro;
+    zts_gro_seg s;
+    if (! t || ! _rx_coalescing || ! zts_gro_parse(p, &s)) {
+        zts_lwip_input(n, p);
         return;
     }
-    Mutex::Lock _l(lwip_state_m);
-#if defined(__WINDOWS__)
-    sys_init();   // Required for win32 init of critical sections
-#endif
-    sys_thread_new(
-        ZTS_LWIP_THREAD_NAME,
-        zts_main_lwip_driver_loop,
-        NULL,
-        DEFAULT_THREAD_STACKSIZE,
-        DEFAULT_THREAD_PRIO);
+    struct netif* outn = NULL;
+    struct pbuf* out = NULL;   // Pending segment that has to go first
+    struct pbuf* now = NULL;   // Segment that cannot wait
+    {
+        Mutex::Lock _l(t->m);
+        zts_gro_flow* f = NULL;
+        zts_gro_flow* free_slot = NULL;
+        for (int i = 0; i < ZTS_GRO_MAX_FLOWS && ! f; i++) {
+            if (! t->flows[i].p) {
+                free_slot = free_slot ? free_slot : &t->flows[i];
+            }
+            else if (zts_gro_same_flow(&t->flows[i], n, &s)) {
+                f = &t->flows[i];
+            }
+        }
+        if (f && zts_gro_can_merge(f, &s)) {
+            zts_gro_merge(f, p, &s);
+            if (s.tcp[13] & TCP_PSH) {
+                // The sender has nothing more queued right now
+                out = f->p;
+                outn = f->netif;
+                f->p = NULL;
+            }
+        }
+        else {
+            if (! f && s.mergeable && ! (f = free_slot)) {
+                f = &t->flows[t->next];
+                t->next = (t->next + 1) % ZTS_GRO_MAX_FLOWS;
+            }
+            if (f && f->p) {
+                out = f->p;
+                outn = f->netif;
+                f->p = NULL;
+            }
+            if (s.mergeable && ! (s.tcp[13] & TCP_PSH)) {
+                f->netif = n;
+                f->p = p;
+                f->next_seq = zts_gro_seq(s.tcp) + s.datalen;
+            }
+            else {
+                now = p;
+            }
+        }
+    }
+    if (out) {
+        zts_lwip_input(outn, out);
+    }
+    if (now) {
+        zts_lwip_input(n, now);
+    }
 }
 
-void zts_lwip_driver_shutdown()
+void zts_lwip_rx_flush()
+{
+    std::vector<zts_gro_flow> pending;
+    {
+        Mutex::Lock _l(_gro_taps_m);
+        for (std::vector<VirtualTap*>::iterator it(_gro_taps.begin()); it != _gro_taps.end(); ++it) {
+            zts_gro_table* t = (zts_gro_table*)(*it)->_gro;
+            Mutex::Lock _lt(t->m);
+            for (int i = 0; i < ZTS_GRO_MAX_FLOWS; i++) {
+                if (t->flows[i].p) {
+                    pending.push_back(t->flows[i]);
+                    t->flows[i].p = NULL;
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < pending.size(); i++) {
+        zts_lwip_input(pending[i].netif, pending[i].p);
+    }
+}
+
+void zts_lwip_rx_attach(VirtualTap* tap)
+{
+    zts_gro_table* t = zts_mem_new<zts_gro_table>(ZTS_ALLOC_TAP);
+    if (! t) {
+        return;   // The tap works without coalescing
+    }
+    tap->_gro = t;
+    Mutex::Lock _l(_gro_taps_m);
+    _gro_taps.push_back(tap);
+}
+
+void zts_lwip_rx_detach(VirtualTap* tap)
 {
-    if (_has_exited) {
+    zts_gro_table* t = (zts_gro_table*)tap->_gro;
+    if (! t) {
         return;
     }
-    Mutex::Lock _l(lwip_state_m);
-    // Set flag to stop sending frames into the core
-    zts_events->clrState(ZTS_STATE_STACK_RUNNING);
-    // Wait until the main lwIP thread has exited
-    if (_has_started) {
-        while (! _has_exited) {
-            zts_util_delay(LWIP_DRIVER_LOOP_INTERVAL);
+    {
+        Mutex::Lock _l(_gro_taps_m);
+        _gro_taps.erase(std::remove(_gro_taps.begin(), _gro_taps.end(), tap), _gro_taps.end());
+    }
+    tap->_gro = NULL;
+    for (int i = 0; i < ZTS_GRO_MAX_FLOWS; i++) {
+        if (t->flows[i].p) {
+            pbuf_free(t->flows[i].p);
         }
     }
+    zts_mem_delete(t);
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void zts_tcp_gro_input(struct tcp_pcb* pcb, struct pbuf* p)
+{
+    // A merged segment stands for several full-sized ones, which would have
+    // been acknowledged at least every second one. Let lwIP's delayed ACK logic
+    // see it as the second of a pair so that the sender's ACK clock keeps going
+    if ((p->flags & ZTS_PBUF_FLAG_GRO) && pcb->state == ESTABLISHED) {
+        tcp_set_flags(pcb, TF_ACK_DELAY);
+    }
 }
 
+#ifdef __cplusplus
+}
+#endif
+
 void zts_lwip_remove_netif(void* netif)
 {
     if (! netif) {
@@ -372,6 +678,82 @@ void zts_lwip_remove_netif(void* netif)
     netif_set_down(n);
     netif_set_link_down(n);
     UNLOCK_TCPIP_CORE();
+    zts_mem_free(n);
+}
+
+void VirtualTap::setUnderlayState(unsigned int queued, bool failed)
+{
+    _txBacklog = queued;
+    if (failed) {
+        _txBlockedUntil = OSUtils::now() + ZTS_TX_BLOCK_TIME;
+    }
+}
+
+bool VirtualTap::txBlocked() const
+{
+    return _txBacklog >= ZTS_TX_BACKLOG_MAX || OSUtils::now() < _txBlockedUntil;
+}
+
+/**
+ * Whether an IP packet is a TCP segment carrying data (or SYN/FIN). Pure ACKs
+ * and everything else are never held back. lwIP sends an ACK along with the
+ * data it has queued though, so while data is held back zts_lwip_tx_retry()
+ * sends the ACKs separately
+ */
+static bool zts_lwip_is_tcp_data(const uint8_t* ip, int len, int proto)
+{
+    int iphlen, tcplen;
+    if (proto == 0x800 && len >= 20 && ip[9] == IP_PROTO_TCP) {
+        iphlen = (ip[0] & 0x0f) * 4;
+        tcplen = ((ip[2] << 8) | ip[3]) - iphlen;
+    }
+    else if (proto == 0x86DD && len >= 40 && ip[6] == IP6_NEXTH_TCP) {
+        iphlen = 40;
+        tcplen = (ip[4] << 8) | ip[5];
+    }
+    else {
+        return false;
+    }
+    if (len < iphlen + 20) {
+        return false;
+    }
+    const uint8_t* tcp = ip + iphlen;
+    return tcplen > (tcp[12] >> 4) * 4 || (tcp[13] & (TCP_SYN | TCP_FIN));
+}
+
+/**
+ * Retry the TCP data that was held back once the underlay has drained. Until
+ * then send the ACKs that lwIP would have sent with that data, or the peer
+ * stops sending too
+ */
+static void zts_lwip_tx_retry(void* arg)
+{
+    VirtualTap* tap = (VirtualTap*)arg;
+    if (tap->txBlocked()) {
+        for (struct tcp_pcb* pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+            if (pcb->unsent && (pcb->flags & (TF_ACK_DELAY | TF_ACK_NOW))) {
+                tcp_send_empty_ack(pcb);
+            }
+        }
+        sys_timeout(ZTS_TX_RETRY_INTERVAL, zts_lwip_tx_retry, tap);
+        return;
+    }
+    tap->_txRetryScheduled = false;
+    for (struct tcp_pcb* pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+        if (pcb->unsent) {
+            tcp_output(pcb);
+        }
+    }
+}
+
+void zts_lwip_tx_cancel(VirtualTap* tap)
+{
+    LOCK_TCPIP_CORE();
+    if (tap->_txRetryScheduled) {
+        sys_untimeout(zts_lwip_tx_retry, tap);
+        tap->_txRetryScheduled = false;
+    }
+    UNLOCK_TCPIP_CORE();
 }
 
 signed char zts_lwip_eth_tx(struct netif* n, struct pbuf* p)
@@ -402,6 +784,15 @@ signed char zts_lwip_eth_tx(struct netif* n, struct pbuf* p)
     char* data = buf + sizeof(struct eth_hdr);
     int len = totalLength - sizeof(struct eth_hdr);
     int proto = Utils::ntoh((uint16_t)ethhdr->type);
+    // Rather than let the underlay drop it, keep TCP data queued in lwIP until it drains
+    if (tap->txBlocked() && zts_lwip_is_tcp_data((const uint8_t*)data, len, proto)) {
+        if (! tap->_txRetryScheduled) {
+            // Right after the current output, for the ACK that was to go with this segment
+            tap->_txRetryScheduled = true;
+            sys_timeout(0, zts_lwip_tx_retry, tap);
+        }
+        return ERR_WOULDBLOCK;
+    }
     tap->_handler(tap->_arg, NULL, tap->_net_id, src_mac, dest_mac, proto, 0, data, len);
 
     return ERR_OK;
@@ -418,7 +809,7 @@ void zts_lwip_eth_rx(
 #ifdef LWIP_STATS
     stats_display();
 #endif
-    if (! zts_events->getState(ZTS_STATE_STACK_RUNNING)) {
+    if (! Events::stackIsRunning()) {
         return;
     }
     struct pbuf *p, *q;
@@ -454,24 +845,19 @@ void zts_lwip_eth_rx(
         dataptr += q->len;
     }
     // Feed packet into stack
-    int err;
-
     if (Utils::ntoh(ethhdr.type) == 0x800 || Utils::ntoh(ethhdr.type) == 0x806) {
         if (tap->netif4) {
-            if ((err = ((struct netif*)tap->netif4)->input(p, (struct netif*)tap->netif4)) != ERR_OK) {
-                // DEBUG_ERROR("packet input error (%d)", err);
-                pbuf_free(p);
-            }
+            zts_lwip_rx_input(tap, (struct netif*)tap->netif4, p);
+            return;
         }
     }
     if (Utils::ntoh(ethhdr.type) == 0x86DD) {
         if (tap->netif6) {
-            if ((err = ((struct netif*)tap->netif6)->input(p, (struct netif*)tap->netif6)) != ERR_OK) {
-                // DEBUG_ERROR("packet input error (%d)", err);
-                pbuf_free(p);
-            }
+            zts_lwip_rx_input(tap, (struct netif*)tap->netif6, p);
+            return;
         }
     }
+    pbuf_free(p);
 }
 
 bool zts_lwip_is_netif_up(void* n)
@@ -485,6 +871,111 @@ bool zts_lwip_is_netif_up(void* n)
     return result;
 }
 
+/**
+ * Return the ZeroTier address of the peer a connection's remote address
+ * belongs to, or 0 if it cannot be told
+ */
+static uint64_t zts_lwip_pcb_peer(struct tcp_pcb* pcb)
+{
+#if LWIP_IPV6
+    if (IP_IS_V6(&pcb->remote_ip)) {
+        const uint8_t* a = (const uint8_t*)ip_2_ip6(&pcb->remote_ip)->addr;
+        const uint8_t* node = NULL;
+        if (a[0] == 0xfd && a[9] == 0x99 && a[10] == 0x93) {
+            node = a + 11;   // RFC 4193: fd + net_id + 9993 + node_id
+        }
+        else if (a[0] == 0xfc) {
+            node = a + 5;   // 6PLANE: fc + hashed net_id + node_id
+        }
+        if (! node) {
+            return 0;
+        }
+        uint64_t id = 0;
+        for (int i = 0; i < 5; i++) {
+            id = (id << 8) | node[i];
+        }
+        return id;
+    }
+#endif
+#if LWIP_IPV4
+    // The peer's MAC address is derived from its ZeroTier address
+    struct netif* n = ip4_route(ip_2_ip4(&pcb->remote_ip));
+    if (! n || n->linkoutput != zts_lwip_eth_tx || ! n->state) {
+        return 0;
+    }
+    struct eth_addr* eth = NULL;
+    const ip4_addr_t* ip = NULL;
+    if (etharp_find_addr(n, ip_2_ip4(&pcb->remote_ip), &eth, &ip) < 0) {
+        return 0;
+    }
+    return MAC(eth->addr, ETH_HWADDR_LEN).toAddress(((VirtualTap*)n->state)->_net_id).toInt();
+#else
+    return 0;
+#endif
+}
+
+void zts_lwip_peer_path_changed(uint64_t peer, bool reset)
+{
+    if (! peer || ! Events::stackIsRunning()) {
+        return;
+    }
+    LOCK_TCPIP_CORE();
+    struct tcp_pcb* pcb = tcp_active_pcbs;
+    while (pcb) {
+        struct tcp_pcb* next = pcb->next;
+        if (pcb->state == TIME_WAIT || zts_lwip_pcb_peer(pcb) != peer) {
+            pcb = next;
+            continue;
+        }
+        if (reset) {
+            /* The netconn reports ECONNABORTED. The error callback may close
+            other connections as well, so the walk starts over */
+            tcp_abort(pcb);
+            pcb = tcp_active_pcbs;
+            continue;
+        }
+        else if (pcb->state >= ESTABLISHED && pcb->unacked) {
+            // Start over from a fresh RTO instead of the backed-off one
+            pcb->nrtx = 0;
+            if (pcb->sa) {
+                pcb->rto = (s16_t)((pcb->sa >> 3) + pcb->sv);
+            }
+            pcb->rtime = 0;
+            tcp_rexmit_rto(pcb);
+        }
+        else if (pcb->state == SYN_SENT) {
+            pcb->nrtx = 0;
+            pcb->rtime = pcb->rto;   // Resend the SYN on the next slow timer tick
+        }
+        pcb = next;
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
+void zts_lwip_set_mtu(void* netif, unsigned int mtu)
+{
+    if (! netif) {
+        return;
+    }
+    struct netif* n = (struct netif*)netif;
+    LOCK_TCPIP_CORE();
+    n->mtu = (u16_t)std::min(LWIP_MTU, (int)mtu);
+#if LWIP_IPV6 && LWIP_ND6_ALLOW_RA_UPDATES
+    n->mtu6 = n->mtu;
+#endif
+    // New connections pick up the MTU by themselves, shrink the MSS of existing ones
+    for (struct tcp_pcb* pcb = tcp_active_pcbs; pcb != NULL; pcb = pcb->next) {
+        if (ip_route(&pcb->local_ip, &pcb->remote_ip) != n) {
+            continue;
+        }
+        u16_t mss = tcp_eff_send_mss_netif(pcb->mss, n, &pcb->remote_ip);
+        if (mss < pcb->mss) {
+            pcb->mss = mss;
+        }
+    }
+    UNLOCK_TCPIP_CORE();
+}
+
 static err_t zts_netif_init4(struct netif* n)
 {
     if (! n || ! n->state) {
@@ -538,7 +1029,10 @@ void zts_lwip_init_interface(void* tapref, const InetAddress& ip)
             n = (struct netif*)vtap->netif4;
         }
         else {
-            n = new struct netif;
+            if (! (n = (struct netif*)zts_mem_alloc(ZTS_ALLOC_TAP, sizeof(struct netif)))) {
+                return;
+            }
+            memset(n, 0, sizeof(struct netif));
             isNewNetif = true;
             netifCount++;
         }
@@ -567,7 +1061,10 @@ void zts_lwip_init_interface(void* tapref, const InetAddress& ip)
             n = (struct netif*)vtap->netif6;
         }
         else {
-            n = new struct netif;
+            if (! (n = (struct netif*)zts_mem_alloc(ZTS_ALLOC_TAP, sizeof(struct netif)))) {
+                return;
+            }
+            memset(n, 0, sizeof(struct netif));
             isNewNetif = true;
             netifCount++;
         }
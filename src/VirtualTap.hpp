@@ -20,16 +20,18 @@
 #ifndef ZTS_VIRTUAL_TAP_HPP
 #define ZTS_VIRTUAL_TAP_HPP
 
-#define ZTS_LWIP_THREAD_NAME "ZTNetworkStackThread"
 #define VTAP_NAME_LEN        64
 
 #define ZTS_UNUSED_ARG(x) (void)x
 
+#include "Allocator.hpp"
 #include "Events.hpp"
 #include "MAC.hpp"
 #include "Phy.hpp"
 #include "Thread.hpp"
 
+#include <atomic>
+
 namespace ZeroTier {
 
 /* Forward declarations */
@@ -43,7 +45,7 @@ struct InetAddress;
  * Virtual tap device. ZeroTier will create one per joined network. It will
  * then be destroyed upon leaving the network.
  */
-class VirtualTap {
+class VirtualTap : public zts_mem_object<ZTS_ALLOC_TAP> {
     friend class Phy<VirtualTap*>;
 
   public:
@@ -143,6 +145,31 @@ class VirtualTap {
     void* netif4 = NULL;
     void* netif6 = NULL;
 
+    /**
+     * Report the state of the underlay send path so that the stack can hold
+     * back this tap's TCP data instead of having it dropped
+     *
+     * @usage Called by the node service whenever it queues or sends packets
+     * @param queued Number of bytes waiting in the TCP fallback tunnel
+     * @param failed Whether a packet was just refused because the underlay's
+     * send buffer was full
+     */
+    void setUnderlayState(unsigned int queued, bool failed);
+
+    /**
+     * Whether TCP data sent through this tap is currently held back
+     */
+    bool txBlocked() const;
+
+    // State of the underlay send path, as last reported by the node service
+    std::atomic<unsigned int> _txBacklog;
+    std::atomic<int64_t> _txBlockedUntil;
+    // A retry of held back TCP data is scheduled. Only accessed with the core lock held
+    bool _txRetryScheduled;
+
+    // Flow table for receive coalescing, see zts_lwip_rx_attach()
+    void* _gro;
+
     // The last time that this virtual tap received a network config update
     // from the core
     uint64_t _lastConfigUpdateTime = 0;
@@ -229,19 +256,19 @@ bool zts_lwip_is_up();
 /**
  * @brief Initialize network stack semaphores, threads, and timers.
  *
- * @usage This is called during the initial setup of each VirtualTap but is
- * only allowed to execute once
+ * @usage This is called when a node is started. The tcpip thread is only
+ * created the first time, later calls bring the stack back up after
+ * zts_lwip_driver_shutdown(). Returns once the stack is ready
  */
 void zts_lwip_driver_init();
 
 /**
- * @brief Shutdown the stack as completely as possible (not officially
- * supported by lwIP)
+ * @brief Shutdown the stack as completely as lwIP allows
  *
  * @usage This is to be called after it is determined that no further
- * network activity will take place. The tcpip thread will be stopped, all
- * interfaces will be brought down and all resources will be deallocated. A
- * full application restart will be required to bring the stack back online.
+ * network activity will take place. Frames are no longer fed to the stack and
+ * remaining TCP connections are reset. The tcpip thread is kept (lwIP cannot
+ * stop it) and is reused by the next zts_lwip_driver_init()
  */
 void zts_lwip_driver_shutdown();
 
@@ -250,6 +277,36 @@ void zts_lwip_driver_shutdown();
  */
 void zts_lwip_remove_netif(void* netif);
 
+/**
+ * @brief Cancel the retry of TCP data held back by a tap that goes away
+ */
+void zts_lwip_tx_cancel(VirtualTap* tap);
+
+/**
+ * @brief Give a tap its own flow table for receive coalescing
+ *
+ * @usage Called when the tap is created
+ */
+void zts_lwip_rx_attach(VirtualTap* tap);
+
+/**
+ * @brief Drop what a tap holds back for receive coalescing and free its flow
+ * table
+ *
+ * @usage Called when the tap is destroyed, before its interfaces are removed
+ */
+void zts_lwip_rx_detach(VirtualTap* tap);
+
+/**
+ * @brief Change the MTU of a netif, e.g. after the network's configuration
+ * changed. Established TCP connections routed through it lower their MSS if
+ * it no longer fits
+ *
+ * @param netif lwIP netif, may be NULL
+ * @param mtu New MTU, limited to LWIP_MTU
+ */
+void zts_lwip_set_mtu(void* netif, unsigned int mtu);
+
 /**
  * @brief Starts DHCP timers
  */
@@ -306,6 +363,33 @@ void zts_lwip_eth_rx(
     const void* data,
     unsigned int len);
 
+/**
+ * @brief Enable or disable receive coalescing: merging in-order TCP segments
+ * of a flow that arrive in the same burst before they are input to the stack
+ *
+ * @usage Called by the node service when it starts
+ */
+void zts_lwip_set_rx_coalescing(bool enabled);
+
+/**
+ * @brief Input the TCP segments that all taps hold back for receive coalescing
+ *
+ * @usage Called by the node service after each burst of received packets
+ */
+void zts_lwip_rx_flush();
+
+/**
+ * @brief Apply a change in the ZeroTier paths to a peer to the TCP connections
+ * whose remote address belongs to that peer
+ *
+ * @usage Called from the node service's background loop. Connections either
+ * retransmit their outstanding data immediately with a fresh backoff, or, if
+ * reset is set, fail with ECONNABORTED
+ * @param peer ZeroTier address of the peer
+ * @param reset Whether to fail the connections instead of retransmitting
+ */
+void zts_lwip_peer_path_changed(uint64_t peer, bool reset);
+
 }   // namespace ZeroTier
 
 #endif   // _H
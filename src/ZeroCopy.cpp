@@ -0,0 +1,434 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Zero-copy socket API operating directly on lwIP netconns and pbufs
+ */
+
+#include "Coalesce.hpp"
+#include "Events.hpp"
+#include "SocketBuffers.hpp"
+#include "SocketEvents.hpp"
+#include "ZeroCopy.hpp"
+#include "ZeroTierSockets.h"
+#include "lwip/api.h"
+#include "lwip/pbuf.h"
+#include "lwip/priv/sockets_priv.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/tcpip.h"
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
+/**
+ * Upper bound on how long a closing socket sleeps between checks of its
+ * outstanding zero-copy data. Normally it is woken as soon as an ACK arrives
+ */
+#define ZTS_ZC_CLOSE_WAIT_INTERVAL 100
+
+/**
+ * How long (ms) a close waits for outstanding zero-copy data to be
+ * acknowledged when SO_LINGER is not set. The connection is aborted after that
+ */
+#define ZTS_ZC_CLOSE_TIMEOUT 20000
+
+namespace ZeroTier {
+
+/**
+ * Zero-copy send that has been queued but not yet acknowledged
+ */
+struct zts_zc_inflight {
+    u32_t end_seq;   // Sequence number following the last queued byte
+    void* cookie;
+};
+
+/**
+ * Zero-copy bookkeeping for one lwIP socket slot. Only accessed with the core
+ * lock held
+ */
+struct zts_zc_state {
+    struct netconn* conn;
+    std::vector<zts_zc_inflight> inflight;
+    std::vector<zts_zc_completion_t> done;
+    bool closing;
+    sys_sem_t close_sem;
+};
+
+static zts_zc_state _zc[NUM_SOCKETS];
+
+/**
+ * Per-PCB state, kept in a TCP ext arg once a zero-copy send was made on the
+ * connection
+ */
+struct zts_zc_pcb {
+    struct netconn* conn;
+    tcp_sent_fn sent;   // Callback the netconn layer installed on the PCB
+};
+
+static u8_t _zc_id = LWIP_TCP_PCB_NUM_EXT_ARGS;   // Not yet allocated
+
+static inline zts_zc_state* zts_zc_get_state(int fd)
+{
+    int i = fd - LWIP_SOCKET_OFFSET;
+    if (i < 0 || i >= NUM_SOCKETS) {
+        return NULL;
+    }
+    return &_zc[i];
+}
+
+/**
+ * Move acknowledged sends to the completion list. If pcb is NULL the
+ * connection is gone (and with it every segment referencing user memory), so
+ * all outstanding sends complete with an error. Core lock must be held.
+ */
+static void zts_zc_complete(int fd, zts_zc_state* st, struct tcp_pcb* pcb)
+{
+    size_t n = 0;
+    while (n < st->inflight.size()) {
+        if (pcb && ! TCP_SEQ_GEQ(pcb->lastack, st->inflight[n].end_seq)) {
+            break;
+        }
+        zts_zc_completion_t c = { st->inflight[n].cookie, pcb ? ZTS_ERR_OK : ZTS_ERR_SOCKET };
+        st->done.push_back(c);
+        n++;
+    }
+    if (n > 0) {
+        st->inflight.erase(st->inflight.begin(), st->inflight.begin() + n);
+        zts_socket_watch_notify(fd, ZTS_POLLOUT);
+    }
+    if (st->closing) {
+        sys_sem_signal(&st->close_sem);
+    }
+}
+
+static inline zts_zc_state* zts_zc_state_for_conn(struct netconn* conn)
+{
+    if (! conn) {
+        return NULL;
+    }
+    zts_zc_state* st = zts_zc_get_state(conn->socket);
+    if (! st || st->conn != conn || (st->inflight.empty() && ! st->closing)) {
+        return NULL;
+    }
+    return st;
+}
+
+/**
+ * Replacement TCP sent callback. Completions are collected before handing
+ * control to the netconn layer since it may close and free the PCB
+ */
+static err_t zts_zc_sent(void* arg, struct tcp_pcb* pcb, u16_t len)
+{
+    zts_zc_pcb* zp = (zts_zc_pcb*)tcp_ext_arg_get(pcb, _zc_id);
+    zts_zc_state* st = zts_zc_state_for_conn((struct netconn*)arg);
+    if (st) {
+        zts_zc_complete(((struct netconn*)arg)->socket, st, pcb);
+    }
+    return (zp && zp->sent) ? zp->sent(arg, pcb, len) : ERR_OK;
+}
+
+/**
+ * Called when the PCB is freed, whether after a reset, an abort or the end
+ * of an orderly close. Segments referencing user memory are gone by now
+ */
+static void zts_zc_destroy(u8_t id, void* data)
+{
+    LWIP_UNUSED_ARG(id);
+    zts_zc_pcb* zp = (zts_zc_pcb*)data;
+    if (! zp) {
+        return;
+    }
+    zts_zc_state* st = zts_zc_state_for_conn(zp->conn);
+    if (st) {
+        zts_zc_complete(zp->conn->socket, st, NULL);
+    }
+    delete zp;
+}
+
+static const struct tcp_ext_arg_callbacks _zc_callbacks = { zts_zc_destroy, NULL };
+
+/**
+ * Install the zero-copy sent callback on a connection. Core lock must be held
+ */
+static bool zts_zc_attach(struct netconn* conn, struct tcp_pcb* pcb)
+{
+    if (_zc_id == LWIP_TCP_PCB_NUM_EXT_ARGS) {
+        _zc_id = tcp_ext_arg_alloc_id();
+    }
+    zts_zc_pcb* zp = (zts_zc_pcb*)tcp_ext_arg_get(pcb, _zc_id);
+    if (! zp) {
+        zp = new (std::nothrow) zts_zc_pcb();
+        if (! zp) {
+            return false;
+        }
+        zp->conn = conn;
+        zp->sent = NULL;
+        tcp_ext_arg_set_callbacks(pcb, _zc_id, &_zc_callbacks);
+        tcp_ext_arg_set(pcb, _zc_id, zp);
+    }
+    if (pcb->sent != zts_zc_sent) {
+        zp->sent = pcb->sent;
+        tcp_sent(pcb, zts_zc_sent);
+    }
+    return true;
+}
+
+/**
+ * Return the lwIP socket for fd if it is backed by a netconn of the given
+ * type group, otherwise NULL
+ */
+static struct lwip_sock* zts_zc_get_socket(int fd, enum netconn_type type)
+{
+    struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+    if (! sock || ! sock->conn) {
+        return NULL;
+    }
+    if (NETCONNTYPE_GROUP(netconn_type(sock->conn)) != type) {
+        return NULL;
+    }
+    return sock;
+}
+
+void zts_zc_close(int fd)
+{
+    zts_zc_state* st = zts_zc_get_state(fd);
+    if (! st) {
+        return;
+    }
+    LOCK_TCPIP_CORE();
+    if (! st->conn) {
+        UNLOCK_TCPIP_CORE();
+        return;
+    }
+    // SO_LINGER bounds the wait like it bounds lwIP's own close, 0 aborts
+    u32_t timeout = st->conn->linger >= 0 ? (u32_t)st->conn->linger * 1000 : ZTS_ZC_CLOSE_TIMEOUT;
+    u32_t start = sys_now();
+    bool wait = ! st->inflight.empty() && timeout > 0 && sys_sem_new(&st->close_sem, 0) == ERR_OK;
+    st->closing = wait;
+    while (! st->inflight.empty()) {
+        struct lwip_sock* sock = lwip_socket_dbg_get_socket(fd);
+        struct tcp_pcb* pcb = (sock && sock->conn == st->conn) ? st->conn->pcb.tcp : NULL;
+        u32_t elapsed = sys_now() - start;
+        if (pcb && (! wait || elapsed >= timeout)) {
+            /* The memory must not be referenced once close returns. Aborting
+            frees the segments and completes what is left with an error */
+            tcp_abort(pcb);
+            pcb = NULL;
+        }
+        if (! pcb) {
+            zts_zc_complete(fd, st, NULL);
+            break;
+        }
+        UNLOCK_TCPIP_CORE();
+        sys_arch_sem_wait(&st->close_sem, LWIP_MIN(timeout - elapsed, ZTS_ZC_CLOSE_WAIT_INTERVAL));
+        LOCK_TCPIP_CORE();
+    }
+    if (wait) {
+        st->closing = false;
+        sys_sem_free(&st->close_sem);
+    }
+    st->inflight.clear();
+    st->done.clear();
+    st->conn = NULL;
+    UNLOCK_TCPIP_CORE();
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+ssize_t zts_recv_zc(int fd, zts_rxbuf_t* out)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! out) {
+        return ZTS_ERR_ARG;
+    }
+    struct lwip_sock* sock = zts_zc_get_socket(fd, NETCONN_TCP);
+    if (! sock) {
+        return ZTS_ERR_ARG;
+    }
+    struct pbuf* p = NULL;
+    // Data left over from a previous partial read is returned first
+    if (sock->lastdata.pbuf) {
+        p = sock->lastdata.pbuf;
+        sock->lastdata.pbuf = NULL;
+    }
+    else {
+        /* The window is only re-opened once the application gives the data
+        back, so holding leases applies backpressure to the sender */
+        err_t err = netconn_recv_tcp_pbuf_flags(sock->conn, &p, NETCONN_NOAUTORCVD);
+        if (err == ERR_CLSD) {
+            return 0;
+        }
+        if (err != ERR_OK) {
+            zts_errno = err_to_errno(err);
+            return ZTS_ERR_SOCKET;
+        }
+    }
+    // Lend at most ZTS_RXBUF_MAX_IOV segments, hand the rest back to the socket
+    int n = 1;
+    struct pbuf* last = p;
+    while (last->next && n < ZTS_RXBUF_MAX_IOV) {
+        last = last->next;
+        n++;
+    }
+    if (last->next) {
+        struct pbuf* rest = last->next;
+        u16_t rest_len = rest->tot_len;
+        last->next = NULL;
+        for (struct pbuf* q = p; q; q = q->next) {
+            q->tot_len -= rest_len;
+        }
+        sock->lastdata.pbuf = rest;
+    }
+    out->iovcnt = 0;
+    out->len = p->tot_len;
+    for (struct pbuf* q = p; q; q = q->next) {
+        if (q->len == 0) {
+            continue;
+        }
+        out->iov[out->iovcnt].iov_base = q->payload;
+        out->iov[out->iovcnt].iov_len = q->len;
+        out->iovcnt++;
+    }
+    out->_chain = p;
+    out->_conn = sock->conn;
+    out->_fd = fd;
+    return (ssize_t)out->len;
+}
+
+int zts_rxbuf_release(zts_rxbuf_t* buf)
+{
+    if (! buf || ! buf->_chain) {
+        return ZTS_ERR_ARG;
+    }
+    struct pbuf* p = (struct pbuf*)buf->_chain;
+    if (transport_ok()) {
+        // Only touch the netconn if the socket has not been closed in the meantime
+        struct lwip_sock* sock = zts_zc_get_socket(buf->_fd, NETCONN_TCP);
+        if (sock && sock->conn == (struct netconn*)buf->_conn && buf->len > 0) {
+            netconn_tcp_recvd(sock->conn, buf->len);
+            // The data counts as consumed only now, for autotuning and window sizing
+            zts_sockbuf_consumed(buf->_fd, buf->len);
+        }
+    }
+    pbuf_free(p);
+    buf->_chain = NULL;
+    buf->_conn = NULL;
+    buf->iovcnt = 0;
+    buf->len = 0;
+    return ZTS_ERR_OK;
+}
+
+ssize_t zts_send_zc(int fd, const struct zts_iovec* iov, int iovcnt, void* cookie)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    if (! iov || iovcnt <= 0 || iovcnt > ZTS_SEND_ZC_MAX_IOV) {
+        return ZTS_ERR_ARG;
+    }
+    struct lwip_sock* sock = zts_zc_get_socket(fd, NETCONN_TCP);
+    zts_zc_state* st = zts_zc_get_state(fd);
+    if (! sock || ! st) {
+        return ZTS_ERR_ARG;
+    }
+    // Data held back by write coalescing goes first
+    if (zts_coalesce_flush(fd) != ZTS_ERR_OK) {
+        return ZTS_ERR_SOCKET;
+    }
+    struct netconn* conn = sock->conn;
+    LOCK_TCPIP_CORE();
+    if (st->conn != conn) {
+        st->inflight.clear();
+        st->done.clear();
+        st->conn = conn;
+    }
+    if (st->inflight.size() + st->done.size() >= ZTS_SEND_ZC_MAX_PENDING) {
+        UNLOCK_TCPIP_CORE();
+        zts_errno = ZTS_ENOBUFS;
+        return ZTS_ERR_SOCKET;
+    }
+    struct tcp_pcb* pcb = conn->pcb.tcp;
+    if (! pcb || pcb->state == LISTEN) {
+        UNLOCK_TCPIP_CORE();
+        zts_errno = ZTS_ENOTCONN;
+        return ZTS_ERR_SOCKET;
+    }
+    if (! zts_zc_attach(conn, pcb)) {
+        UNLOCK_TCPIP_CORE();
+        zts_errno = ZTS_ENOMEM;
+        return ZTS_ERR_SOCKET;
+    }
+    UNLOCK_TCPIP_CORE();
+
+    struct netvector vectors[ZTS_SEND_ZC_MAX_IOV];
+    for (int i = 0; i < iovcnt; i++) {
+        vectors[i].ptr = iov[i].iov_base;
+        vectors[i].len = iov[i].iov_len;
+    }
+    // Without NETCONN_COPY tcp_write() builds segments referencing our memory
+    size_t written = 0;
+    err_t err = netconn_write_vectors_partly(conn, vectors, (u16_t)iovcnt, NETCONN_NOCOPY, &written);
+    if (written == 0) {
+        zts_errno = err_to_errno(err == ERR_OK ? ERR_WOULDBLOCK : err);
+        return ZTS_ERR_SOCKET;
+    }
+
+    LOCK_TCPIP_CORE();
+    pcb = conn->pcb.tcp;
+    if (pcb) {
+        /* snd_lbb may include bytes queued by another thread since, which only
+        makes the completion conservative. Check right away in case the data
+        was already acknowledged */
+        zts_zc_inflight f = { pcb->snd_lbb, cookie };
+        st->inflight.push_back(f);
+        zts_zc_complete(fd, st, pcb);
+    }
+    else {
+        zts_zc_completion_t c = { cookie, ZTS_ERR_SOCKET };
+        st->done.push_back(c);
+    }
+    UNLOCK_TCPIP_CORE();
+    return (ssize_t)written;
+}
+
+int zts_send_zc_reap(int fd, zts_zc_completion_t* completions, int max_completions)
+{
+    if (! transport_ok()) {
+        return ZTS_ERR_SERVICE;
+    }
+    zts_zc_state* st = zts_zc_get_state(fd);
+    if (! st || ! completions || max_completions <= 0) {
+        return ZTS_ERR_ARG;
+    }
+    LOCK_TCPIP_CORE();
+    int n = (int)std::min(st->done.size(), (size_t)max_completions);
+    for (int i = 0; i < n; i++) {
+        completions[i] = st->done[i];
+    }
+    st->done.erase(st->done.begin(), st->done.begin() + n);
+    UNLOCK_TCPIP_CORE();
+    return n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+}   // namespace ZeroTier
@@ -0,0 +1,38 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Header for zero-copy socket API
+ */
+
+#ifndef ZTS_ZERO_COPY_HPP
+#define ZTS_ZERO_COPY_HPP
+
+namespace ZeroTier {
+
+/**
+ * @brief Wait until every zero-copy send on the socket has been acknowledged
+ * (or the connection has failed) and discard its completion state. The wait
+ * is bounded by SO_LINGER (ZTS_ZC_CLOSE_TIMEOUT if not set), after which the
+ * connection is aborted. After this returns no segment references application
+ * memory any longer.
+ *
+ * @usage Called from zts_bsd_close() before the socket is handed back to lwIP
+ */
+void zts_zc_close(int fd);
+
+}   // namespace ZeroTier
+
+#endif   // _H
@@ -1441,6 +1441,49 @@ SWIGEXPORT int SWIGSTDCALL CSharp_zts_bsd_send(int jarg1, void* jarg2, unsigned
     return zts_bsd_send(arg1, (void const*)arg2, arg3, arg4);
 }
 
+/*
+ * Batch datagram I/O. Managed code passes parallel arrays of pinned buffer
+ * pointers and lengths; the message vector is assembled here so that no
+ * zts_mmsghdr layout needs to be mirrored in C#. Lengths are updated in place.
+ */
+static int CSharp_zts_bsd_mmsg(int fd, void** bufs, int* lens, unsigned int vlen, int flags, bool recv)
+{
+    if (! bufs || ! lens) {
+        return ZTS_ERR_ARG;
+    }
+    vlen = vlen > ZTS_MMSG_MAX ? ZTS_MMSG_MAX : vlen;
+    struct zts_iovec* iov = (struct zts_iovec*)calloc(vlen + 1, sizeof(struct zts_iovec));
+    struct zts_mmsghdr* msgvec = (struct zts_mmsghdr*)calloc(vlen + 1, sizeof(struct zts_mmsghdr));
+    int retval = ZTS_ERR_GENERAL;
+    if (iov && msgvec) {
+        for (unsigned int i = 0; i < vlen; i++) {
+            iov[i].iov_base = bufs[i];
+            iov[i].iov_len = lens[i];
+            msgvec[i].msg_hdr.msg_iov = &iov[i];
+            msgvec[i].msg_hdr.msg_iovlen = 1;
+        }
+        retval = recv ? zts_bsd_recvmmsg(fd, msgvec, vlen, flags) : zts_bsd_sendmmsg(fd, msgvec, vlen, flags);
+        for (int i = 0; i < retval; i++) {
+            lens[i] = msgvec[i].msg_len;
+        }
+    }
+    free(msgvec);
+    free(iov);
+    return retval;
+}
+
+SWIGEXPORT int SWIGSTDCALL
+CSharp_zts_bsd_sendmmsg(int jarg1, void** jarg2, int* jarg3, unsigned int jarg4, int jarg5)
+{
+    return CSharp_zts_bsd_mmsg(jarg1, jarg2, jarg3, jarg4, jarg5, false);
+}
+
+SWIGEXPORT int SWIGSTDCALL
+CSharp_zts_bsd_recvmmsg(int jarg1, void** jarg2, int* jarg3, unsigned int jarg4, int jarg5)
+{
+    return CSharp_zts_bsd_mmsg(jarg1, jarg2, jarg3, jarg4, jarg5, true);
+}
+
 SWIGEXPORT int SWIGSTDCALL
 CSharp_zts_bsd_sendto(int jarg1, void* jarg2, unsigned long jarg3, int jarg4, zts_sockaddr* jarg5, unsigned short jarg6)
 {
@@ -577,6 +577,76 @@ namespace ZeroTier.Sockets
         [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_poll")]
         static extern int zts_bsd_poll(IntPtr arg1, uint arg2, int arg3);
 
+        /// <summary>
+        /// Send each buffer as a separate datagram to the connected remote host with a single call.
+        /// Returns the number of datagrams sent.
+        /// </summary>
+        public Int32 SendBatch(Byte[][] buffers)
+        {
+            if (buffers == null) {
+                throw new ArgumentNullException("buffers");
+            }
+            int[] lengths = new int[buffers.Length];
+            for (int i = 0; i < buffers.Length; i++) {
+                lengths[i] = buffers[i] != null ? buffers[i].Length : 0;
+            }
+            return BatchTransfer(buffers, lengths, false);
+        }
+
+        /// <summary>
+        /// Receive up to buffers.Length datagrams with a single call. Waits for the first datagram
+        /// and then fills as many of the remaining buffers as are already queued. The size of each
+        /// received datagram is stored in lengths. Returns the number of datagrams received.
+        /// </summary>
+        public Int32 ReceiveBatch(Byte[][] buffers, int[] lengths)
+        {
+            if (buffers == null) {
+                throw new ArgumentNullException("buffers");
+            }
+            if (lengths == null || lengths.Length < buffers.Length) {
+                throw new ArgumentOutOfRangeException("lengths");
+            }
+            for (int i = 0; i < buffers.Length; i++) {
+                lengths[i] = buffers[i] != null ? buffers[i].Length : 0;
+            }
+            return BatchTransfer(buffers, lengths, true);
+        }
+
+        Int32 BatchTransfer(Byte[][] buffers, int[] lengths, bool receive)
+        {
+            if (_isClosed) {
+                throw new ObjectDisposedException("Socket has been closed");
+            }
+            if (_fd < 0) {
+                throw new ZeroTier.Sockets.SocketException((int)ZeroTier.Constants.ERR_SOCKET);
+            }
+            GCHandle[] handles = new GCHandle[buffers.Length];
+            IntPtr[] pointers = new IntPtr[buffers.Length];
+            try {
+                for (int i = 0; i < buffers.Length; i++) {
+                    if (buffers[i] == null) {
+                        throw new ArgumentNullException("buffers");
+                    }
+                    handles[i] = GCHandle.Alloc(buffers[i], GCHandleType.Pinned);
+                    pointers[i] = handles[i].AddrOfPinnedObject();
+                }
+                int flags = 0;
+                int result = receive ? zts_bsd_recvmmsg(_fd, pointers, lengths, (uint)buffers.Length, flags)
+                                     : zts_bsd_sendmmsg(_fd, pointers, lengths, (uint)buffers.Length, flags);
+                if (result < 0) {
+                    throw new ZeroTier.Sockets.SocketException(result, ZeroTier.Core.Node.ErrNo);
+                }
+                return result;
+            }
+            finally {
+                for (int i = 0; i < handles.Length; i++) {
+                    if (handles[i].IsAllocated) {
+                        handles[i].Free();
+                    }
+                }
+            }
+        }
+
         [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_ioctl")]
         static extern int zts_bsd_ioctl(int arg1, uint arg2, IntPtr arg3);
 
@@ -589,6 +659,9 @@ namespace ZeroTier.Sockets
         [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_sendmsg")]
         static extern int zts_bsd_sendmsg(int arg1, IntPtr arg2, int arg3);
 
+        [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_sendmmsg")]
+        static extern int zts_bsd_sendmmsg(int arg1, IntPtr[] arg2, [In, Out] int[] arg3, uint arg4, int arg5);
+
         [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_recv")]
         static extern int zts_bsd_recv(int arg1, IntPtr arg2, uint arg3, int arg4);
 
@@ -598,6 +671,9 @@ namespace ZeroTier.Sockets
         [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_recvmsg")]
         static extern int zts_bsd_recvmsg(int arg1, IntPtr arg2, int arg3);
 
+        [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_recvmmsg")]
+        static extern int zts_bsd_recvmmsg(int arg1, IntPtr[] arg2, [In, Out] int[] arg3, uint arg4, int arg5);
+
         [DllImport("libzt", EntryPoint = "CSharp_zts_bsd_read")]
         static extern int zts_bsd_read(int arg1, IntPtr arg2, uint arg3);
 
@@ -252,6 +252,105 @@ JNIEXPORT jint JNICALL Java_com_zerotier_sockets_ZeroTierNative_zts_1bsd_1recvfr
     return retval > -1 ? retval : -(zts_errno);
 }
 
+/*
+ * Batch datagram I/O on connected sockets. bufs[i] holds message i and lens[i]
+ * its length (send) or receives its length (recv). The element arrays are
+ * pinned or copied for the duration of the whole batch rather than one
+ * critical section per message, since the call may block.
+ */
+static int zts_java_mmsg_prepare(
+    JNIEnv* env,
+    jobjectArray bufs,
+    jint* lens,
+    int count,
+    jbyteArray* arrays,
+    jbyte** elems,
+    struct zts_iovec* iov,
+    struct zts_mmsghdr* msgvec)
+{
+    for (int i = 0; i < count; i++) {
+        arrays[i] = (jbyteArray)env->GetObjectArrayElement(bufs, i);
+        if (! arrays[i] || lens[i] < 0 || lens[i] > env->GetArrayLength(arrays[i])) {
+            return i;
+        }
+        elems[i] = env->GetByteArrayElements(arrays[i], NULL);
+        iov[i].iov_base = elems[i];
+        iov[i].iov_len = lens[i];
+        memset(&msgvec[i], 0, sizeof(msgvec[i]));
+        msgvec[i].msg_hdr.msg_iov = &iov[i];
+        msgvec[i].msg_hdr.msg_iovlen = 1;
+    }
+    return count;
+}
+
+static void zts_java_mmsg_release(JNIEnv* env, jbyteArray* arrays, jbyte** elems, int count, int mode)
+{
+    for (int i = 0; i < count; i++) {
+        if (elems[i]) {
+            env->ReleaseByteArrayElements(arrays[i], elems[i], mode);
+        }
+        if (arrays[i]) {
+            env->DeleteLocalRef(arrays[i]);
+        }
+    }
+}
+
+static int zts_java_mmsg(JNIEnv* env, jint fd, jobjectArray bufs, jintArray lens, jint flags, bool recv)
+{
+    int count = env->GetArrayLength(bufs);
+    if (count > env->GetArrayLength(lens)) {
+        count = env->GetArrayLength(lens);
+    }
+    if (count > ZTS_MMSG_MAX) {
+        count = ZTS_MMSG_MAX;
+    }
+    jbyteArray* arrays = (jbyteArray*)calloc(count + 1, sizeof(jbyteArray));
+    jbyte** elems = (jbyte**)calloc(count + 1, sizeof(jbyte*));
+    struct zts_iovec* iov = (struct zts_iovec*)calloc(count + 1, sizeof(struct zts_iovec));
+    struct zts_mmsghdr* msgvec = (struct zts_mmsghdr*)calloc(count + 1, sizeof(struct zts_mmsghdr));
+    int retval = ZTS_ERR_ARG;
+    if (arrays && elems && iov && msgvec) {
+        jint* lengths = env->GetIntArrayElements(lens, NULL);
+        int prepared = zts_java_mmsg_prepare(env, bufs, lengths, count, arrays, elems, iov, msgvec);
+        if (prepared == count) {
+            retval = recv ? zts_bsd_recvmmsg(fd, msgvec, count, flags) : zts_bsd_sendmmsg(fd, msgvec, count, flags);
+            retval = retval > -1 ? retval : -(zts_errno);
+        }
+        for (int i = 0; i < retval; i++) {
+            lengths[i] = msgvec[i].msg_len;
+        }
+        env->ReleaseIntArrayElements(lens, lengths, 0);
+        zts_java_mmsg_release(env, arrays, elems, prepared < count ? prepared + 1 : count, recv ? 0 : JNI_ABORT);
+    }
+    free(msgvec);
+    free(iov);
+    free(elems);
+    free(arrays);
+    return retval;
+}
+
+JNIEXPORT jint JNICALL Java_com_zerotier_sockets_ZeroTierNative_zts_1bsd_1sendmmsg(
+    JNIEnv* env,
+    jclass clazz,
+    jint fd,
+    jobjectArray bufs,
+    jintArray lens,
+    jint flags)
+{
+    return zts_java_mmsg(env, fd, bufs, lens, flags, false);
+}
+
+JNIEXPORT jint JNICALL Java_com_zerotier_sockets_ZeroTierNative_zts_1bsd_1recvmmsg(
+    JNIEnv* env,
+    jclass clazz,
+    jint fd,
+    jobjectArray bufs,
+    jintArray lens,
+    jint flags)
+{
+    return zts_java_mmsg(env, fd, bufs, lens, flags, true);
+}
+
 JNIEXPORT jint JNICALL
 Java_com_zerotier_sockets_ZeroTierNative_zts_1bsd_1read(JNIEnv* env, jclass clazz, jint fd, jbyteArray buf)
 {
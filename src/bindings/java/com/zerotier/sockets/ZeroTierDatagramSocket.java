@@ -169,6 +169,54 @@ public class ZeroTierDatagramSocket {
         }
     }
 
+    /**
+     * Send several DatagramPackets to the connected remote host with a single call
+     * @param packets The packets to send
+     * @return Number of packets sent
+     *
+     * @exception IOException when an I/O error occurs
+     */
+    public int send(DatagramPacket[] packets) throws IOException
+    {
+        byte[][] bufs = new byte[packets.length][];
+        int[] lens = new int[packets.length];
+        for (int i = 0; i < packets.length; i++) {
+            bufs[i] = packets[i].getData();
+            lens[i] = packets[i].getLength();
+        }
+        int sent = ZeroTierNative.zts_bsd_sendmmsg(_socket.getNativeFileDescriptor(), bufs, lens, 0);
+        if (sent < 0) {
+            throw new IOException("send(DatagramPacket[]), errno=" + sent);
+        }
+        return sent;
+    }
+
+    /**
+     * Receive several DatagramPackets with a single call. Waits for the first packet and then
+     * fills as many of the remaining packets as are already queued
+     * @param packets The packets to receive into. The length of each received packet is updated
+     * @return Number of packets received
+     *
+     * @exception IOException when an I/O error occurs
+     */
+    public int receive(DatagramPacket[] packets) throws IOException
+    {
+        byte[][] bufs = new byte[packets.length][];
+        int[] lens = new int[packets.length];
+        for (int i = 0; i < packets.length; i++) {
+            bufs[i] = packets[i].getData();
+            lens[i] = packets[i].getLength();
+        }
+        int received = ZeroTierNative.zts_bsd_recvmmsg(_socket.getNativeFileDescriptor(), bufs, lens, 0);
+        if (received <= 0) {
+            throw new IOException("receive(DatagramPacket[]), errno=" + received);
+        }
+        for (int i = 0; i < received; i++) {
+            packets[i].setLength(lens[i]);
+        }
+        return received;
+    }
+
     /**
      * Close the ZeroTierSocket.
      *
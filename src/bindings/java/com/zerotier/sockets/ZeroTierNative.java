@@ -534,6 +534,8 @@ public class ZeroTierNative {
     public static native int zts_bsd_write_offset(int fd, byte[] buf, int offset, int len);
     public static native int zts_bsd_sendto(int fd, byte[] buf, int flags, ZeroTierSocketAddress addr);
     public static native int zts_bsd_send(int fd, byte[] buf, int flags);
+    public static native int zts_bsd_sendmmsg(int fd, byte[][] bufs, int[] lens, int flags);
+    public static native int zts_bsd_recvmmsg(int fd, byte[][] bufs, int[] lens, int flags);
     public static native int zts_bsd_shutdown(int fd, int how);
     public static native int zts_bsd_close(int fd);
     public static native boolean zts_bsd_getsockname(int fd, ZeroTierSocketAddress addr);
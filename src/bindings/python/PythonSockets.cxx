@@ -250,6 +250,123 @@ done:
     return res;
 }
 
+int zts_py_sendmmsg(int fd, int family, PyObject* buffers, PyObject* addr_obj, int flags)
+{
+    struct zts_sockaddr_storage addrbuf;
+    int addrlen = 0;
+    int err;
+    if (addr_obj != Py_None) {
+        if (zts_py_tuple_to_sockaddr(family, addr_obj, (struct zts_sockaddr*)&addrbuf, &addrlen) != ZTS_ERR_OK) {
+            return ZTS_ERR_ARG;
+        }
+    }
+    PyObject* seq = PySequence_Fast(buffers, "buffers must be a sequence");
+    if (seq == NULL) {
+        return ZTS_ERR_ARG;
+    }
+    Py_ssize_t count = PySequence_Fast_GET_SIZE(seq);
+    if (count > ZTS_MMSG_MAX) {
+        count = ZTS_MMSG_MAX;
+    }
+    Py_buffer* views = (Py_buffer*)PyMem_Calloc(count ? count : 1, sizeof(Py_buffer));
+    struct zts_iovec* iov = (struct zts_iovec*)PyMem_Calloc(count ? count : 1, sizeof(struct zts_iovec));
+    struct zts_mmsghdr* msgvec = (struct zts_mmsghdr*)PyMem_Calloc(count ? count : 1, sizeof(struct zts_mmsghdr));
+    Py_ssize_t acquired = 0;
+    if (! views || ! iov || ! msgvec) {
+        err = ZTS_ERR_NO_RESULT;
+        goto done;
+    }
+    for (; acquired < count; acquired++) {
+        if (PyObject_GetBuffer(PySequence_Fast_GET_ITEM(seq, acquired), &views[acquired], PyBUF_SIMPLE) != 0) {
+            err = ZTS_ERR_ARG;
+            goto done;
+        }
+        iov[acquired].iov_base = views[acquired].buf;
+        iov[acquired].iov_len = views[acquired].len;
+        msgvec[acquired].msg_hdr.msg_iov = &iov[acquired];
+        msgvec[acquired].msg_hdr.msg_iovlen = 1;
+        if (addrlen) {
+            msgvec[acquired].msg_hdr.msg_name = &addrbuf;
+            msgvec[acquired].msg_hdr.msg_namelen = addrlen;
+        }
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    err = zts_bsd_sendmmsg(fd, msgvec, (unsigned int)count, flags);
+    Py_END_ALLOW_THREADS;
+
+done:
+    for (Py_ssize_t i = 0; i < acquired; i++) {
+        PyBuffer_Release(&views[i]);
+    }
+    PyMem_Free(msgvec);
+    PyMem_Free(iov);
+    PyMem_Free(views);
+    Py_DECREF(seq);
+    return err;
+}
+
+PyObject* zts_py_recvmmsg(int fd, int count, int bufsize, int flags)
+{
+    PyObject *t, *list;
+    int err;
+
+    if (count < 0 || bufsize < 0) {
+        count = 0;
+    }
+    if (count > ZTS_MMSG_MAX) {
+        count = ZTS_MMSG_MAX;
+    }
+    struct zts_sockaddr_in* addrs = (struct zts_sockaddr_in*)PyMem_Calloc(count ? count : 1, sizeof(struct zts_sockaddr_in));
+    struct zts_iovec* iov = (struct zts_iovec*)PyMem_Calloc(count ? count : 1, sizeof(struct zts_iovec));
+    struct zts_mmsghdr* msgvec = (struct zts_mmsghdr*)PyMem_Calloc(count ? count : 1, sizeof(struct zts_mmsghdr));
+    PyObject** bufs = (PyObject**)PyMem_Calloc(count ? count : 1, sizeof(PyObject*));
+    int allocated = 0;
+    if (! addrs || ! iov || ! msgvec || ! bufs) {
+        err = ZTS_ERR_NO_RESULT;
+        goto done;
+    }
+    for (; allocated < count; allocated++) {
+        if ((bufs[allocated] = PyBytes_FromStringAndSize((char*)0, bufsize)) == NULL) {
+            err = ZTS_ERR_NO_RESULT;
+            goto done;
+        }
+        iov[allocated].iov_base = PyBytes_AS_STRING(bufs[allocated]);
+        iov[allocated].iov_len = bufsize;
+        msgvec[allocated].msg_hdr.msg_iov = &iov[allocated];
+        msgvec[allocated].msg_hdr.msg_iovlen = 1;
+        msgvec[allocated].msg_hdr.msg_name = &addrs[allocated];
+        msgvec[allocated].msg_hdr.msg_namelen = sizeof(struct zts_sockaddr_in);
+    }
+    Py_BEGIN_ALLOW_THREADS;
+    err = zts_bsd_recvmmsg(fd, msgvec, (unsigned int)count, flags);
+    Py_END_ALLOW_THREADS;
+
+done:
+    list = PyList_New(0);
+    for (int i = 0; i < err; i++) {
+        // Each entry is (data, (host, port))
+        char ipstr[ZTS_INET_ADDRSTRLEN] = { 0 };
+        zts_inet_ntop(ZTS_AF_INET, &(addrs[i].sin_addr), ipstr, ZTS_INET_ADDRSTRLEN);
+        _PyBytes_Resize(&bufs[i], msgvec[i].msg_len);
+        PyObject* entry = Py_BuildValue("(N(si))", bufs[i], ipstr, lwip_ntohs(addrs[i].sin_port));
+        bufs[i] = NULL;
+        PyList_Append(list, entry);
+        Py_DECREF(entry);
+    }
+    for (int i = 0; i < allocated; i++) {
+        Py_XDECREF(bufs[i]);
+    }
+    PyMem_Free(bufs);
+    PyMem_Free(msgvec);
+    PyMem_Free(iov);
+    PyMem_Free(addrs);
+    t = PyTuple_New(2);
+    PyTuple_SetItem(t, 0, PyLong_FromLong(err));
+    PyTuple_SetItem(t, 1, list);
+    Py_INCREF(t);
+    return t;
+}
+
 int zts_py_close(int fd)
 {
     int err;
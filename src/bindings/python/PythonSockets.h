@@ -31,6 +31,10 @@ int zts_py_send(int fd, PyObject* buf, int flags);
 
 int zts_py_sendall(int fd, PyObject* bytes, int flags);
 
+int zts_py_sendmmsg(int fd, int family, PyObject* buffers, PyObject* addr_obj, int flags);
+
+PyObject* zts_py_recvmmsg(int fd, int count, int bufsize, int flags);
+
 int zts_py_close(int fd);
 
 PyObject* zts_py_addr_get_str(uint64_t net_id, int family);
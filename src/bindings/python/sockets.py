@@ -493,6 +493,44 @@ class socket:
         if err < 0:
             handle_error(err)
 
+    def sendmmsg(self, buffers, address=None, flags=0):
+        """sendmmsg(buffers[, address[, flags]]) -> count
+
+        | Send each buffer as a separate datagram with a single call. Returns the number of datagrams sent.
+
+        :param buffers: Datagrams to send
+        :type buffers: list[Union[bytes, bytearray]]
+        :param address: Destination (host, port), or None if the socket is connected
+        :type address: tuple
+        :param flags: Optional flags
+        :type flags: int
+        :return: Number of datagrams sent
+        """
+        err = libzt.zts_py_sendmmsg(self._fd, self._family, buffers, address, flags)
+        if err < 0:
+            handle_error(err)
+        return err
+
+    def recvmmsg(self, count, bufsize, flags=0):
+        """recvmmsg(count, bufsize[, flags]) -> [(data, address), ...]
+
+        | Receive up to count datagrams with a single call. Waits for the first datagram and then
+        | returns any others that are already queued.
+
+        :param count: Maximum number of datagrams to receive
+        :type count: int
+        :param bufsize: Maximum size of each datagram
+        :type bufsize: int
+        :param flags: Optional flags
+        :type flags: int
+        :return: List of (data, (host, port)) tuples
+        """
+        err, msgs = libzt.zts_py_recvmmsg(self._fd, count, bufsize, flags)
+        if err < 0:
+            handle_error(err)
+            return None
+        return msgs
+
     def sendto(self, n_bytes, flags, address):
         """libzt does not support this (yet)"""
         raise NotImplementedError("libzt does not support this (yet?)")
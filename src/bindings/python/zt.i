@@ -34,6 +34,7 @@
 %ignore zts_pollfd;
 %ignore zts_nfds_t;
 %ignore zts_msghdr;
+%ignore zts_mmsghdr;
 
 %include "ZeroTierSockets.h"
 %include "PythonSockets.h"
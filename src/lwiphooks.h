@@ -0,0 +1,74 @@
+/*
+ * Copyright (c)2013-2021 ZeroTier, Inc.
+ *
+ * Use of this software is governed by the Business Source License included
+ * in the LICENSE.TXT file in the project's root directory.
+ *
+ * Change Date: 2026-01-01
+ *
+ * On the date above, in accordance with the Business Source License, use
+ * of this software will be governed by version 2.0 of the Apache License.
+ */
+/****/
+
+/**
+ * @file
+ *
+ * Prototypes of the libzt functions installed as lwIP hooks (see lwipopts.h).
+ * Included by lwIP's C sources, so this must remain plain C.
+ */
+
+#ifndef ZTS_LWIP_HOOKS_H
+#define ZTS_LWIP_HOOKS_H
+
+#include "lwip/arch.h"
+#include "lwip/err.h"
+#include "lwip/ip_addr.h"
+
+struct netif;
+struct pbuf;
+struct tcp_pcb;
+struct udp_pcb;
+struct tcp_hdr;
+struct lwip_sock;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* SACK loss recovery (TcpRecovery.cpp) */
+void zts_tcp_sack_input(struct tcp_pcb* pcb, struct tcp_hdr* hdr, u16_t optlen, u16_t opt1len, u8_t* opt2);
+u32_t* zts_tcp_sack_output(const struct tcp_pcb* pcb, struct tcp_hdr* hdr, u32_t* opts);
+
+/* Congestion control (Congestion.cpp) */
+err_t zts_tcp_cc_input(struct tcp_pcb* pcb, struct tcp_hdr* hdr);
+u32_t* zts_tcp_cc_output(const struct tcp_pcb* pcb, struct tcp_hdr* hdr, u32_t* opts);
+int zts_tcp_cc_setsockopt(struct lwip_sock* sock, int level, int optname, const void* optval, unsigned int optlen, int* err);
+int zts_tcp_cc_getsockopt(struct lwip_sock* sock, int level, int optname, void* optval, unsigned int* optlen, int* err);
+
+/* Path MTU discovery (PathMtu.cpp) */
+u32_t* zts_tcp_pmtu_output(const struct tcp_pcb* pcb, struct tcp_hdr* hdr, u32_t* opts);
+
+/* Receive coalescing (VirtualTap.cpp) */
+void zts_tcp_gro_input(struct tcp_pcb* pcb, struct pbuf* p);
+
+/* Socket slot free list (SocketSlots.cpp) */
+int zts_socket_alloc_hint(void);
+
+/* Hashed PCB lookup (PcbLookup.cpp) */
+void zts_tcp_lookup_input(struct tcp_pcb* pcb);
+struct tcp_pcb* zts_tcp_lookup(const struct tcp_hdr* hdr, const ip_addr_t* src, const ip_addr_t* dest, struct netif* inp);
+int zts_udp_lookup(u16_t port, struct udp_pcb** pcb);
+void zts_udp_lookup_bind(struct udp_pcb* pcb, u16_t port);
+void zts_udp_lookup_remove(struct udp_pcb* pcb);
+
+/* TCP timer wheel (TcpTimers.cpp) */
+int zts_tcp_timer_tick(void);
+void zts_tcp_timer_wake(const struct tcp_pcb* pcb);
+void zts_tcp_timer_setsockopt(struct lwip_sock* sock, int level, int optname);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif   // _H
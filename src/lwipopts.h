@@ -83,10 +83,36 @@
 ------------------------------------ Presets -----------------------------------
 ------------------------------------------------------------------------------*/
 
-#define LWIP_MTU                        2800
+/* Largest MTU a ZeroTier network can be configured with (ZT_MAX_MTU). Each netif
+follows its network's MTU up to this, and TCP_MSS is only an upper bound */
+#define LWIP_MTU                        10000
+/* MTU of ZeroTier networks with default settings (ZT_DEFAULT_MTU). Buffer sizes are
+based on it so that they do not grow with LWIP_MTU */
+#define ZTS_DEFAULT_MTU                 2800
+#define ZTS_DEFAULT_MSS                 (ZTS_DEFAULT_MTU - 40)
 #define LWIP_CHKSUM_ALGORITHM           2
+/* Vectorized checksum with runtime CPU dispatch (Checksum.cpp), also computed
+while tcp_write() copies data in. LWIP_CHKSUM_ALGORITHM 2 is still built as the
+scalar reference */
+#include "Checksum.h"
+#define LWIP_CHKSUM                     zts_chksum
+#define LWIP_CHECKSUM_ON_COPY           1
+#define LWIP_CHKSUM_COPY(dst, src, len) zts_chksum_copy(dst, src, len)
 // memory
-#define MEMP_NUM_NETCONN                1024
+/* Socket capacity. PCBs and netconns are allocated from the heap on demand
+(MEMP_MEM_MALLOC), so the only memory reserved up front is lwIP's socket table */
+#ifndef ZTS_MAX_SOCKETS
+#define ZTS_MAX_SOCKETS                 1024
+#endif
+#define MEMP_NUM_NETCONN                ZTS_MAX_SOCKETS
+/* The heap is a slab allocator with per-thread caches (Slab.cpp) instead of libc
+malloc. Pool objects come from it too, so per-pool counts are kept by MEMP_STATS.
+MEM_SIZE is not enforced with MEM_LIBC_MALLOC, see zts_init_set_memory_budget() */
+#include "Slab.h"
+#define mem_clib_malloc                 zts_slab_malloc
+#define mem_clib_calloc                 zts_slab_calloc
+#define mem_clib_free                   zts_slab_free
+#define MEMP_STATS                      1
 #define MEMP_NUM_NETBUF                 2
 #define MEMP_NUM_TCPIP_MSG_API          1024
 #define MEMP_NUM_TCPIP_MSG_INPKT        1024
@@ -108,13 +134,15 @@
 #define LWIP_TCP_SACK_OUT               1
 #define LWIP_TCP_MAX_SACK_NUM           4
 #define TCP_MSS                         (LWIP_MTU - 40)
-#define TCP_SND_BUF                     (64 * TCP_MSS)
-#define TCP_SND_QUEUELEN                (64 * (2 * (TCP_SND_BUF/TCP_MSS)))
-#define TCP_SNDLOWAT                    (0xffff - (4*TCP_MSS) - 1)
+#define TCP_SND_BUF                     (64 * ZTS_DEFAULT_MSS)
+#define TCP_SND_QUEUELEN                (64 * (2 * (TCP_SND_BUF/ZTS_DEFAULT_MSS)))
+// Must stay below 0xffff - 4 * TCP_MSS (checked in lwIP's init.c), which TCP_MSS makes the binding limit
+#define TCP_SNDLOWAT                    LWIP_MIN(LWIP_MAX(((TCP_SND_BUF)/2), (2 * TCP_MSS) + 1), 0xFFFF - (4 * TCP_MSS) - 1)
 #define TCP_SNDQUEUELOWAT               LWIP_MAX(((TCP_SND_QUEUELEN)/2), 5)
-#define TCP_WND_UPDATE_THRESHOLD        LWIP_MIN((TCP_WND / 4), (TCP_MSS * 4))
+#define TCP_WND_UPDATE_THRESHOLD        LWIP_MIN((TCP_WND / 4), (ZTS_DEFAULT_MSS * 4))
 #define LWIP_WND_SCALE                  1
 #define TCP_RCV_SCALE                   4
+#define LWIP_TCP_PCB_NUM_EXT_ARGS       6
 // tcpip
 #define TCPIP_MBOX_SIZE                 0
 #define LWIP_TCPIP_CORE_LOCKING         1
@@ -126,6 +154,24 @@
 #define LWIP_NETIF_HWADDRHINT           1
 #define LWIP_NETIF_TX_SINGLE_PBUF       0
 #define TCPIP_THREAD_PRIO               1
+// hooks
+#define LWIP_HOOK_FILENAME              "lwiphooks.h"
+#define LWIP_HOOK_TCP_INPACKET_PCB(pcb, hdr, optlen, opt1len, opt2, p) \
+    (zts_tcp_sack_input(pcb, hdr, optlen, opt1len, opt2), zts_tcp_gro_input(pcb, p), zts_tcp_lookup_input(pcb), \
+     zts_tcp_timer_wake(pcb), zts_tcp_cc_input(pcb, hdr))
+#define LWIP_HOOK_TCP_OUT_ADD_TCPOPTS(p, hdr, pcb, opts) \
+    (zts_tcp_timer_wake(pcb), zts_tcp_pmtu_output(pcb, hdr, zts_tcp_cc_output(pcb, hdr, zts_tcp_sack_output(pcb, hdr, opts))))
+#define LWIP_HOOK_SOCKETS_SETSOCKOPT(s, sock, level, optname, optval, optlen, err) \
+    (zts_tcp_timer_setsockopt(sock, level, optname), zts_tcp_cc_setsockopt(sock, level, optname, optval, (unsigned int)(optlen), err))
+#define LWIP_HOOK_SOCKETS_GETSOCKOPT(s, sock, level, optname, optval, optlen, err) \
+    zts_tcp_cc_getsockopt(sock, level, optname, optval, (unsigned int*)(optlen), err)
+// Provided by ext/lwip-patches, which the build applies to a copy of ext/lwip
+#define LWIP_HOOK_SOCKETS_ALLOC_HINT()  zts_socket_alloc_hint()
+#define LWIP_HOOK_TCP_INPUT_PCB_LOOKUP(hdr, src, dest, inp) zts_tcp_lookup(hdr, src, dest, inp)
+#define LWIP_HOOK_UDP_INPUT_PCB_LOOKUP(port, pcb) zts_udp_lookup(port, pcb)
+#define LWIP_HOOK_UDP_PCB_BIND(pcb, port) zts_udp_lookup_bind(pcb, port)
+#define LWIP_HOOK_UDP_PCB_REMOVE(pcb)   zts_udp_lookup_remove(pcb)
+#define LWIP_HOOK_TCP_TMR()             zts_tcp_timer_tick()
 
 /*------------------------------------------------------------------------------
 ------------------------------------ Timers ------------------------------------
@@ -523,7 +569,7 @@ happening sooner than they should.
  * (requires the LWIP_RAW option)
  */
 #if !defined MEMP_NUM_RAW_PCB || defined __DOXYGEN__
-#define MEMP_NUM_RAW_PCB                1024
+#define MEMP_NUM_RAW_PCB                ZTS_MAX_SOCKETS
 #endif
 
 /**
@@ -532,7 +578,7 @@ happening sooner than they should.
  * (requires the LWIP_UDP option)
  */
 #if !defined MEMP_NUM_UDP_PCB || defined __DOXYGEN__
-#define MEMP_NUM_UDP_PCB                1024
+#define MEMP_NUM_UDP_PCB                ZTS_MAX_SOCKETS
 #endif
 
 /**
@@ -540,7 +586,7 @@ happening sooner than they should.
  * (requires the LWIP_TCP option)
  */
 #if !defined MEMP_NUM_TCP_PCB || defined __DOXYGEN__
-#define MEMP_NUM_TCP_PCB                1024
+#define MEMP_NUM_TCP_PCB                ZTS_MAX_SOCKETS
 #endif
 
 /**
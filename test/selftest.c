@@ -15,6 +15,7 @@
 
 #define LIBZT_DEBUG 1
 
+#include "../src/Checksum.h"
 #include "../src/Debug.hpp"
 
 #pragma GCC diagnostic ignored "-Wunused-value"
@@ -819,6 +820,51 @@ void api_value_arg_test(int tid, uint8_t num, int8_t i8, int16_t i16, int32_t i3
             assert(zts_util_ipstr_to_saddr(i32, NULL, i32, null_addr, NULL) == ZTS_ERR_SERVICE);
             break;
             */
+        case 177:
+            assert(zts_set_socket_callback(i32, NULL, nullable) == ZTS_ERR_SERVICE);
+            break;
+        case 178:
+            assert(zts_sockset_add(i32, i32, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 179:
+            assert(zts_sockset_del(i32, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 180:
+            assert(zts_recv_zc(i32, (zts_rxbuf_t*)nullable) == ZTS_ERR_SERVICE);
+            break;
+        case 181:
+            assert(zts_send_zc(i32, (struct zts_iovec*)nullable, i32, nullable) == ZTS_ERR_SERVICE);
+            break;
+        case 182:
+            assert(zts_send_zc_reap(i32, (zts_zc_completion_t*)nullable, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 183:
+            assert(zts_bsd_sendmmsg(i32, (struct zts_mmsghdr*)nullable, (unsigned int)i32, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 184:
+            assert(zts_bsd_recvmmsg(i32, (struct zts_mmsghdr*)nullable, (unsigned int)i32, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 185:
+            assert(zts_sendfile(i32, i32, i64, (size_t)i64) == ZTS_ERR_SERVICE);
+            break;
+        case 186:
+            assert(zts_tcp_raw_connect((zts_tcp_raw_t**)nullable, (char*)nullable, i16, NULL, nullable) == ZTS_ERR_SERVICE);
+            break;
+        case 187:
+            assert(zts_tcp_raw_write((zts_tcp_raw_t*)nullable, nullable, (size_t)i64, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 188:
+            assert(zts_udp_raw_sendto((zts_udp_raw_t*)nullable, nullable, (size_t)i64, (char*)nullable, i16) == ZTS_ERR_SERVICE);
+            break;
+        case 189:
+            assert(zts_set_recv_buf_autotune(i32, i32) == ZTS_ERR_SERVICE);
+            break;
+        case 190:
+            assert(zts_get_recv_drop_count(i32) == ZTS_ERR_SERVICE);
+            break;
+        case 191:
+            assert(zts_get_sock_mem_usage(i32, (zts_sock_mem_t*)nullable) == ZTS_ERR_SERVICE);
+            break;
         default:
             break;
     }
@@ -1224,11 +1270,6 @@ void test_server_socket_usage(uint16_t port4, uint16_t port6)
     zts_bsd_close(acc6);
     assert(err == ZTS_ERR_OK && zts_errno == 0);
 
-    zts_node_stop();
-    assert(err == ZTS_ERR_OK && zts_errno == 0);
-    int s = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
-    assert(s == ZTS_ERR_SERVICE);
-
     assert(bytes_sent == bytes_read);
     if (bytes_sent == bytes_read) {
         DEBUG_INFO("server6: Test OK");
@@ -1238,6 +1279,72 @@ void test_server_socket_usage(uint16_t port4, uint16_t port6)
     }
 }
 
+#define ACCEPT_CLOSE_ROUNDS 32
+#define SETTLE_TIME         10   // s
+
+/* Live stack blocks and connections, which must not grow with accepted and closed connections */
+static void get_stack_usage(uint64_t* blocks, uint32_t* pcbs)
+{
+    zts_alloc_counter_t a;
+    zts_stats_counter_t s;
+    assert(zts_stats_get_alloc(ZTS_ALLOC_STACK, &a) == ZTS_ERR_OK);
+    assert(zts_stats_get_all(&s) == ZTS_ERR_OK);
+    *blocks = a.allocs - a.frees;
+    *pcbs = s.mem[ZTS_STATS_MEM_TCP_PCB].used;
+}
+
+void test_server_accept_close(uint16_t port)
+{
+    // Connections accepted from a listener with a congestion control algorithm
+    // allocate its state, which must be freed with them. The client sends a byte
+    // (the state is allocated on the first segment) and closes first, so that
+    // no connection is left in TIME_WAIT here
+    char c;
+    uint64_t blocks, base_blocks = 0;
+    uint32_t pcbs, base_pcbs = 0;
+
+    DEBUG_INFO("server4: accept/close on port %d", port);
+    int s = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    assert(s >= 0);
+    int err = zts_bsd_setsockopt(s, ZTS_IPPROTO_TCP, ZTS_TCP_CONGESTION, ZTS_TCP_CC_CUBIC, strlen(ZTS_TCP_CC_CUBIC));
+    assert(err == ZTS_ERR_OK);
+    assert(zts_bind(s, "0.0.0.0", port) == ZTS_ERR_OK);
+    assert(zts_bsd_listen(s, 1) == ZTS_ERR_OK);
+
+    // The first round warms up the stack's slabs
+    for (int i = 0; i <= ACCEPT_CLOSE_ROUNDS; i++) {
+        int acc = zts_bsd_accept(s, NULL, NULL);
+        assert(acc >= 0);
+        while (zts_bsd_read(acc, &c, 1) > 0) { }
+        zts_bsd_close(acc);
+        if (i == 0) {
+            zts_util_delay(SETTLE_TIME * 1000);
+            get_stack_usage(&base_blocks, &base_pcbs);
+        }
+    }
+
+    // Closed connections are freed once the client has acknowledged the FIN
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do {
+        zts_util_delay(250);
+        get_stack_usage(&blocks, &pcbs);
+        clock_gettime(CLOCK_MONOTONIC, &now);
+    } while ((blocks != base_blocks || pcbs != base_pcbs) && now.tv_sec - start.tv_sec < SETTLE_TIME);
+    DEBUG_INFO(
+        "server4: %llu blocks, %u connections (baseline %llu, %u)",
+        (unsigned long long)blocks,
+        pcbs,
+        (unsigned long long)base_blocks,
+        base_pcbs);
+    assert(blocks == base_blocks && pcbs == base_pcbs);
+    zts_bsd_close(s);
+
+    zts_node_stop();
+    s = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    assert(s == ZTS_ERR_SERVICE);
+}
+
 //----------------------------------------------------------------------------//
 // Client                                                                     //
 //----------------------------------------------------------------------------//
@@ -1335,11 +1442,6 @@ void test_client_socket_usage(char* ip4, uint16_t port4, char* ip6, uint16_t por
     zts_bsd_close(s6);
     assert(err == ZTS_ERR_OK && zts_errno == 0);
 
-    zts_node_stop();
-    assert(err == ZTS_ERR_OK && zts_errno == 0);
-    int s = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
-    assert(s == ZTS_ERR_SERVICE);
-
     assert(bytes_sent == bytes_read);
     if (bytes_sent == bytes_read) {
         DEBUG_INFO("client6: Test OK");
@@ -1349,6 +1451,36 @@ void test_client_socket_usage(char* ip4, uint16_t port4, char* ip6, uint16_t por
     }
 }
 
+void test_client_accept_close(char* ip, uint16_t port)
+{
+    // Counterpart of test_server_accept_close()
+    struct timespec start, now;
+    for (int i = 0; i <= ACCEPT_CLOSE_ROUNDS; i++) {
+        int s = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+        assert(s >= 0);
+        int err;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do {
+            if ((err = zts_connect(s, ip, port, CONNECT_TIMEOUT)) < 0) {
+                zts_util_delay(250);
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+        } while (err < 0 && now.tv_sec - start.tv_sec < MAX_CONNECT_TIME);
+        assert(err == ZTS_ERR_OK);
+        assert(zts_bsd_write(s, "x", 1) == 1);
+        zts_bsd_close(s);
+        if (i == 0) {
+            // Let the server take its baseline with no connection pending
+            zts_util_delay(2 * SETTLE_TIME * 1000);
+        }
+    }
+    DEBUG_INFO("client4: %d connections closed", ACCEPT_CLOSE_ROUNDS + 1);
+
+    zts_node_stop();
+    int s = zts_bsd_socket(ZTS_AF_INET, ZTS_SOCK_STREAM, 0);
+    assert(s == ZTS_ERR_SERVICE);
+}
+
 //----------------------------------------------------------------------------//
 // Start node                                                                 //
 //----------------------------------------------------------------------------//
@@ -1746,6 +1878,36 @@ void test_start_sequences()
     assert(! strcmp(keypair_i, keypair_f));
 }
 
+void test_instances()
+{
+    DEBUG_INFO("\n\n***\ttest_instances");
+    zts_ctx_t* def = zts_ctx_current();
+    assert(zts_ctx_free(NULL) == ZTS_ERR_ARG);
+    assert(zts_ctx_free(def) == ZTS_ERR_ARG);
+    zts_ctx_t* a = zts_ctx_new();
+    zts_ctx_t* b = zts_ctx_new();
+    assert(a && b && a != b && a != def);
+    // Each instance is its own node with its own identity
+    uint64_t ids[2];
+    zts_ctx_t* ctxs[2] = { a, b };
+    for (int i = 0; i < 2; i++) {
+        assert(zts_ctx_use(ctxs[i]) == ZTS_ERR_OK);
+        assert(zts_ctx_current() == ctxs[i]);
+        assert(test_start_node(".", 0x0, NULL, 0, 0, 0, 0, 0) == ZTS_ERR_OK);
+        ids[i] = zts_node_get_id();
+    }
+    assert(ids[0] != ids[1]);
+    assert(zts_ctx_use(NULL) == ZTS_ERR_OK);
+    assert(zts_ctx_current() == def);
+    assert(zts_node_get_id() != ids[0] && zts_node_get_id() != ids[1]);
+    assert(zts_ctx_free(a) == ZTS_ERR_OK);
+    // Freeing one instance leaves the other running
+    assert(zts_ctx_use(b) == ZTS_ERR_OK);
+    assert(zts_node_is_online());
+    assert(zts_ctx_free(b) == ZTS_ERR_OK);
+    assert(zts_ctx_current() == def);
+}
+
 #define NUM_THREADS 2
 
 int test_thread_safety()
@@ -1826,9 +1988,52 @@ int test_stats()
         s.nd6_rx,
         s.nd6_drop,
         s.nd6_err);
+
+    // Allocation counters are available whether or not the node runs
+    const char* subsys[ZTS_ALLOC_COUNT] = { "stack", "events", "tap", "tunnel" };
+    zts_alloc_counter_t a;
+    for (int i = 0; i < ZTS_ALLOC_COUNT; i++) {
+        assert(zts_stats_get_alloc(i, &a) == ZTS_ERR_OK);
+        assert(a.frees <= a.allocs && a.bytes <= a.max_bytes);
+        printf(
+            "%9s allocs=%9llu, frees=%9llu, bytes=%9llu\n",
+            subsys[i],
+            (unsigned long long)a.allocs,
+            (unsigned long long)a.frees,
+            (unsigned long long)a.bytes);
+    }
+    assert(zts_stats_get_alloc(ZTS_ALLOC_COUNT, &a) == ZTS_ERR_ARG);
+    assert(zts_stats_get_alloc(ZTS_ALLOC_STACK, NULL) == ZTS_ERR_ARG);
     return 0;
 }
 
+void test_checksum()
+{
+    DEBUG_INFO("\n\n***\ttest_checksum");
+    // Every implementation available here must agree with lwIP's scalar one,
+    // whatever the alignment and length, for both plain and copying variants
+    static uint8_t src[65536 + 64], dst[65536 + 64];
+    for (int impl = ZTS_CHKSUM_SCALAR; impl <= ZTS_CHKSUM_NEON; impl++) {
+        if (zts_chksum_use(impl) != 0) {
+            continue;
+        }
+        for (int i = 0; i < 20000; i++) {
+            int src_off = rand() % 64;
+            int dst_off = rand() % 64;
+            int len = (i % 100 == 0) ? rand() % 65536 : rand() % 3000;
+            int fill = rand() % 4;
+            for (int j = 0; j < len; j++) {
+                src[src_off + j] = fill == 0 ? 0x00 : fill == 1 ? 0xff : (uint8_t)rand();
+            }
+            uint16_t expected = lwip_standard_chksum(src + src_off, len);
+            assert(zts_chksum(src + src_off, len) == expected);
+            assert(zts_chksum_copy(dst + dst_off, src + src_off, (uint16_t)len) == expected);
+            assert(! memcmp(dst + dst_off, src + src_off, len));
+        }
+    }
+    assert(zts_chksum_use(ZTS_CHKSUM_AUTO) == 0);
+}
+
 int test_utils()
 {
     DEBUG_INFO("\n\n***\ttest_utils");
@@ -1886,12 +2091,14 @@ int main(int argc, char** argv)
         srand(time(NULL));
         DEBUG_INFO("Single node test");
         test_utils();
+        test_checksum();
         test_pre_service_fuzz();
         test_thread_safety();
         test_identity_key_handling();
         test_addr_computation();
         test_roots_handling();
         test_start_sequences();
+        test_instances();
         test_api_abuse();
         test_stats();
         // test_sockets();
@@ -1905,6 +2112,7 @@ int main(int argc, char** argv)
         int port6 = atoi(argv[4]);
         test_start_node(argv[1], net_id, NULL, 1, 1, 0, 1, 0);
         test_server_socket_usage(port4, port6);
+        test_server_accept_close(port4 + 1);
     }
     // Client test
     if (argc == 7) {
@@ -1914,6 +2122,7 @@ int main(int argc, char** argv)
         int port6 = atoi(argv[5]);
         test_start_node(argv[1], net_id, NULL, 1, 1, 0, 1, 0);
         test_client_socket_usage(argv[4], port4, argv[6], port6);
+        test_client_accept_close(argv[4], port4 + 1);
     }
     DEBUG_INFO("SUCCESS");
     return 0;